@@ -10,6 +10,10 @@
 #define CONFIG_BME680_ADAFRUIT 1
 #define CONFIG_HAS_SEN0170 1
 #define CONFIG_HAS_LPPYRA03AV 1
+#define CONFIG_LIGHT_SLEEP_WAIT 1
+#define CONFIG_LIGHT_SLEEP_WAIT_MIN_MS 10
+#define CONFIG_WAKE_STUB 1
+#define CONFIG_WAKE_STUB_SLICE_S 600
 #define CONFIG_DCDC1_DEVICE "BME680"
 #define CONFIG_PMU_IRQ 35
 #define CONFIG_MAX_PAYLOAD 200
@@ -20,6 +24,7 @@
 #define CONFIG_CHAN_BME680_HUM 5
 #define CONFIG_CHAN_BME680_ALT 6
 #define CONFIG_CHAN_SEN0170_WIND 7
+#define CONFIG_CHAN_SEN0170_GUST 21
 #define CONFIG_CHAN_LPPYRA03AV_IRRAD 8
 #define CONFIG_CHAN_SPS30_PM1Ugm3 9
 #define CONFIG_CHAN_SPS30_PM2Ugm3 10
@@ -31,6 +36,7 @@
 #define CONFIG_CHAN_SPS30_PM4Particlem3 16
 #define CONFIG_CHAN_SPS30_PM10Particlem3 17
 #define CONFIG_CHAN_SPS30_PMAverageUm 18
+#define CONFIG_CHAN_TIMESTAMP 20
 #define CONFIG_CHAN_GPS 19
 #define CONFIG_GPS_SERIAL_NUM 1
 #define CONFIG_GPS_BAUDRATE 9600
@@ -45,13 +51,33 @@
 #define CONFIG_DIO0_GPIO 26
 #define CONFIG_DIO1_GPIO 33
 #define CONFIG_DIO2_GPIO 32
+#define CONFIG_REGION_EU868 1
 #define CONFIG_LORAWAN_PORT 10
+#define CONFIG_LORAWAN_CMD_PORT 20
 #define CONFIG_LORA_SPREADING_FACTOR 5
 #define CONFIG_LORA_TX_POW 14
 #define CONFIG_LORA_ADR 1
+#define CONFIG_LORA_LINK_MARGIN 10
+#define CONFIG_LORA_CONFIRM_EVERY 16
+#define CONFIG_LORA_QUEUE_LEN 4
+#define CONFIG_LORA_LIGHT_SLEEP 1
+#define CONFIG_LORA_CLOCK_ERROR_MAX 20
+#define CONFIG_LMIC_HW_AES 1
+#define CONFIG_LORA_FCNT_PERSIST_EVERY 32
+#define CONFIG_TIME_SYNC_HOURS 24
+#define CONFIG_STORE_AND_FORWARD 1
+#define CONFIG_SPI_FLASH_CS_GPIO 13
+#define CONFIG_FLASHLOG_FIRST_SECTOR 0
+#define CONFIG_FLASHLOG_SECTORS 64
+#define CONFIG_FLASHLOG_PORT 11
+#define CONFIG_FLASHLOG_BATCHES_PER_WAKE 4
+#define CONFIG_TRACE_UPLINK_EVERY 96
+#define CONFIG_TRACE_PORT 12
 #define CONFIG_SPS30_CLEAN_NOW 1
 #define CONFIG_SEN0170_PIN 0
 #define CONFIG_LPPYRA03AV_PIN 36
+#define CONFIG_ULP_ADC 1
+#define CONFIG_ULP_ADC_PERIOD_MS 100
 #define CONFIG_BME680_TEMP_MV_AVG 5
 #define CONFIG_SEALEVELPRESSURE_HPA 1013
 #define CONFIG_BME680_ADDR1 0x76
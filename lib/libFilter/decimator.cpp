@@ -0,0 +1,91 @@
+/***
+ * CIC Decimator - Implementation
+ *
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "decimator.h"
+
+// CONSTRUCTOR AND DESTRUCTOR * * * * * * * * * * * * * * *
+
+Decimator::Decimator(uint8_t rate_, uint8_t stages_, uint8_t inBits_) :
+  R( rate_ ),
+  N( stages_ ),
+  f_err( false )
+{
+  if(R < 1) R = 1;
+  if(N < 1) N = 1;
+  if(N > CIC::MAX_STAGES) {
+    N     = CIC::MAX_STAGES;
+    f_err = true;
+  }
+
+  // Bit growth is N*log2(R); the output must fit a signed 32-bit word
+  uint8_t rbits = 0;
+  while((1UL << rbits) < R) rbits++;
+  f_err = f_err | (inBits_ + N*rbits > 31);
+
+  gain = 1.0 / pow((float_t)R, (float_t)N);
+
+  // Flatten the sinc^N droop at a quarter of the output rate
+  a = (pow(CIC::SINC_QUARTER, -(float_t)N) - 1.0) / 2.0;
+
+  flush();
+}
+
+Decimator::~Decimator() { }
+
+// PUBLIC METHODS * * * * * * * * * * * * * * * * * * * * *
+
+bool Decimator::filterIn(int32_t input) {
+  // Integrators, at the input rate
+  integ[0] += (uint32_t)input;
+  for(uint8_t i=1; i<N; i++) {
+    integ[i] += integ[i-1];
+  }
+
+  if(++phase < R) return false;
+  phase = 0;
+
+  // Combs, at the output rate (differential delay of one)
+  uint32_t v = integ[N-1];
+  for(uint8_t i=0; i<N; i++) {
+    uint32_t t = v;
+    v -= comb[i];
+    comb[i] = t;
+  }
+
+  // Compensation FIR
+  float_t x0 = (float_t)(int32_t)v * gain;
+  out = -a*x0 + (1.0 + 2.0*a)*x1 - a*x2;
+  x2 = x1;
+  x1 = x0;
+
+  if(warm <= N + 1) warm++;
+
+  return true;
+}
+
+void Decimator::flush() {
+  for(uint8_t i=0; i<CIC::MAX_STAGES; i++) {
+    integ[i] = 0;
+    comb[i]  = 0;
+  }
+  phase = 0;
+  warm  = 0;
+  x1    = 0.0;
+  x2    = 0.0;
+  out   = 0.0;
+}
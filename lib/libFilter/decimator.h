@@ -0,0 +1,74 @@
+/***
+ * CIC Decimator - Header
+ *
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/// Has to be executed on Arduino IDE > 1.6.7
+#include <Arduino.h>
+
+#include "filters_defs.h"
+
+namespace CIC {
+  const uint8_t MAX_STAGES = 4;
+  const float_t SINC_QUARTER = 0.9003163;  // sin(pi/4)/(pi/4), CIC droop at a quarter of the output rate
+}
+
+class Decimator {
+public:
+
+  /** \brief Cascaded integrator-comb decimator followed by a 3-tap compensation FIR.
+   *
+   *  Takes an integer ADC stream at the input rate and produces one float sample every \p rate_
+   *  inputs, normalized to the input scale (unity DC gain). Integrators run on modular 32-bit
+   *  arithmetic: \p inBits_ + \p stages_ * log2(\p rate_) must not exceed 31 bits.
+   */
+  Decimator(uint8_t rate_, uint8_t stages_ = 3, uint8_t inBits_ = 12);
+  ~Decimator();
+
+  /** \brief Feeds one input sample; returns true when a new output sample is available. */
+  bool filterIn(int32_t input);
+  float_t getOutput() { return out; }
+
+  /** \brief True once the comb delays and the FIR taps hold real data: the first N+1 outputs after a
+   *  flush() are start-up transient (N combs, then the FIR), and should not seed a following filter.
+   */
+  bool isSettled() { return warm > N + 1; }
+
+  void flush();
+
+  /** \brief Sets the compensation FIR taps to [-a, 1+2a, -a]; 0 disables compensation. */
+  void setCompensation(float_t a_) { a = a_; }
+
+  uint8_t getRate() { return R; }
+  bool isInErrorState() { return f_err; }
+
+private:
+  uint8_t R, N;
+  uint8_t phase;
+  uint8_t warm;     // outputs since flush, saturates at N+2
+
+  // CIC state: integrators (input rate) and comb delays (output rate)
+  uint32_t integ[CIC::MAX_STAGES], comb[CIC::MAX_STAGES];
+
+  // Normalization and compensation FIR (output rate)
+  float_t gain, a;
+  float_t x1, x2;
+  float_t out;
+
+  bool f_err;
+};
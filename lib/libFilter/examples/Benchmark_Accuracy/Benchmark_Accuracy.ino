@@ -0,0 +1,111 @@
+/***
+ * Benchmark_Accuracy Example
+ *
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Throughput (samples/s) of every type and order, then step and frequency response
+// checked against the analytic Butterworth magnitude. Prints PASS/FAIL per check.
+// Builds as a plain C++ program too: provide Serial, micros() and PI, and call setup().
+
+#include <filters.h>
+
+const float cutoff_freq   = 10.0;   //Cutoff frequency in Hz
+const float sampling_time = 0.001;  //Sampling time in seconds (fs = 1 kHz)
+const float tolerance     = 0.05;   //Max absolute error on the magnitude
+
+const IIR::ORDER orders[] = {IIR::ORDER::OD1, IIR::ORDER::OD2, IIR::ORDER::OD3, IIR::ORDER::OD4};
+
+// High-pass filters stop at the second order
+uint8_t maxOrder(IIR::TYPE ty) {
+  return (ty == IIR::TYPE::HIGHPASS) ? 2 : 4;
+}
+
+const char *typeName(IIR::TYPE ty) {
+  return (ty == IIR::TYPE::HIGHPASS) ? "HP" : "LP";
+}
+
+// Analytic Butterworth magnitude of order n at frequency f
+float butterworth(IIR::TYPE ty, uint8_t n, float f) {
+  float r  = pow(f/cutoff_freq, 2.0*n);
+  float lp = 1.0/sqrt(1.0 + r);
+  return (ty == IIR::TYPE::HIGHPASS) ? sqrt(r)*lp : lp;
+}
+
+uint16_t failures = 0;
+
+void check(const char *what, IIR::TYPE ty, uint8_t n, float got, float expected) {
+  bool ok = abs(got - expected) <= tolerance;
+  if(!ok) failures++;
+  Serial.print(ok ? "PASS " : "FAIL ");
+  Serial.print(typeName(ty)); Serial.print(" OD"); Serial.print(n); Serial.print(" ");
+  Serial.print(what); Serial.print(": got "); Serial.print(got, 4);
+  Serial.print(", expected "); Serial.println(expected, 4);
+}
+
+void benchmark(IIR::TYPE ty, uint8_t n) {
+  const uint16_t samples = 20000;
+  Filter f(cutoff_freq, sampling_time, orders[n-1], ty);
+  float sink = 0.0;
+  unsigned long start = micros();
+  for(uint16_t i=0; i<samples; i++) sink += f.filterIn((float)(i & 0xFFF));
+  unsigned long us = micros() - start;
+  if(us == 0) us = 1;
+  Serial.print(typeName(ty)); Serial.print(" OD"); Serial.print(n); Serial.print("\t");
+  Serial.print(1e6 * samples / us, 0); Serial.println(" samples/s");
+  (void)sink;
+}
+
+// Final value of the unit step response: DC gain
+void stepResponse(IIR::TYPE ty, uint8_t n) {
+  Filter f(cutoff_freq, sampling_time, orders[n-1], ty);
+  float y = 0.0;
+  for(uint16_t i=0; i<5000; i++) y = f.filterIn(1.0);
+  check("step", ty, n, y, (ty == IIR::TYPE::HIGHPASS) ? 0.0 : 1.0);
+}
+
+// Steady-state amplitude of a unit sine at freq
+void frequencyResponse(IIR::TYPE ty, uint8_t n, float freq) {
+  Filter f(cutoff_freq, sampling_time, orders[n-1], ty);
+  const uint16_t settle = 3000, measure = 2000;
+  float peak = 0.0;
+  for(uint16_t i=0; i<settle + measure; i++) {
+    float y = f.filterIn(sin(2.0*PI*freq*i*sampling_time));
+    if(i >= settle && abs(y) > peak) peak = abs(y);
+  }
+  char what[24];
+  snprintf(what, sizeof(what), "|H(%g Hz)|", freq);
+  check(what, ty, n, peak, butterworth(ty, n, freq));
+}
+
+void run(IIR::TYPE ty) {
+  for(uint8_t n=1; n<=maxOrder(ty); n++) {
+    benchmark(ty, n);
+    stepResponse(ty, n);
+    frequencyResponse(ty, n, cutoff_freq / 4.0);
+    frequencyResponse(ty, n, cutoff_freq);
+    frequencyResponse(ty, n, cutoff_freq * 4.0);
+  }
+}
+
+void setup() {
+  Serial.begin(115200);
+  run(IIR::TYPE::LOWPASS);
+  run(IIR::TYPE::HIGHPASS);
+  Serial.print(failures); Serial.println(" checks failed");
+}
+
+void loop() {
+}
@@ -0,0 +1,76 @@
+/***
+ * Robust_Spikes Example
+ *
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <filters.h>
+#include <robust.h>
+
+// Spiky slow signal: a 12 bit DC level plus noise, with a large spike every 50 samples
+const int   spike_every   = 50;
+const float spike_height  = 3000.0;
+
+const float cutoff_freq   = 1.0;   //Cutoff frequency in Hz
+const float sampling_time = 0.005; //Sampling time in seconds.
+
+Hampel<15>      hampel;
+MovingMedian<5> median;
+EWMA            ewma(0.05);
+Filter          f(cutoff_freq, sampling_time, IIR::ORDER::OD2);
+Filter          fc(cutoff_freq, sampling_time, IIR::ORDER::OD2);
+
+int n = 0;
+
+float spiky() {
+  float x = 1000.0 + random(-20, 21);
+  if(++n % spike_every == 0) x += spike_height;
+  return x;
+}
+
+// Prints the throughput of a filter in samples/second
+template <class F>
+void bench(const char *name, F &filt) {
+  const uint16_t samples = 10000;
+  float sink = 0.0;
+  unsigned long start = micros();
+  for(uint16_t i=0; i<samples; i++) sink += filt.filterIn(spiky());
+  unsigned long us = micros() - start;
+  Serial.print(name); Serial.print("\t");
+  Serial.print(1e6 * samples / us, 0); Serial.print(" samples/s\t(");
+  Serial.print(sink / samples); Serial.println(")");
+}
+
+void setup() {
+  Serial.begin(115200);
+  bench("EWMA",         ewma);
+  bench("MovingMedian5", median);
+  bench("Hampel15",     hampel);
+  bench("IIR OD2",      f);
+  hampel.flush();
+  f.flush();
+}
+
+// View with serial plotter
+void loop() {
+  float raw = spiky();
+  float clean = hampel.filterIn(raw);
+  Serial.print(raw);                  // raw signal, with spikes
+  Serial.print(",");
+  Serial.print(f.filterIn(raw));      // low-pass only: spikes leak through
+  Serial.print(",");
+  Serial.println(fc.filterIn(clean)); // Hampel in front of the low-pass
+  delay(5); // Loop time will approx. match the sampling time.
+}
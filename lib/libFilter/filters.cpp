@@ -20,13 +20,17 @@
 
 using namespace IIR;
 
+Coeffs  Filter::cache[COEFF_CACHE_SIZE];
+uint8_t Filter::cacheNext = 0;
+
 // CONSTRUCTOR AND DESTRUCTOR * * * * * * * * * * * * * * *
 
 Filter::Filter(float_t hz_, float_t ts_, ORDER od_, TYPE ty_) :
   ts( ts_ ),
   hz( hz_ ),
   od( od_ ),
-  ty( ty_ )
+  ty( ty_ ),
+  seedN( 0 )
 {
   init();
 }
@@ -37,22 +41,82 @@ Filter::~Filter() { }
 
 void Filter::init(bool doFlush) {
   if(doFlush) flush();
-  f_err  = false;
-  f_warn = false;
 
-  switch ((uint8_t)ty) {
-    case (uint8_t)TYPE::LOWPASS :
-      initLowPass();
-      break;
-    case (uint8_t)TYPE::HIGHPASS :
-      initHighPass();
-      break;
+  Coeffs *c = lookup(hz*ts);
+  if(c) {
+    f_err  = false;
+    f_warn = false;
+    load(*c);
+  }
+  else {
+    computeCoeffs();
+  }
+}
+
+void Filter::retune(float_t hz_, float_t ts_) {
+  hz = hz_;
+  ts = ts_;
+  float_t wt = hz*ts;
+
+  // Nearest cached sets below and above wt
+  Coeffs *lo = nullptr, *hi = nullptr;
+  for(uint8_t i=0; i<COEFF_CACHE_SIZE; i++) {
+    Coeffs &c = cache[i];
+    if(!c.valid || c.ty != ty || c.od != od) continue;
+    if(c.wt == wt) { f_err = false; f_warn = false; load(c); return; }
+    if(c.wt < wt && (!lo || c.wt > lo->wt)) lo = &c;
+    if(c.wt > wt && (!hi || c.wt < hi->wt)) hi = &c;
+  }
+
+  if(lo && hi && (hi->wt - lo->wt) <= INTERP_SPAN*wt) {
+    float_t t = (wt - lo->wt)/(hi->wt - lo->wt);
+    k0 = lo->k0 + t*(hi->k0 - lo->k0);
+    k1 = lo->k1 + t*(hi->k1 - lo->k1);
+    k2 = lo->k2 + t*(hi->k2 - lo->k2);
+    k3 = lo->k3 + t*(hi->k3 - lo->k3);
+    k4 = lo->k4 + t*(hi->k4 - lo->k4);
+    j0 = lo->j0 + t*(hi->j0 - lo->j0);
+    j1 = lo->j1 + t*(hi->j1 - lo->j1);
+    j2 = lo->j2 + t*(hi->j2 - lo->j2);
+    pr = lo->pr + t*(hi->pr - lo->pr);
+    f_err  = false;
+    f_warn = false;
+    return;
   }
+
+  computeCoeffs();
+}
+
+void Filter::precompute(float_t hz_, float_t ts_) {
+  float_t hz0 = hz, ts0 = ts;
+  Coeffs cur;
+  store(cur, hz*ts);
+  bool err = f_err, warn = f_warn;
+
+  hz = hz_;
+  ts = ts_;
+  if(!lookup(hz*ts)) computeCoeffs();
+
+  hz = hz0;
+  ts = ts0;
+  load(cur);
+  f_err  = err;
+  f_warn = warn;
 }
 
 float_t Filter::filterIn(float input) {
   if(f_err) return 0.0;
 
+  if(seedCnt < seedN) {
+    seedAcc += input;
+    seedCnt++;
+    float_t mean = seedAcc / seedCnt;
+    if(seedCnt == seedN) seed(mean);
+    return mean;
+  }
+
+  se *= pr;
+
   switch ((uint8_t)ty) {
     case (uint8_t)TYPE::LOWPASS :
       return computeLowPass(input);
@@ -70,6 +134,21 @@ void Filter::flush() {
     u[i] = 0.0;
     y[i] = 0.0;
   }
+  se      = 1.0;
+  seedCnt = 0;
+  seedAcc = 0.0;
+}
+
+// Low-pass filters have unity DC gain, high-pass filters block DC:
+// the steady state for a constant input is y = value resp. y = 0.
+void Filter::seed(float_t value, float_t residual) {
+  float_t out = ((uint8_t)ty == (uint8_t)TYPE::HIGHPASS) ? 0.0 : value;
+  for(uint8_t i=0; i<MAX_ORDER; i++) {
+    u[i] = value;
+    y[i] = out;
+  }
+  se      = residual;
+  seedCnt = seedN;
 }
 
 void Filter::dumpParams() {
@@ -89,6 +168,53 @@ void Filter::dumpParams() {
 
 // PRIVATE METHODS  * * * * * * * * * * * * * * * * * * * *
 
+void Filter::computeCoeffs() {
+  f_err  = false;
+  f_warn = false;
+  k0 = k1 = k2 = k3 = k4 = 0.0;
+  j0 = j1 = j2 = 0.0;
+
+  switch ((uint8_t)ty) {
+    case (uint8_t)TYPE::LOWPASS :
+      initLowPass();
+      break;
+    case (uint8_t)TYPE::HIGHPASS :
+      initHighPass();
+      break;
+  }
+
+  // Numerically bad sets are not worth keeping
+  if(f_err) return;
+
+  Coeffs &c = cache[cacheNext];
+  cacheNext = (cacheNext + 1) % COEFF_CACHE_SIZE;
+  store(c, hz*ts);
+}
+
+Coeffs *Filter::lookup(float_t wt) {
+  for(uint8_t i=0; i<COEFF_CACHE_SIZE; i++) {
+    Coeffs &c = cache[i];
+    if(c.valid && c.ty == ty && c.od == od && c.wt == wt) return &c;
+  }
+  return nullptr;
+}
+
+void Filter::load(const Coeffs &c) {
+  k0 = c.k0; k1 = c.k1; k2 = c.k2; k3 = c.k3; k4 = c.k4;
+  j0 = c.j0; j1 = c.j1; j2 = c.j2;
+  pr = c.pr;
+}
+
+void Filter::store(Coeffs &c, float_t wt) {
+  c.ty = ty;
+  c.od = od;
+  c.wt = wt;
+  c.k0 = k0; c.k1 = k1; c.k2 = k2; c.k3 = k3; c.k4 = k4;
+  c.j0 = j0; c.j1 = j1; c.j2 = j2;
+  c.pr = pr;
+  c.valid = true;
+}
+
 inline float_t Filter::computeLowPass(float_t input) {
   for(uint8_t i=MAX_ORDER-1; i>0; i--) {
     y[i] = y[i-1];
@@ -145,6 +271,7 @@ inline void  Filter::initLowPass() {
         a  = 2.0*PI*hz;
         k1 = exp(-a*ts);
         k0 = 1.0 - k1;
+        pr = k1;
       break;
     case (uint8_t)ORDER::OD2:
         a  = -PI*hz*SQRT2;
@@ -152,6 +279,7 @@ inline void  Filter::initLowPass() {
         k2 = ap(exp(2.0*ts*a));
         k1 = ap(2.0*exp(a*ts)*cos(b*ts));
         k0 = ap(1.0*KM - k1*KM + k2*KM);
+        pr = exp(a*ts);
       break;
     case (uint8_t)ORDER::OD3:
         a  = -PI*hz;
@@ -164,6 +292,7 @@ inline void  Filter::initLowPass() {
         k2 = ap(b2 + b1*b3);
         k1 = ap(b1 + b3);
         k0 = ap(1.0*KM - b1*KM + b2*KM -b3*KM + b1*KM*b3 - b2*KM*b3);
+        pr = exp(a*ts);
       break;
     case (uint8_t)ORDER::OD4:
         a  = -0.3827*2.0*PI*hz;
@@ -179,6 +308,7 @@ inline void  Filter::initLowPass() {
         k2 = ap(b4 + b1*b3 + b2);
         k1 = ap(b1 + b3);
         k0 = ap(1.0*KM - k1*KM + k2*KM - k3*KM + k4*KM);
+        pr = exp(a*ts);
       break;
   }
 }
@@ -203,6 +333,7 @@ inline void  Filter::initHighPass() {
           j0 =  b0/a0;
           j1 =  b1/a0;
           k1 = -a1/a0;
+          pr = abs(k1);
         break;
       case (uint8_t)ORDER::OD2:
       case (uint8_t)ORDER::OD3:
@@ -213,15 +344,17 @@ inline void  Filter::initHighPass() {
           b0 = ksq;
           b1 = -2.0*ksq;
           b2 = ksq;
-          a0 = w0sq + k*w0 + ksq;
+          a0 = w0sq + SQRT2*k*w0 + ksq;
           a1 = 2.0*w0sq - 2.0*ksq;
-          a2 = w0sq - k*w0 + ksq;
+          a2 = w0sq - SQRT2*k*w0 + ksq;
           // Diff equation terms
           j0 = b0/a0;
           j1 = b1/a0;
           j2 = b2/a0;
           k1 = -a1/a0;
           k2 = -a2/a0;
+          // complex pole pair, radius sqrt(a2/a0)
+          pr = sqrt(abs(a2/a0));
         break;
       }
 }
@@ -32,6 +32,21 @@
 
 using namespace IIR;
 
+namespace IIR {
+  /** \brief Difference-equation coefficients of one filter design.
+   *  They only depend on type, order and the product hz*ts, which is the cache key.
+   */
+  struct Coeffs {
+    TYPE    ty;
+    ORDER   od;
+    float_t wt;
+    float_t k0, k1, k2, k3, k4;
+    float_t j0, j1, j2;
+    float_t pr;
+    bool    valid;
+  };
+}
+
 class Filter {
 public:
 
@@ -46,10 +61,45 @@ public:
   void flush();
   void init(bool doFlush=true);
 
+  /** \brief Loads the filter state as if it had been fed \p value forever (steady state).
+   *  Use it with the first sample, or with a value kept from a previous run (e.g. RTC memory).
+   *  \p residual is how far the seed may be from the true steady state, as a fraction of the
+   *  error a flush would leave (1.0); settlingError() decays from it. The default 0 is right
+   *  for a seed taken from the signal itself (e.g. the auto-seed mean); pass e.g. 0.2 for an
+   *  RTC value that may have drifted.
+   */
+  void seed(float_t value, float_t residual = 0.0);
+
+  /** \brief Seeds the filter with the mean of the first \p samples inputs after a flush.
+   *  While seeding, filterIn() returns the running mean. 0 disables auto-seeding.
+   */
+  void setAutoSeed(uint8_t samples) { seedN = samples; seedCnt = 0; seedAcc = 0.0; }
+
+  /** \brief Fraction of the initial state error still present in the output, from the
+   *  slowest pole of the filter: 1.0 right after a flush, the seed's residual after a seed,
+   *  ~0 once settled. It says nothing about noise, only about the start-up transient.
+   */
+  float_t settlingError() { return se; }
+  bool isSettled(float_t tol) { return se <= tol; }
+
+  float_t getOutput() { return y[0]; }
+
   void setSamplingTime(float_t ts_, bool doFlush=true) { ts = ts_; init(doFlush); }
   void setCutoffFreqHZ(float_t hz_, bool doFlush=true) { hz = hz_; init(doFlush); }
   void setOrder(ORDER od_, bool doFlush=true)          { od = od_; init(doFlush); }
 
+  /** \brief Changes cutoff and sampling time mid-stream, without flushing.
+   *  Uses a cached coefficient set if there is one for the new hz*ts, otherwise interpolates
+   *  between the two nearest cached sets when they are at most INTERP_SPAN apart;
+   *  only falls back to computing the coefficients when neither is possible.
+   */
+  void retune(float_t hz_, float_t ts_);
+
+  /** \brief Computes and caches the coefficients for (hz_, ts_) without switching to them,
+   *  e.g. for the end points of a range that retune() will then interpolate over.
+   */
+  void precompute(float_t hz_, float_t ts_);
+
   bool isInErrorState() { return f_err;  }
   bool isInWarnState()  { return f_warn; }
   void dumpParams();
@@ -70,10 +120,24 @@ private:
   // Filter buffer 
   float_t y[MAX_ORDER], u[MAX_ORDER];
 
+  // Settling estimate: slowest pole radius and residual transient
+  float_t pr, se;
+  // Auto-seed: number of samples to average, samples seen, accumulator
+  uint8_t seedN, seedCnt;
+  float_t seedAcc;
+
   bool f_err, f_warn; ///< Numerical error or warning; only relevant for 8-bit micros
 
   float_t ap(float_t p); ///< Assert Parameter
 
+  static Coeffs  cache[COEFF_CACHE_SIZE];
+  static uint8_t cacheNext;
+
+  void computeCoeffs();                          ///< Computes the coefficients for hz, ts and caches them
+  Coeffs *lookup(float_t wt);                    ///< Cached set for this type, order and hz*ts, or nullptr
+  void load(const Coeffs &c);
+  void store(Coeffs &c, float_t wt);
+
   inline float_t computeLowPass(float_t input);
   inline float_t computeHighPass(float_t input);
 
@@ -41,4 +41,7 @@ namespace IIR {
   const float_t EPSILON   = 0.00001;    // Tolerance for numerical constants
   const float_t WEPSILON  = 0.00010;    // Warning threshold for numerical degradation
   const float_t KM        = 100.0;      // Pre-multiplier to reduce the impact of the AVRs limited float representation
+
+  const uint8_t COEFF_CACHE_SIZE = 8;   // Coefficient sets kept across all filters
+  const float_t INTERP_SPAN      = 0.25; // Max relative hz*ts span between two cached sets to interpolate over
 }
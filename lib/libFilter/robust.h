@@ -0,0 +1,229 @@
+/***
+ * Robust streaming filters - Header
+ *
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** All filters here have fixed-capacity storage sized by a template parameter, no heap.
+ *  They are meant to sit in front of an IIR Filter to take spikes out of the signal.
+ */
+
+#pragma once
+
+/// Has to be executed on Arduino IDE > 1.6.7
+#include <Arduino.h>
+
+#include "filters_defs.h"
+
+namespace ROBUST {
+  const float_t MAD_SCALE = 1.4826;   // MAD to standard deviation, for gaussian noise
+  const float_t HAMPEL_K  = 3.0;      // Default Hampel threshold, in standard deviations
+}
+
+/** \brief Exponentially weighted moving average, y += alpha*(x - y).
+ *  The first sample after a flush seeds the state.
+ */
+class EWMA {
+public:
+  EWMA(float_t alpha_) : alpha( alpha_ ) { flush(); }
+
+  float_t filterIn(float_t input) {
+    if(empty) seed(input);
+    y += alpha*(input - y);
+    return y;
+  }
+
+  void seed(float_t value) { y = value; empty = false; }
+  void flush() { y = 0.0; empty = true; }
+
+  void setAlpha(float_t alpha_) { alpha = alpha_; }
+  float_t getOutput() { return y; }
+
+private:
+  float_t alpha;
+  float_t y;
+  bool empty;
+};
+
+/** \brief Moving median over the last N samples, O(log N) per sample.
+ *
+ *  Indexable double heap: a max-heap of the lower half and a min-heap of the upper half share
+ *  one array around the median (negative resp. positive positions). Each window slot knows its
+ *  heap position, so the sample leaving the window is replaced in place and sifted.
+ */
+template <uint8_t N>
+class MovingMedian {
+public:
+  MovingMedian() { flush(); }
+
+  float_t filterIn(float_t input) {
+    bool isNew = ct < N;
+    int16_t p = pos[idx];
+    float_t old = data[idx];
+    data[idx] = input;
+    idx = (idx + 1) % N;
+    if(isNew) ct++;
+
+    if(p > 0) {                   // slot is in the min-heap
+      if(!isNew && old < input) minSortDown(p*2);
+      else if(minSortUp(p))     maxSortDown(-1);
+    }
+    else if(p < 0) {              // slot is in the max-heap
+      if(!isNew && input < old) maxSortDown(p*2);
+      else if(maxSortUp(p))     minSortDown(1);
+    }
+    else {                        // slot is the median
+      if(maxCt()) maxSortDown(-1);
+      if(minCt()) minSortDown(1);
+    }
+    return getOutput();
+  }
+
+  /** \brief Median of the window; mean of the two middle samples when the count is even. */
+  float_t getOutput() {
+    if(ct == 0) return 0.0;
+    float_t v = data[heap[0]];
+    if((ct & 1) == 0) v = (v + data[heap[-1]]) / 2.0;
+    return v;
+  }
+
+  void flush() {
+    heap = heapBuf + N/2;
+    idx  = 0;
+    ct   = 0;
+    // Initial fill pattern: median, max, min, max, min, ...
+    for(int16_t i=N-1; i>=0; i--) {
+      data[i] = 0.0;
+      pos[i]  = ((i + 1)/2) * ((i & 1) ? -1 : 1);
+      heap[pos[i]] = i;
+    }
+  }
+
+  uint8_t size() { return ct; }
+
+  /** \brief Raw window contents, in slot order (not time order); \see size(). */
+  const float_t *window() { return data; }
+
+private:
+  float_t data[N];       ///< Window samples (circular)
+  int16_t pos[N];        ///< Heap position of each window slot
+  int16_t heapBuf[N];    ///< Heap storage; heap points to its middle
+  int16_t *heap;
+  uint8_t idx, ct;
+
+  int16_t minCt() { return (ct - 1)/2; }
+  int16_t maxCt() { return ct/2; }
+
+  bool less(int16_t i, int16_t j) { return data[heap[i]] < data[heap[j]]; }
+
+  bool exchange(int16_t i, int16_t j) {
+    int16_t t = heap[i];
+    heap[i] = heap[j];
+    heap[j] = t;
+    pos[heap[i]] = i;
+    pos[heap[j]] = j;
+    return true;
+  }
+
+  bool cmpExch(int16_t i, int16_t j) { return less(i, j) && exchange(i, j); }
+
+  // Sift from child i downwards (the children of the median are 1 and -1)
+  void minSortDown(int16_t i) {
+    for(; i <= minCt(); i *= 2) {
+      if(i > 1 && i < minCt() && less(i + 1, i)) ++i;
+      if(!cmpExch(i, i/2)) break;
+    }
+  }
+
+  void maxSortDown(int16_t i) {
+    for(; i >= -maxCt(); i *= 2) {
+      if(i < -1 && i > -maxCt() && less(i, i - 1)) --i;
+      if(!cmpExch(i/2, i)) break;
+    }
+  }
+
+  // Return true if the median changed
+  bool minSortUp(int16_t i) {
+    while(i > 0 && cmpExch(i, i/2)) i /= 2;
+    return i == 0;
+  }
+
+  bool maxSortUp(int16_t i) {
+    while(i < 0 && cmpExch(i/2, i)) i /= 2;
+    return i == 0;
+  }
+};
+
+/** \brief Causal Hampel filter: a sample further than k robust standard deviations
+ *  (k * 1.4826 * MAD) from the window median is replaced by the median.
+ *
+ *  The median is O(log N); the MAD is a quickselect over the window, O(N) on average,
+ *  so keep N small (a few tens of samples).
+ */
+template <uint8_t N>
+class Hampel {
+public:
+  Hampel(float_t k_ = ROBUST::HAMPEL_K) : k( k_ ), outliers( 0 ) { }
+
+  float_t filterIn(float_t input) {
+    float_t med = median.filterIn(input);
+    uint8_t ct  = median.size();
+    if(ct < 3) return input;
+
+    const float_t *w = median.window();
+    for(uint8_t i=0; i<ct; i++) dev[i] = abs(w[i] - med);
+    float_t mad = select(dev, ct, ct/2);
+
+    if(abs(input - med) > k*ROBUST::MAD_SCALE*mad) {
+      outliers++;
+      return med;
+    }
+    return input;
+  }
+
+  void flush() { median.flush(); outliers = 0; }
+
+  void setThreshold(float_t k_) { k = k_; }
+
+  /** \brief Number of samples replaced since the last flush. */
+  uint32_t getOutliers() { return outliers; }
+
+private:
+  MovingMedian<N> median;
+  float_t dev[N];
+  float_t k;
+  uint32_t outliers;
+
+  // Quickselect (Hoare), partially reorders a
+  static float_t select(float_t *a, uint8_t n, uint8_t kth) {
+    int16_t lo = 0, hi = n - 1;
+    while(lo < hi) {
+      float_t pivot = a[(lo + hi)/2];
+      int16_t i = lo, j = hi;
+      while(i <= j) {
+        while(a[i] < pivot) i++;
+        while(pivot < a[j]) j--;
+        if(i <= j) {
+          float_t t = a[i]; a[i] = a[j]; a[j] = t;
+          i++; j--;
+        }
+      }
+      if(kth <= j)      hi = j;
+      else if(kth >= i) lo = i;
+      else break;
+    }
+    return a[kth];
+  }
+};
@@ -0,0 +1,67 @@
+/***
+ * bench_filters.cpp - Throughput of every filter type and order
+ *
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// items_per_second is samples/s; args are (type, order).
+
+#include <benchmark/benchmark.h>
+
+#include <filters.h>
+
+namespace {
+
+const float_t cutoff_freq   = 10.0;
+const float_t sampling_time = 0.001;
+
+const ORDER orders[] = {ORDER::OD1, ORDER::OD2, ORDER::OD3, ORDER::OD4};
+
+void BM_Filter(benchmark::State &state) {
+  TYPE ty   = (TYPE)state.range(0);
+  uint8_t n = (uint8_t)state.range(1);
+  Filter f(cutoff_freq, sampling_time, orders[n-1], ty);
+  state.SetLabel(std::string(ty == TYPE::HIGHPASS ? "HP" : "LP") + " OD" + std::to_string(n));
+
+  uint32_t i = 0;
+  for(auto _ : state) {
+    benchmark::DoNotOptimize(f.filterIn((float_t)(i++ & 0xFFF)));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// High-pass filters stop at the second order
+BENCHMARK(BM_Filter)
+  ->ArgNames({"type", "order"})
+  ->Args({(int)TYPE::LOWPASS, 1})->Args({(int)TYPE::LOWPASS, 2})
+  ->Args({(int)TYPE::LOWPASS, 3})->Args({(int)TYPE::LOWPASS, 4})
+  ->Args({(int)TYPE::HIGHPASS, 1})->Args({(int)TYPE::HIGHPASS, 2});
+
+// Switching between two cached coefficient sets
+void BM_Retune(benchmark::State &state) {
+  Filter f(cutoff_freq, sampling_time, ORDER::OD2);
+  f.precompute(cutoff_freq * 2, sampling_time);
+  bool hi = false;
+  for(auto _ : state) {
+    f.retune(hi ? cutoff_freq * 2 : cutoff_freq, sampling_time);
+    hi = !hi;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Retune);
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,93 @@
+/***
+ * bench_robust.cpp - Throughput of the spike rejection filters
+ *
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Same spiky signal as the Robust_Spikes example: a 12 bit DC level plus noise, with a large
+// spike every 50 samples. items_per_second is samples/s.
+
+#include <benchmark/benchmark.h>
+
+#include <filters.h>
+#include <robust.h>
+
+namespace {
+
+const int     spike_every  = 50;
+const float_t spike_height = 3000.0;
+const size_t  SIGNAL_LEN   = 4096;    // power of two, indexed with a mask
+
+// Precomputed so the generator stays out of the measurement
+struct Spiky {
+  float_t x[SIGNAL_LEN];
+  Spiky() {
+    srand(1);
+    for(size_t i=0; i<SIGNAL_LEN; i++) {
+      x[i] = 1000.0 + (rand() % 41 - 20);
+      if((i+1) % spike_every == 0) x[i] += spike_height;
+    }
+  }
+};
+
+const Spiky &spiky() {
+  static const Spiky s;
+  return s;
+}
+
+template <class F>
+void run(benchmark::State &state, F &filt) {
+  const float_t *x = spiky().x;
+  size_t i = 0;
+  for(auto _ : state) {
+    benchmark::DoNotOptimize(filt.filterIn(x[i++ & (SIGNAL_LEN-1)]));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+void BM_EWMA(benchmark::State &state) {
+  EWMA f(0.05);
+  run(state, f);
+}
+BENCHMARK(BM_EWMA);
+
+template <uint8_t N>
+void BM_MovingMedian(benchmark::State &state) {
+  MovingMedian<N> f;
+  run(state, f);
+}
+BENCHMARK_TEMPLATE(BM_MovingMedian, 5);
+BENCHMARK_TEMPLATE(BM_MovingMedian, 15);
+BENCHMARK_TEMPLATE(BM_MovingMedian, 63);
+
+template <uint8_t N>
+void BM_Hampel(benchmark::State &state) {
+  Hampel<N> f;
+  run(state, f);
+}
+BENCHMARK_TEMPLATE(BM_Hampel, 5);
+BENCHMARK_TEMPLATE(BM_Hampel, 15);
+BENCHMARK_TEMPLATE(BM_Hampel, 63);
+
+// Reference: the low-pass the robust filters sit in front of
+void BM_IIR_OD2(benchmark::State &state) {
+  Filter f(1.0, 0.005, ORDER::OD2);
+  run(state, f);
+}
+BENCHMARK(BM_IIR_OD2);
+
+} // namespace
+
+BENCHMARK_MAIN();
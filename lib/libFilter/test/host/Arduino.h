@@ -0,0 +1,66 @@
+/***
+ * Arduino.h - Minimal host stand-in for the Arduino core
+ *
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Just what the library and its examples use, so they build and run on a PC:
+// integer types, the math functions, PI, micros() and a Serial printing to stdout.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+
+using std::min;
+using std::max;
+
+#ifndef PI
+  #define PI 3.1415926535897932384626433832795
+#endif
+
+inline unsigned long micros() {
+  using namespace std::chrono;
+  static const steady_clock::time_point t0 = steady_clock::now();
+  return (unsigned long)duration_cast<microseconds>(steady_clock::now() - t0).count();
+}
+
+inline unsigned long millis() { return micros() / 1000; }
+
+class HostSerial {
+public:
+  void begin(unsigned long) { }
+  void flush() { fflush(stdout); }
+
+  void print(const char *s)            { fputs(s, stdout); }
+  void print(char c)                   { fputc(c, stdout); }
+  void print(long v)                   { printf("%ld", v); }
+  void print(unsigned long v)          { printf("%lu", v); }
+  void print(int v)                    { print((long)v); }
+  void print(unsigned int v)           { print((unsigned long)v); }
+  void print(uint8_t v)                { print((unsigned long)v); }
+  void print(double v, int digits = 2) { printf("%.*f", digits, v); }
+
+  template<typename T> void println(T v)            { print(v); print('\n'); }
+  template<typename T> void println(T v, int digits) { print((double)v, digits); print('\n'); }
+  void println()                                     { print('\n'); }
+};
+
+extern HostSerial Serial;
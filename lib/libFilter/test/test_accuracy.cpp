@@ -0,0 +1,95 @@
+/***
+ * test_accuracy.cpp - Step and frequency response against the analytic Butterworth curves
+ *
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Same checks as the Benchmark_Accuracy example, one test case per type, order and frequency.
+
+#include <gtest/gtest.h>
+#include <tuple>
+
+#include <filters.h>
+
+namespace {
+
+const float_t cutoff_freq   = 10.0;   // Hz
+const float_t sampling_time = 0.001;  // s (fs = 1 kHz)
+const float_t tolerance     = 0.05;   // max absolute error on the magnitude
+
+const ORDER orders[] = {ORDER::OD1, ORDER::OD2, ORDER::OD3, ORDER::OD4};
+
+// Analytic Butterworth magnitude of order n at frequency f
+float_t butterworth(TYPE ty, uint8_t n, float_t f) {
+  float_t r  = pow(f/cutoff_freq, 2.0*n);
+  float_t lp = 1.0/sqrt(1.0 + r);
+  return (ty == TYPE::HIGHPASS) ? sqrt(r)*lp : lp;
+}
+
+// Steady-state amplitude of a unit sine at freq
+float_t amplitude(Filter &f, float_t freq) {
+  const uint16_t settle = 3000, measure = 2000;
+  float_t peak = 0.0;
+  for(uint16_t i=0; i<settle + measure; i++) {
+    float_t y = f.filterIn(sin(2.0*PI*freq*i*sampling_time));
+    if(i >= settle && fabs(y) > peak) peak = fabs(y);
+  }
+  return peak;
+}
+
+// (type, order)
+typedef std::tuple<TYPE, uint8_t> Design;
+
+class Butterworth : public ::testing::TestWithParam<Design> {
+protected:
+  TYPE    ty() const { return std::get<0>(GetParam()); }
+  uint8_t n()  const { return std::get<1>(GetParam()); }
+};
+
+TEST_P(Butterworth, StepSettlesToDcGain) {
+  Filter f(cutoff_freq, sampling_time, orders[n()-1], ty());
+  float_t y = 0.0;
+  for(uint16_t i=0; i<5000; i++) y = f.filterIn(1.0);
+  EXPECT_NEAR(y, (ty() == TYPE::HIGHPASS) ? 0.0 : 1.0, tolerance);
+}
+
+TEST_P(Butterworth, MagnitudeMatchesAnalyticCurve) {
+  for(float_t freq : {cutoff_freq / 4, cutoff_freq, cutoff_freq * 4}) {
+    Filter f(cutoff_freq, sampling_time, orders[n()-1], ty());
+    EXPECT_NEAR(amplitude(f, freq), butterworth(ty(), n(), freq), tolerance) << "at " << freq << " Hz";
+  }
+}
+
+TEST_P(Butterworth, SeedStartsAtSteadyState) {
+  Filter f(cutoff_freq, sampling_time, orders[n()-1], ty());
+  f.seed(1.0);
+  EXPECT_NEAR(f.filterIn(1.0), (ty() == TYPE::HIGHPASS) ? 0.0 : 1.0, 1e-3);
+  EXPECT_LE(f.settlingError(), 1e-3);
+}
+
+std::string designName(const ::testing::TestParamInfo<Design> &info) {
+  return std::string(std::get<0>(info.param) == TYPE::HIGHPASS ? "HP" : "LP") +
+         "_OD" + std::to_string(std::get<1>(info.param));
+}
+
+// High-pass filters stop at the second order
+INSTANTIATE_TEST_SUITE_P(LowPass, Butterworth,
+                         ::testing::Combine(::testing::Values(TYPE::LOWPASS), ::testing::Values(1, 2, 3, 4)),
+                         designName);
+INSTANTIATE_TEST_SUITE_P(HighPass, Butterworth,
+                         ::testing::Combine(::testing::Values(TYPE::HIGHPASS), ::testing::Values(1, 2)),
+                         designName);
+
+} // namespace
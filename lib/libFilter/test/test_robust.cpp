@@ -0,0 +1,165 @@
+/***
+ * test_robust.cpp - Moving median, Hampel and EWMA against their definitions
+ *
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// The median is checked sample by sample against sorting the window, through the warm-up and
+// many wrap-arounds; Hampel and EWMA on hand-made signals with a known answer.
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <deque>
+#include <type_traits>
+#include <vector>
+
+#include <robust.h>
+
+namespace {
+
+// Median of the last n samples (or of all, during the warm-up), by sorting
+float_t bruteMedian(const std::deque<float_t> &window) {
+  std::vector<float_t> s(window.begin(), window.end());
+  std::sort(s.begin(), s.end());
+  size_t n = s.size();
+  return (n & 1) ? s[n/2] : (s[n/2 - 1] + s[n/2]) / 2.0;
+}
+
+// Deterministic, with repeated values so ties get exercised too
+float_t sample(uint32_t i) {
+  return static_cast<float_t>((i*7919u + (i >> 3)*104729u) % 97u) - 48.0;
+}
+
+template <typename T>
+class Median : public ::testing::Test { };
+
+typedef ::testing::Types<std::integral_constant<uint8_t, 1>, std::integral_constant<uint8_t, 2>,
+                         std::integral_constant<uint8_t, 7>, std::integral_constant<uint8_t, 8>,
+                         std::integral_constant<uint8_t, 31>> Sizes;
+TYPED_TEST_SUITE(Median, Sizes);
+
+TYPED_TEST(Median, MatchesSortedWindow) {
+  const uint8_t n = TypeParam::value;
+  MovingMedian<n> m;
+  std::deque<float_t> window;
+
+  EXPECT_EQ(m.getOutput(), 0.0);
+
+  for(uint32_t i=0; i<20u*n + 50; i++) {
+    float_t x = sample(i);
+    window.push_back(x);
+    if(window.size() > n) window.pop_front();
+
+    ASSERT_EQ(m.filterIn(x), bruteMedian(window)) << "sample " << i;
+    ASSERT_EQ(m.size(), window.size());
+  }
+}
+
+TYPED_TEST(Median, FlushStartsOver) {
+  const uint8_t n = TypeParam::value;
+  MovingMedian<n> m;
+
+  for(uint32_t i=0; i<3u*n; i++) m.filterIn(1000.0 + i);
+  m.flush();
+  EXPECT_EQ(m.size(), 0);
+
+  std::deque<float_t> window;
+  for(uint32_t i=0; i<2u*n; i++) {
+    window.push_back(sample(i));
+    if(window.size() > n) window.pop_front();
+    ASSERT_EQ(m.filterIn(sample(i)), bruteMedian(window)) << "sample " << i;
+  }
+}
+
+// Alternating +-1 around 0: median 0 (or close), MAD 1
+float_t noise(uint32_t i) { return (i & 1) ? 1.0 : -1.0; }
+
+TEST(Hampel, ReplacesSingleSpike) {
+  Hampel<9> h;
+
+  for(uint32_t i=0; i<20; i++) ASSERT_EQ(h.filterIn(noise(i)), noise(i));
+
+  float_t y = h.filterIn(100.0);
+  EXPECT_NEAR(y, 0.0, 1.0);
+  EXPECT_EQ(h.getOutliers(), 1u);
+
+  // The spike stays in the window but doesn't drag the neighbours out
+  for(uint32_t i=21; i<40; i++) ASSERT_EQ(h.filterIn(noise(i)), noise(i)) << "sample " << i;
+  EXPECT_EQ(h.getOutliers(), 1u);
+}
+
+TEST(Hampel, FollowsStep) {
+  const uint8_t n = 9;
+  const float_t step = 20.0;
+  Hampel<n> h;
+
+  for(uint32_t i=0; i<20; i++) h.filterIn(noise(i));
+
+  // Taken for outliers until the new level holds the majority of the window, then passed
+  for(uint32_t i=0; i<40; i++) {
+    float_t x = step + noise(i);
+    float_t y = h.filterIn(x);
+    if(i >= n/2) ASSERT_EQ(y, x) << i << " samples after the step";
+  }
+  EXPECT_LE(h.getOutliers(), n/2);
+}
+
+TEST(Hampel, ZeroMadReplacesAnyChange) {
+  Hampel<5> h;
+
+  for(uint8_t i=0; i<10; i++) ASSERT_EQ(h.filterIn(5.0), 5.0);
+
+  // All equal: MAD is 0, the threshold too; an equal sample passes, a different one doesn't
+  EXPECT_EQ(h.filterIn(5.5), 5.0);
+  EXPECT_EQ(h.getOutliers(), 1u);
+  EXPECT_EQ(h.filterIn(5.0), 5.0);
+  EXPECT_EQ(h.getOutliers(), 1u);
+}
+
+TEST(Hampel, PassesWarmUp) {
+  Hampel<5> h;
+
+  // Fewer than 3 samples: no statistics yet
+  EXPECT_EQ(h.filterIn(0.0), 0.0);
+  EXPECT_EQ(h.filterIn(100.0), 100.0);
+  EXPECT_EQ(h.getOutliers(), 0u);
+}
+
+TEST(EWMA, FirstSampleSeeds) {
+  EWMA e(0.1);
+
+  EXPECT_EQ(e.filterIn(42.0), 42.0);
+  EXPECT_EQ(e.getOutput(), 42.0);
+
+  e.flush();
+  EXPECT_EQ(e.filterIn(-3.0), -3.0);
+
+  // An explicit seed takes the place of the first sample
+  e.flush();
+  e.seed(10.0);
+  EXPECT_FLOAT_EQ(e.filterIn(0.0), 9.0);
+}
+
+TEST(EWMA, StepResponse) {
+  const float_t alpha = 0.2;
+  EWMA e(alpha);
+
+  e.filterIn(0.0);
+  for(int n=1; n<=30; n++) {
+    EXPECT_NEAR(e.filterIn(1.0), 1.0 - pow(1.0 - alpha, n), 1e-5) << "sample " << n;
+  }
+}
+
+} // namespace
@@ -40,10 +40,35 @@ typedef enum
         EV_PENDING = 101,
         EV_ACK = 102,
         EV_RESPONSE = 103,
+        EV_NACK = 104,
 } extra_ev;
 
-/// \var message counter, stored in RTC memory to survive deep sleep
-static RTC_DATA_ATTR uint32_t count = 0;
+/// \enum uplink priorities, lower values are sent first
+typedef enum
+{
+        PRIO_ALERT = 0,
+        PRIO_DATA = 1,
+        PRIO_BACKFILL = 2,
+} prio_t;
+
+/// the frame has no age field, see send()
+const uint8_t NO_AGE = 0xFF;
+
+/// \struct counters since the last cold boot, kept in RTC memory
+typedef struct
+{
+        uint32_t joins;            ///< OTAA joins completed
+        uint32_t resumes;          ///< wakes that resumed the session from RTC memory
+        uint32_t uplinks;          ///< frames sent (TX complete)
+        uint32_t confirmed;        ///< of which asked for an ACK
+        uint32_t acks;             ///< ACKs received
+        uint32_t downlinks;        ///< frames received in RX1/RX2
+        uint64_t airtime_us;       ///< time on air, join requests included
+        uint32_t wakes;            ///< wake cycles ended by save_session()
+        uint32_t awake_ms_last;    ///< wake-to-sleep time of the last cycle
+        uint32_t awake_ms_max;     ///< longest wake-to-sleep time
+        uint64_t awake_ms_sum;     ///< total wake-to-sleep time, for the average
+} stats_t;
 
 ///
 /// \brief           Registers callback for running when a message
@@ -56,6 +81,17 @@ static RTC_DATA_ATTR uint32_t count = 0;
 ///
 void regist(void (*callback)(uint8_t message));
 
+///
+/// \brief           Registers the handler of downlink payloads, run on
+///                  TX complete when the network sent data on a port
+///
+/// \param[in]       handler     function pointer to the handler; gets the
+///                              port, the payload and its size
+///
+/// \return          void
+///
+void regist_downlink(void (*handler)(uint8_t port, const uint8_t *data, uint8_t size));
+
 ///
 /// \brief           Sets the spreading factor for LoRa PHY
 ///
@@ -75,14 +111,23 @@ void set_spreading_factor(unsigned char sf);
 void adr(const bool enabled);
 
 ///
-/// \brief           Initializes the message sent counter to zero,
-///                  thereby clearing the previous stored value
-///                  in the EEPROM
+/// \brief           Initializes the message sent counter: kept as is
+///                  after a deep sleep, otherwise restored from NVS and
+///                  advanced by CONFIG_LORA_FCNT_PERSIST_EVERY, since up
+///                  to that many frames may have gone out unrecorded
 ///
 /// \return          void
 ///
 void init_count();
 
+///
+/// \brief           Restarts the message sent counter from zero, e.g.
+///                  for a new session, and records it in NVS
+///
+/// \return          void
+///
+void reset_count();
+
 ///
 /// \brief           Initializes the message sent counter to zero,
 ///                  thereby clearing the previous stored value
@@ -97,12 +142,40 @@ bool setup();
 
 ///
 /// \brief           Tries to join the network using the OTAA credentials
-///                  previously set in setup()
+///                  previously set in setup(); after a deep sleep, resumes
+///                  the MAC state saved by save_session() instead
 ///
 /// \return          void
 ///
 void join();
 
+///
+/// \brief           Saves the whole LMIC MAC state (session, data rate,
+///                  TX power, channels, RX2 and duty cycle timers) to
+///                  RTC memory; call right before deep sleep
+///
+/// \param[in]       sleep_ms    how long we are going to sleep, in ms
+///
+/// \return          void
+///
+void save_session(const uint64_t sleep_ms);
+
+///
+/// \brief           Restores the MAC state saved by save_session(),
+///                  rebasing its timers on the current LMIC clock
+///
+/// \return          true if a session was restored, false otherwise
+///
+bool restore_session();
+
+///
+/// \brief           Checks whether there is a usable session,
+///                  either joined now or restored
+///
+/// \return          true if joined, false otherwise
+///
+bool is_joined();
+
 ///
 /// \brief           Main loop of LoRaWAN handler module,
 ///                  run asynchronously and in another OS task
@@ -113,19 +186,33 @@ void loop();
 
 ///
 /// \brief           Gets current value of sent message count
-///                  from the EEPROM
 ///
 /// \return          the value of the counter
 ///
 uint32_t get_count();
 
 ///
-/// \brief           Dumps the current message counter value in the EEPROM
+/// \brief           Hands the current message counter to LMIC and writes
+///                  it to NVS once every CONFIG_LORA_FCNT_PERSIST_EVERY frames
 ///
 /// \return          the current count
 ///
 int dump_count();
 
+///
+/// \brief           Counters of joins, frames, airtime and wake time
+///
+/// \return          the counters
+///
+const stats_t &stats();
+
+///
+/// \brief           Logs the counters
+///
+/// \return          void
+///
+void dump_stats();
+
 ///
 /// \brief           Deletes LoRaWAN module's prefs stored in the EEPROM
 ///
@@ -134,15 +221,115 @@ int dump_count();
 void erase_prefs();
 
 ///
-/// \brief           Sends data to port port, optionally asking for ACK
+/// \brief           Uplink policy: frames go unconfirmed, except one every
+///                  set_confirm_every(); after a missing ACK or a
+///                  failed link check, confirmations are requested on the
+///                  next frame, then every 2, 4... frames until the network
+///                  answers again
 ///
-/// \param[in]       data        the data buffer to send
-/// \param[in]       data_size   size of data
-/// \param[in]       port        the LoRaWAN port to use
-/// \param[in]       confirmed   whether to ask for ACK
+/// \return          true if the next frame should ask for an ACK
+///
+bool confirm_due();
+
+///
+/// \brief           Sets how often frames ask for an ACK while the link is
+///                  up (CONFIG_LORA_CONFIRM_EVERY until called)
+///
+/// \param[in]       every     ask for an ACK every these many frames
+///
+/// \return          void
+///
+void set_confirm_every(const uint8_t every);
+
+///
+/// \brief           Tells whether the last confirmation (or link check)
+///                  succeeded
+///
+/// \return          true if the link is considered up
+///
+bool link_up();
+
+///
+/// \brief           Counts a frame that was kept offline instead of being
+///                  sent, so the uplink policy still comes to the next
+///                  confirmed probe
+///
+/// \return          void
+///
+void skip();
+
+///
+/// \brief           Records the outcome of a confirmed frame or link check
+///                  in the uplink policy state (kept in RTC memory)
+///
+/// \param[in]       acked     whether the network answered
+///
+/// \return          void
+///
+void confirm_result(const bool acked);
+
+///
+/// \brief           Sends data to port port, optionally asking for ACK;
+///                  if LMIC is busy the frame is kept in the uplink queue
+///                  (RTC memory, CONFIG_LORA_QUEUE_LEN entries) and sent
+///                  as soon as LMIC is free, highest priority first. When
+///                  the queue is full the oldest lowest-priority entry is
+///                  dropped, or the new frame if that has lower priority.
+///                  A frame LMIC refuses, or cancels later (e.g. too long
+///                  for the data rate), ends with EV_TXCANCELED instead
+///                  of EV_TXCOMPLETE. A frame with an age field gets, as
+///                  it goes to LMIC, the seconds since its data was sampled
+///
+/// \param[in]       data         the data buffer to send
+/// \param[in]       data_size    size of data
+/// \param[in]       port         the LoRaWAN port to use
+/// \param[in]       confirmed    whether to ask for ACK
+/// \param[in]       prio         the priority, see prio_t
+/// \param[in]       age_at       offset of a u16 (MSB first) age field in
+///                               data, NO_AGE if it has none
+/// \param[in]       sampled_at   Unix time of the data, in seconds
 ///
 /// \return          void
 ///
-void send(uint8_t *data, const uint8_t data_size, const uint8_t port, const bool confirmed);
+void send(uint8_t *data, const uint8_t data_size, const uint8_t port, const bool confirmed,
+          const uint8_t prio = PRIO_DATA, const uint8_t age_at = NO_AGE, const uint32_t sampled_at = 0);
+
+///
+/// \brief           Hands the next queued frame to LMIC, if it's free
+///
+/// \return          void
+///
+void drain();
+
+///
+/// \brief           Tells whether LMIC has a frame scheduled or in flight
+///
+/// \return          true if busy
+///
+bool busy();
+
+///
+/// \brief           Number of frames not sent yet: queued ones plus the
+///                  one LMIC is working on, if any
+///
+/// \return          the number of frames
+///
+uint8_t pending();
+
+///
+/// \brief           Longest payload a frame can carry at the current data
+///                  rate, with room for the MAC commands LMIC may add
+///
+/// \return          the size in bytes, at most CONFIG_MAX_PAYLOAD
+///
+uint8_t max_payload();
+
+///
+/// \brief           Time before a duty-cycle band of the enabled channels
+///                  is free, from the airtime ledger
+///
+/// \return          the wait in milliseconds, 0 if a frame can go now
+///
+uint32_t next_slot_ms();
 
 } // namespace wan
\ No newline at end of file
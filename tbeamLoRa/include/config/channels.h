@@ -0,0 +1,281 @@
+/*
+ *
+ * Channel plans file
+ *
+ * PURPOSE: Holds the uplink channel plan of each LoRaWAN region,
+ *          selected through Kconfig
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <lmic.h>
+
+#include "../../../config.h"
+
+///
+/// \note
+///
+/// The plan is applied on a cold join only: after deep sleep the channels
+/// come back with the rest of the MAC state from RTC memory. LMIC is built
+/// for a single region (CFG_xxx in platformio.ini), so the Kconfig region
+/// must match it. Each table is checked at compile time: channel count,
+/// frequency range, data rate map and duplicate frequencies.
+///
+/// DATARATES maps the uplink data rates of the region (DR0 first, always
+/// the slowest) to spreading factor, bandwidth and longest MAC payload
+/// (N in the Regional Parameters, which piggybacked MAC commands share):
+/// DR0 is SF12 in EU-like plans but SF10 in US915.
+///
+
+#if defined(CONFIG_REGION_EU868) && !defined(CFG_eu868)
+#error "Kconfig region is EU868 but LMIC is not built with CFG_eu868"
+#elif defined(CONFIG_REGION_US915) && !defined(CFG_us915)
+#error "Kconfig region is US915 but LMIC is not built with CFG_us915"
+#elif defined(CONFIG_REGION_AU915) && !defined(CFG_au915)
+#error "Kconfig region is AU915 but LMIC is not built with CFG_au915"
+#elif defined(CONFIG_REGION_AS923) && !defined(CFG_as923)
+#error "Kconfig region is AS923 but LMIC is not built with CFG_as923"
+#elif defined(CONFIG_REGION_KR920) && !defined(CFG_kr920)
+#error "Kconfig region is KR920 but LMIC is not built with CFG_kr920"
+#elif defined(CONFIG_REGION_IN865) && !defined(CFG_in866)
+#error "Kconfig region is IN865 but LMIC is not built with CFG_in866"
+#endif
+
+namespace channels
+{
+
+/// \struct one uplink channel of a dynamic (EU-like) plan
+struct channel_t
+{
+        uint32_t freq;     ///< frequency, Hz
+        uint16_t drmap;    ///< data rates allowed, DR_RANGE_MAP()
+        uint8_t  band;     ///< duty-cycle band (EU868 only, ignored elsewhere)
+};
+
+#if defined(CONFIG_REGION_EU868)
+
+/// \var PLAN EU868: the three default channels, five more at 867 MHz and FSK
+constexpr channel_t PLAN[] =
+{
+        {868100000, DR_RANGE_MAP(DR_SF12, DR_SF7), BAND_CENTI},
+        {868300000, DR_RANGE_MAP(DR_SF12, DR_SF7B), BAND_CENTI},
+        {868500000, DR_RANGE_MAP(DR_SF12, DR_SF7), BAND_CENTI},
+        {867100000, DR_RANGE_MAP(DR_SF12, DR_SF7), BAND_CENTI},
+        {867300000, DR_RANGE_MAP(DR_SF12, DR_SF7), BAND_CENTI},
+        {867500000, DR_RANGE_MAP(DR_SF12, DR_SF7), BAND_CENTI},
+        {867700000, DR_RANGE_MAP(DR_SF12, DR_SF7), BAND_CENTI},
+        {867900000, DR_RANGE_MAP(DR_SF12, DR_SF7), BAND_CENTI},
+        {868800000, DR_RANGE_MAP(DR_FSK, DR_FSK), BAND_MILLI},
+};
+
+constexpr uint32_t FREQ_MIN = 863000000;
+constexpr uint32_t FREQ_MAX = 870000000;
+
+#elif defined(CONFIG_REGION_AS923)
+
+/// \var PLAN AS923: the two default channels and six more
+constexpr channel_t PLAN[] =
+{
+        {923200000, DR_RANGE_MAP(DR_SF12, DR_SF7), 0},
+        {923400000, DR_RANGE_MAP(DR_SF12, DR_SF7), 0},
+        {922200000, DR_RANGE_MAP(DR_SF12, DR_SF7), 0},
+        {922400000, DR_RANGE_MAP(DR_SF12, DR_SF7), 0},
+        {922600000, DR_RANGE_MAP(DR_SF12, DR_SF7), 0},
+        {922800000, DR_RANGE_MAP(DR_SF12, DR_SF7), 0},
+        {923000000, DR_RANGE_MAP(DR_SF12, DR_SF7), 0},
+        {922000000, DR_RANGE_MAP(DR_SF12, DR_SF7), 0},
+};
+
+constexpr uint32_t FREQ_MIN = 915000000;
+constexpr uint32_t FREQ_MAX = 928000000;
+
+#elif defined(CONFIG_REGION_KR920)
+
+/// \var PLAN KR920: the three default channels and four more
+constexpr channel_t PLAN[] =
+{
+        {922100000, DR_RANGE_MAP(DR_SF12, DR_SF7), 0},
+        {922300000, DR_RANGE_MAP(DR_SF12, DR_SF7), 0},
+        {922500000, DR_RANGE_MAP(DR_SF12, DR_SF7), 0},
+        {922700000, DR_RANGE_MAP(DR_SF12, DR_SF7), 0},
+        {922900000, DR_RANGE_MAP(DR_SF12, DR_SF7), 0},
+        {923100000, DR_RANGE_MAP(DR_SF12, DR_SF7), 0},
+        {923300000, DR_RANGE_MAP(DR_SF12, DR_SF7), 0},
+};
+
+constexpr uint32_t FREQ_MIN = 920900000;
+constexpr uint32_t FREQ_MAX = 923300000;
+
+#elif defined(CONFIG_REGION_IN865)
+
+/// \var PLAN IN865: the three default channels
+constexpr channel_t PLAN[] =
+{
+        {865062500, DR_RANGE_MAP(DR_SF12, DR_SF7), 0},
+        {865402500, DR_RANGE_MAP(DR_SF12, DR_SF7), 0},
+        {865985000, DR_RANGE_MAP(DR_SF12, DR_SF7), 0},
+};
+
+constexpr uint32_t FREQ_MIN = 865000000;
+constexpr uint32_t FREQ_MAX = 867000000;
+
+#elif defined(CONFIG_REGION_US915) || defined(CONFIG_REGION_AU915)
+
+//
+// fixed channel plans: the gateways listen on one sub-band of 8 channels
+// (plus a 500 kHz one), chosen with LMIC_selectSubBand()
+//
+constexpr uint8_t SUBBAND = CONFIG_LORA_SUBBAND;
+
+static_assert(SUBBAND < 8, "sub-band must be 0 to 7");
+
+#endif
+
+/// \struct one uplink data rate, DATARATES is indexed by DR number
+struct datarate_t
+{
+        uint8_t  sf;       ///< spreading factor, 0 for FSK
+        uint16_t bw_khz;   ///< bandwidth, kHz (0 for FSK)
+        uint8_t  payload;  ///< longest MAC payload at this data rate, bytes
+};
+
+#if defined(CONFIG_REGION_EU868)
+
+constexpr datarate_t DATARATES[] =
+{
+        {12, 125, 51}, {11, 125, 51}, {10, 125, 51}, {9, 125, 115},
+        {8, 125, 222}, {7, 125, 222}, {7, 250, 222}, {0, 0, 222},
+};
+
+#elif defined(CONFIG_REGION_US915)
+
+constexpr datarate_t DATARATES[] =
+{
+        {10, 125, 11}, {9, 125, 53}, {8, 125, 125}, {7, 125, 242}, {8, 500, 242},
+};
+
+#elif defined(CONFIG_REGION_AU915)
+
+constexpr datarate_t DATARATES[] =
+{
+        {12, 125, 51}, {11, 125, 51}, {10, 125, 51}, {9, 125, 115},
+        {8, 125, 242}, {7, 125, 242}, {8, 500, 242},
+};
+
+#elif defined(CONFIG_REGION_AS923)
+
+//
+// no uplink dwell time limit (TxParamSetupReq can impose one)
+//
+constexpr datarate_t DATARATES[] =
+{
+        {12, 125, 51}, {11, 125, 51}, {10, 125, 51}, {9, 125, 115},
+        {8, 125, 242}, {7, 125, 242}, {7, 250, 242}, {0, 0, 242},
+};
+
+#elif defined(CONFIG_REGION_KR920)
+
+constexpr datarate_t DATARATES[] =
+{
+        {12, 125, 51}, {11, 125, 51}, {10, 125, 51}, {9, 125, 115},
+        {8, 125, 242}, {7, 125, 242},
+};
+
+#elif defined(CONFIG_REGION_IN865)
+
+//
+// DR6 is reserved, DR7 is FSK
+//
+constexpr datarate_t DATARATES[] =
+{
+        {12, 125, 51}, {11, 125, 51}, {10, 125, 51}, {9, 125, 115},
+        {8, 125, 242}, {7, 125, 242}, {0, 0, 0}, {0, 0, 242},
+};
+
+#endif
+
+constexpr uint8_t DR_COUNT = sizeof(DATARATES) / sizeof(DATARATES[0]);
+
+/// \var DR_SLOWEST DR0 is the slowest data rate in every plan
+constexpr uint8_t DR_SLOWEST = 0;
+
+constexpr bool lora125(const uint8_t dr)
+{
+        return dr < DR_COUNT && DATARATES[dr].bw_khz == 125;
+}
+
+/// \brief spreading factor of a data rate, 0 for FSK or an unknown one
+constexpr uint8_t sf_of(const uint8_t dr)
+{
+        return dr < DR_COUNT ? DATARATES[dr].sf : 0;
+}
+
+/// \brief longest MAC payload at a data rate, 0 for an unknown one
+constexpr uint8_t payload_of(const uint8_t dr)
+{
+        return dr < DR_COUNT ? DATARATES[dr].payload : 0;
+}
+
+/// \brief fastest 125 kHz data rate with at least this spreading factor,
+///        or the slowest one if none has it (e.g. SF12 in US915)
+constexpr uint8_t dr_for_sf(const uint8_t sf, const uint8_t dr = DR_COUNT - 1)
+{
+        return dr == DR_SLOWEST ? DR_SLOWEST : ((lora125(dr) && sf_of(dr) >= sf) ? dr : dr_for_sf(sf, dr - 1));
+}
+
+constexpr bool rate_valid(const datarate_t &r)
+{
+        return (r.sf == 0 && r.bw_khz == 0) ||
+               (r.sf >= 7 && r.sf <= 12 && (r.bw_khz == 125 || r.bw_khz == 250 || r.bw_khz == 500) && r.payload > 0);
+}
+
+constexpr bool rates_valid(const datarate_t *r, const uint8_t n)
+{
+        return n == 0 || (rate_valid(r[0]) && r[0].payload <= 242 &&
+                          (n == 1 || !(r[0].bw_khz == 125 && r[1].bw_khz == 125) || r[1].sf < r[0].sf) &&
+                          rates_valid(r + 1, n - 1));
+}
+
+static_assert(lora125(DR_SLOWEST) && DATARATES[DR_SLOWEST].payload > 0, "DR0 must be LoRa at 125 kHz");
+static_assert(rates_valid(DATARATES, DR_COUNT), "bad spreading factor, bandwidth or payload, or 125 kHz rates out of order");
+
+#if defined(CFG_LMIC_EU_like)
+
+constexpr uint8_t PLAN_SIZE = sizeof(PLAN) / sizeof(PLAN[0]);
+
+constexpr bool unique(const channel_t *p, const uint8_t n, const uint32_t freq)
+{
+        return n == 0 || (p[0].freq != freq && unique(p + 1, n - 1, freq));
+}
+
+constexpr bool valid(const channel_t *p, const uint8_t n)
+{
+        return n == 0 || (p[0].freq >= FREQ_MIN && p[0].freq <= FREQ_MAX && p[0].drmap != 0 &&
+                          unique(p + 1, n - 1, p[0].freq) && valid(p + 1, n - 1));
+}
+
+static_assert(PLAN_SIZE > 0 && PLAN_SIZE <= MAX_CHANNELS, "too many channels for LMIC");
+static_assert(valid(PLAN, PLAN_SIZE), "channel out of band, without data rates or duplicated");
+
+#endif
+
+} // namespace channels
@@ -37,6 +37,17 @@ namespace axp192
 ///
 void setup(bool gps);
 
+///
+/// \brief           Warm counterpart of setup() after a timer wake: the
+///                  PMU configuration survived, only the rails cut before
+///                  deep sleep are turned back on
+///
+/// \param[in]       gps     whether to turn on GPS
+///
+/// \return          void
+///
+void resume(bool gps);
+
 ///
 /// \brief           Cut power off the GPS module via the
 ///                  AXP192 Power Management Unit
@@ -3,6 +3,7 @@
  * Sleep module
  *
  * PURPOSE: Gives various functions to selectively put the MCU in deep-sleep
+ *          or light-sleep
  *
  * -----------------------------------------------------------------------
  *
@@ -57,4 +58,33 @@ void seconds(const uint32_t seconds);
 ///
 void do_deepsleep(const uint64_t ms, const bool gps);
 
-} // namespace deepsleep
\ No newline at end of file
+} // namespace deepsleep
+
+namespace lightsleep
+{
+
+///
+/// \brief              Put the MCU in light sleep for at most ms
+///                     milliseconds, or until one of the GPIOs in
+///                     gpio_mask goes high; RAM and peripherals keep
+///                     their state and execution resumes here
+///
+/// \param[in]          ms            the longest period to sleep in milliseconds
+/// \param[in]          gpio_mask     bit map of the GPIOs that can wake the MCU
+///
+/// \return             true if woken by a GPIO
+///
+bool until(const uint32_t ms, const uint64_t gpio_mask);
+
+///
+/// \brief              Drop-in replacement for delay(): waits ms
+///                     milliseconds in light sleep when the wait is at
+///                     least CONFIG_LIGHT_SLEEP_WAIT_MIN_MS, busy otherwise
+///
+/// \param[in]          ms     time to wait in milliseconds
+///
+/// \return             void
+///
+void wait(const uint32_t ms);
+
+} // namespace lightsleep
\ No newline at end of file
@@ -0,0 +1,63 @@
+/*
+ *
+ * Wake stub module
+ *
+ * PURPOSE: Splits long deep sleeps into slices; the wakes in between are
+ *          handled by a stub in RTC fast memory, without booting
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+///
+/// \note
+///
+/// On a timer wake the ROM runs esp_wake_deep_sleep() from RTC fast memory
+/// before loading the application from flash. Ours folds the ULP
+/// statistics, counts the wake and goes back to sleep until the last slice
+/// is over; any other wake (button, reset) boots as usual. The stub can
+/// only touch RTC memory, registers and ROM functions.
+///
+
+namespace wakestub
+{
+
+///
+/// \brief           Plans a deep sleep of sleep_ms in slices of at most
+///                  CONFIG_WAKE_STUB_SLICE_S, the first one as long as the
+///                  remainder so the stub re-arms the same period each time
+///
+/// \param[in]       sleep_ms     the whole sleep, in milliseconds
+///
+/// \return          the first slice in milliseconds: deep sleep this long
+///
+uint64_t arm(const uint64_t sleep_ms);
+
+///
+/// \brief           Wakes the stub handled during the last sleep
+///
+/// \return          the number of wakes
+///
+uint32_t handled();
+
+} // namespace wakestub
@@ -26,6 +26,8 @@
 
 #pragma once
 
+#include <stdint.h>
+
 namespace gps
 {
 ///
@@ -56,6 +58,15 @@ float get_longitude();
 ///
 float get_altitude();
 
+///
+/// \brief          Get the UTC time of the last fix
+///
+/// \param[out]     unix_ms    milliseconds since the Unix epoch
+///
+/// \return         true if date and time are valid and fresh
+///
+bool get_unix_time(uint64_t &unix_ms);
+
 ///
 /// \brief          Setup GPS communication
 ///
@@ -36,4 +36,13 @@ namespace lppyra03av
 ///
 float get_irradiance();
 
+///
+/// \brief              Converts a raw ADC reading to irradiance
+///
+/// \param[in]          raw     12 bit ADC counts (may be an average)
+///
+/// \return             the irradiance in W/m^2
+///
+float from_raw(const float raw);
+
 } // namespace LPPYRA03AV
\ No newline at end of file
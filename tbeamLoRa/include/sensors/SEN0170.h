@@ -36,4 +36,13 @@ namespace sen0170
 ///
 float get_windspeed();
 
+///
+/// \brief              Converts a raw ADC reading to wind speed
+///
+/// \param[in]          raw     12 bit ADC counts (may be an average)
+///
+/// \return             windspeed in m/s
+///
+float from_raw(const float raw);
+
 } // namespace sen0170
\ No newline at end of file
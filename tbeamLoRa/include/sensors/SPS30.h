@@ -41,6 +41,23 @@ namespace SPS3O
 ///
 bool setup();
 
+///
+/// \brief             Warm setup after a timer wake, for a sensor that
+///                    setup() already started: no reset, device info
+///                    or fan cleaning
+///
+/// \return            true if the driver is ready, false otherwise
+///
+bool resume();
+
+///
+/// \brief             Stops the measurement: the fan and the laser stay
+///                    off, through deep sleep too, until setup()
+///
+/// \return            true if the sensor acknowledged
+///
+bool stop();
+
 ///
 /// \brief             Print device info
 ///
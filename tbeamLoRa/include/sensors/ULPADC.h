@@ -0,0 +1,97 @@
+/*
+ *
+ * ULP ADC module
+ *
+ * PURPOSE: Samples the analog sensors with the ULP coprocessor during
+ *          deep sleep and keeps their statistics in RTC slow memory
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+///
+/// \note
+///
+/// The ULP wakes every CONFIG_ULP_ADC_PERIOD_MS, converts each channel and
+/// adds the sample to a 32 bit sum, a 16 bit count, a minimum and a maximum
+/// kept in the RTC slow memory reserved to it; fold() moves them to 32 bit
+/// totals, on every wake (the wake stub's included) so the count never
+/// wraps. The main CPU never touches the ADC while the ULP owns it: it
+/// stops the ULP, reads the statistics and starts it again, cleared, right
+/// before the next deep sleep.
+///
+
+namespace ulpadc
+{
+
+/// \enum the channels sampled
+typedef enum
+{
+        CH_SEN0170 = 0,
+        CH_LPPYRA03AV = 1,
+        CHANNELS = 2,
+} channel_t;
+
+/// \struct statistics of a channel over the sleep, raw 12 bit ADC counts
+typedef struct
+{
+        uint32_t count;    ///< samples taken
+        uint16_t min;      ///< lowest sample
+        uint16_t max;      ///< highest sample
+        float    mean;     ///< average sample
+} stats_t;
+
+///
+/// \brief           Clears the statistics, loads the ULP program and
+///                  starts sampling; call right before deep sleep
+///
+/// \return          true if the ULP is running
+///
+bool start();
+
+///
+/// \brief           Stops the ULP sampling and hands the ADC back
+///
+/// \return          void
+///
+void stop();
+
+///
+/// \brief           Adds the ULP accumulators to the totals and clears
+///                  them; in RTC fast memory, callable from the wake stub
+///
+/// \return          void
+///
+void fold();
+
+///
+/// \brief           Statistics of a channel since start(); stop() first
+///
+/// \param[in]       channel     the channel
+/// \param[out]      stats       the statistics
+///
+/// \return          true if the ULP took samples (false e.g. on cold boot)
+///
+bool get(const channel_t channel, stats_t &stats);
+
+} // namespace ulpadc
@@ -0,0 +1,122 @@
+/*
+ *
+ * Airtime module
+ *
+ * PURPOSE: LoRa time-on-air calculator and per-band duty-cycle ledger
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+namespace airtime
+{
+
+/// \brief number of sub-bands tracked by the ledger (as LMIC's EU-like plans)
+const uint8_t MAX_BANDS = 4;
+
+/// \brief LoRaWAN overhead on the app payload: MHDR, FHDR (no FOpts), FPort, MIC
+const uint8_t LORAWAN_OVERHEAD = 13;
+
+///
+/// \brief           Time on air of a LoRa frame (Semtech AN1200.13)
+///
+/// \param[in]       size       PHY payload size in bytes
+/// \param[in]       sf         spreading factor, 7 to 12
+/// \param[in]       bw_khz     bandwidth in kHz: 125, 250 or 500
+/// \param[in]       cr         coding rate 4/(4 + cr), 1 to 4
+/// \param[in]       header     whether the explicit header is sent
+/// \param[in]       crc        whether the payload CRC is sent
+/// \param[in]       preamble   programmed preamble length in symbols
+///
+/// \return          the time on air in microseconds
+///
+uint32_t lora_us(const uint8_t size, const uint8_t sf, const uint16_t bw_khz = 125, const uint8_t cr = 1,
+                 const bool header = true, const bool crc = true, const uint16_t preamble = 8);
+
+///
+/// \brief           Time on air of a LoRaWAN uplink at 125 kHz, CR 4/5
+///
+/// \param[in]       payload    app payload size in bytes
+/// \param[in]       sf         spreading factor, 7 to 12
+///
+/// \return          the time on air in microseconds
+///
+uint32_t uplink_us(const uint8_t payload, const uint8_t sf);
+
+///
+/// \brief           Books a transmission in the ledger (kept in RTC memory,
+///                  timed on the RTC counter so it holds across deep sleep
+///                  and clock corrections)
+///
+/// \param[in]       band       sub-band index
+/// \param[in]       us         time on air in microseconds
+/// \param[in]       txcap      inverse of the band duty cycle, e.g. 100 for 1 %
+///
+/// \return          void
+///
+void record(const uint8_t band, const uint32_t us, const uint16_t txcap);
+
+///
+/// \brief           Time before band may transmit again
+///
+/// \param[in]       band       sub-band index
+///
+/// \return          the wait in milliseconds, 0 if free
+///
+uint32_t wait_ms(const uint8_t band);
+
+///
+/// \brief           Airtime used on band in the last hour (rolling)
+///
+/// \param[in]       band       sub-band index
+///
+/// \return          the airtime in milliseconds
+///
+uint32_t last_hour_ms(const uint8_t band);
+
+///
+/// \brief           Airtime used on band since the last cold boot
+///
+/// \param[in]       band       sub-band index
+///
+/// \return          the airtime in milliseconds
+///
+uint32_t total_ms(const uint8_t band);
+
+///
+/// \brief           Frames sent on band since the last cold boot
+///
+/// \param[in]       band       sub-band index
+///
+/// \return          the number of frames
+///
+uint32_t frames(const uint8_t band);
+
+///
+/// \brief           Logs the ledger
+///
+/// \return          void
+///
+void dump();
+
+} // namespace airtime
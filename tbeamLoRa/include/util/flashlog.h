@@ -0,0 +1,125 @@
+/*
+ *
+ * Flash log module
+ *
+ * PURPOSE: Store-and-forward log of encoded frames on the external
+ *          SPI flash, for the periods the node can't reach a gateway
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <SPIMemory.h>
+#include <stdint.h>
+
+///
+/// \note
+///
+/// The log is a ring of CONFIG_FLASHLOG_SECTORS 4 KiB sectors. Records are
+/// appended one after the other; a sector is erased only when the ring wraps
+/// onto it, so every sector wears at the same rate. Sent records are marked
+/// by clearing a state byte in place (1 -> 0, no erase needed).
+///
+/// Batches sent on CONFIG_FLASHLOG_PORT are encoded as
+///
+///     [epoch u32] [len] [record] [len] [record] ...
+///
+/// where the first record is verbatim and each following one is XORed with
+/// the previous (zero padded) and its runs of zero bytes are written as
+/// [0x00][run length]. Frames from the same sensors share most of their
+/// bytes, so they shrink a lot.
+///
+/// epoch (MSB first) is the sample time of the first record in the batch
+/// that has one, in seconds since the Unix epoch, 0 if none has. Each
+/// record with a sample time carries its seconds after epoch in the u16
+/// (MSB first) at the offset given to read_batch(); the absolute time only
+/// goes on the air once per batch.
+///
+
+namespace flashlog
+{
+
+/// records carry no age field
+const uint8_t NO_AGE = 0xFF;
+
+///
+/// \brief           Binds the log to the flash chip and recovers the write
+///                  and read positions (kept in RTC memory, or found by
+///                  scanning the flash after a cold boot)
+///
+/// \param[in]       flash     the external flash, already constructed
+///
+/// \return          true if the flash answered and the log is usable
+///
+bool setup(SPIFlash *flash);
+
+///
+/// \brief           Tells whether the log is usable
+///
+/// \return          true if setup() succeeded
+///
+bool available();
+
+///
+/// \brief           Appends a frame to the log; when the ring is full the
+///                  oldest sector is erased and its records are lost
+///
+/// \param[in]       data         the frame
+/// \param[in]       size         size of the frame in bytes
+/// \param[in]       sampled_at   Unix time of its data in seconds, 0 if unknown
+///
+/// \return          true if written
+///
+bool append(const uint8_t *data, const uint8_t size, const uint32_t sampled_at = 0);
+
+///
+/// \brief           Number of records not sent yet
+///
+/// \return          the number of records
+///
+uint32_t backlog();
+
+///
+/// \brief           Encodes the oldest unsent records into buf, as many as
+///                  fit in max bytes; they stay in the log until
+///                  commit_batch() is called. A first record longer
+///                  than max waits for a larger one (e.g. a faster data
+///                  rate); corrupted records, and records longer than any
+///                  frame, are skipped and retired with the batch (right
+///                  away if nothing else is in it)
+///
+/// \param[out]      buf      the buffer for the batch
+/// \param[in]       max      size of buf, at most CONFIG_MAX_PAYLOAD
+/// \param[in]       age_at   offset of the u16 age field in the records,
+///                           NO_AGE if they have none
+///
+/// \return          the size of the batch in bytes, 0 if there is nothing to send
+///
+uint8_t read_batch(uint8_t *buf, const uint8_t max, const uint8_t age_at = NO_AGE);
+
+///
+/// \brief           Marks the records of the last read_batch() as sent
+///
+/// \return          void
+///
+void commit_batch();
+
+} // namespace flashlog
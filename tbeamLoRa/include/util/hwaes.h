@@ -0,0 +1,51 @@
+/*
+ *
+ * Hardware AES module
+ *
+ * PURPOSE: Runs LMIC crypto (MIC, payload encryption, join) on the
+ *          ESP32 AES peripheral
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+///
+/// \note
+///
+/// LMIC calls os_aes() for every AES job; the linker routes those calls to
+/// this module (-Wl,--wrap=os_aes), which runs them through mbedTLS, backed
+/// by the AES peripheral on the ESP32. Without CONFIG_LMIC_HW_AES, or if the
+/// self test fails, they go on to LMIC's own software AES.
+///
+
+namespace hwaes
+{
+
+///
+/// \brief           Checks the hardware path against known answers
+///                  (RFC 4493 CMAC vectors) and against LMIC's software
+///                  AES on every os_aes() mode, then enables it
+///
+/// \return          true if LMIC crypto runs on the hardware
+///
+bool setup();
+
+} // namespace hwaes
@@ -0,0 +1,112 @@
+/*
+ *
+ * Link quality module
+ *
+ * PURPOSE: Keeps SNR and RSSI of the last downlinks and tells how much
+ *          margin each spreading factor would have
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+namespace linkq
+{
+
+/// \brief downlinks remembered (RTC memory ring)
+const uint8_t HISTORY = 16;
+
+///
+/// \brief           Records a received downlink
+///
+/// \param[in]       snr_q4     SNR in quarters of dB, as the SX1276 (and LMIC.snr) give it
+/// \param[in]       rssi       RSSI in dBm
+///
+/// \return          void
+///
+void record(const int8_t snr_q4, const int16_t rssi);
+
+///
+/// \brief           Number of downlinks in the history
+///
+/// \return          the number of samples
+///
+uint8_t samples();
+
+///
+/// \brief           Mean SNR of the history
+///
+/// \return          the SNR in dB, 0 if there are no samples
+///
+float mean_snr();
+
+///
+/// \brief           Worst SNR of the history
+///
+/// \return          the SNR in dB, 0 if there are no samples
+///
+float min_snr();
+
+///
+/// \brief           Mean RSSI of the history
+///
+/// \return          the RSSI in dBm, 0 if there are no samples
+///
+float mean_rssi();
+
+///
+/// \brief           Demodulation floor of the SX127x at 125 kHz
+///
+/// \param[in]       sf     spreading factor, 7 to 12
+///
+/// \return          the lowest SNR that can be received, in dB
+///
+float required_snr(const uint8_t sf);
+
+///
+/// \brief           SNR margin a spreading factor would have: the SNR of
+///                  the channel doesn't depend on the SF, the floor does
+///
+/// \param[in]       sf     spreading factor, 7 to 12
+///
+/// \return          the mean SNR minus the floor, in dB
+///
+float margin(const uint8_t sf);
+
+///
+/// \brief           Fastest spreading factor with at least margin_db of margin
+///
+/// \param[in]       margin_db     the margin required, in dB
+///
+/// \return          the spreading factor, 12 if none has enough margin,
+///                  0 if there are no samples
+///
+uint8_t best_sf(const float margin_db);
+
+///
+/// \brief           Logs the statistics
+///
+/// \return          void
+///
+void dump();
+
+} // namespace linkq
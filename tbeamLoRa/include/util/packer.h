@@ -28,6 +28,19 @@
 namespace packer
 {
 
+///
+/// \note
+///
+/// A frame sampled with the clock set starts with the age of its sample on
+/// CONFIG_CHAN_TIMESTAMP: seconds (u16, MSB first, as an LPP luminosity)
+/// before the frame went to the radio, or after the epoch of its flash
+/// batch. It is left at 0 by read_n_pack() and filled in by whoever sends
+/// the frame, at AGE_AT.
+///
+
+/// offset of the age in a frame that has one (after the LPP channel and type)
+const uint8_t AGE_AT = 2;
+
 ///
 /// \brief           Read sensor values and encodes them
 ///
@@ -55,4 +68,11 @@ uint8_t *get_buffer();
 ///
 uint8_t get_buffer_size();
 
+///
+/// \brief           Get the sample time of the encoded buffer
+///
+/// \return          seconds since the Unix epoch, 0 if the buffer has no age
+///
+uint32_t get_sampled_at();
+
 } // namespace packer
\ No newline at end of file
@@ -26,6 +26,8 @@
 
 #pragma once
 
+#include <stdint.h>
+
 namespace i2c
 {
 
@@ -38,4 +40,22 @@ namespace i2c
 ///
 void scan();
 
+///
+/// \brief               Probes only the devices the last scan() found,
+///                      instead of the whole address space
+///
+/// \return              true if all of them answered, false if one is
+///                      missing or there was no scan since cold boot
+///
+bool verify();
+
+///
+/// \brief               Tells whether the last scan() found a device
+///
+/// \param[in]           addr     the I2C address
+///
+/// \return              true if found
+///
+bool present(const uint8_t addr);
+
 } // namespace i2c
\ No newline at end of file
@@ -0,0 +1,115 @@
+/*
+ *
+ * Settings module
+ *
+ * PURPOSE: Runtime sampling and reporting parameters, kept in NVS and
+ *          updated by downlink commands
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+///
+/// \note
+///
+/// Downlinks on CONFIG_LORAWAN_CMD_PORT carry one or more commands, each an
+/// opcode followed by its fixed-size argument (multi-byte values MSB first):
+///
+///     0x01 [u16]   send interval, seconds (30 to 65535)
+///     0x02 [u8]    sensor enable mask, see sensor_t (bits of sensors the
+///                  build lacks are ignored)
+///     0x03 [u8]    ask for an ACK every N frames (1 to 255)
+///     0x04 [u8]    flash log batches sent per wake (0 to 16)
+///     0xFF         back to the Kconfig defaults
+///
+/// Parsing stops at the first unknown opcode or truncated argument; the
+/// commands before it still apply.
+///
+
+namespace settings
+{
+
+/// \enum sensor enable bits
+typedef enum
+{
+        SENSOR_BME680 = 0x01,
+        SENSOR_SPS30 = 0x02,
+        SENSOR_LPPYRA03AV = 0x04,
+        SENSOR_SEN0170 = 0x08,
+} sensor_t;
+
+/// \enum downlink opcodes
+typedef enum
+{
+        CMD_SEND_INTERVAL = 0x01,
+        CMD_SENSORS = 0x02,
+        CMD_CONFIRM_EVERY = 0x03,
+        CMD_BACKFILL_BATCHES = 0x04,
+        CMD_DEFAULTS = 0xFF,
+} cmd_t;
+
+/// \struct the runtime parameters
+typedef struct
+{
+        uint32_t send_interval;      ///< ms between frames
+        uint8_t  sensors;            ///< sensor_t bit mask
+        uint8_t  confirm_every;      ///< ask for an ACK every these many frames
+        uint8_t  backfill_batches;   ///< flash log batches sent per wake
+} settings_t;
+
+///
+/// \brief           Loads the settings from NVS on cold boot (RTC memory
+///                  holds them across deep sleep), Kconfig defaults if none
+///
+/// \return          void
+///
+void setup();
+
+///
+/// \brief           Current settings
+///
+/// \return          the settings
+///
+const settings_t &get();
+
+///
+/// \brief           Tells whether a sensor is enabled
+///
+/// \param[in]       sensor     one of sensor_t
+///
+/// \return          true if enabled
+///
+bool enabled(const sensor_t sensor);
+
+///
+/// \brief           Applies the commands of a downlink and saves the
+///                  result to NVS if anything changed
+///
+/// \param[in]       data     the downlink payload
+/// \param[in]       size     size of the payload in bytes
+///
+/// \return          true if the settings changed
+///
+bool apply(const uint8_t *data, const uint8_t size);
+
+} // namespace settings
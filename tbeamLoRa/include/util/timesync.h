@@ -0,0 +1,91 @@
+/*
+ *
+ * Time sync module
+ *
+ * PURPOSE: Keeps the wall clock, set from the network (DeviceTimeReq) or
+ *          the GPS, across deep sleep and corrects its drift
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+///
+/// \note
+///
+/// The ESP32 system time keeps running in deep sleep on the RTC slow clock,
+/// which can be off by a few hundred ppm. Each sync measures how far the
+/// clock drifted since the previous one and now() corrects for that rate,
+/// so the stamps stay good between the (rare) syncs.
+///
+
+namespace timesync
+{
+
+/// \enum where the time came from
+typedef enum
+{
+        SRC_NONE = 0,
+        SRC_NETWORK = 1,
+        SRC_GPS = 2,
+} source_t;
+
+///
+/// \brief           Sets the clock
+///
+/// \param[in]       unix_ms     UTC time, milliseconds since the Unix epoch
+/// \param[in]       source      where the time came from
+///
+/// \return          void
+///
+void set(const uint64_t unix_ms, const source_t source);
+
+///
+/// \brief           Tells whether the clock was set since the last cold boot
+///
+/// \return          true if now() can be trusted
+///
+bool valid();
+
+///
+/// \brief           Tells whether the clock should be synced again: never
+///                  set, or last set more than CONFIG_TIME_SYNC_HOURS ago
+///
+/// \return          true if a sync is due
+///
+bool due();
+
+///
+/// \brief           Current UTC time, corrected for the measured drift
+///
+/// \return          seconds since the Unix epoch, 0 if not valid
+///
+uint32_t now();
+
+///
+/// \brief           Logs the clock state
+///
+/// \return          void
+///
+void dump();
+
+} // namespace timesync
@@ -0,0 +1,95 @@
+/*
+ *
+ * Trace module
+ *
+ * PURPOSE: Times the phases of the wake cycle and keeps their statistics
+ *          across deep sleep, for the serial log and a health uplink
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+namespace trace
+{
+
+/// \enum the phases timed
+typedef enum
+{
+        PH_BOOT = 0,       ///< from reset to setup()
+        PH_SETUP = 1,      ///< setup(), GPS lock included
+        PH_SAMPLE = 2,     ///< reading the sensors and packing the frame
+        PH_RADIO = 3,      ///< from handing the frame over to the queue drained (TX, RX windows, backfill)
+        PH_SLEEP = 4,      ///< shutdown before deep sleep
+        PH_AWAKE = 5,      ///< the whole wake, reset to deep sleep
+        PHASES = 6,
+} phase_t;
+
+/// \brief events remembered (RTC memory ring)
+const uint8_t HISTORY = 32;
+
+/// \brief size of the summary() payload
+const uint8_t SUMMARY_SIZE = 2 + PHASES * 4;
+
+///
+/// \brief           Marks the start of a phase; PH_BOOT and PH_AWAKE
+///                  start at reset by themselves
+///
+/// \param[in]       phase     the phase
+///
+/// \return          void
+///
+void begin(const phase_t phase);
+
+///
+/// \brief           Marks the end of a phase and records its duration;
+///                  a phase not begun in this wake is ignored
+///
+/// \param[in]       phase     the phase
+///
+/// \return          void
+///
+void end(const phase_t phase);
+
+///
+/// \brief           Logs the statistics of each phase (min/avg/max since
+///                  cold boot) and the last events
+///
+/// \return          void
+///
+void dump();
+
+///
+/// \brief           Encodes the statistics for the uplink, appended to
+///                  a data frame:
+///
+///                      [cycles, u16 BE] then for each phase
+///                      [avg ms, u16 BE] [max ms, u16 BE]
+///
+/// \param[out]      buf     the buffer, at least SUMMARY_SIZE bytes
+/// \param[in]       max     size of buf
+///
+/// \return          the size of the payload, 0 if buf is too small
+///
+uint8_t summary(uint8_t *buf, const uint8_t max);
+
+} // namespace trace
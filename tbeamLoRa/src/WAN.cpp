@@ -25,17 +25,38 @@
  */
 
 #include <Preferences.h>
+#include <algorithm>
 #include <SPI.h>
+#include <esp_sleep.h>
 #include <hal/hal.h>
 #include <lmic.h>
 
 #include "../include/WAN.h"
+#include "include/pwr/sleep.h"
+#include "include/util/airtime.h"
+#include "include/util/hwaes.h"
+#include "include/util/linkq.h"
+#include "include/util/timesync.h"
 
 #include "../config.h"
+#include "include/config/channels.h"
 #include "include/config/credentials.h"
 
 static const char *TAG = "LoRaWAN";
 
+//
+// os_runloop_once() calls hal_sleep() only when it finds no job to run;
+// the linker routes that call here (-Wl,--wrap=hal_sleep) so we know
+// when the CPU can doze
+//
+volatile bool lmic_idle = false;
+
+extern "C" void __wrap_hal_sleep(void)
+{
+
+        lmic_idle = true;
+}
+
 void os_getArtEui(uint8_t *buf)
 {
 
@@ -69,9 +90,110 @@ const lmic_pinmap lmic_pins =
                 CONFIG_DIO2_GPIO},
 };
 
+/// longest light sleep while a frame is in flight, in ms
+const uint32_t DOZE_MAX_MS = 1000;
+
+/// wake this early before the next LMIC job, in ms
+const uint32_t DOZE_GUARD_MS = 5;
+
+/// shorter dozes aren't worth it, in ms
+const uint32_t DOZE_MIN_MS = 10;
+
 /// function pointer of LoRaWAN callback
 void (*cb)(uint8_t);
 
+/// function pointer of the downlink handler
+void (*dl_cb)(uint8_t, const uint8_t *, uint8_t) = nullptr;
+
+/// ask for an ACK every these many frames while the link is up
+uint8_t confirm_every = CONFIG_LORA_CONFIRM_EVERY;
+
+/// message counter, RTC memory is the source of truth while it survives
+RTC_DATA_ATTR uint32_t count = 0;
+
+/// whether count has been initialized since the last cold boot
+RTC_DATA_ATTR bool count_valid = false;
+
+/// last value of count written to NVS
+RTC_DATA_ATTR uint32_t count_persisted = 0;
+
+/// frames sent since the last confirmed one
+RTC_DATA_ATTR uint32_t frames_since_confirm = 0;
+
+/// consecutive confirmed frames that got no ACK (or failed link checks)
+RTC_DATA_ATTR uint8_t confirm_failures = 0;
+
+/// whether the frame in flight asked for an ACK
+bool tx_confirmed = false;
+
+/// counters since the last cold boot
+RTC_DATA_ATTR stats_t counters;
+
+/// \struct one frame waiting for the radio
+typedef struct
+{
+        uint8_t  data[CONFIG_MAX_PAYLOAD];
+        uint8_t  size;
+        uint8_t  port;
+        uint8_t  prio;
+        bool     confirmed;
+        bool     used;
+        uint32_t seq;              ///< arrival order, FIFO within a priority
+        uint8_t  age_at;           ///< offset of the age field, NO_AGE if none
+        uint32_t sampled_at;       ///< Unix time of the data, s
+} uplink_t;
+
+/// uplinks waiting for LMIC, kept across deep sleep
+RTC_DATA_ATTR uplink_t queue[CONFIG_LORA_QUEUE_LEN];
+
+/// arrival counter for queue entries
+RTC_DATA_ATTR uint32_t queue_seq = 0;
+
+/// LMIC MAC state (session, DR, TX power, channels, RX2, duty cycle) kept across deep sleep
+RTC_DATA_ATTR lmic_t rtc_lmic;
+
+/// whether rtc_lmic holds a session that can be resumed
+RTC_DATA_ATTR bool rtc_lmic_valid = false;
+
+/// LMIC time when rtc_lmic was saved
+RTC_DATA_ATTR ostime_t rtc_lmic_saved_at = 0;
+
+/// how long we slept after saving rtc_lmic, in ms
+RTC_DATA_ATTR uint64_t rtc_lmic_sleep_ms = 0;
+
+/// LMIC.rssi is the RSSI in dBm plus this offset
+const int16_t LMIC_RSSI_OFF = 64;
+
+/// downlinks needed before the data rate policy trusts the link statistics
+const uint8_t LINKQ_MIN_SAMPLES = 3;
+
+/// room kept for the MAC commands LMIC piggybacks in FOpts
+const uint8_t FOPTS_MAX = 15;
+
+/// widest clock error allowance, in MAX_CLOCK_ERROR units
+const uint32_t CLOCK_ERROR_CAP = (uint32_t) MAX_CLOCK_ERROR * CONFIG_LORA_CLOCK_ERROR_MAX / 1000;
+
+/// smallest step when widening after a missed downlink (0.1 %)
+const uint32_t CLOCK_ERROR_STEP = MAX_CLOCK_ERROR / 1000;
+
+/// learnt timing error, in MAX_CLOCK_ERROR units; none until a downlink
+/// is measured or missed, so the RX windows start as LMIC sizes them
+RTC_DATA_ATTR uint32_t clock_error = 0;
+
+/// fixed part of the downlink timing offset: RXDONE is timestamped when the
+/// HAL polls DIO0 after the light-sleep wake-up, not at the last symbol, and
+/// doesn't scale with the RX delay as clock error does
+const ostime_t RX_LATENCY = us2osticks(1000);
+
+/// the GPS epoch (1980-01-06) in Unix time
+const uint64_t GPS_UNIX_OFFSET = 315964800;
+
+/// GPS time is ahead of UTC by the leap seconds since 1980
+const uint64_t GPS_LEAP_SECONDS = 18;
+
+/// a DeviceTimeReq rides on the frame in flight
+bool time_requested = false;
+
 void set_spreading_factor(unsigned char sf)
 {
 
@@ -81,14 +203,9 @@ void set_spreading_factor(unsigned char sf)
 void adr(const bool enabled)
 {
         //
-        // set ADR
+        // set ADR; link check stays as join() set it, with or without ADR
         //
         LMIC_setAdrMode(enabled);
-
-        //
-        // set manual ACK setting accordingly
-        //
-        LMIC_setLinkCheckMode(!enabled);
 }
 
 void run_callback(uint8_t message)
@@ -104,36 +221,83 @@ void regist(void (*callback)(uint8_t message))
         cb = callback;
 }
 
+void regist_downlink(void (*handler)(uint8_t port, const uint8_t *data, uint8_t size))
+{
+        dl_cb = handler;
+}
+
+void persist_count()
+{
+
+        Preferences p;
+
+        if (p.begin("lora", false))
+        {
+
+                (void) p.putUInt("count", count);
+                p.end();
+        }
+
+        count_persisted = count;
+}
+
 void init_count()
 {
 
         //
-        // if the value for LORA packet counts is unknown,
-        // restore from flash
+        // RTC memory survived (deep sleep wake): it's the source of truth
         //
-        if (count == 0)
+        if (count_valid)
         {
+                return;
+        }
 
-                Preferences p;
-
-                if (p.begin("lora", true))
-                {
+        //
+        // cold boot: restore from flash, skipping ahead by the frames
+        // that may have been sent after the last write
+        //
+        Preferences p;
+        uint32_t stored = UINT32_MAX;
 
-                        count = p.getUInt("count", 0);
+        if (p.begin("lora", true))
+        {
 
-                        p.end();
-                }
+                stored = p.getUInt("count", UINT32_MAX);
+                p.end();
         }
+
+        count = (stored == UINT32_MAX) ? 0 : stored + CONFIG_LORA_FCNT_PERSIST_EVERY;
+        count_valid = true;
+
+        //
+        // record the skip now, so another cold boot skips from here
+        //
+        wan::persist_count();
+
+        ESP_LOGI(TAG, "Frame counter restored from flash: %u", count);
+}
+
+void reset_count()
+{
+
+        count = 0;
+        count_valid = true;
+        wan::persist_count();
 }
 
 bool setup()
 {
 
         //
-        // wipe the message counter
+        // restore the message counter
         //
         wan::init_count();
 
+        //
+        // move LMIC crypto to the AES peripheral, if it passes its self test
+        //
+        (void) hwaes::setup();
+
         //
         // SPI interface
         //
@@ -145,6 +309,201 @@ bool setup()
         return os_init_ex(static_cast<const void*>(&lmic_pins)) == 1;
 }
 
+void save_session(const uint64_t sleep_ms)
+{
+
+        //
+        // the board woke up at millis() == 0
+        //
+        uint32_t awake = millis();
+
+        counters.wakes++;
+        counters.awake_ms_last = awake;
+        counters.awake_ms_max = std::max(counters.awake_ms_max, awake);
+        counters.awake_ms_sum += awake;
+
+        //
+        // only an idle, joined MAC can be resumed later
+        //
+        rtc_lmic_valid = wan::is_joined() && (LMIC.opmode & OP_TXRXPEND) == 0;
+
+        if (rtc_lmic_valid)
+        {
+
+                rtc_lmic          = LMIC;
+                rtc_lmic_saved_at = os_getTime();
+                rtc_lmic_sleep_ms = sleep_ms;
+
+                ESP_LOGD(TAG, "MAC state saved to RTC memory (DR %u, seqno %u)", LMIC.datarate, LMIC.seqnoUp);
+        }
+}
+
+ostime_t rebase(const ostime_t avail, const ostime_t now, const uint64_t elapsed_ms)
+{
+
+        //
+        // how far in the future it was at saving time (the difference is
+        // wrap-safe), in ms: sleeps longer than the 32-bit tick range are fine
+        //
+        int64_t remaining_ms = osticks2ms(static_cast<ostime_t>(avail - rtc_lmic_saved_at));
+        int64_t left_ms = remaining_ms - static_cast<int64_t>(elapsed_ms);
+
+        if (left_ms <= 0)
+        {
+                return now;
+        }
+
+        return now + ms2osticks(left_ms);
+}
+
+bool restore_session()
+{
+
+        //
+        // RTC memory is only meaningful after a deep sleep
+        //
+        if (!rtc_lmic_valid || esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_UNDEFINED)
+        {
+                return false;
+        }
+
+        LMIC = rtc_lmic;
+
+        //
+        // it's consumed: it will be saved again before next deep sleep
+        //
+        rtc_lmic_valid = false;
+
+        //
+        // the LMIC clock restarted from zero: what was left of each duty cycle
+        // timer at saving time, less the sleep and the boot since, counts from now
+        //
+        ostime_t now = os_getTime();
+        uint64_t elapsed_ms = rtc_lmic_sleep_ms + millis();
+
+#if defined(CFG_LMIC_EU_like)
+
+        for (auto &band : LMIC.bands)
+        {
+                band.avail = wan::rebase(band.avail, now, elapsed_ms);
+        }
+
+#endif
+
+        LMIC.globalDutyAvail = wan::rebase(LMIC.globalDutyAvail, now, elapsed_ms);
+
+        ESP_LOGI(TAG, "Resuming MAC state from RTC memory (DR %u, seqno %u)", LMIC.datarate, LMIC.seqnoUp);
+
+        return true;
+}
+
+void apply_clock_error()
+{
+
+        //
+        // twice the learnt error: the next frame may drift either way
+        //
+        LMIC_setClockError(static_cast<u2_t>(std::min(2 * clock_error, CLOCK_ERROR_CAP)));
+}
+
+void learn_clock()
+{
+
+        //
+        // the gateway answers exactly RX1 (or RX2 = RX1 + 1 s) seconds after
+        // our TX end, so the downlink should end at txend + delay + its airtime
+        //
+        bool rx2 = (LMIC.txrxFlags & TXRX_DNW2) != 0;
+        ostime_t delay = sec2osticks(LMIC.rxDelay + (rx2 ? 1 : 0));
+        ostime_t expected = LMIC.txend + delay + calcAirTime(LMIC.rps, LMIC.dataBeg + LMIC.dataLen + MIC_LEN);
+        ostime_t offset = LMIC.rxtime - expected;
+
+        //
+        // a late downlink within the fixed latency is on time
+        //
+        ostime_t drift = offset < 0 ? -offset : (offset > RX_LATENCY ? offset - RX_LATENCY : 0);
+
+        uint32_t measured = static_cast<uint32_t>(
+            static_cast<uint64_t>(drift) * MAX_CLOCK_ERROR / delay);
+
+        //
+        // peak hold with a slow decay: one lucky downlink mustn't narrow
+        // the windows below what the worst recent one needed
+        //
+        clock_error = std::min(std::max(measured, clock_error - clock_error / 8), CLOCK_ERROR_CAP);
+
+        ESP_LOGD(TAG, "Downlink in RX%u off by %ld us, clock error now %u/%u",
+                 rx2 ? 2 : 1, static_cast<long>(offset * 1000000LL / OSTICKS_PER_SEC),
+                 clock_error, MAX_CLOCK_ERROR);
+
+        wan::apply_clock_error();
+}
+
+uint8_t dr_to_sf(const dr_t dr)
+{
+
+        //
+        // per region: DR0 is SF12 in EU-like plans, SF10 in US915
+        //
+        return channels::sf_of(dr);
+}
+
+void choose_dr()
+{
+
+        //
+        // ADR lets the network do this
+        //
+        if (LMIC.adrEnabled || linkq::samples() < LINKQ_MIN_SAMPLES)
+        {
+                return;
+        }
+
+        dr_t target = channels::dr_for_sf(linkq::best_sf(CONFIG_LORA_LINK_MARGIN));
+        dr_t dr = LMIC.datarate;
+
+        //
+        // slow down at once, speed up one step at a time
+        //
+        if (target < dr)
+        {
+                dr = target;
+        }
+        else if (target > dr)
+        {
+                dr++;
+        }
+        else
+        {
+                return;
+        }
+
+        ESP_LOGI(TAG, "Link margin %.1f dB at SF%u: moving to SF%u",
+                 linkq::margin(dr_to_sf(LMIC.datarate)), dr_to_sf(LMIC.datarate), dr_to_sf(dr));
+
+        LMIC_setDrTxpow(dr, CONFIG_LORA_TX_POW);
+}
+
+void missed_downlink()
+{
+
+        //
+        // maybe the window opened too late or closed too early: widen it
+        //
+        clock_error = std::min(std::max(2 * clock_error, CLOCK_ERROR_STEP), CLOCK_ERROR_CAP);
+
+        wan::apply_clock_error();
+
+        //
+        // or the network didn't hear us: one step slower
+        //
+        if (!LMIC.adrEnabled && LMIC.datarate > channels::DR_SLOWEST)
+        {
+                ESP_LOGI(TAG, "No downlink: moving to SF%u", dr_to_sf(LMIC.datarate - 1));
+                LMIC_setDrTxpow(LMIC.datarate - 1, CONFIG_LORA_TX_POW);
+        }
+}
+
 void join()
 {
 
@@ -154,30 +513,50 @@ void join()
         LMIC_reset();
 
         //
-        // manually set available frequencies for LMiC to use;
-        // without this, only three base channels from the LoRaWAN specification would be used
+        // after a deep sleep, pick up where we left: session, data rate, TX power,
+        // channels and duty cycle state, without touching flash
         //
+        if (wan::restore_session())
+        {
+                counters.resumes++;
+                wan::apply_clock_error();
+                wan::run_callback(EV_JOINED);
+                return;
+        }
 
-        (void)LMIC_setupChannel(0, 868100000, DR_RANGE_MAP(DR_SF12, DR_SF7), BAND_CENTI);
-        (void)LMIC_setupChannel(1, 868300000, DR_RANGE_MAP(DR_SF12, DR_SF7B), BAND_CENTI);
-        (void)LMIC_setupChannel(2, 868500000, DR_RANGE_MAP(DR_SF12, DR_SF7), BAND_CENTI);
-        (void)LMIC_setupChannel(3, 867100000, DR_RANGE_MAP(DR_SF12, DR_SF7), BAND_CENTI);
-        (void)LMIC_setupChannel(4, 867300000, DR_RANGE_MAP(DR_SF12, DR_SF7), BAND_CENTI);
-        (void)LMIC_setupChannel(5, 867500000, DR_RANGE_MAP(DR_SF12, DR_SF7), BAND_CENTI);
-        (void)LMIC_setupChannel(6, 867700000, DR_RANGE_MAP(DR_SF12, DR_SF7), BAND_CENTI);
-        (void)LMIC_setupChannel(7, 867900000, DR_RANGE_MAP(DR_SF12, DR_SF7), BAND_CENTI);
-        (void)LMIC_setupChannel(8, 868800000, DR_RANGE_MAP(DR_FSK, DR_FSK), BAND_MILLI);
+        wan::apply_clock_error();
 
         //
-        // disable link check validation
+        // set the channels of the region plan (see channels.h); without this,
+        // EU-like regions would only use the three base channels from the
+        // LoRaWAN specification and US-like ones would hop over all 72
         //
-        LMIC_setLinkCheckMode(false);
+#if defined(CFG_LMIC_EU_like)
+        for (uint8_t i = 0; i < channels::PLAN_SIZE; i++)
+                (void)LMIC_setupChannel(i, channels::PLAN[i].freq, channels::PLAN[i].drmap, channels::PLAN[i].band);
+#else
+        (void)LMIC_selectSubBand(channels::SUBBAND);
+#endif
+
+        //
+        // link check: after a long run of uplinks without any downlink, LMIC
+        // asks the network to answer and, if it doesn't, reports EV_LINK_DEAD,
+        // which turns on confirmed probes. The counter lives in the MAC state,
+        // so it is only armed here and carries over deep sleep
+        //
+        LMIC_setLinkCheckMode(true);
 
         //
         // set default rate and transmit power for uplink (note: txpow seems to be ignored by the library)
         //
         wan::set_spreading_factor(CONFIG_LORA_SPREADING_FACTOR);
 
+        //
+        // Adaptive Data Rate: only on a cold join, a resumed session keeps
+        // what the network last told it
+        //
+        wan::adr(CONFIG_LORA_ADR);
+
         //
         // make LMiC initialize the default channels, choose a channel, and
         // schedule the OTAA join
@@ -234,6 +613,12 @@ void join()
         }
 }
 
+bool is_joined()
+{
+
+        return LMIC.devaddr != 0 && (LMIC.opmode & OP_JOINING) == 0;
+}
+
 uint32_t get_count()
 {
 
@@ -249,27 +634,12 @@ int dump_count()
         (void)LMIC_setSeqnoUp(count);
 
         //
-        // ensure we write at least once
-        //
-        static uint32_t lastWriteMsec = UINT32_MAX;
-        uint32_t now = millis();
-
-        //
-        // dump to rom every 5 mins
+        // write behind: flash only sees one write every N frames
         //
-        if (now < lastWriteMsec || (now - lastWriteMsec) > 5 * 60 * 1000L)
+        if (count - count_persisted >= CONFIG_LORA_FCNT_PERSIST_EVERY)
         {
 
-                lastWriteMsec = now;
-
-                Preferences p;
-
-                if (p.begin("lora", false))
-                {
-
-                        (void) p.putUInt("count", count);
-                        p.end();
-                }
+                wan::persist_count();
         }
 
         return count;
@@ -278,6 +648,12 @@ int dump_count()
 void erase_prefs()
 {
 
+        //
+        // forget the retained session and counter too
+        //
+        rtc_lmic_valid = false;
+        count_valid    = false;
+
         Preferences p;
 
         //
@@ -290,43 +666,489 @@ void erase_prefs()
         }
 }
 
-void send(uint8_t *data, const uint8_t data_size, const uint8_t port, const bool confirmed)
+bool busy()
+{
+
+        //
+        // a frame waiting for its slot (duty cycle) counts as busy too,
+        // handing LMIC another one would overwrite it
+        //
+        return (LMIC.opmode & (OP_TXDATA | OP_TXRXPEND)) != 0;
+}
+
+#if LMIC_ENABLE_DeviceTimeReq
+
+void network_time(void *user, int ok)
+{
+
+        (void)user;
+
+        time_requested = false;
+
+        lmic_time_reference_t ref;
+
+        if (ok != 1 || LMIC_getNetworkTimeReference(&ref) != 1)
+        {
+                ESP_LOGW(TAG, "No network time");
+                return;
+        }
+
+        //
+        // tNetwork is the GPS time (whole seconds) of the end of the uplink,
+        // tLocal the LMIC clock at that moment: add what elapsed since then
+        //
+        uint64_t unix_ms = ((uint64_t)ref.tNetwork + GPS_UNIX_OFFSET - GPS_LEAP_SECONDS) * 1000 +
+                           osticks2ms(os_getTime() - ref.tLocal);
+
+        timesync::set(unix_ms, timesync::SRC_NETWORK);
+}
+
+#endif
+
+void request_time()
+{
+
+#if LMIC_ENABLE_DeviceTimeReq
+
+        if (time_requested || !timesync::due())
+        {
+                return;
+        }
+
+        //
+        // the MAC command goes out with the next frame, the answer
+        // comes in its receive windows
+        //
+        LMIC_requestNetworkTime(wan::network_time, nullptr);
+        time_requested = true;
+
+#endif
+}
+
+bool tx(uint8_t *data, const uint8_t data_size, const uint8_t port, const bool confirmed, const uint8_t age_at,
+        const uint32_t sampled_at)
 {
 
+        //
+        // how old the data is now: LMIC sends it right away, duty cycle
+        // permitting, and the backend subtracts it from the arrival time
+        //
+        uint8_t frame[CONFIG_MAX_PAYLOAD];
+
+        if (age_at != NO_AGE && age_at + 2 <= data_size && data_size <= sizeof(frame))
+        {
+                uint32_t now = timesync::now();
+                uint32_t age = std::min<uint32_t>(now > sampled_at ? now - sampled_at : 0, UINT16_MAX);
+
+                (void) memcpy(frame, data, data_size);
+                frame[age_at] = age >> 8;
+                frame[age_at + 1] = age & 0xFF;
+                data = frame;
+        }
+
+        //
+        // piggyback a time request when the clock needs it
+        //
+        wan::request_time();
+
         //
         // save current packet count
         //
         (void) wan::dump_count();
 
         //
-        // check if there is not a current TX/RX job running
+        // prepare upstream data transmission at the next possible time;
+        // a refused frame is reported as cancelled, as LMIC does when it
+        // finds out later (e.g. too long for the data rate)
+        //
+        lmic_tx_error_t err = LMIC_setTxData2(port, data, data_size, confirmed);
+
+        if (err != LMIC_ERROR_SUCCESS)
+        {
+                ESP_LOGW(TAG, "Frame of %u B refused by LMIC (%d)", data_size, err);
+                wan::run_callback(EV_TXCANCELED);
+                return false;
+        }
+
+        tx_confirmed = confirmed;
+        frames_since_confirm = confirmed ? 0 : frames_since_confirm + 1;
+
+        //
+        // increment global message counter
+        //
+        count++;
+
+        return true;
+}
+
+uint8_t queued()
+{
+
+        uint8_t n = 0;
+
+        for (const auto &e : queue)
+        {
+                n += e.used ? 1 : 0;
+        }
+
+        return n;
+}
+
+uint8_t pending()
+{
+
+        return wan::queued() + (wan::busy() ? 1 : 0);
+}
+
+bool enqueue(uint8_t *data, const uint8_t data_size, const uint8_t port, const bool confirmed, const uint8_t prio,
+             const uint8_t age_at, const uint32_t sampled_at)
+{
+
+        //
+        // look for a free slot, or else for the entry we would
+        // sacrifice: the lowest priority one, oldest first
+        //
+        uplink_t *slot = nullptr;
+
+        for (auto &e : queue)
+        {
+
+                if (!e.used)
+                {
+                        slot = &e;
+                        break;
+                }
+
+                if (slot == nullptr || e.prio > slot->prio || (e.prio == slot->prio && e.seq < slot->seq))
+                {
+                        slot = &e;
+                }
+        }
+
+        if (slot->used)
+        {
+
+                if (slot->prio < prio)
+                {
+
+                        ESP_LOGW(TAG, "Uplink queue full, frame dropped");
+                        return false;
+                }
+
+                ESP_LOGW(TAG, "Uplink queue full, oldest frame with priority %u dropped", slot->prio);
+        }
+
+        uint8_t size = std::min<uint8_t>(data_size, sizeof(slot->data));
+        (void) memcpy(slot->data, data, size);
+
+        slot->size       = size;
+        slot->port       = port;
+        slot->prio       = prio;
+        slot->confirmed  = confirmed;
+        slot->seq        = queue_seq++;
+        slot->age_at     = age_at;
+        slot->sampled_at = sampled_at;
+        slot->used       = true;
+
+        return true;
+}
+
+void drain()
+{
+
+        if (wan::busy() || !wan::is_joined())
+        {
+                return;
+        }
+
+        //
+        // pick the highest priority entry, oldest first
+        //
+        uplink_t *next = nullptr;
+
+        for (auto &e : queue)
+        {
+
+                if (e.used && (next == nullptr || e.prio < next->prio || (e.prio == next->prio && e.seq < next->seq)))
+                {
+                        next = &e;
+                }
+        }
+
+        if (next == nullptr)
+        {
+                return;
+        }
+
+        ESP_LOGD(TAG, "Sending queued frame (priority %u, %u left)", next->prio, wan::queued() - 1);
+
+        next->used = false;
+
+        if (wan::tx(next->data, next->size, next->port, next->confirmed, next->age_at, next->sampled_at))
+        {
+                wan::run_callback(wan::EV_QUEUED);
+        }
+}
+
+void send(uint8_t *data, const uint8_t data_size, const uint8_t port, const bool confirmed, const uint8_t prio,
+          const uint8_t age_at, const uint32_t sampled_at)
+{
+
+        //
+        // check if there is not a current TX/RX job running, or frames
+        // waiting before this one
         //
-        if (LMIC.opmode & OP_TXRXPEND)
+        if (wan::busy() || wan::queued() > 0 || !wan::is_joined())
         {
 
                 //
-                // if there is, run appropriate callback e.g to send ACKs
+                // if there is, keep the frame for later and run the
+                // appropriate callback e.g to send ACKs
                 //
+                (void) wan::enqueue(data, data_size, port, confirmed, prio, age_at, sampled_at);
                 wan::run_callback(wan::EV_PENDING);
+
+                //
+                // a higher priority frame may have just arrived
+                //
+                wan::drain();
                 return;
         }
 
+        if (wan::tx(data, data_size, port, confirmed, age_at, sampled_at))
+        {
+                wan::run_callback(wan::EV_QUEUED);
+        }
+}
+
+bool confirm_due()
+{
+
+        uint32_t every = confirm_every;
+
+        //
+        // link is suspect: probe with confirmed frames, backing off
+        // exponentially (every 1, 2, 4... frames) up to the normal rate
+        //
+        if (confirm_failures > 0)
+        {
+                every = std::min<uint32_t>(1UL << (confirm_failures - 1), every);
+        }
+
         //
-        // prepare upstream data transmission at the next possible time
+        // thin margin: check more often that the network still hears us
         //
-        (void) LMIC_setTxData2(port, data, data_size, confirmed);
+        if (linkq::samples() > 0 && linkq::margin(wan::dr_to_sf(LMIC.datarate)) < CONFIG_LORA_LINK_MARGIN / 2.0f)
+        {
+                every = std::max<uint32_t>(every / 4, 1);
+        }
+
+        return frames_since_confirm + 1 >= every;
+}
+
+void set_confirm_every(const uint8_t every)
+{
+
+        confirm_every = std::max<uint8_t>(every, 1);
+}
+
+bool link_up()
+{
+
+        return confirm_failures == 0;
+}
+
+void skip()
+{
+
+        frames_since_confirm++;
+}
+
+void confirm_result(const bool acked)
+{
+
+        if (acked)
+        {
+
+                if (confirm_failures > 0)
+                {
+                        ESP_LOGI(TAG, "Link is back after %u failed confirmations", confirm_failures);
+                }
 
-        wan::run_callback(wan::EV_QUEUED);
+                confirm_failures = 0;
+        }
+        else if (confirm_failures < 16)
+        {
+
+                confirm_failures++;
+                ESP_LOGW(TAG, "No ACK, %u confirmations failed in a row", confirm_failures);
+        }
+}
+
+void book_airtime()
+{
+
+#if defined(CFG_LMIC_EU_like)
 
         //
-        // increment global message counter
+        // LMIC.dataLen is the whole PHY frame here; FSK isn't accounted
         //
-        count++;
+        rps_t rps = LMIC.rps;
+
+        if (getSf(rps) == FSK)
+        {
+                return;
+        }
+
+        uint8_t band = LMIC.channelFreq[LMIC.txChnl] & 0x3;
+        uint32_t us = airtime::lora_us(LMIC.dataLen, getSf(rps) - SF7 + 7, 125 << getBw(rps),
+                                       getCr(rps) - CR_4_5 + 1, getIh(rps) == 0, getNocrc(rps) == 0);
+
+        airtime::record(band, us, LMIC.bands[band].txcap);
+        counters.airtime_us += us;
+
+#endif
+}
+
+uint8_t max_payload()
+{
+
+        //
+        // the longest payload of the current data rate, less the room
+        // for piggybacked MAC commands; never more than a queue entry
+        //
+        uint8_t n = channels::payload_of(LMIC.datarate);
+
+        return std::min<uint8_t>(n > FOPTS_MAX ? n - FOPTS_MAX : 0, CONFIG_MAX_PAYLOAD);
+}
+
+uint32_t next_slot_ms()
+{
+
+        uint32_t wait = 0;
+
+#if defined(CFG_LMIC_EU_like)
+
+        //
+        // LMIC picks any enabled channel: the first band to free up wins
+        //
+        wait = UINT32_MAX;
+
+        for (uint8_t ch = 0; ch < MAX_CHANNELS; ch++)
+        {
+                if ((LMIC.channelMap & (1 << ch)) && LMIC.channelFreq[ch] != 0)
+                {
+                        wait = std::min(wait, airtime::wait_ms(LMIC.channelFreq[ch] & 0x3));
+                }
+        }
+
+        if (wait == UINT32_MAX)
+        {
+                wait = 0;
+        }
+
+#endif
+
+        return wait;
+}
+
+uint32_t next_job_ms()
+{
+
+        //
+        // LMIC only tells whether a job is due within a given time:
+        // bisect for the deadline of the first one
+        //
+        if (!os_queryTimeCriticalJobs(ms2osticks(DOZE_MAX_MS)))
+        {
+                return DOZE_MAX_MS;
+        }
+
+        uint32_t lo = 0, hi = DOZE_MAX_MS;
+
+        while (hi - lo > 1)
+        {
+                uint32_t mid = (lo + hi) / 2;
+
+                if (os_queryTimeCriticalJobs(ms2osticks(mid)))
+                {
+                        hi = mid;
+                }
+                else
+                {
+                        lo = mid;
+                }
+        }
+
+        return lo;
+}
+
+void doze()
+{
+
+        //
+        // a frame is in flight but LMIC has nothing to run: sleep until
+        // its next job (e.g. the RX windows) or a DIO interrupt
+        // (TX done, RX done, RX timeout)
+        //
+        // drain the UART before reading the deadline: lightsleep::until()
+        // flushes too, and at 115200 baud a full FIFO would come out of the
+        // guard time and make the wake late
+        //
+        Serial.flush();
+
+        uint32_t ms = wan::next_job_ms();
+
+        if (ms < DOZE_GUARD_MS + DOZE_MIN_MS)
+        {
+                return;
+        }
+
+        (void) lightsleep::until(ms - DOZE_GUARD_MS,
+                                 (1ULL << CONFIG_DIO0_GPIO) | (1ULL << CONFIG_DIO1_GPIO));
+}
+
+const stats_t &stats()
+{
+
+        return counters;
+}
+
+void dump_stats()
+{
+
+        linkq::dump();
+        timesync::dump();
+
+        ESP_LOGI(TAG, "Joins %u, resumes %u, uplinks %u (%u confirmed, %u ACKed), downlinks %u",
+                 counters.joins, counters.resumes, counters.uplinks, counters.confirmed,
+                 counters.acks, counters.downlinks);
+
+        ESP_LOGI(TAG, "Time on air %llu ms, awake %u ms last wake, %llu ms average, %u ms max",
+                 counters.airtime_us / 1000, counters.awake_ms_last,
+                 counters.wakes > 0 ? counters.awake_ms_sum / counters.wakes : 0ULL,
+                 counters.awake_ms_max);
 }
 
 void loop()
 {
+        lmic_idle = false;
+
         os_runloop_once();
+
+#if CONFIG_LORA_LIGHT_SLEEP
+
+        if (lmic_idle && wan::busy())
+        {
+                wan::doze();
+        }
+
+#endif
+
+        //
+        // hand queued frames to LMIC as soon as it's free
+        //
+        wan::drain();
 }
 
 } // namespace WAN
@@ -359,14 +1181,6 @@ void onEvent(ev_t event)
 
         case EV_JOINED: {
 
-#if CONFIG_LORA_ADR
-
-                //
-                // disable link check validation
-                //
-                LMIC_setLinkCheckMode(false);
-
-#endif
                 ESP_LOGI(TAG, "EV_JOINED");
 
                 uint32_t netid = 0;
@@ -410,17 +1224,16 @@ void onEvent(ev_t event)
                 ESP_LOGD(TAG, "-> saved to EEPROM");
 
                 //
-                // restart
+                // a fresh session starts counting frames from zero
                 //
-
-                ESP_LOGD(TAG, "Restarting...");
+                wan::reset_count();
+                wan::counters.joins++;
 
                 //
-                // give some time to read the screen
+                // keep the session live: data queued while joining
+                // goes out right away, no need to reboot
                 //
-                delay(CONFIG_LOGO_DELAY);
-
-                ESP.restart();
+                break;
         }
 
         case EV_RFU1:
@@ -439,15 +1252,57 @@ void onEvent(ev_t event)
 
                 ESP_LOGI(TAG, "EV_TXCOMPLETE");
 
+                wan::counters.uplinks++;
+                wan::counters.confirmed += wan::tx_confirmed ? 1 : 0;
+                wan::counters.acks += (LMIC.txrxFlags & TXRX_ACK) ? 1 : 0;
+                wan::counters.downlinks += (LMIC.txrxFlags & (TXRX_DNW1 | TXRX_DNW2)) ? 1 : 0;
+
                 if (LMIC.txrxFlags & TXRX_ACK)
                 {
                         ESP_LOGI(TAG, "EV_ACK");
                         wan::run_callback(wan::EV_ACK);
                 }
 
+                //
+                // every downlink tells how far off our timing is
+                //
+                if (LMIC.txrxFlags & (TXRX_DNW1 | TXRX_DNW2))
+                {
+                        wan::learn_clock();
+                        linkq::record(LMIC.snr, LMIC.rssi - wan::LMIC_RSSI_OFF);
+                        wan::choose_dr();
+                }
+                else if (wan::tx_confirmed)
+                {
+                        wan::missed_downlink();
+                }
+
+                //
+                // feed the uplink policy
+                //
+                if (wan::tx_confirmed)
+                {
+
+                        bool acked = (LMIC.txrxFlags & TXRX_ACK) != 0;
+                        wan::confirm_result(acked);
+
+                        if (!acked)
+                        {
+                                wan::run_callback(wan::EV_NACK);
+                        }
+                }
+
                 if (LMIC.dataLen > 0)
                 {
                         wan::run_callback(wan::EV_RESPONSE);
+
+                        //
+                        // the port byte sits right before the payload
+                        //
+                        if ((LMIC.txrxFlags & TXRX_PORT) && wan::dl_cb != nullptr)
+                        {
+                                wan::dl_cb(LMIC.frame[LMIC.dataBeg - 1], LMIC.frame + LMIC.dataBeg, LMIC.dataLen);
+                        }
                 }
 
                 break;
@@ -467,6 +1322,11 @@ void onEvent(ev_t event)
 
         case EV_LINK_DEAD:
                 ESP_LOGI(TAG, "EV_LINK_DEAD");
+
+                //
+                // failed link check: ask for ACKs until the network answers
+                //
+                wan::confirm_result(false);
                 break;
 
         case EV_LINK_ALIVE:
@@ -475,12 +1335,22 @@ void onEvent(ev_t event)
 
         case EV_TXSTART:
                 ESP_LOGI(TAG, "EV_TXSTART");
+                wan::book_airtime();
                 break;
 
         case EV_JOIN_TXCOMPLETE:
                 ESP_LOGI(TAG, "EV_JOIN_TXCOMPLETE");
                 break;
 
+        case EV_TXCANCELED:
+
+                //
+                // the frame never went out: the callback must not wait
+                // for its EV_TXCOMPLETE
+                //
+                ESP_LOGW(TAG, "EV_TXCANCELED");
+                break;
+
         default:
                 ESP_LOGI(TAG, "Unknown event");
                 break;
@@ -24,6 +24,7 @@
  *
  */
 
+#include <algorithm>
 #include <cinttypes>
 
 #include <esp_task_wdt.h>       // watchdog
@@ -31,11 +32,13 @@
 #include "include/WAN.h"
 #include "include/pwr/AXP192.h"
 #include "include/pwr/sleep.h"
+#include "include/pwr/wakestub.h"
 #include "include/util/panic.h"
 #include "include/util/scanI2C.h"
 
 #include "include/sensors/GPS.h"
 #include "include/sensors/SPS30.h"
+#include "include/sensors/ULPADC.h"
 
 #include <EEPROM.h>
 #include <SPIMemory.h>
@@ -43,8 +46,13 @@
 
 #include "include/sensors/BME680.h"
 #include "include/util/packer.h"
+#include "include/util/settings.h"
+#include "include/util/timesync.h"
+#include "include/util/trace.h"
 
+#include "include/util/airtime.h"
 #include "include/util/art.h"
+#include "include/util/flashlog.h"
 
 #include "../config.h"
 
@@ -62,6 +70,10 @@ RTC_DATA_ATTR int bootCount = 0;
 /// if we want GPS data too
 RTC_DATA_ATTR bool wantGPS = false;
 
+/// sensors set up in the last cycle; a warm boot resumes them
+RTC_DATA_ATTR bool has_bme680 = false;
+RTC_DATA_ATTR bool has_sps30  = false;
+
 
 //============================================================
 //                      Regular globals
@@ -72,7 +84,8 @@ static uint32_t last    = 0;
 static bool first_check = true;
 
 bool packetSent, packetQueued;
-bool has_bme680, has_sps30;
+bool backfillInFlight   = false;
+uint8_t backfillBatches = 0;
 
 #define WDT_TIMEOUT (15*60)                  // watchdog timeout
 
@@ -91,8 +104,10 @@ SPIFlash *flash;
 void hello();
 void enqueue_packet();
 bool grab_n_send();
+bool backfill();
 void sleep();
 void callback(uint8_t message);
+void on_downlink(uint8_t port, const uint8_t *data, uint8_t size);
 void show_flash_info();
 
 
@@ -147,7 +162,7 @@ void send_GPS()
         // turn on blue led for 1 second
         //
         axp192::turn_on_blueled();
-        delay(1000);
+        lightsleep::wait(1000);
         axp192::turn_off_blueled();
 
         //
@@ -163,6 +178,8 @@ void send_GPS()
 
 void sleep()
 {
+        trace::begin(trace::PH_SLEEP);
+
 
         //
         // set the user button to wake the board
@@ -173,26 +190,95 @@ void sleep()
         // we sleep for the interval between messages minus the current millis:
         // this way we distribute the messages evenly every SEND_INTERVAL millis
         //
+        uint32_t interval = settings::get().send_interval;
         uint32_t sleep_for =
-            (millis() < CONFIG_SEND_INTERVAL) ?
-                                                CONFIG_SEND_INTERVAL - millis()
-                                              : CONFIG_SEND_INTERVAL;
+            (millis() < interval) ?
+                                    interval - millis()
+                                  : interval;
+
+        //
+        // never wake before the duty cycle lets the next frame out,
+        // or it would just wait in LMIC with the CPU on
+        //
+        sleep_for = std::max(sleep_for, wan::next_slot_ms());
+
+        airtime::dump();
+
+        //
+        // keep the MAC state, so next wake resumes at the current data rate
+        //
+        wan::save_session(sleep_for);
+        wan::dump_stats();
+
         //
         // delete the button object from the heap to avoid leak
         //
         delete button;
         
         
+#if CONFIG_ULP_ADC
+
+        //
+        // let the ULP watch the analog sensors while we sleep
+        //
+        (void) ulpadc::start();
+
+#endif
+
+        ESP_LOGD(TAG, "Wake stub handled %u wakes in the last sleep", (unsigned)wakestub::handled());
+
         //
-        // do the deepsleep
+        // do the deepsleep; long sleeps go in slices, the wakes in
+        // between are handled by the wake stub without booting
         //
-        deepsleep::do_deepsleep(sleep_for, wantGPS);
+        deepsleep::do_deepsleep(wakestub::arm(sleep_for), wantGPS);
 }
 
 void callback(uint8_t message)
 {
 
-        if (message == EV_TXCOMPLETE && packetQueued)
+#if CONFIG_STORE_AND_FORWARD
+
+        if (backfillInFlight)
+        {
+
+                //
+                // the records stay on flash until the network has them
+                //
+                if (message == wan::EV_ACK)
+                {
+                        flashlog::commit_batch();
+                }
+
+                //
+                // cancelled (e.g. too long for the data rate): the records
+                // stay on flash, the next batch is sized again
+                //
+                if (message == EV_TXCOMPLETE || message == EV_TXCANCELED)
+                {
+                        backfillInFlight = false;
+                }
+        }
+        else if (message == EV_TXCANCELED && packetQueued)
+        {
+
+                //
+                // our frame never went out: keep it for later
+                //
+                (void) flashlog::append(packer::get_buffer(), packer::get_buffer_size(), packer::get_sampled_at());
+        }
+        else if (message == wan::EV_NACK && packetQueued)
+        {
+
+                //
+                // our frame was a probe and nobody answered: keep it for later
+                //
+                (void) flashlog::append(packer::get_buffer(), packer::get_buffer_size(), packer::get_sampled_at());
+        }
+
+#endif
+
+        if ((message == EV_TXCOMPLETE || message == EV_TXCANCELED) && packetQueued)
         {
 
                 packetQueued = false;
@@ -200,8 +286,32 @@ void callback(uint8_t message)
         }
 }
 
+void on_downlink(uint8_t port, const uint8_t *data, uint8_t size)
+{
+
+        ESP_LOGI(TAG, "Downlink on port %u, %u B", port, size);
+
+        if (port == CONFIG_LORAWAN_CMD_PORT && settings::apply(data, size))
+        {
+                wan::set_confirm_every(settings::get().confirm_every);
+
+                //
+                // left alone, a disabled SPS30 would keep its fan running
+                // through every deep sleep
+                //
+                if (has_sps30 && !settings::enabled(settings::SENSOR_SPS30))
+                {
+                        (void) SPS3O::stop();
+                        has_sps30 = false;
+                }
+        }
+}
+
 void setup()
 {
+        trace::end(trace::PH_BOOT);
+        trace::begin(trace::PH_SETUP);
+
         //
         // check if we've woken up from deep sleep
         //
@@ -268,17 +378,10 @@ void setup()
         //
         Serial.begin(CONFIG_SERIAL_BAUD);
 
-        //===============================
-        //         Init SPI Flash
-        //===============================
-
         //
-        // init SPI flash on CS pin 5
+        // runtime parameters, possibly changed by downlinks
         //
-        // flash = new SPIFlash(5);
-
-        // show SPI flash info
-        // show_flash_info();
+        settings::setup();
 
         //================================
         //      Init I2C and devices
@@ -293,14 +396,31 @@ void setup()
         }
 
         //
-        // setup the power management chip
+        // on a timer wake the hardware is the one found at cold boot:
+        // check the devices we know of instead of discovering them
         //
-        axp192::setup(wantGPS);
+        bool warm = false;
 
-        //
-        // find I2C devices
-        //
-        i2c::scan();
+        if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER)
+        {
+
+                axp192::resume(wantGPS);
+                warm = i2c::verify();
+        }
+
+        if (!warm)
+        {
+
+                //
+                // setup the power management chip
+                //
+                axp192::setup(wantGPS);
+
+                //
+                // find I2C devices
+                //
+                i2c::scan();
+        }
 
         //
         // setup ERASE button pin to pullup
@@ -313,10 +433,18 @@ void setup()
 
         //delete flash;
 
-        has_sps30 = SPS3O::setup();
+        //
+        // the SPS30 keeps measuring in deep sleep: a full setup (reset,
+        // device info, fan cleaning) only if it wasn't running already
+        //
+        has_sps30 = settings::enabled(settings::SENSOR_SPS30) &&
+                    (!warm || i2c::present(CONFIG_SPS30_ADDR)) &&
+                    ((warm && has_sps30) ? SPS3O::resume() : SPS3O::setup());
         ESP_LOGD(TAG, "has_SPS30 = %s", has_sps30 ? "TRUE" : "FALSE");
 
-        has_bme680 = bme680::setup();
+        has_bme680 = settings::enabled(settings::SENSOR_BME680) &&
+                     (!warm || i2c::present(CONFIG_BME680_ADDR1) || i2c::present(CONFIG_BME680_ADDR2)) &&
+                     bme680::setup();
         ESP_LOGD(TAG, "has_bme680 = %s", has_bme680 ? "TRUE" : "FALSE");
 
         //
@@ -349,18 +477,33 @@ void setup()
                 // register previous callback
                 //
                 wan::regist(callback);
+                wan::regist_downlink(on_downlink);
+                wan::set_confirm_every(settings::get().confirm_every);
 
                 //
                 // join the net
                 //
                 wan::join();
+        }
 
-                //
-                // set Adaptive Data Rate
-                //
-                wan::set_spreading_factor(CONFIG_LORA_ADR);
+#if CONFIG_STORE_AND_FORWARD
+
+        //===============================
+        //         Init SPI Flash
+        //===============================
+
+        //
+        // the flash shares the SPI bus the LoRa HAL has just set up
+        //
+        flash = new SPIFlash(CONFIG_SPI_FLASH_CS_GPIO);
+
+        if (flashlog::setup(flash))
+        {
+                show_flash_info();
         }
 
+#endif
+
         //
         // handler for button press, 1/2 s
         // on holding for 500ms -> reboot, turn on GPS, get coords
@@ -396,17 +539,17 @@ void setup()
                         gps::loop();
                 }
         }
+
+        trace::end(trace::PH_SETUP);
 }
 
 void show_flash_info()
 {
-        ESP_LOGI(TAG, "Initializing external flash...", flash->getJEDECID());
-        delay(500);
         ESP_LOGD(TAG, "FLASH JEDEC ID: %u", flash->getJEDECID());
         ESP_LOGD(TAG, "FLASH capacity: %u B", flash->getCapacity());
-        ESP_LOGD(TAG, "FLASH unique ID: %ll", flash->getUniqueID());
+        ESP_LOGD(TAG, "FLASH unique ID: %" PRIu64, flash->getUniqueID());
         ESP_LOGD(TAG, "FLASH man ID: %u", flash->getManID());
-        ESP_LOGD(TAG, "FLASH JEDEC ID: %u", flash->getMaxPage());
+        ESP_LOGD(TAG, "FLASH max page: %u", flash->getMaxPage());
 }
 
 void loop()
@@ -417,10 +560,15 @@ void loop()
         //
         wan::loop();
 
-        if (packetSent)
+        //
+        // sleep once our frame and whatever was queued before it are out,
+        // and the flash log has been backfilled as far as the link allows
+        //
+        if (packetSent && wan::pending() == 0 && !backfill())
         {
 
                 packetSent = false;
+                trace::end(trace::PH_RADIO);
                 sleep();
         }
 
@@ -429,7 +577,21 @@ void loop()
         //
         button->update();
 
-        if (last == 0 || (millis() - last) >= CONFIG_SEND_INTERVAL)
+        //
+        // sample only once we have a session, so the first
+        // frame goes out as soon as the join completes
+        //
+        bool due = wan::is_joined() && (last == 0 || (millis() - last) >= settings::get().send_interval);
+
+        //
+        // the duty cycle would hold the frame in LMIC: sample when it can go
+        //
+        if (due && wan::pending() == 0 && wan::next_slot_ms() > 0)
+        {
+
+                lightsleep::wait(100);
+        }
+        else if (due)
         {
 
                 if (grab_n_send())
@@ -466,9 +628,9 @@ void loop()
 
                         //
                         // put the CPU in low power mode
-                        // for 100 ms (can be interrupted)
+                        // for 100 ms
                         //
-                        delay(100);
+                        lightsleep::wait(100);
                 }
         }
 
@@ -495,11 +657,22 @@ bool grab_n_send()
                 if (gps::isValidData())
                 {
 
+                        //
+                        // a fix is the best time source we have
+                        //
+                        uint64_t unix_ms;
+
+                        if (gps::get_unix_time(unix_ms))
+                        {
+                                timesync::set(unix_ms, timesync::SRC_GPS);
+                        }
+
                         //
                         // encode the payload with GPS
                         //
                         packer::read_n_pack(true, has_bme680, has_sps30,
-                                            CONFIG_HAS_LPPYRA03AV, CONFIG_HAS_SEN0170);
+                                            settings::enabled(settings::SENSOR_LPPYRA03AV),
+                                            settings::enabled(settings::SENSOR_SEN0170));
 
                         //
                         // the message is queued
@@ -546,7 +719,8 @@ bool grab_n_send()
                 // encode the payload without GPS
                 //
                 packer::read_n_pack(false, has_bme680, has_sps30,
-                                    CONFIG_HAS_LPPYRA03AV, CONFIG_HAS_SEN0170);
+                                    settings::enabled(settings::SENSOR_LPPYRA03AV),
+                                    settings::enabled(settings::SENSOR_SEN0170));
 
                 //
                 // enqueue for sending
@@ -557,6 +731,52 @@ bool grab_n_send()
         }
 }
 
+bool backfill()
+{
+
+#if CONFIG_STORE_AND_FORWARD
+
+        if (backfillInFlight)
+        {
+                return true;
+        }
+
+        if (!wan::link_up() || backfillBatches >= settings::get().backfill_batches)
+        {
+                return false;
+        }
+
+        //
+        // as much as the current data rate carries: 36 B at SF12 in EU868,
+        // a longer frame would be cancelled by LMIC
+        //
+        uint8_t batch[CONFIG_MAX_PAYLOAD];
+        uint8_t size = flashlog::read_batch(batch, wan::max_payload(), packer::AGE_AT);
+
+        if (size == 0)
+        {
+                return false;
+        }
+
+        ESP_LOGI(TAG, "Backfilling %u B, %u frames on flash", size, flashlog::backlog());
+
+        backfillInFlight = true;
+        backfillBatches++;
+
+        //
+        // confirmed: the records are marked as sent only on ACK
+        //
+        wan::send(batch, size, CONFIG_FLASHLOG_PORT, true, wan::PRIO_BACKFILL);
+
+        return true;
+
+#else
+
+        return false;
+
+#endif
+}
+
 void enqueue_packet()
 {
         //
@@ -571,8 +791,52 @@ void enqueue_packet()
         uint8_t *data = packer::get_buffer();
         uint8_t size  = packer::get_buffer_size();
 
+#if CONFIG_STORE_AND_FORWARD
+
         //
-        // delegate WAN to send
+        // link is down and this frame isn't a probe: don't waste airtime,
+        // keep it on flash until the network answers again
         //
-        wan::send(data, size, CONFIG_LORAWAN_PORT, true);
+        if (!wan::link_up() && !wan::confirm_due() && flashlog::append(data, size, packer::get_sampled_at()))
+        {
+                ESP_LOGI(TAG, "-> Link down, message logged to flash");
+
+                wan::skip();
+                packetQueued = false;
+                packetSent   = true;
+                return;
+        }
+
+#endif
+
+        uint8_t port = CONFIG_LORAWAN_PORT;
+
+#if CONFIG_TRACE_UPLINK
+
+        //
+        // every so often, tell the backend where the awake time goes: the
+        // summary rides at the end of the data frame, on its own port so
+        // the decoder knows. A frame of its own would wait out the duty
+        // cycle with the CPU up
+        //
+        uint8_t frame[CONFIG_MAX_PAYLOAD];
+
+        if (bootCount % CONFIG_TRACE_UPLINK_EVERY == 0 && size + trace::SUMMARY_SIZE <= wan::max_payload())
+        {
+                (void) memcpy(frame, data, size);
+                size += trace::summary(frame + size, trace::SUMMARY_SIZE);
+                data = frame;
+                port = CONFIG_TRACE_PORT;
+        }
+
+#endif
+
+        //
+        // delegate WAN to send, asking for an ACK only when the policy says so
+        //
+        uint32_t sampled_at = packer::get_sampled_at();
+
+        trace::begin(trace::PH_RADIO);
+        wan::send(data, size, port, wan::confirm_due(), wan::PRIO_DATA, sampled_at != 0 ? packer::AGE_AT : wan::NO_AGE,
+                  sampled_at);
 }
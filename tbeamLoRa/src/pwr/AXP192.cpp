@@ -40,6 +40,48 @@ AXP20X_Class axp;
 
 void powerevent_IRQ();
 
+void attach_IRQ()
+{
+
+        //
+        // set pin IRQ
+        //
+        pinMode(CONFIG_PMU_IRQ, INPUT_PULLUP);
+
+        //
+        // attach our interrupt handler
+        //
+        attachInterrupt(CONFIG_PMU_IRQ,
+                        [] {axp192::powerevent_IRQ();},
+                        FALLING);
+}
+
+void resume(const bool gps)
+{
+
+        //
+        // the PMU kept its registers through the deep sleep (voltages, LED,
+        // ADC and IRQ masks): bind the driver and give back the rails
+        // do_deepsleep() cut
+        //
+        if (axp.begin(Wire, AXP192_SLAVE_ADDRESS) != AXP_PASS)
+        {
+                ESP_LOGE(TAG, "AXP192 Begin FAIL");
+        }
+
+        if (axp.setPowerOutPut(AXP192_LDO2, true) != AXP_PASS) // LORA radio
+        {
+                ESP_LOGE(TAG, "!!! AXP192 LDO2 setPowerOutPut FAIL !!!");
+        }
+
+        if (gps && axp.setPowerOutPut(AXP192_LDO3, true) != AXP_PASS)
+        {
+                ESP_LOGE(TAG, "!!! AXP192 GPS setPowerOutPut FAIL !!!");
+        }
+
+        axp192::attach_IRQ();
+}
+
 void setup(const bool gps)
 {
 
@@ -153,17 +195,7 @@ void setup(const bool gps)
         //               sets IRQs for PMU
         //===================================================
 
-        //
-        // set pin IRQ
-        //
-        pinMode(CONFIG_PMU_IRQ, INPUT_PULLUP);
-
-        //
-        // attach our interrupt handler
-        //
-        attachInterrupt(CONFIG_PMU_IRQ,
-                        [] {axp192::powerevent_IRQ();},
-                        FALLING);
+        axp192::attach_IRQ();
 
         //
         // set adc1 to battery voltage monitor
@@ -31,6 +31,8 @@
 
 #include "../../../config.h"
 #include "include/pwr/AXP192.h"
+#include "include/pwr/sleep.h"
+#include "include/util/trace.h"
 
 static const char *TAG = "Sleep";
 
@@ -87,7 +89,7 @@ void do_deepsleep(const uint64_t ms, const bool gps)
         //
         // wait a bit for stuff to complete
         //
-        delay(500);
+        lightsleep::wait(500);
 
         //
         // check if the modules are off
@@ -120,10 +122,89 @@ void do_deepsleep(const uint64_t ms, const bool gps)
         //
         (void) esp_sleep_enable_timer_wakeup(ms * 1000ULL);
 
+        trace::end(trace::PH_SLEEP);
+        trace::end(trace::PH_AWAKE);
+
+        //
+        // the statistics include this wake only once both phases ended;
+        // the UART stops with the CPU, let the dump out first
+        //
+        trace::dump();
+        Serial.flush();
+
         //
         // put MCU to sleep
         //
         esp_deep_sleep_start();
 }
 
-} // namespace deepsleep
\ No newline at end of file
+} // namespace deepsleep
+
+namespace lightsleep
+{
+
+bool until(const uint32_t ms, const uint64_t gpio_mask)
+{
+
+        //
+        // level triggered: a GPIO already high wakes us right away
+        //
+        for (uint8_t gpio = 0; gpio < GPIO_NUM_MAX; gpio++)
+        {
+                if (gpio_mask & (1ULL << gpio))
+                {
+                        (void) gpio_wakeup_enable(static_cast<gpio_num_t>(gpio), GPIO_INTR_HIGH_LEVEL);
+                }
+        }
+
+        (void) esp_sleep_enable_gpio_wakeup();
+        (void) esp_sleep_enable_timer_wakeup(ms * 1000ULL);
+
+        //
+        // the UART is clock gated too, don't cut the logs
+        //
+        Serial.flush();
+
+        (void) esp_light_sleep_start();
+
+        bool by_gpio = esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_GPIO;
+
+        //
+        // leave the wakeup sources as we found them
+        //
+        (void) esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_GPIO);
+        (void) esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_TIMER);
+
+        for (uint8_t gpio = 0; gpio < GPIO_NUM_MAX; gpio++)
+        {
+                if (gpio_mask & (1ULL << gpio))
+                {
+                        (void) gpio_wakeup_disable(static_cast<gpio_num_t>(gpio));
+                }
+        }
+
+        return by_gpio;
+}
+
+void wait(const uint32_t ms)
+{
+
+#if CONFIG_LIGHT_SLEEP_WAIT
+
+        //
+        // entering and leaving light sleep costs about a millisecond
+        // (and the log flush), not worth it for short waits; the timer
+        // wakeup is as accurate as delay() and millis() keeps counting
+        //
+        if (ms >= CONFIG_LIGHT_SLEEP_WAIT_MIN_MS)
+        {
+                (void) until(ms, 0);
+                return;
+        }
+
+#endif
+
+        delay(ms);
+}
+
+} // namespace lightsleep
\ No newline at end of file
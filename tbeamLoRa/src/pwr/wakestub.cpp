@@ -0,0 +1,168 @@
+/*
+ *
+ * Wake stub module
+ *
+ * PURPOSE: Splits long deep sleeps into slices; the wakes in between are
+ *          handled by a stub in RTC fast memory, without booting
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <Arduino.h>
+#include <esp_clk.h>
+#include <esp_sleep.h>
+#include <rom/ets_sys.h>
+#include <rom/rtc.h>
+#include <soc/rtc.h>
+#include <soc/rtc_cntl_reg.h>
+
+#include "include/pwr/wakestub.h"
+#include "include/sensors/ULPADC.h"
+
+#include "../../../config.h"
+
+static const char *TAG = "WakeStub";
+
+namespace wakestub
+{
+
+/// slices still to sleep after the current one
+RTC_DATA_ATTR uint32_t slices_left = 0;
+
+/// length of a slice, in RTC slow clock ticks
+RTC_DATA_ATTR uint64_t slice_ticks = 0;
+
+/// wakes handled by the stub in this sleep
+RTC_DATA_ATTR uint32_t stub_wakes = 0;
+
+uint64_t arm(const uint64_t sleep_ms)
+{
+
+        uint64_t slice_ms = (uint64_t)CONFIG_WAKE_STUB_SLICE_S * 1000;
+
+        stub_wakes = 0;
+        slices_left = 0;
+
+#if CONFIG_WAKE_STUB
+
+        if (sleep_ms <= slice_ms)
+        {
+                return sleep_ms;
+        }
+
+        //
+        // the stub can't divide 64 bit numbers (that's a libgcc call, in
+        // flash): convert the slice to slow clock ticks here, with the
+        // calibration the sleep code uses (us per tick, Q13.19)
+        //
+        slices_left = (sleep_ms - 1) / slice_ms;
+        slice_ticks = ((slice_ms * 1000) << RTC_CLK_CAL_FRACT) / esp_clk_slowclk_cal_get();
+
+        uint64_t first_ms = sleep_ms - slices_left * slice_ms;
+
+        ESP_LOGD(TAG, "Sleeping %llu ms: %llu ms, then %u slices of %llu ms",
+                 sleep_ms, first_ms, (unsigned)slices_left, slice_ms);
+
+        return first_ms;
+
+#else
+
+        (void) slice_ms;
+
+        return sleep_ms;
+
+#endif
+}
+
+uint32_t handled()
+{
+
+        return stub_wakes;
+}
+
+} // namespace wakestub
+
+#if CONFIG_WAKE_STUB
+
+//
+// replaces the weak default of ESP-IDF; runs from RTC fast memory before
+// the bootloader, so no logging, no flash and no 64 bit division here
+//
+extern "C" void RTC_IRAM_ATTR esp_wake_deep_sleep(void)
+{
+
+        esp_default_wake_deep_sleep();
+
+        if (wakestub::slices_left == 0 || rtc_get_wakeup_cause() != TIMER_EXPIRE)
+        {
+                return;
+        }
+
+        wakestub::slices_left--;
+        wakestub::stub_wakes++;
+
+#if CONFIG_ULP_ADC
+
+        //
+        // keep the ULP counters from wrapping
+        //
+        ulpadc::fold();
+
+#endif
+
+        //
+        // read the RTC counter and set the alarm one slice later
+        //
+        SET_PERI_REG_MASK(RTC_CNTL_TIME_UPDATE_REG, RTC_CNTL_TIME_UPDATE);
+
+        while (GET_PERI_REG_MASK(RTC_CNTL_TIME_UPDATE_REG, RTC_CNTL_TIME_VALID) == 0)
+        {
+                ets_delay_us(1);
+        }
+
+        SET_PERI_REG_MASK(RTC_CNTL_INT_CLR_REG, RTC_CNTL_TIME_VALID_INT_CLR);
+
+        uint64_t now = READ_PERI_REG(RTC_CNTL_TIME0_REG);
+        now |= (uint64_t)READ_PERI_REG(RTC_CNTL_TIME1_REG) << 32;
+
+        uint64_t alarm = now + wakestub::slice_ticks;
+
+        WRITE_PERI_REG(RTC_CNTL_SLP_TIMER0_REG, alarm & UINT32_MAX);
+        WRITE_PERI_REG(RTC_CNTL_SLP_TIMER1_REG, alarm >> 32);
+
+        //
+        // wake into this stub again, with the wakeup sources already set;
+        // the ROM checks the RTC memory CRC before jumping here
+        //
+        REG_WRITE(RTC_ENTRY_ADDR_REG, (uint32_t)&esp_wake_deep_sleep);
+        set_rtc_memory_crc();
+
+        CLEAR_PERI_REG_MASK(RTC_CNTL_STATE0_REG, RTC_CNTL_SLEEP_EN);
+        SET_PERI_REG_MASK(RTC_CNTL_STATE0_REG, RTC_CNTL_SLEEP_EN);
+
+        //
+        // sleep takes a few cycles to start
+        //
+        while (true)
+        {
+        }
+}
+
+#endif
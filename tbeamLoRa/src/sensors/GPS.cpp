@@ -65,6 +65,42 @@ float get_altitude()
         return gps.altitude.meters();
 }
 
+uint32_t days_from_civil(int32_t y, const uint32_t m, const uint32_t d)
+{
+
+        //
+        // days since 1970-01-01 of a Gregorian date (H. Hinnant)
+        //
+        y -= m <= 2 ? 1 : 0;
+
+        const int32_t era = (y >= 0 ? y : y - 399) / 400;
+        const uint32_t yoe = (uint32_t)(y - era * 400);
+        const uint32_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+        const uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+        return era * 146097 + doe - 719468;
+}
+
+bool get_unix_time(uint64_t &unix_ms)
+{
+
+        //
+        // the receiver reports time before it has a full fix; an old
+        // sentence would set the clock in the past
+        //
+        if (!gps.date.isValid() || !gps.time.isValid() || gps.date.year() < 2020 || gps.time.age() > 1000)
+        {
+                return false;
+        }
+
+        uint64_t days = days_from_civil(gps.date.year(), gps.date.month(), gps.date.day());
+        uint64_t secs = days * 86400 + gps.time.hour() * 3600 + gps.time.minute() * 60 + gps.time.second();
+
+        unix_ms = secs * 1000 + gps.time.centisecond() * 10 + gps.time.age();
+
+        return true;
+}
+
 void setup()
 {
 
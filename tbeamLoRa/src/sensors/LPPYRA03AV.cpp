@@ -26,7 +26,9 @@
 
 #include <Arduino.h>
 #include <filters.h>
+#include <robust.h>
 
+#include "include/pwr/sleep.h"
 #include "include/sensors/LPPYRA03AV.h"
 
 #include "../../../config.h"
@@ -35,6 +37,12 @@ static const char *TAG = "LPPYRA03AV";
 
 const float CUTOFF_FREQ = 0.01;     // Cutoff frequency in Hz
 const float SAMPLING_TIME = 0.020;  // Sampling time in seconds (20 ms)
+const int   SEED_SAMPLES  = 25;     // Samples averaged to seed the filter (500 ms)
+const int   ACQ_WINDOW_MS = 2000;   // Acquisition window (ms)
+const int   SAMPLE_MS     = 20;     // Sampling time in ms
+
+// Hampel outlier filter, takes out spikes coupled from the radio TX
+Hampel<15> spikeFilter;
 
 // Low-pass filter
 Filter lowpassFilter(CUTOFF_FREQ, SAMPLING_TIME, IIR::ORDER::OD1);
@@ -42,15 +50,40 @@ Filter lowpassFilter(CUTOFF_FREQ, SAMPLING_TIME, IIR::ORDER::OD1);
 namespace lppyra03av
 {
 
+float from_raw(const float raw)
+{
+
+        //
+        // convert to actual voltage
+        //
+        float outvoltage = raw * (3.3 / 4095.0);
+
+        //
+        // actual irradiance in W/m^2
+        // see http://www.deltaohm.com/ver2012/download/LP_pyra03_M_uk.pdf section 5.3, formula 2
+        //
+        return 400.0 * outvoltage;
+}
+
 float get_irradiance()
 {
 
         int start = millis();
         float filteredval = 0.0;
 
-        ESP_LOGI(TAG, "Init pyra measurement - 5 s");
+        ESP_LOGI(TAG, "Init pyra measurement - %d ms", ACQ_WINDOW_MS);
+
+        //
+        // start from the mean of the first samples instead of zero,
+        // otherwise the filter would need minutes to settle
+        //
+        spikeFilter.flush();
+        lowpassFilter.flush();
+        lowpassFilter.setAutoSeed(SEED_SAMPLES);
 
-        while (millis() - start < 5000)
+        uint32_t next = millis();
+
+        while (millis() - start < ACQ_WINDOW_MS)
         {
 
                 //
@@ -59,26 +92,25 @@ float get_irradiance()
                 auto sensorValue = static_cast<float>(analogRead(CONFIG_LPPYRA03AV_PIN));
 
                 //
-                // lowpass filter
+                // reject spikes, then lowpass filter
                 //
-                filteredval = lowpassFilter.filterIn(sensorValue);
+                filteredval = lowpassFilter.filterIn(spikeFilter.filterIn(sensorValue));
 
                 // ESP_LOGD(TAG, "%u, %f, %f", sensorValue, outvoltage, irradiance);
-                delay(20);
-        }
 
-        //
-        // convert to actual voltage
-        //
-        float outvoltage = filteredval * (3.3 / 4095.0);
+                //
+                // sleep to the next sample slot, so the filter keeps its
+                // sampling time whatever the read and the wakeup cost
+                //
+                next += SAMPLE_MS;
+                int32_t left = (int32_t)(next - millis());
+                lightsleep::wait(left > 0 ? left : 0);
+        }
 
-        //
-        // actual irradiance in W/m^2
-        // see http://www.deltaohm.com/ver2012/download/LP_pyra03_M_uk.pdf section 5.3, formula 2
-        //
-        float irradiance = 400.0 * outvoltage;
+        ESP_LOGD(TAG, "Residual settling error: %.4f", lowpassFilter.settlingError());
+        ESP_LOGD(TAG, "Spikes rejected: %u", spikeFilter.getOutliers());
 
-        return irradiance;
+        return from_raw(filteredval);
 }
 
 } // namespace lppyra03av
\ No newline at end of file
@@ -25,7 +25,9 @@
  */
 
 #include <Arduino.h>
+#include <decimator.h>
 #include <filters.h>
+#include <robust.h>
 
 #include "../../config.h"
 
@@ -35,14 +37,37 @@
 static const char *TAG = "SEN0170";
 
 const float CUTOFF_FREQ   = 0.01;                    // Cutoff frequency in Hz
-const float SAMPLING_TIME = 0.010;                   // Sampling time in seconds (20 ms)
+const float SAMPLING_TIME = 0.001;                   // ADC sampling time in seconds (1 ms)
+const int   DECIMATION    = 16;                      // ADC samples per filter sample (16 ms)
+const int   SEED_SAMPLES  = 25;                      // Decimated samples averaged to seed the filter
+const int   ACQ_WINDOW_MS = 2000;                    // Acquisition window (ms)
 
-// Low-pass filter
-Filter lowpassFilterAnemometer(CUTOFF_FREQ, SAMPLING_TIME, IIR::ORDER::OD1);
+// Moving median on the raw ADC stream, takes out single-sample spikes from the radio TX
+MovingMedian<5> spikeFilterAnemometer;
+
+// CIC decimator, brings the 12 bit ADC stream down to the filter rate
+Decimator decimatorAnemometer(DECIMATION);
+
+// Low-pass filter, runs at the decimated rate
+Filter lowpassFilterAnemometer(CUTOFF_FREQ, SAMPLING_TIME * DECIMATION, IIR::ORDER::OD1);
 
 namespace sen0170
 {
 
+float from_raw(const float raw)
+{
+
+        //
+        // convert to actual voltage
+        //
+        float outvoltage = (raw * 5.0F) / 4095.0F;
+
+        //
+        // convert to wind speed
+        //
+        return 6.0 * outvoltage;
+}
+
 float get_windspeed()
 {
 
@@ -54,9 +79,18 @@ float get_windspeed()
         int start = millis();
         float filteredval = 0.0;
 
-        ESP_LOGI(TAG, "Initializing anemometer measurement - 5 seconds...");
+        ESP_LOGI(TAG, "Initializing anemometer measurement - %d ms...", ACQ_WINDOW_MS);
 
-        while (millis() - start < 5000)
+        //
+        // start from the mean of the first samples instead of zero,
+        // otherwise the filter would need minutes to settle
+        //
+        spikeFilterAnemometer.flush();
+        decimatorAnemometer.flush();
+        lowpassFilterAnemometer.flush();
+        lowpassFilterAnemometer.setAutoSeed(SEED_SAMPLES);
+
+        while (millis() - start < ACQ_WINDOW_MS)
         {
                 //
                 // read raw value
@@ -64,22 +98,25 @@ float get_windspeed()
                 unsigned short rawValue = analogRead(CONFIG_SEN0170_PIN);
 
                 //
-                // lowpass filter
+                // reject spikes, decimate, then lowpass filter at the lower rate
                 //
-                filteredval = lowpassFilterAnemometer.filterIn(static_cast<float_t>(rawValue));
-        }
+                auto despiked = static_cast<int32_t>(spikeFilterAnemometer.filterIn(rawValue));
 
-        //
-        // convert to actual voltage
-        //
-        float outvoltage = (filteredval * 5.0F) / 4095.0F;
+                //
+                // the first decimator outputs are CIC/FIR start-up transient,
+                // keep them out of the seed window
+                //
+                if (decimatorAnemometer.filterIn(despiked) && decimatorAnemometer.isSettled())
+                {
+                        filteredval = lowpassFilterAnemometer.filterIn(decimatorAnemometer.getOutput());
+                }
 
-        //
-        // convert to wind speed
-        //
-        float speed = 6.0 * outvoltage;
+                delayMicroseconds(static_cast<uint32_t>(SAMPLING_TIME * 1e6F));
+        }
+
+        ESP_LOGD(TAG, "Residual settling error: %.4f", lowpassFilterAnemometer.settlingError());
 
-        return speed;
+        return from_raw(filteredval);
 }
 
 } // namespace sen0170
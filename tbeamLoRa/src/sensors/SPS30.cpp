@@ -139,6 +139,40 @@ bool setup()
         return true;
 }
 
+bool resume()
+{
+
+        //
+        // the sensor stayed powered and measuring through the deep
+        // sleep: only the driver has to be bound to the bus again
+        //
+        if (!sps30.begin(&Wire))
+        {
+
+                ESP_LOGE(TAG, "Could not set I2C communication channel");
+                return false;
+        }
+
+        ESP_LOGI(TAG, "SPS30 resumed");
+
+        return true;
+}
+
+bool stop()
+{
+
+        if (!sps30.stop())
+        {
+
+                ESP_LOGW(TAG, "Could NOT stop measurement");
+                return false;
+        }
+
+        ESP_LOGI(TAG, "Measurement stopped");
+
+        return true;
+}
+
 void getDeviceInfo()
 {
 
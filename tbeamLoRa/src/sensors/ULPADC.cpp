@@ -0,0 +1,342 @@
+/*
+ *
+ * ULP ADC module
+ *
+ * PURPOSE: Samples the analog sensors with the ULP coprocessor during
+ *          deep sleep and keeps their statistics in RTC slow memory
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <Arduino.h>
+#include <driver/adc.h>
+#include <esp32/ulp.h>
+#include <rom/ets_sys.h>
+#include <soc/rtc_cntl_reg.h>
+#include <soc/sens_struct.h>
+
+#include "include/sensors/ULPADC.h"
+
+#include "../../../config.h"
+
+static const char *TAG = "ULPADC";
+
+namespace ulpadc
+{
+
+//
+// layout of the reserved RTC slow memory, in 32 bit words (the ULP
+// reads and writes the low 16 bits only): a block of statistics per
+// channel, then the program
+//
+enum
+{
+        SUM_LO = 0,
+        SUM_HI = 1,
+        MIN = 2,
+        MAX = 3,
+        COUNT = 4,
+        BLOCK_WORDS = 5,
+};
+
+/// \brief where the program is loaded, after the statistics
+const uint32_t PROG_ADDR = 16;
+
+static_assert(CHANNELS * BLOCK_WORDS <= PROG_ADDR, "statistics overlap the ULP program");
+
+/// \brief GPIO of each channel
+const uint8_t PINS[CHANNELS] = {CONFIG_SEN0170_PIN, CONFIG_LPPYRA03AV_PIN};
+
+/// \brief time for a ULP run in progress to finish its stores, in us
+const uint32_t SETTLE_US = 1000;
+
+/// \struct statistics folded out of the ULP words, which are only 16 bit
+typedef struct
+{
+        uint32_t sum;
+        uint32_t count;
+        uint16_t min;
+        uint16_t max;
+} total_t;
+
+/// whether the ULP was started before the last deep sleep
+RTC_DATA_ATTR bool running = false;
+
+/// totals since start()
+RTC_DATA_ATTR total_t totals[CHANNELS];
+
+void adc_to_ulp(const uint8_t unit, const uint8_t pad)
+{
+
+        //
+        // 12 bit, 11 dB: the same scale analogRead() gives
+        //
+        if (unit == 0)
+        {
+
+                (void) adc1_config_width(ADC_WIDTH_BIT_12);
+                (void) adc1_config_channel_atten(static_cast<adc1_channel_t>(pad), ADC_ATTEN_DB_11);
+                adc1_ulp_enable();
+        }
+        else
+        {
+
+                (void) adc2_config_channel_atten(static_cast<adc2_channel_t>(pad), ADC_ATTEN_DB_11);
+
+                //
+                // there is no adc2_ulp_enable(): hand SAR ADC2 to the RTC
+                // controller the way adc1_ulp_enable() does for SAR ADC1
+                //
+                SENS.sar_meas_start2.meas2_start_force = 0;
+                SENS.sar_meas_start2.sar2_en_pad_force = 0;
+                SENS.sar_read_ctrl2.sar2_dig_force = 0;
+                SENS.sar_meas_wait2.force_xpd_sar = SENS_FORCE_XPD_SAR_FSM;
+        }
+}
+
+bool start()
+{
+
+        //
+        // don't rewrite the program under a running ULP
+        //
+        stop();
+
+        //
+        // labels, six per channel
+        //
+        enum
+        {
+                L_DONE = 0,
+                L_CARRY = 1,
+                L_SUMMED = 2,
+                L_NEWMIN = 3,
+                L_CHKMAX = 4,
+                L_NEWMAX = 5,
+                LABELS = 6,
+        };
+
+        ulp_insn_t program[CHANNELS * 32];
+        size_t n = 0;
+
+        for (uint8_t ch = 0; ch < CHANNELS; ch++)
+        {
+
+                //
+                // Arduino numbers ADC1 channels 0-9 and ADC2 channels 10-19
+                //
+                int8_t analog = digitalPinToAnalogChannel(PINS[ch]);
+
+                if (analog < 0)
+                {
+                        ESP_LOGE(TAG, "GPIO %u is not an ADC pin", PINS[ch]);
+                        return false;
+                }
+
+                uint8_t unit = analog >= 10 ? 1 : 0;
+                uint8_t pad = analog % 10;
+                uint32_t block = ch * BLOCK_WORDS;
+                uint32_t l = ch * LABELS;
+
+                adc_to_ulp(unit, pad);
+
+                //
+                // clear the statistics
+                //
+                RTC_SLOW_MEM[block + SUM_LO] = 0;
+                RTC_SLOW_MEM[block + SUM_HI] = 0;
+                RTC_SLOW_MEM[block + MIN] = 0xFFFF;
+                RTC_SLOW_MEM[block + MAX] = 0;
+                RTC_SLOW_MEM[block + COUNT] = 0;
+
+                totals[ch] = {0, 0, 0xFFFF, 0};
+
+                //
+                // R0 sample, R3 block address; SUB sets the overflow flag
+                // on borrow, which is how the ULP compares two registers
+                //
+                const ulp_insn_t channel[] =
+                {
+                        I_ADC(R0, unit, pad),
+                        I_MOVI(R3, block),
+
+                        // count, stop accumulating when it would wrap
+                        I_LD(R1, R3, COUNT),
+                        I_ADDI(R1, R1, 1),
+                        M_BXF(l + L_DONE),
+                        I_ST(R1, R3, COUNT),
+
+                        // 32 bit sum
+                        I_LD(R1, R3, SUM_LO),
+                        I_ADDR(R1, R1, R0),
+                        M_BXF(l + L_CARRY),
+                        I_ST(R1, R3, SUM_LO),
+                        M_BX(l + L_SUMMED),
+                        M_LABEL(l + L_CARRY),
+                        I_ST(R1, R3, SUM_LO),
+                        I_LD(R1, R3, SUM_HI),
+                        I_ADDI(R1, R1, 1),
+                        I_ST(R1, R3, SUM_HI),
+                        M_LABEL(l + L_SUMMED),
+
+                        // sample < min
+                        I_LD(R1, R3, MIN),
+                        I_SUBR(R2, R0, R1),
+                        M_BXF(l + L_NEWMIN),
+                        M_BX(l + L_CHKMAX),
+                        M_LABEL(l + L_NEWMIN),
+                        I_ST(R0, R3, MIN),
+
+                        // sample > max
+                        M_LABEL(l + L_CHKMAX),
+                        I_LD(R1, R3, MAX),
+                        I_SUBR(R2, R1, R0),
+                        M_BXF(l + L_NEWMAX),
+                        M_BX(l + L_DONE),
+                        M_LABEL(l + L_NEWMAX),
+                        I_ST(R0, R3, MAX),
+
+                        M_LABEL(l + L_DONE),
+                };
+
+                static_assert(sizeof(channel) / sizeof(channel[0]) <= 32, "ULP channel code too long");
+
+                for (const auto &insn : channel)
+                {
+                        program[n++] = insn;
+                }
+        }
+
+        program[n++] = I_HALT();
+
+        size_t size = n;
+
+        if (ulp_process_macros_and_load(PROG_ADDR, program, &size) != ESP_OK)
+        {
+                ESP_LOGE(TAG, "ULP program doesn't fit (%u instructions)", (unsigned)n);
+                return false;
+        }
+
+        (void) ulp_set_wakeup_period(0, CONFIG_ULP_ADC_PERIOD_MS * 1000);
+
+        running = ulp_run(PROG_ADDR) == ESP_OK;
+
+        ESP_LOGD(TAG, "ULP sampling every %u ms: %s", CONFIG_ULP_ADC_PERIOD_MS, running ? "ok" : "failed");
+
+        return running;
+}
+
+void stop()
+{
+
+        if (!running)
+        {
+                return;
+        }
+
+        //
+        // no more timer wakeups; a run in progress is a few tens of
+        // microseconds, let it finish its stores
+        //
+        CLEAR_PERI_REG_MASK(RTC_CNTL_STATE0_REG, RTC_CNTL_ULP_CP_SLP_TIMER_EN);
+        ets_delay_us(SETTLE_US);
+}
+
+void RTC_IRAM_ATTR fold()
+{
+
+        if (!running)
+        {
+                return;
+        }
+
+        //
+        // runs from the wake stub too: no calls into flash, register
+        // macros and ROM functions only
+        //
+        bool sampling = GET_PERI_REG_MASK(RTC_CNTL_STATE0_REG, RTC_CNTL_ULP_CP_SLP_TIMER_EN) != 0;
+
+        if (sampling)
+        {
+                CLEAR_PERI_REG_MASK(RTC_CNTL_STATE0_REG, RTC_CNTL_ULP_CP_SLP_TIMER_EN);
+                ets_delay_us(SETTLE_US);
+        }
+
+        for (uint8_t ch = 0; ch < CHANNELS; ch++)
+        {
+
+                volatile uint32_t *words = RTC_SLOW_MEM + ch * BLOCK_WORDS;
+                uint16_t count = words[COUNT] & 0xFFFF;
+
+                if (count == 0)
+                {
+                        continue;
+                }
+
+                uint16_t min = words[MIN] & 0xFFFF;
+                uint16_t max = words[MAX] & 0xFFFF;
+
+                totals[ch].sum += ((words[SUM_HI] & 0xFFFF) << 16) | (words[SUM_LO] & 0xFFFF);
+                totals[ch].count += count;
+                totals[ch].min = min < totals[ch].min ? min : totals[ch].min;
+                totals[ch].max = max > totals[ch].max ? max : totals[ch].max;
+
+                words[SUM_LO] = 0;
+                words[SUM_HI] = 0;
+                words[MIN] = 0xFFFF;
+                words[MAX] = 0;
+                words[COUNT] = 0;
+        }
+
+        if (sampling)
+        {
+                SET_PERI_REG_MASK(RTC_CNTL_STATE0_REG, RTC_CNTL_ULP_CP_SLP_TIMER_EN);
+        }
+}
+
+bool get(const channel_t channel, stats_t &stats)
+{
+
+        if (!running)
+        {
+                return false;
+        }
+
+        fold();
+
+        const total_t &t = totals[channel];
+
+        if (t.count == 0)
+        {
+                return false;
+        }
+
+        stats.count = t.count;
+        stats.min = t.min;
+        stats.max = t.max;
+        stats.mean = (float)t.sum / t.count;
+
+        ESP_LOGD(TAG, "Channel %u: %u samples, min %u, max %u, mean %.1f",
+                 channel, (unsigned)stats.count, stats.min, stats.max, stats.mean);
+
+        return true;
+}
+
+} // namespace ulpadc
@@ -0,0 +1,192 @@
+/*
+ *
+ * Airtime module
+ *
+ * PURPOSE: LoRa time-on-air calculator and per-band duty-cycle ledger
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <Arduino.h>
+#include <esp_clk.h>
+#include <soc/rtc.h>
+
+#include <algorithm>
+
+#include "include/util/airtime.h"
+
+#include "../../../config.h"
+
+static const char *TAG = "Airtime";
+
+namespace airtime
+{
+
+/// the rolling hour is kept in buckets of this many minutes
+const uint8_t BUCKET_MIN = 10;
+const uint8_t BUCKETS = 60 / BUCKET_MIN;
+
+/// \struct duty-cycle state of one sub-band
+typedef struct
+{
+        int64_t  avail_ms;               ///< RTC counter time the band is free again, in ms
+        uint64_t total_us;               ///< airtime since the last cold boot
+        uint32_t frames;                 ///< frames since the last cold boot
+        uint32_t bucket_ms[BUCKETS];     ///< airtime in each bucket of the last hour
+        uint32_t bucket_slot[BUCKETS];   ///< which BUCKET_MIN slot each bucket holds
+} band_t;
+
+/// the ledger, kept across deep sleep
+RTC_DATA_ATTR band_t bands[MAX_BANDS];
+
+int64_t now_ms()
+{
+
+        //
+        // the RTC slow clock counter keeps running in deep sleep, unlike
+        // millis(), and isn't stepped by timesync::set() as the system
+        // time is: a jump would free every band at once
+        //
+        return static_cast<int64_t>(rtc_time_slowclk_to_us(rtc_time_get(), esp_clk_slowclk_cal_get()) / 1000);
+}
+
+uint32_t lora_us(const uint8_t size, const uint8_t sf, const uint16_t bw_khz, const uint8_t cr,
+                 const bool header, const bool crc, const uint16_t preamble)
+{
+
+        uint32_t tsym_us = (1UL << sf) * 1000UL / bw_khz;
+
+        //
+        // low data rate optimization is mandated when a symbol lasts 16 ms or more
+        //
+        int32_t de = (tsym_us >= 16000) ? 1 : 0;
+
+        int32_t num = 8 * size - 4 * sf + 28 + (crc ? 16 : 0) - (header ? 0 : 20);
+        int32_t den = 4 * (sf - 2 * de);
+        int32_t payload_sym = 8 + std::max<int32_t>((num + den - 1) / den, 0) * (cr + 4);
+
+        //
+        // preamble: programmed symbols plus 4.25 for the sync word
+        //
+        return (preamble * 4 + 17) * tsym_us / 4 + payload_sym * tsym_us;
+}
+
+uint32_t uplink_us(const uint8_t payload, const uint8_t sf)
+{
+
+        return lora_us(payload + LORAWAN_OVERHEAD, sf);
+}
+
+void record(const uint8_t band, const uint32_t us, const uint16_t txcap)
+{
+
+        if (band >= MAX_BANDS)
+        {
+                return;
+        }
+
+        band_t &b = bands[band];
+        int64_t now = now_ms();
+        uint32_t ms = (us + 999) / 1000;
+
+        //
+        // LMIC's rule: after a frame the band stays off for airtime * txcap
+        //
+        b.avail_ms = now + static_cast<int64_t>(ms) * txcap;
+        b.total_us += us;
+        b.frames++;
+
+        uint32_t slot = static_cast<uint32_t>(now / (BUCKET_MIN * 60000LL));
+        uint8_t i = slot % BUCKETS;
+
+        if (b.bucket_slot[i] != slot)
+        {
+                b.bucket_slot[i] = slot;
+                b.bucket_ms[i] = 0;
+        }
+
+        b.bucket_ms[i] += ms;
+
+        ESP_LOGD(TAG, "Band %u: %u us on air, free again in %u ms", band, us, ms * txcap);
+}
+
+uint32_t wait_ms(const uint8_t band)
+{
+
+        if (band >= MAX_BANDS)
+        {
+                return 0;
+        }
+
+        int64_t wait = bands[band].avail_ms - now_ms();
+
+        return wait > 0 ? static_cast<uint32_t>(wait) : 0;
+}
+
+uint32_t last_hour_ms(const uint8_t band)
+{
+
+        if (band >= MAX_BANDS)
+        {
+                return 0;
+        }
+
+        uint32_t slot = static_cast<uint32_t>(now_ms() / (BUCKET_MIN * 60000LL));
+        uint32_t ms = 0;
+
+        for (uint8_t i = 0; i < BUCKETS; i++)
+        {
+                if (slot - bands[band].bucket_slot[i] < BUCKETS)
+                {
+                        ms += bands[band].bucket_ms[i];
+                }
+        }
+
+        return ms;
+}
+
+uint32_t total_ms(const uint8_t band)
+{
+
+        return band < MAX_BANDS ? static_cast<uint32_t>(bands[band].total_us / 1000) : 0;
+}
+
+uint32_t frames(const uint8_t band)
+{
+
+        return band < MAX_BANDS ? bands[band].frames : 0;
+}
+
+void dump()
+{
+
+        for (uint8_t band = 0; band < MAX_BANDS; band++)
+        {
+                if (bands[band].frames == 0)
+                {
+                        continue;
+                }
+
+                ESP_LOGI(TAG, "Band %u: %u frames, %u ms on air (%u ms last hour), free in %u ms",
+                         band, frames(band), total_ms(band), last_hour_ms(band), wait_ms(band));
+        }
+}
+
+} // namespace airtime
@@ -0,0 +1,638 @@
+/*
+ *
+ * Flash log module
+ *
+ * PURPOSE: Store-and-forward log of encoded frames on the external
+ *          SPI flash, for the periods the node can't reach a gateway
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <Arduino.h>
+
+#include <algorithm>
+#include <cstddef>
+
+#include "include/util/flashlog.h"
+
+#include "../../../config.h"
+
+static const char *TAG = "FlashLog";
+
+namespace flashlog
+{
+
+const uint32_t SECTOR_SIZE = 4096;
+const uint8_t  REC_MAGIC   = 0xA5;
+const uint8_t  REC_LIVE    = 0xFF;
+const uint8_t  REC_SENT    = 0x00;
+
+/// \struct record header, followed by len bytes of data
+typedef struct
+{
+        uint8_t  magic;        ///< REC_MAGIC, 0xFF if erased (end of sector data)
+        uint8_t  state;        ///< REC_LIVE or REC_SENT
+        uint8_t  len;          ///< data length
+        uint8_t  crc8;         ///< CRC-8 of len, seq, time and the data, see crc8()
+        uint32_t seq;          ///< record sequence number, grows forever
+        uint32_t time;         ///< sample time (Unix, s), 0 if unknown
+} rec_hdr_t;
+
+/// batch header: the epoch the record ages count from
+const uint8_t BATCH_HDR = 4;
+
+/// first and one-past-last byte of the ring
+const uint32_t RING_START = CONFIG_FLASHLOG_FIRST_SECTOR * SECTOR_SIZE;
+const uint32_t RING_END   = RING_START + CONFIG_FLASHLOG_SECTORS * SECTOR_SIZE;
+
+static_assert(CONFIG_FLASHLOG_SECTORS >= 2, "the flash log needs at least 2 sectors");
+
+/// the flash chip
+SPIFlash *chip = nullptr;
+
+/// whether the positions below are known, kept across deep sleep
+RTC_DATA_ATTR bool positions_valid = false;
+
+/// address of the next record to write, always in an erased area
+RTC_DATA_ATTR uint32_t head = 0;
+
+/// address of the oldest unsent record (== head if none)
+RTC_DATA_ATTR uint32_t tail = 0;
+
+/// sequence number of the next record
+RTC_DATA_ATTR uint32_t next_seq = 0;
+
+/// number of unsent records
+RTC_DATA_ATTR uint32_t unsent = 0;
+
+/// records and end address of the batch last read
+uint32_t batch_addr[CONFIG_MAX_PAYLOAD / 2];
+uint8_t  batch_count = 0;
+uint32_t batch_end = 0;
+
+uint32_t sector_of(const uint32_t addr)
+{
+        return addr - (addr - RING_START) % SECTOR_SIZE;
+}
+
+uint32_t next_sector(const uint32_t addr)
+{
+        uint32_t next = sector_of(addr) + SECTOR_SIZE;
+        return next >= RING_END ? RING_START : next;
+}
+
+bool is_record(const uint32_t addr, rec_hdr_t &hdr)
+{
+        uint32_t end = sector_of(addr) + SECTOR_SIZE;
+
+        //
+        // a record never crosses a sector boundary
+        //
+        return addr + sizeof(hdr) <= end &&
+               chip->readByteArray(addr, reinterpret_cast<uint8_t *>(&hdr), sizeof(hdr)) &&
+               hdr.magic == REC_MAGIC && addr + sizeof(hdr) + hdr.len <= end;
+}
+
+///
+/// \brief           Address of the record following the one at addr
+///
+uint32_t next_record(const uint32_t addr, const rec_hdr_t &hdr)
+{
+        uint32_t next = addr + sizeof(hdr) + hdr.len;
+
+        return (next == sector_of(addr) + SECTOR_SIZE) ? next_sector(addr) : next;
+}
+
+/// CRC-8/SAE-J1850 (x^8 + x^4 + x^3 + x^2 + 1), MSB first
+const uint8_t CRC8_TABLE[256] = {
+        0x00, 0x1d, 0x3a, 0x27, 0x74, 0x69, 0x4e, 0x53,
+        0xe8, 0xf5, 0xd2, 0xcf, 0x9c, 0x81, 0xa6, 0xbb,
+        0xcd, 0xd0, 0xf7, 0xea, 0xb9, 0xa4, 0x83, 0x9e,
+        0x25, 0x38, 0x1f, 0x02, 0x51, 0x4c, 0x6b, 0x76,
+        0x87, 0x9a, 0xbd, 0xa0, 0xf3, 0xee, 0xc9, 0xd4,
+        0x6f, 0x72, 0x55, 0x48, 0x1b, 0x06, 0x21, 0x3c,
+        0x4a, 0x57, 0x70, 0x6d, 0x3e, 0x23, 0x04, 0x19,
+        0xa2, 0xbf, 0x98, 0x85, 0xd6, 0xcb, 0xec, 0xf1,
+        0x13, 0x0e, 0x29, 0x34, 0x67, 0x7a, 0x5d, 0x40,
+        0xfb, 0xe6, 0xc1, 0xdc, 0x8f, 0x92, 0xb5, 0xa8,
+        0xde, 0xc3, 0xe4, 0xf9, 0xaa, 0xb7, 0x90, 0x8d,
+        0x36, 0x2b, 0x0c, 0x11, 0x42, 0x5f, 0x78, 0x65,
+        0x94, 0x89, 0xae, 0xb3, 0xe0, 0xfd, 0xda, 0xc7,
+        0x7c, 0x61, 0x46, 0x5b, 0x08, 0x15, 0x32, 0x2f,
+        0x59, 0x44, 0x63, 0x7e, 0x2d, 0x30, 0x17, 0x0a,
+        0xb1, 0xac, 0x8b, 0x96, 0xc5, 0xd8, 0xff, 0xe2,
+        0x26, 0x3b, 0x1c, 0x01, 0x52, 0x4f, 0x68, 0x75,
+        0xce, 0xd3, 0xf4, 0xe9, 0xba, 0xa7, 0x80, 0x9d,
+        0xeb, 0xf6, 0xd1, 0xcc, 0x9f, 0x82, 0xa5, 0xb8,
+        0x03, 0x1e, 0x39, 0x24, 0x77, 0x6a, 0x4d, 0x50,
+        0xa1, 0xbc, 0x9b, 0x86, 0xd5, 0xc8, 0xef, 0xf2,
+        0x49, 0x54, 0x73, 0x6e, 0x3d, 0x20, 0x07, 0x1a,
+        0x6c, 0x71, 0x56, 0x4b, 0x18, 0x05, 0x22, 0x3f,
+        0x84, 0x99, 0xbe, 0xa3, 0xf0, 0xed, 0xca, 0xd7,
+        0x35, 0x28, 0x0f, 0x12, 0x41, 0x5c, 0x7b, 0x66,
+        0xdd, 0xc0, 0xe7, 0xfa, 0xa9, 0xb4, 0x93, 0x8e,
+        0xf8, 0xe5, 0xc2, 0xdf, 0x8c, 0x91, 0xb6, 0xab,
+        0x10, 0x0d, 0x2a, 0x37, 0x64, 0x79, 0x5e, 0x43,
+        0xb2, 0xaf, 0x88, 0x95, 0xc6, 0xdb, 0xfc, 0xe1,
+        0x5a, 0x47, 0x60, 0x7d, 0x2e, 0x33, 0x14, 0x09,
+        0x7f, 0x62, 0x45, 0x58, 0x0b, 0x16, 0x31, 0x2c,
+        0x97, 0x8a, 0xad, 0xb0, 0xe3, 0xfe, 0xd9, 0xc4,
+};
+
+///
+/// \brief           CRC-8 of a record: its primitive polynomial catches any
+///                  two flipped bits less than 255 bits apart, so the same bit
+///                  flipped in two bytes (as a torn NOR program leaves it) is
+///                  caught anywhere in a record, unlike a plain XOR
+///
+uint8_t crc8(const rec_hdr_t &hdr, const uint8_t *data)
+{
+        uint8_t crc = 0xFF;
+        uint8_t fields[sizeof(hdr.seq) + sizeof(hdr.time)];
+
+        (void) memcpy(fields, &hdr.seq, sizeof(hdr.seq));
+        (void) memcpy(fields + sizeof(hdr.seq), &hdr.time, sizeof(hdr.time));
+
+        crc = CRC8_TABLE[crc ^ hdr.len];
+
+        for (uint8_t b : fields)
+        {
+                crc = CRC8_TABLE[crc ^ b];
+        }
+
+        for (uint8_t i = 0; i < hdr.len; i++)
+        {
+                crc = CRC8_TABLE[crc ^ data[i]];
+        }
+
+        return crc ^ 0xFF;
+}
+
+///
+/// \brief           Moves head to the start of the sector after current,
+///                  erasing it; the unsent records it held are lost
+///
+bool advance(const uint32_t current)
+{
+        uint32_t sector = next_sector(current);
+        rec_hdr_t hdr;
+
+        //
+        // the next sector is the oldest one: if the tail is there
+        // the ring is full
+        //
+        if (unsent > 0 && sector_of(tail) == sector)
+        {
+                uint32_t lost = 0;
+
+                for (uint32_t addr = tail; sector_of(addr) == sector && is_record(addr, hdr);
+                     addr += sizeof(hdr) + hdr.len)
+                {
+                        lost += (hdr.state == REC_LIVE) ? 1 : 0;
+                }
+
+                ESP_LOGW(TAG, "Log full, %u oldest records dropped", lost);
+
+                unsent -= std::min(unsent, lost);
+                tail = next_sector(sector);
+        }
+
+        //
+        // a batch in flight may point into the sector
+        //
+        if (batch_count > 0 && sector_of(batch_addr[0]) == sector)
+        {
+                batch_count = 0;
+        }
+
+        if (!chip->eraseSector(sector))
+        {
+                ESP_LOGE(TAG, "!!! CANNOT ERASE SECTOR 0x%x !!!", sector);
+                return false;
+        }
+
+        head = sector;
+
+        if (unsent == 0)
+        {
+                tail = head;
+        }
+
+        return true;
+}
+
+///
+/// \brief           Rebuilds head, tail and counters by scanning the flash
+///
+bool recover()
+{
+        rec_hdr_t hdr;
+
+        //
+        // the head sector is the one whose first record is the newest
+        //
+        uint32_t head_sector = RING_START;
+        bool empty = true;
+
+        for (uint32_t s = RING_START; s < RING_END; s += SECTOR_SIZE)
+        {
+                if (is_record(s, hdr) && (empty || hdr.seq >= next_seq))
+                {
+                        head_sector = s;
+                        next_seq = hdr.seq + 1;
+                        empty = false;
+                }
+        }
+
+        head = head_sector;
+        tail = head_sector;
+        unsent = 0;
+
+        if (empty)
+        {
+                ESP_LOGI(TAG, "Empty log");
+                next_seq = 0;
+                return chip->eraseSector(head);
+        }
+
+        //
+        // walk to the end of the head sector
+        //
+        while (is_record(head, hdr))
+        {
+                next_seq = hdr.seq + 1;
+                head += sizeof(hdr) + hdr.len;
+        }
+
+        //
+        // walk the ring from the oldest sector (the one after the head)
+        // counting the unsent records
+        //
+        bool found = false;
+        uint32_t s = head_sector;
+
+        for (uint16_t i = 0; i < CONFIG_FLASHLOG_SECTORS; i++)
+        {
+                s = next_sector(s);
+
+                for (uint32_t addr = s; addr != head && sector_of(addr) == s && is_record(addr, hdr);
+                     addr += sizeof(hdr) + hdr.len)
+                {
+                        if (hdr.state != REC_LIVE)
+                        {
+                                continue;
+                        }
+
+                        if (!found)
+                        {
+                                tail = addr;
+                                found = true;
+                        }
+
+                        unsent++;
+                }
+        }
+
+        if (!found)
+        {
+                tail = head;
+        }
+
+        ESP_LOGI(TAG, "Log recovered: %u unsent records, next seq %u", unsent, next_seq);
+
+        //
+        // head must be in an erased area
+        //
+        return (head < head_sector + SECTOR_SIZE) || advance(head_sector);
+}
+
+bool setup(SPIFlash *flash)
+{
+        chip = flash;
+
+        if (chip == nullptr || !chip->begin())
+        {
+                ESP_LOGW(TAG, "No external flash, store-and-forward disabled");
+                chip = nullptr;
+                return false;
+        }
+
+        if (chip->getCapacity() < RING_END)
+        {
+                ESP_LOGE(TAG, "!!! FLASH TOO SMALL FOR THE LOG (%u B) !!!", chip->getCapacity());
+                chip = nullptr;
+                return false;
+        }
+
+        if (!positions_valid)
+        {
+                if (!recover())
+                {
+                        ESP_LOGE(TAG, "!!! COULD NOT RECOVER THE LOG !!!");
+                        chip = nullptr;
+                        return false;
+                }
+
+                positions_valid = true;
+        }
+
+        ESP_LOGD(TAG, "Flash log ready, %u unsent records", unsent);
+
+        return true;
+}
+
+bool available()
+{
+        return chip != nullptr;
+}
+
+uint32_t backlog()
+{
+        return available() ? unsent : 0;
+}
+
+bool append(const uint8_t *data, const uint8_t size, const uint32_t sampled_at)
+{
+        if (!available())
+        {
+                return false;
+        }
+
+        rec_hdr_t hdr = {REC_MAGIC, REC_LIVE, size, 0, next_seq, sampled_at};
+
+        hdr.crc8 = crc8(hdr, data);
+
+        //
+        // not enough room left in this sector: move on to the next one
+        //
+        if (head + sizeof(hdr) + size > sector_of(head) + SECTOR_SIZE && !advance(sector_of(head)))
+        {
+                return false;
+        }
+
+        if (!chip->writeByteArray(head, reinterpret_cast<uint8_t *>(&hdr), sizeof(hdr)) ||
+            !chip->writeByteArray(head + sizeof(hdr), const_cast<uint8_t *>(data), size))
+        {
+                ESP_LOGE(TAG, "!!! CANNOT WRITE RECORD AT 0x%x !!!", head);
+                return false;
+        }
+
+        if (unsent == 0)
+        {
+                tail = head;
+        }
+
+        uint32_t sector = sector_of(head);
+
+        head += sizeof(hdr) + size;
+        next_seq++;
+        unsent++;
+
+        ESP_LOGD(TAG, "Frame logged (%u B), %u unsent", size, unsent);
+
+        //
+        // sector exactly full: head must stay in an erased area
+        //
+        if (head == sector + SECTOR_SIZE)
+        {
+                (void) advance(sector);
+        }
+
+        return true;
+}
+
+///
+/// \brief           Encodes cur against prev (XOR, zero runs as [0][n]);
+///                  prev is nullptr for the first record of a batch
+///
+/// \return          encoded size, or 0 if it doesn't fit in max
+///
+uint16_t encode(const uint8_t *cur, const uint8_t len, const uint8_t *prev, const uint8_t prev_len,
+                uint8_t *out, const uint16_t max)
+{
+        uint16_t n = 0;
+
+        if (max < 1)
+        {
+                return 0;
+        }
+
+        out[n++] = len;
+
+        for (uint16_t i = 0; i < len;)
+        {
+                uint8_t b = cur[i] ^ ((prev != nullptr && i < prev_len) ? prev[i] : 0);
+
+                if (prev != nullptr && b == 0)
+                {
+                        uint8_t run = 0;
+
+                        while (i < len && run < 255 && (cur[i] ^ (i < prev_len ? prev[i] : 0)) == 0)
+                        {
+                                run++;
+                                i++;
+                        }
+
+                        if (n + 2 > max)
+                        {
+                                return 0;
+                        }
+
+                        out[n++] = 0;
+                        out[n++] = run;
+                        continue;
+                }
+
+                if (n + 1 > max)
+                {
+                        return 0;
+                }
+
+                out[n++] = b;
+                i++;
+        }
+
+        return n;
+}
+
+uint8_t fill_batch(uint8_t *buf, const uint8_t max, const uint8_t age_at, uint8_t &emitted)
+{
+        batch_count = 0;
+        emitted = 0;
+
+        if (max <= BATCH_HDR)
+        {
+                return 0;
+        }
+
+        uint8_t prev[UINT8_MAX], cur[UINT8_MAX];
+        uint8_t prev_len = 0;
+        uint16_t size = BATCH_HDR;
+        uint32_t epoch = 0;
+        uint32_t addr = tail;
+        rec_hdr_t hdr;
+
+        while (addr != head && batch_count < sizeof(batch_addr) / sizeof(batch_addr[0]))
+        {
+                if (!is_record(addr, hdr))
+                {
+                        //
+                        // end of the data in this sector
+                        //
+                        addr = (sector_of(addr) == sector_of(head)) ? head : next_sector(addr);
+                        continue;
+                }
+
+                if (hdr.state == REC_LIVE)
+                {
+                        if (!chip->readByteArray(addr + sizeof(hdr), cur, hdr.len) ||
+                            crc8(hdr, cur) != hdr.crc8)
+                        {
+                                //
+                                // unreadable: it'll be marked as sent with the batch
+                                //
+                                ESP_LOGW(TAG, "Corrupted record at 0x%x skipped", addr);
+                        }
+                        else
+                        {
+                                //
+                                // its age after the batch epoch: a few send
+                                // intervals, where the absolute time would take
+                                // 4 bytes in every record
+                                //
+                                bool stamped = hdr.time != 0 && age_at != NO_AGE && age_at + 2 <= hdr.len;
+
+                                if (stamped && epoch == 0)
+                                {
+                                        epoch = hdr.time;
+                                }
+
+                                if (stamped)
+                                {
+                                        uint32_t age = std::min<uint32_t>(hdr.time > epoch ? hdr.time - epoch : 0,
+                                                                          UINT16_MAX);
+
+                                        cur[age_at] = age >> 8;
+                                        cur[age_at + 1] = age & 0xFF;
+                                }
+
+                                //
+                                // the first record emitted goes verbatim, the others
+                                // as a delta against the one before
+                                //
+                                uint16_t n = encode(cur, hdr.len, emitted > 0 ? prev : nullptr,
+                                                    prev_len, buf + size, max - size);
+
+                                //
+                                // batch full, or the record fits a faster data rate
+                                // only: it'll lead the next batch
+                                //
+                                if (n == 0 && (emitted > 0 || BATCH_HDR + 1 + hdr.len <= CONFIG_MAX_PAYLOAD))
+                                {
+                                        break;
+                                }
+
+                                if (n == 0)
+                                {
+                                        //
+                                        // longer than any frame: it would hold the backlog forever
+                                        //
+                                        ESP_LOGW(TAG, "Record at 0x%x too long for any frame, dropped", addr);
+                                }
+                                else
+                                {
+                                        size += n;
+                                        (void) memcpy(prev, cur, hdr.len);
+                                        prev_len = hdr.len;
+                                        emitted++;
+                                }
+                        }
+
+                        batch_addr[batch_count++] = addr;
+                }
+
+                addr = next_record(addr, hdr);
+        }
+
+        batch_end = addr;
+
+        if (emitted == 0)
+        {
+                return 0;
+        }
+
+        buf[0] = epoch >> 24;
+        buf[1] = (epoch >> 16) & 0xFF;
+        buf[2] = (epoch >> 8) & 0xFF;
+        buf[3] = epoch & 0xFF;
+
+        return size;
+}
+
+uint8_t read_batch(uint8_t *buf, const uint8_t max, const uint8_t age_at)
+{
+        if (backlog() == 0)
+        {
+                batch_count = 0;
+                return 0;
+        }
+
+        uint8_t emitted;
+        uint8_t size = fill_batch(buf, max, age_at, emitted);
+
+        //
+        // a batch of corrupted or dropped records only has nothing to
+        // send and nothing to wait an ACK for: retire it here, or the
+        // tail would never move
+        //
+        while (emitted == 0 && batch_count > 0)
+        {
+                commit_batch();
+                size = fill_batch(buf, max, age_at, emitted);
+        }
+
+        ESP_LOGD(TAG, "Batch of %u records (%u skipped), %u B", batch_count, batch_count - emitted, size);
+
+        return size;
+}
+
+void commit_batch()
+{
+        if (batch_count == 0)
+        {
+                return;
+        }
+
+        for (uint8_t i = 0; i < batch_count; i++)
+        {
+                //
+                // 0xFF -> 0x00 needs no erase
+                //
+                (void) chip->writeByte(batch_addr[i] + offsetof(rec_hdr_t, state), REC_SENT, false);
+        }
+
+        unsent -= std::min<uint32_t>(unsent, batch_count);
+        tail = (unsent > 0) ? batch_end : head;
+        batch_count = 0;
+
+        ESP_LOGD(TAG, "Batch committed, %u unsent", unsent);
+}
+
+} // namespace flashlog
@@ -0,0 +1,326 @@
+/*
+ *
+ * Hardware AES module
+ *
+ * PURPOSE: Runs LMIC crypto (MIC, payload encryption, join) on the
+ *          ESP32 AES peripheral
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <Arduino.h>
+
+#include <lmic.h>
+#include <mbedtls/aes.h>
+
+#include "include/util/hwaes.h"
+
+#include "../../../config.h"
+
+static const char *TAG = "HwAES";
+
+//
+// LMIC's own implementation, see -Wl,--wrap=os_aes
+//
+extern "C" u4_t __real_os_aes(u1_t mode, xref2u1_t buf, u2_t len);
+
+namespace hwaes
+{
+
+const uint8_t BLOCK = 16;
+
+/// whether os_aes() runs on the hardware
+bool enabled = false;
+
+/// the key schedule is only redone when LMIC changes AESkey
+mbedtls_aes_context ctx;
+uint8_t key[BLOCK];
+bool key_valid = false;
+
+void encrypt(uint8_t *block)
+{
+
+        if (!key_valid || memcmp(key, AESkey, BLOCK) != 0)
+        {
+                (void) memcpy(key, AESkey, BLOCK);
+                (void) mbedtls_aes_setkey_enc(&ctx, key, 128);
+                key_valid = true;
+        }
+
+        (void) mbedtls_aes_crypt_ecb(&ctx, MBEDTLS_AES_ENCRYPT, block, block);
+}
+
+///
+/// \brief           Doubling in GF(2^128), for the CMAC subkeys
+///
+void dbl(uint8_t *k)
+{
+
+        uint8_t carry = k[0] & 0x80;
+
+        for (uint8_t i = 0; i < BLOCK - 1; i++)
+        {
+                k[i] = (k[i] << 1) | (k[i + 1] >> 7);
+        }
+
+        k[BLOCK - 1] = (k[BLOCK - 1] << 1) ^ (carry ? 0x87 : 0);
+}
+
+///
+/// \brief           RFC 4493 AES-CMAC of aux (one block, may be nullptr)
+///                  followed by buf
+///
+/// \return          the first 4 bytes of the CMAC, MSB first as LMIC wants
+///
+u4_t cmac(const uint8_t *aux, const uint8_t *buf, const uint16_t len)
+{
+
+        uint8_t k[BLOCK] = {0};
+        encrypt(k);
+        dbl(k);
+
+        uint16_t skip = aux != nullptr ? BLOCK : 0;
+        uint16_t total = skip + len;
+        uint16_t blocks = (total == 0) ? 1 : (total + BLOCK - 1) / BLOCK;
+        bool complete = total > 0 && (total % BLOCK) == 0;
+
+        //
+        // K1 for a complete last block, K2 = 2 * K1 for a padded one
+        //
+        if (!complete)
+        {
+                dbl(k);
+        }
+
+        uint8_t x[BLOCK] = {0};
+
+        for (uint16_t b = 0; b < blocks; b++)
+        {
+                bool last = (b == blocks - 1);
+
+                for (uint8_t i = 0; i < BLOCK; i++)
+                {
+                        uint16_t at = b * BLOCK + i;
+                        uint8_t m;
+
+                        if (at < skip)
+                        {
+                                m = aux[at];
+                        }
+                        else if (at < total)
+                        {
+                                m = buf[at - skip];
+                        }
+                        else
+                        {
+                                m = (at == total) ? 0x80 : 0x00;
+                        }
+
+                        x[i] ^= m ^ (last ? k[i] : 0);
+                }
+
+                encrypt(x);
+        }
+
+        return os_rmsbf4(x);
+}
+
+void ctr(uint8_t *buf, const uint16_t len)
+{
+
+        uint8_t counter[BLOCK];
+        (void) memcpy(counter, AESaux, BLOCK);
+
+        for (uint16_t off = 0; off < len; off += BLOCK)
+        {
+                uint8_t s[BLOCK];
+                (void) memcpy(s, counter, BLOCK);
+                encrypt(s);
+
+                for (uint16_t i = 0; i < BLOCK && off + i < len; i++)
+                {
+                        buf[off + i] ^= s[i];
+                }
+
+                //
+                // LMIC's block counter is the last byte of the aux block
+                //
+                counter[BLOCK - 1]++;
+        }
+}
+
+u4_t os_aes(const u1_t mode, uint8_t *buf, const uint16_t len)
+{
+
+        if (mode & AES_MIC)
+        {
+                return cmac((mode & AES_MICNOAUX) ? nullptr : AESaux, buf, len);
+        }
+
+        if (mode & AES_CTR)
+        {
+                ctr(buf, len);
+                return 0;
+        }
+
+        if (mode == AES_ENC)
+        {
+                for (uint16_t off = 0; off + BLOCK <= len; off += BLOCK)
+                {
+                        encrypt(buf + off);
+                }
+
+                return 0;
+        }
+
+        //
+        // decryption isn't used by a LoRaWAN 1.0 device
+        //
+        return __real_os_aes(mode, buf, len);
+}
+
+bool kat()
+{
+
+        //
+        // RFC 4493, section 4
+        //
+        static const uint8_t k[BLOCK] =
+        {
+                0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+                0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c
+        };
+        static const uint8_t m[40] =
+        {
+                0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96,
+                0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+                0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c,
+                0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51,
+                0x30, 0xc8, 0x1c, 0x46, 0xa3, 0x5c, 0xe4, 0x11
+        };
+
+        uint8_t buf[sizeof(m)];
+        (void) memcpy(buf, m, sizeof(m));
+        (void) memcpy(AESkey, k, BLOCK);
+
+        return cmac(nullptr, buf, 0) == 0xbb1d6929 &&
+               cmac(nullptr, buf, 16) == 0x070a16b4 &&
+               cmac(nullptr, buf, 40) == 0xdfa66747;
+}
+
+///
+/// \brief           Loads the test key and aux block: LMIC reloads them
+///                  before every os_aes() call and may scramble them
+///
+void prime(const uint8_t *aux)
+{
+
+        for (uint8_t i = 0; i < BLOCK; i++)
+        {
+                AESkey[i] = i * 13 + 5;
+        }
+
+        (void) memcpy(AESaux, aux, BLOCK);
+}
+
+bool same_as_lmic()
+{
+
+        uint8_t a[48], b[48], aux[BLOCK];
+
+        for (uint8_t i = 0; i < sizeof(a); i++)
+        {
+                a[i] = i * 37 + 11;
+        }
+
+        for (uint8_t i = 0; i < BLOCK; i++)
+        {
+                aux[i] = i * 7 + 3;
+        }
+
+        //
+        // uplink/downlink MIC and FRMPayload lengths, join messages
+        //
+        static const uint8_t lens[] = {1, 7, 15, 16, 17, 23, 32, 33, 48};
+
+        for (const uint8_t len : lens)
+        {
+                static const u1_t modes[] = {AES_MIC, AES_MIC | AES_MICNOAUX, AES_CTR, AES_ENC};
+
+                for (const u1_t mode : modes)
+                {
+                        if (mode == AES_ENC && len % BLOCK != 0)
+                        {
+                                continue;
+                        }
+
+                        (void) memcpy(b, a, sizeof(a));
+
+                        prime(aux);
+                        u4_t hw = os_aes(mode, a, len);
+                        prime(aux);
+                        u4_t sw = __real_os_aes(mode, b, len);
+
+                        if (hw != sw || memcmp(a, b, len) != 0)
+                        {
+                                ESP_LOGE(TAG, "Mode 0x%02x, %u B: hardware and software AES differ", mode, len);
+                                return false;
+                        }
+                }
+        }
+
+        return true;
+}
+
+bool setup()
+{
+
+#if CONFIG_LMIC_HW_AES
+
+        mbedtls_aes_init(&ctx);
+
+        enabled = kat() && same_as_lmic();
+
+        if (enabled)
+        {
+                ESP_LOGI(TAG, "LMIC crypto on the AES peripheral");
+        }
+        else
+        {
+                ESP_LOGE(TAG, "!!! HARDWARE AES SELF TEST FAILED, USING SOFTWARE AES !!!");
+        }
+
+#endif
+
+        return enabled;
+}
+
+} // namespace hwaes
+
+extern "C" u4_t __wrap_os_aes(u1_t mode, xref2u1_t buf, u2_t len)
+{
+
+        if (hwaes::enabled)
+        {
+                return hwaes::os_aes(mode, buf, len);
+        }
+
+        return __real_os_aes(mode, buf, len);
+}
@@ -0,0 +1,173 @@
+/*
+ *
+ * Link quality module
+ *
+ * PURPOSE: Keeps SNR and RSSI of the last downlinks and tells how much
+ *          margin each spreading factor would have
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <Arduino.h>
+
+#include <algorithm>
+
+#include "include/util/linkq.h"
+
+#include "../../../config.h"
+
+static const char *TAG = "LinkQ";
+
+namespace linkq
+{
+
+/// \struct one downlink
+typedef struct
+{
+        int8_t  snr_q4;        ///< SNR, quarters of dB
+        int16_t rssi;          ///< RSSI, dBm
+} sample_t;
+
+/// the history, kept across deep sleep
+RTC_DATA_ATTR sample_t history[HISTORY];
+
+/// next slot to write
+RTC_DATA_ATTR uint8_t next = 0;
+
+/// number of valid slots
+RTC_DATA_ATTR uint8_t count = 0;
+
+void record(const int8_t snr_q4, const int16_t rssi)
+{
+
+        history[next] = {snr_q4, rssi};
+        next = (next + 1) % HISTORY;
+        count = std::min<uint8_t>(count + 1, HISTORY);
+
+        ESP_LOGD(TAG, "Downlink SNR %.2f dB, RSSI %d dBm", snr_q4 / 4.0, rssi);
+}
+
+uint8_t samples()
+{
+
+        return count;
+}
+
+float mean_snr()
+{
+
+        if (count == 0)
+        {
+                return 0;
+        }
+
+        int32_t sum = 0;
+
+        for (uint8_t i = 0; i < count; i++)
+        {
+                sum += history[i].snr_q4;
+        }
+
+        return sum / (4.0f * count);
+}
+
+float min_snr()
+{
+
+        if (count == 0)
+        {
+                return 0;
+        }
+
+        int8_t worst = INT8_MAX;
+
+        for (uint8_t i = 0; i < count; i++)
+        {
+                worst = std::min(worst, history[i].snr_q4);
+        }
+
+        return worst / 4.0f;
+}
+
+float mean_rssi()
+{
+
+        if (count == 0)
+        {
+                return 0;
+        }
+
+        int32_t sum = 0;
+
+        for (uint8_t i = 0; i < count; i++)
+        {
+                sum += history[i].rssi;
+        }
+
+        return static_cast<float>(sum) / count;
+}
+
+float required_snr(const uint8_t sf)
+{
+
+        //
+        // SX1276 datasheet, table 13: -7.5 dB at SF7, 2.5 dB less per SF
+        //
+        return -7.5f - 2.5f * (std::min<uint8_t>(std::max<uint8_t>(sf, 7), 12) - 7);
+}
+
+float margin(const uint8_t sf)
+{
+
+        return mean_snr() - required_snr(sf);
+}
+
+uint8_t best_sf(const float margin_db)
+{
+
+        if (count == 0)
+        {
+                return 0;
+        }
+
+        for (uint8_t sf = 7; sf < 12; sf++)
+        {
+                if (margin(sf) >= margin_db)
+                {
+                        return sf;
+                }
+        }
+
+        return 12;
+}
+
+void dump()
+{
+
+        if (count == 0)
+        {
+                return;
+        }
+
+        ESP_LOGI(TAG, "%u downlinks: SNR %.1f dB mean, %.1f dB worst, RSSI %.0f dBm mean",
+                 count, mean_snr(), min_snr(), mean_rssi());
+}
+
+} // namespace linkq
@@ -32,14 +32,18 @@
 
 #include "include/util/packer.h"
 #include "include/util/panic.h"
+#include "include/util/timesync.h"
+#include "include/util/trace.h"
 
 #include "include/sensors/BME680.h"
 #include "include/sensors/GPS.h"
 #include "include/sensors/LPPYRA03AV.h"
 #include "include/sensors/SEN0170.h"
 #include "include/sensors/SPS30.h"
+#include "include/sensors/ULPADC.h"
 
 #include "include/pwr/AXP192.h"
+#include "include/pwr/sleep.h"
 
 #include "../../../config.h"
 
@@ -60,6 +64,9 @@ RTC_DATA_ATTR float altitude;
 /// the encoded message payload
 CayenneLPP Payload(CONFIG_MAX_PAYLOAD);
 
+/// Unix time of the payload's sample, 0 if the clock wasn't set
+uint32_t sampled_at = 0;
+
 bool isValid(float temperature, float pressure, float gas, float humidity);
 
 #define CAYENNE_UNK_TYPE "ERROR: CayenneLPP unknown type for %s"
@@ -75,6 +82,11 @@ uint8_t get_buffer_size()
         return Payload.getSize();
 }
 
+uint32_t get_sampled_at()
+{
+        return sampled_at;
+}
+
 void checkErr(const char *typestr)
 {
 
@@ -98,11 +110,32 @@ void checkErr(const char *typestr)
 
 void read_n_pack(bool gps_too, bool bme680_too, bool sps30_too, bool pyra_too, bool wind_too)
 {
+        trace::begin(trace::PH_SAMPLE);
+
         //
         // clear payload
         //
         Payload.reset();
 
+        //===================================================
+        //                      Time
+        //===================================================
+
+        //
+        // once the clock is set, the frame says how old its sample is, so
+        // frames that reach the backend late (queued, or backfilled from
+        // flash) keep their time. Only a place for it here: the age goes
+        // in when the frame goes to the radio (or into a flash batch),
+        // 2 bytes where an absolute time would take 4
+        //
+        sampled_at = timesync::now();
+
+        if (sampled_at != 0)
+        {
+                (void)Payload.addLuminosity(CONFIG_CHAN_TIMESTAMP, 0);
+                checkErr("timestamp");
+        }
+
         //===================================================
         //                      GPS
         //===================================================
@@ -124,7 +157,7 @@ void read_n_pack(bool gps_too, bool bme680_too, bool sps30_too, bool pyra_too, b
                         longitude = gps::get_longitude();
                         altitude = gps::get_altitude();
 
-                        delay(1000);
+                        lightsleep::wait(1000);
                 }
         }
 
@@ -147,14 +180,39 @@ void read_n_pack(bool gps_too, bool bme680_too, bool sps30_too, bool pyra_too, b
         //                      SEN0170
         //===================================================
 
+        //
+        // the ULP sampled the analog sensors during the sleep: stop it
+        // before reading its statistics (or before polling the ADC)
+        //
+        ulpadc::stop();
+
+        ulpadc::stats_t stats;
+
         if (wind_too)
         {
 
-                float windspeed = sen0170::get_windspeed();
+                //
+                // mean and gust over the whole sleep, or a few seconds of
+                // polling when there are no ULP statistics (cold boot)
+                //
+                bool sampled = ulpadc::get(ulpadc::CH_SEN0170, stats);
+
+                float windspeed = sampled ? sen0170::from_raw(stats.mean) : sen0170::get_windspeed();
 
                 ESP_LOGI(TAG, "Anemometer:");
                 ESP_LOGI(TAG, "    Wind speed: %.2f m/s", windspeed);
 
+                if (sampled)
+                {
+
+                        float gust = sen0170::from_raw(stats.max);
+
+                        ESP_LOGI(TAG, "    Gust:       %.2f m/s (%u samples)", gust, (unsigned)stats.count);
+
+                        (void)Payload.addGenericSensor(CONFIG_CHAN_SEN0170_GUST, gust);
+                        checkErr("gust");
+                }
+
                 //
                 // add wind speed to payload
                 //
@@ -177,7 +235,8 @@ void read_n_pack(bool gps_too, bool bme680_too, bool sps30_too, bool pyra_too, b
                 // get irradiance and show it
                 //
 
-                float irradiance = lppyra03av::get_irradiance();
+                float irradiance = ulpadc::get(ulpadc::CH_LPPYRA03AV, stats) ?
+                                   lppyra03av::from_raw(stats.mean) : lppyra03av::get_irradiance();
 
                 ESP_LOGI(TAG, "Pyranometer:");
                 ESP_LOGI(TAG, "    %.2f W/m^2", irradiance);
@@ -346,6 +405,8 @@ void read_n_pack(bool gps_too, bool bme680_too, bool sps30_too, bool pyra_too, b
 
         // show payload size
         ESP_LOGD(TAG, "--- Payload size: %u B", Payload.getSize());
+
+        trace::end(trace::PH_SAMPLE);
 }
 
 } // namespace packer
\ No newline at end of file
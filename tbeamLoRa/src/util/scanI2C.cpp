@@ -26,6 +26,8 @@
 
 #include <Wire.h>
 
+#include "include/util/scanI2C.h"
+
 #include "../../../config.h"
 
 static const char *TAG = "scanI2C";
@@ -33,11 +35,72 @@ static const char *TAG = "scanI2C";
 namespace i2c
 {
 
+/// \brief devices remembered
+const uint8_t INVENTORY_MAX = 8;
+
+/// addresses found by the last scan, kept across deep sleep
+RTC_DATA_ATTR uint8_t inventory[INVENTORY_MAX];
+
+/// number of addresses in the inventory
+RTC_DATA_ATTR uint8_t inventory_size = 0;
+
+/// whether the inventory comes from a complete scan
+RTC_DATA_ATTR bool inventory_valid = false;
+
+bool probe(const uint8_t addr)
+{
+
+        Wire.beginTransmission(addr);
+
+        return Wire.endTransmission() == I2C_ERROR_OK;
+}
+
+bool verify()
+{
+
+        if (!inventory_valid)
+        {
+                return false;
+        }
+
+        for (uint8_t i = 0; i < inventory_size; i++)
+        {
+
+                if (!i2c::probe(inventory[i]))
+                {
+
+                        ESP_LOGW(TAG, "I2C device at 0x%x is gone", inventory[i]);
+                        return false;
+                }
+        }
+
+        ESP_LOGI(TAG, "%u I2C devices verified", inventory_size);
+
+        return true;
+}
+
+bool present(const uint8_t addr)
+{
+
+        for (uint8_t i = 0; i < inventory_size; i++)
+        {
+
+                if (inventory[i] == addr)
+                {
+                        return true;
+                }
+        }
+
+        return false;
+}
+
 void scan()
 {
 
         int nDevices = 0;
 
+        inventory_size = 0;
+
         //
         // scan the whole I2C address space
         //
@@ -59,6 +122,11 @@ void scan()
 
                         nDevices++;
 
+                        if (inventory_size < INVENTORY_MAX)
+                        {
+                                inventory[inventory_size++] = addr;
+                        }
+
                         //
                         // check if it is a supported device
                         //
@@ -96,6 +164,8 @@ void scan()
                 }
         }
 
+        inventory_valid = true;
+
         if (nDevices == 0)
         {
 
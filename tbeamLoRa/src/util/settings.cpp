@@ -0,0 +1,200 @@
+/*
+ *
+ * Settings module
+ *
+ * PURPOSE: Runtime sampling and reporting parameters, kept in NVS and
+ *          updated by downlink commands
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <Arduino.h>
+#include <Preferences.h>
+
+#include <algorithm>
+
+#include "include/util/settings.h"
+
+#include "../../../config.h"
+
+static const char *TAG = "Settings";
+
+namespace settings
+{
+
+/// shortest send interval a command can set, in s
+const uint16_t MIN_INTERVAL_S = 30;
+
+/// most flash log batches per wake a command can set
+const uint8_t MAX_BACKFILL_BATCHES = 16;
+
+/// the settings, kept across deep sleep
+RTC_DATA_ATTR settings_t current;
+
+/// whether current has been loaded since the last cold boot
+RTC_DATA_ATTR bool loaded = false;
+
+settings_t defaults()
+{
+
+        settings_t d;
+
+        d.send_interval = CONFIG_SEND_INTERVAL;
+        d.sensors = SENSOR_BME680 | SENSOR_SPS30;
+#if CONFIG_HAS_LPPYRA03AV
+        d.sensors |= SENSOR_LPPYRA03AV;
+#endif
+#if CONFIG_HAS_SEN0170
+        d.sensors |= SENSOR_SEN0170;
+#endif
+        d.confirm_every = CONFIG_LORA_CONFIRM_EVERY;
+#if CONFIG_STORE_AND_FORWARD
+        d.backfill_batches = CONFIG_FLASHLOG_BATCHES_PER_WAKE;
+#else
+        d.backfill_batches = 0;
+#endif
+
+        return d;
+}
+
+void save()
+{
+
+        Preferences p;
+
+        if (p.begin("settings", false))
+        {
+                if (p.putBytes("cfg", &current, sizeof(current)) != sizeof(current))
+                {
+                        ESP_LOGE(TAG, "!!! CANNOT SAVE SETTINGS !!!");
+                }
+
+                p.end();
+        }
+}
+
+void setup()
+{
+
+        if (loaded)
+        {
+                return;
+        }
+
+        current = defaults();
+
+        //
+        // a blob of another size was written by another firmware: ignore it;
+        // one of the same size may still enable sensors this build lacks
+        //
+        Preferences p;
+
+        if (p.begin("settings", true))
+        {
+                settings_t s;
+
+                if (p.getBytesLength("cfg") == sizeof(s) && p.getBytes("cfg", &s, sizeof(s)) == sizeof(s))
+                {
+                        current = s;
+                        current.sensors &= defaults().sensors;
+                        ESP_LOGI(TAG, "Settings loaded from NVS");
+                }
+
+                p.end();
+        }
+
+        loaded = true;
+
+        ESP_LOGD(TAG, "Send interval %u ms, sensors 0x%02x, ACK every %u, %u backfill batches",
+                 current.send_interval, current.sensors, current.confirm_every, current.backfill_batches);
+}
+
+const settings_t &get()
+{
+
+        return current;
+}
+
+bool enabled(const sensor_t sensor)
+{
+
+        return (current.sensors & sensor) != 0;
+}
+
+bool apply(const uint8_t *data, const uint8_t size)
+{
+
+        settings_t s = current;
+        uint8_t i = 0;
+
+        while (i < size)
+        {
+                uint8_t cmd = data[i++];
+                uint8_t left = size - i;
+
+                if (cmd == CMD_SEND_INTERVAL && left >= 2)
+                {
+                        uint16_t secs = (data[i] << 8) | data[i + 1];
+                        s.send_interval = std::max(secs, MIN_INTERVAL_S) * 1000UL;
+                        i += 2;
+                }
+                else if (cmd == CMD_SENSORS && left >= 1)
+                {
+                        //
+                        // a sensor this build lacks would be read from a
+                        // floating pin: only the built ones can be enabled
+                        //
+                        s.sensors = data[i++] & defaults().sensors;
+                }
+                else if (cmd == CMD_CONFIRM_EVERY && left >= 1)
+                {
+                        s.confirm_every = std::max<uint8_t>(data[i++], 1);
+                }
+                else if (cmd == CMD_BACKFILL_BATCHES && left >= 1)
+                {
+                        s.backfill_batches = std::min(data[i++], MAX_BACKFILL_BATCHES);
+                }
+                else if (cmd == CMD_DEFAULTS)
+                {
+                        s = defaults();
+                }
+                else
+                {
+                        ESP_LOGW(TAG, "Bad command 0x%02x at byte %u, rest of the downlink ignored", cmd, i - 1);
+                        break;
+                }
+        }
+
+        if (s.send_interval == current.send_interval && s.sensors == current.sensors &&
+            s.confirm_every == current.confirm_every && s.backfill_batches == current.backfill_batches)
+        {
+                return false;
+        }
+
+        current = s;
+        save();
+
+        ESP_LOGI(TAG, "New settings: send interval %u ms, sensors 0x%02x, ACK every %u, %u backfill batches",
+                 current.send_interval, current.sensors, current.confirm_every, current.backfill_batches);
+
+        return true;
+}
+
+} // namespace settings
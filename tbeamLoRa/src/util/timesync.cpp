@@ -0,0 +1,138 @@
+/*
+ *
+ * Time sync module
+ *
+ * PURPOSE: Keeps the wall clock, set from the network (DeviceTimeReq) or
+ *          the GPS, across deep sleep and corrects its drift
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <Arduino.h>
+#include <sys/time.h>
+
+#include <algorithm>
+
+#include "include/util/timesync.h"
+
+#include "../../../config.h"
+
+static const char *TAG = "Time";
+
+namespace timesync
+{
+
+/// \brief drift rates beyond this are a wrong sync, not a slow clock
+const int32_t MAX_DRIFT_PPM = 20000;
+
+/// \brief syncs closer than this don't measure the drift well enough
+const uint32_t MIN_DRIFT_SPAN_S = 3600;
+
+/// where the last sync came from, SRC_NONE until the first one
+RTC_DATA_ATTR uint8_t source = SRC_NONE;
+
+/// local time of the last sync, seconds since the Unix epoch
+RTC_DATA_ATTR uint32_t synced_at = 0;
+
+/// measured drift of the local clock, ppm (positive: it runs slow)
+RTC_DATA_ATTR int32_t drift_ppm = 0;
+
+uint64_t local_ms()
+{
+
+        struct timeval tv;
+
+        (void)gettimeofday(&tv, nullptr);
+
+        return (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+void set(const uint64_t unix_ms, const source_t src)
+{
+
+        uint64_t local = local_ms();
+        int64_t error_ms = (int64_t)(unix_ms - local);
+
+        //
+        // with a previous sync far enough in the past, the error we
+        // see now is the drift accumulated since then
+        //
+        if (source != SRC_NONE && local / 1000 > synced_at + MIN_DRIFT_SPAN_S)
+        {
+
+                int64_t span_ms = (int64_t)(local - (uint64_t)synced_at * 1000);
+                int64_t ppm = error_ms * 1000000 / span_ms;
+
+                drift_ppm = (int32_t)std::max<int64_t>(-MAX_DRIFT_PPM, std::min<int64_t>(ppm, MAX_DRIFT_PPM));
+        }
+
+        struct timeval tv;
+        tv.tv_sec = unix_ms / 1000;
+        tv.tv_usec = (unix_ms % 1000) * 1000;
+
+        (void)settimeofday(&tv, nullptr);
+
+        synced_at = tv.tv_sec;
+        source = src;
+
+        ESP_LOGI(TAG, "Clock set from %s, error %lld ms, drift %d ppm",
+                 src == SRC_GPS ? "GPS" : "network", (long long)error_ms, (int)drift_ppm);
+}
+
+bool valid()
+{
+
+        return source != SRC_NONE;
+}
+
+bool due()
+{
+
+        return !valid() || local_ms() / 1000 > synced_at + (uint32_t)CONFIG_TIME_SYNC_HOURS * 3600;
+}
+
+uint32_t now()
+{
+
+        if (!valid())
+        {
+                return 0;
+        }
+
+        uint32_t local = local_ms() / 1000;
+        int64_t elapsed = (int64_t)local - synced_at;
+
+        return local + (int32_t)(elapsed * drift_ppm / 1000000);
+}
+
+void dump()
+{
+
+        if (!valid())
+        {
+                ESP_LOGI(TAG, "Clock not set");
+                return;
+        }
+
+        ESP_LOGI(TAG, "Clock %u, from %s %u s ago, drift %d ppm", (unsigned)now(),
+                 source == SRC_GPS ? "GPS" : "network", (unsigned)(local_ms() / 1000 - synced_at), (int)drift_ppm);
+}
+
+} // namespace timesync
@@ -0,0 +1,169 @@
+/*
+ *
+ * Trace module
+ *
+ * PURPOSE: Times the phases of the wake cycle and keeps their statistics
+ *          across deep sleep, for the serial log and a health uplink
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <Arduino.h>
+#include <esp_timer.h>
+
+#include <algorithm>
+
+#include "include/util/trace.h"
+
+#include "../../../config.h"
+
+static const char *TAG = "Trace";
+
+namespace trace
+{
+
+/// \brief phase names, for the log
+const char *const NAMES[PHASES] = {"boot", "setup", "sample", "radio", "sleep", "awake"};
+
+/// \struct one timed phase
+typedef struct
+{
+        uint8_t  phase;
+        uint32_t us;
+} event_t;
+
+/// \struct statistics of a phase
+typedef struct
+{
+        uint32_t count;
+        uint32_t min_us;
+        uint32_t max_us;
+        uint64_t sum_us;
+} stats_t;
+
+/// the last phases timed, kept across deep sleep
+RTC_DATA_ATTR event_t history[HISTORY];
+
+/// next slot to write
+RTC_DATA_ATTR uint8_t next = 0;
+
+/// number of valid slots
+RTC_DATA_ATTR uint8_t count = 0;
+
+/// statistics since cold boot
+RTC_DATA_ATTR stats_t stats[PHASES];
+
+/// start of each phase in this wake, esp_timer time (0 is the reset)
+int64_t started[PHASES] = {0};
+
+/// phases begun and not ended yet; boot and awake are open from reset
+bool in_phase[PHASES] = {true, false, false, false, false, true};
+
+void begin(const phase_t phase)
+{
+
+        started[phase] = esp_timer_get_time();
+        in_phase[phase] = true;
+}
+
+void end(const phase_t phase)
+{
+
+        if (!in_phase[phase])
+        {
+                return;
+        }
+
+        in_phase[phase] = false;
+
+        uint32_t us = (uint32_t)(esp_timer_get_time() - started[phase]);
+        stats_t &s = stats[phase];
+
+        s.min_us = s.count == 0 ? us : std::min(s.min_us, us);
+        s.max_us = std::max(s.max_us, us);
+        s.sum_us += us;
+        s.count++;
+
+        history[next] = {(uint8_t)phase, us};
+        next = (next + 1) % HISTORY;
+        count = std::min<uint8_t>(count + 1, HISTORY);
+}
+
+void dump()
+{
+
+        for (uint8_t p = 0; p < PHASES; p++)
+        {
+
+                const stats_t &s = stats[p];
+
+                if (s.count == 0)
+                {
+                        continue;
+                }
+
+                ESP_LOGI(TAG, "%-6s %u times: min %.1f ms, avg %.1f ms, max %.1f ms", NAMES[p],
+                         (unsigned)s.count, s.min_us / 1000.0, (double)s.sum_us / s.count / 1000.0, s.max_us / 1000.0);
+        }
+
+        //
+        // oldest first
+        //
+        for (uint8_t i = 0; i < count; i++)
+        {
+
+                const event_t &e = history[(next + HISTORY - count + i) % HISTORY];
+
+                ESP_LOGD(TAG, "    %-6s %.1f ms", NAMES[e.phase], e.us / 1000.0);
+        }
+}
+
+void put_u16(uint8_t *buf, const uint32_t value)
+{
+
+        uint16_t v = (uint16_t)std::min<uint32_t>(value, UINT16_MAX);
+
+        buf[0] = v >> 8;
+        buf[1] = v & 0xFF;
+}
+
+uint8_t summary(uint8_t *buf, const uint8_t max)
+{
+
+        if (max < SUMMARY_SIZE)
+        {
+                return 0;
+        }
+
+        put_u16(buf, stats[PH_AWAKE].count);
+
+        for (uint8_t p = 0; p < PHASES; p++)
+        {
+
+                const stats_t &s = stats[p];
+
+                put_u16(buf + 2 + p * 4, s.count == 0 ? 0 : s.sum_us / s.count / 1000);
+                put_u16(buf + 4 + p * 4, s.max_us / 1000);
+        }
+
+        return SUMMARY_SIZE;
+}
+
+} // namespace trace
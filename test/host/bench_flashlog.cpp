@@ -0,0 +1,130 @@
+/*
+ *
+ * Flash log benchmark
+ *
+ * PURPOSE: Append and backfill throughput of the store-and-forward log on
+ *          the emulated flash. items_per_second is the host CPU side; the
+ *          flash_ms_per_record counter is the modeled chip busy time, which
+ *          is what bounds the node (sector erases dominate)
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "include/util/flashlog.h"
+
+#include "../../config.h"
+
+namespace flashlog
+{
+extern bool positions_valid;
+}
+
+namespace
+{
+
+const uint8_t RECORD = 24;
+
+void fill(uint8_t *f, const uint32_t n)
+{
+        for (uint8_t i = 0; i < RECORD; i++)
+        {
+                f[i] = static_cast<uint8_t>((i % 3 == 0) ? i : (n * (i + 1) / 7));
+        }
+}
+
+void start(SPIFlash &chip)
+{
+        flashlog::positions_valid = false;
+        (void) flashlog::setup(&chip);
+        chip.reset_stats();
+}
+
+void report(benchmark::State &state, const uint64_t busy_us, const uint64_t records)
+{
+        state.SetItemsProcessed(static_cast<int64_t>(records));
+        state.counters["flash_ms_per_record"] = records > 0 ? busy_us / 1000.0 / records : 0;
+}
+
+/// steady state: the ring is full and every new sector costs an erase
+void BM_Append(benchmark::State &state)
+{
+        SPIFlash chip;
+        uint8_t f[RECORD];
+        uint32_t n = 0;
+
+        start(chip);
+
+        for (auto _ : state)
+        {
+                fill(f, n++);
+                benchmark::DoNotOptimize(flashlog::append(f, RECORD));
+        }
+
+        report(state, chip.stats.busy_us, n);
+        state.counters["erases"] = chip.stats.erases;
+}
+BENCHMARK(BM_Append);
+
+/// backfill at a given frame size (36 B: SF12 in EU868; 100 B: SF9; 200 B: SF7)
+void BM_Backfill(benchmark::State &state)
+{
+        SPIFlash chip;
+        uint8_t f[RECORD], buf[CONFIG_MAX_PAYLOAD];
+        uint8_t max = static_cast<uint8_t>(state.range(0));
+        uint64_t records = 0, bytes = 0, batches = 0, busy_us = 0;
+
+        start(chip);
+
+        for (auto _ : state)
+        {
+                state.PauseTiming();
+
+                for (uint32_t n = 0; n < 256; n++)
+                {
+                        fill(f, n);
+                        (void) flashlog::append(f, RECORD);
+                }
+
+                chip.reset_stats();
+                state.ResumeTiming();
+
+                while (flashlog::backlog() > 0)
+                {
+                        uint32_t before = flashlog::backlog();
+                        bytes += flashlog::read_batch(buf, max);
+                        flashlog::commit_batch();
+                        records += before - flashlog::backlog();
+                        batches++;
+                }
+
+                busy_us += chip.stats.busy_us;
+        }
+
+        report(state, busy_us, records);
+        state.counters["records_per_frame"] = batches > 0 ? static_cast<double>(records) / batches : 0;
+        state.counters["bytes_per_record"] = records > 0 ? static_cast<double>(bytes) / records : 0;
+}
+BENCHMARK(BM_Backfill)->ArgName("max")->Arg(36)->Arg(100)->Arg(200);
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,257 @@
+/*
+ *
+ * WAN simulation benchmark
+ *
+ * PURPOSE: Join, resume and send flows of the WAN module on the LMIC
+ *          stand-in, against the network server stand-in. The timings
+ *          are the host's cost of simulating them; the counters are what
+ *          the board would see, per flow: time on air, time the radio
+ *          listens, frames each way and wake-to-sleep time (board time,
+ *          waits included)
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <benchmark/benchmark.h>
+#include <memory>
+#include <vector>
+
+#include <Arduino.h>
+#include <lmic.h>
+#include <lmic/sim.h>
+
+#include "include/WAN.h"
+
+#include "board.h"
+
+namespace
+{
+
+/// between two wakes of the resume flow, ms
+const uint64_t SLEEP_MS = 600000;
+
+const uint8_t PAYLOAD = 20;
+
+void ignore(uint8_t ev)
+{
+        (void) ev;
+}
+
+/// \struct what a flow cost the board
+struct cost_t
+{
+        uint64_t airtime_us = 0;
+        uint64_t rx_us = 0;
+        uint64_t uplinks = 0;
+        uint64_t downlinks = 0;
+        uint64_t board_ms = 0;
+};
+
+/// radio counters since the last call
+cost_t take()
+{
+        cost_t c;
+
+        c.airtime_us = sim::radio.tx_us;
+        c.rx_us = sim::radio.rx_us;
+        c.uplinks = sim::radio.tx;
+        c.downlinks = sim::radio.rx;
+        sim::radio = {};
+
+        return c;
+}
+
+void add(cost_t &sum, const cost_t &c)
+{
+        sum.airtime_us += c.airtime_us;
+        sum.rx_us += c.rx_us;
+        sum.uplinks += c.uplinks;
+        sum.downlinks += c.downlinks;
+        sum.board_ms += c.board_ms;
+}
+
+void report(benchmark::State &state, const cost_t &sum, const char *board_counter)
+{
+        double n = static_cast<double>(state.iterations());
+
+        state.counters["airtime_ms"] = sum.airtime_us / 1000.0 / n;
+        state.counters["rx_ms"] = sum.rx_us / 1000.0 / n;
+        state.counters["uplinks"] = sum.uplinks / n;
+        state.counters["downlinks"] = sum.downlinks / n;
+        state.counters[board_counter] = sum.board_ms / n;
+}
+
+std::unique_ptr<sim::pipe_t> start_server()
+{
+        std::unique_ptr<sim::pipe_t> server(new sim::pipe_t(NETSERVER));
+
+        sim::attach(server.get());
+
+        return server;
+}
+
+bool send(const bool confirmed)
+{
+        std::vector<uint8_t> data(PAYLOAD, 0x5a);
+
+        wan::send(data.data(), PAYLOAD, 1, confirmed);
+
+        return board::run();
+}
+
+/// cold board, no session: OTAA join until the MAC is idle
+void BM_Join(benchmark::State &state)
+{
+        cost_t sum;
+
+        wan::regist(ignore);
+
+        for (auto _ : state)
+        {
+                //
+                // a fresh server each time: it refuses DevNonces it saw
+                //
+                state.PauseTiming();
+                board::power_on();
+                std::unique_ptr<sim::pipe_t> server = start_server();
+                state.ResumeTiming();
+
+                if (!board::boot(ESP_SLEEP_WAKEUP_UNDEFINED) || !board::run() || !wan::is_joined())
+                {
+                        state.SkipWithError("join failed");
+                        break;
+                }
+
+                wan::save_session(SLEEP_MS);
+
+                cost_t c = take();
+                c.board_ms = wan::stats().awake_ms_last;
+                add(sum, c);
+
+                state.PauseTiming();
+                sim::attach(nullptr);
+                server.reset();
+                state.ResumeTiming();
+        }
+
+        report(state, sum, "wake_to_sleep_ms");
+}
+BENCHMARK(BM_Join)->Unit(benchmark::kMicrosecond);
+
+/// deep sleep wake: resume the session, send a frame, sleep again
+void BM_Resume(benchmark::State &state)
+{
+        bool confirmed = state.range(0) != 0;
+        cost_t sum;
+
+        wan::regist(ignore);
+        board::power_on();
+        std::unique_ptr<sim::pipe_t> server = start_server();
+
+        if (!board::boot(ESP_SLEEP_WAKEUP_UNDEFINED) || !board::run() || !send(false) ||
+            !board::deep_sleep(SLEEP_MS))
+        {
+                state.SkipWithError("join failed");
+                return;
+        }
+
+        (void) take();
+
+        for (auto _ : state)
+        {
+                if (!send(confirmed) || !board::deep_sleep(SLEEP_MS))
+                {
+                        state.SkipWithError("send failed");
+                        break;
+                }
+
+                //
+                // deep_sleep() saved the wake that just ended
+                //
+                cost_t c = take();
+                c.board_ms = wan::stats().awake_ms_last;
+                add(sum, c);
+        }
+
+        report(state, sum, "wake_to_sleep_ms");
+        state.counters["resumes"] = wan::stats().resumes;
+
+        sim::attach(nullptr);
+}
+BENCHMARK(BM_Resume)->ArgName("confirmed")->Arg(0)->Arg(1)->Unit(benchmark::kMicrosecond);
+
+/// awake and joined: one frame, from send() until LMIC is idle
+void BM_Send(benchmark::State &state)
+{
+        bool confirmed = state.range(0) != 0;
+        dr_t dr = static_cast<dr_t>(state.range(1));
+        cost_t sum;
+
+        wan::regist(ignore);
+        board::power_on();
+        std::unique_ptr<sim::pipe_t> server = start_server();
+
+        if (!board::boot(ESP_SLEEP_WAKEUP_UNDEFINED) || !board::run())
+        {
+                state.SkipWithError("join failed");
+                return;
+        }
+
+        (void) take();
+
+        for (auto _ : state)
+        {
+                //
+                // unconfirmed frames get no downlink: after a while the
+                // link check steps the DR down, put it back
+                //
+                wan::set_spreading_factor(dr);
+
+                uint64_t from = host_rtc_us();
+
+                if (!send(confirmed))
+                {
+                        state.SkipWithError("send failed");
+                        break;
+                }
+
+                cost_t c = take();
+                c.board_ms = (host_rtc_us() - from) / 1000;
+                add(sum, c);
+        }
+
+        //
+        // board time includes the wait for the duty cycle band
+        //
+        report(state, sum, "send_to_idle_ms");
+
+        sim::attach(nullptr);
+}
+BENCHMARK(BM_Send)
+    ->ArgNames({"confirmed", "dr"})
+    ->Args({0, DR_SF7})
+    ->Args({1, DR_SF7})
+    ->Args({0, DR_SF12})
+    ->Args({1, DR_SF12})
+    ->Unit(benchmark::kMicrosecond);
+
+} // namespace
+
+BENCHMARK_MAIN();
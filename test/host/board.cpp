@@ -0,0 +1,176 @@
+/*
+ *
+ * Simulated board
+ *
+ * PURPOSE: Host builds only: power cycles, deep sleeps and the main loop
+ *          of the simulated board, see board.h
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "board.h"
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <lmic.h>
+#include <lmic/sim.h>
+
+#include "include/WAN.h"
+#include "include/pwr/sleep.h"
+
+/// set by os_runloop_once() through hal_sleep() when it found nothing to run
+extern volatile bool lmic_idle;
+
+//
+// RTC memory of the modules under test
+//
+namespace wan
+{
+extern uint32_t count;
+extern bool count_valid;
+extern uint32_t count_persisted;
+extern uint32_t frames_since_confirm;
+extern uint8_t confirm_failures;
+extern stats_t counters;
+extern bool rtc_lmic_valid;
+extern uint32_t clock_error;
+}
+
+namespace linkq
+{
+extern uint8_t next;
+extern uint8_t count;
+}
+
+namespace timesync
+{
+extern uint8_t source;
+extern uint32_t synced_at;
+extern int32_t drift_ppm;
+}
+
+void board::power_on()
+{
+
+        Preferences::host_erase_all();
+
+        wan::count = 0;
+        wan::count_valid = false;
+        wan::count_persisted = 0;
+        wan::frames_since_confirm = 0;
+        wan::confirm_failures = 0;
+        wan::counters = {};
+        wan::rtc_lmic_valid = false;
+        wan::clock_error = 0;
+
+        linkq::next = 0;
+        linkq::count = 0;
+
+        timesync::source = 0;
+        timesync::synced_at = 0;
+        timesync::drift_ppm = 0;
+
+        sim::drift_ppm = 0;
+        sim::radio = {};
+}
+
+void board::provision(const uint32_t net_id, const uint32_t dev_addr, const uint8_t *nwk_key, const uint8_t *art_key)
+{
+
+        Preferences p;
+
+        (void) p.begin("lora", false);
+        (void) p.putUInt("netId", net_id);
+        (void) p.putUInt("devAddr", dev_addr);
+        (void) p.putBytes("nwkKey", nwk_key, 16);
+        (void) p.putBytes("artKey", art_key, 16);
+        p.end();
+}
+
+bool board::boot(const esp_sleep_wakeup_cause_t cause)
+{
+
+        host_reboot();
+        host_set_wakeup_cause(cause);
+
+        if (!wan::setup())
+        {
+                return false;
+        }
+
+        wan::join();
+
+        return true;
+}
+
+bool board::deep_sleep(const uint64_t ms)
+{
+
+        wan::save_session(ms);
+        deepsleep::do_deepsleep(ms, false);
+
+        return board::boot(ESP_SLEEP_WAKEUP_TIMER);
+}
+
+bool board::run(const uint32_t max_ms)
+{
+
+        uint64_t until = host_rtc_us() + max_ms * 1000ULL;
+
+        while (host_rtc_us() < until)
+        {
+                //
+                // the loop dozes on its own while a frame is in flight; the
+                // rest of the wait (e.g. a join backing off) passes here
+                //
+                wan::loop();
+
+                //
+                // a job just ran: there may be more, MCCI's LMIC doesn't tell
+                //
+                if (!lmic_idle)
+                {
+                        continue;
+                }
+
+                ostime_t next, irq;
+                bool job = sim::next_job(&next);
+
+                if (sim::next_irq(&irq) && (!job || sim::diff(irq, next) < 0))
+                {
+                        next = irq;
+                        job = true;
+                }
+
+                if (!job)
+                {
+                        return true;
+                }
+
+                ostime_t wait = sim::diff(next, os_getTime());
+
+                if (wait > 0)
+                {
+                        host_skip_us(osticks2us(wait));
+                }
+        }
+
+        return false;
+}
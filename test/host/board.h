@@ -0,0 +1,79 @@
+/*
+ *
+ * Simulated board
+ *
+ * PURPOSE: Host builds only: the T-Beam as the WAN module sees it, power
+ *          cycles, deep sleeps and the main loop, on the LMIC stand-in.
+ *          Time the board would spend waiting passes at once
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <esp_sleep.h>
+#include <stdint.h>
+
+namespace board
+{
+
+///
+/// \brief           First power on: NVS erased, RTC memory blank
+///
+/// \return          void
+///
+void power_on();
+
+///
+/// \brief           Stores a session in NVS, as a board that joined once
+///
+/// \return          void
+///
+void provision(const uint32_t net_id, const uint32_t dev_addr, const uint8_t *nwk_key, const uint8_t *art_key);
+
+///
+/// \brief           Boots as after cause (ESP_SLEEP_WAKEUP_UNDEFINED: power
+///                  on or reset); RAM is lost, RTC memory isn't. Sets the
+///                  WAN module up and joins, as main.cpp does
+///
+/// \return          false if LMIC didn't start
+///
+bool boot(const esp_sleep_wakeup_cause_t cause);
+
+///
+/// \brief           Deep sleep, as main.cpp does it: saves the session,
+///                  sleeps ms, then wakes on the timer
+///
+/// \param[in]       ms     time to sleep in milliseconds
+///
+/// \return          false if LMIC didn't start after the wake
+///
+bool deep_sleep(const uint64_t ms);
+
+///
+/// \brief           Runs the WAN loop until LMIC has nothing left to do
+///
+/// \param[in]       max_ms     give up after this long, board time
+///
+/// \return          false if it gave up
+///
+bool run(const uint32_t max_ms = 600000);
+
+} // namespace board
@@ -0,0 +1,586 @@
+/*
+ *
+ * Network server stand-in
+ *
+ * PURPOSE: Host builds only: a LoRaWAN 1.0 network and join server for
+ *          one EU868 gateway, in its own process, for the host simulation
+ *          of the WAN module (shim/lmic/pipe.cpp). It answers OTAA joins,
+ *          ACKs confirmed frames, answers LinkCheckReq and DeviceTimeReq,
+ *          and sends application downlinks on request. One line per frame
+ *          on stdin/stdout:
+ *
+ *            in:  UP <tmst us> <freq Hz> <sf> <bw kHz> <PHYPayload hex>
+ *            out: DOWN <tmst us> <freq Hz> <sf> <bw kHz> <rssi dBm> <snr/4 dB> <hex>
+ *                 NONE
+ *
+ *          tmst is the end of the uplink, the start of the downlink
+ *
+ *          netserver [-k AppKey] [-e epoch] [-a every] [-l loss %] [-2] [-u] [-s seed]
+ *
+ *            -k   AppKey of the devices, hex (default all zero)
+ *            -e   Unix time at tmst 0, for DeviceTimeAns (default 1600000000)
+ *            -a   an application downlink (port 10) every this many uplinks
+ *            -l   uplinks the gateway doesn't hear, percent
+ *            -2   answer in RX2 instead of RX1
+ *            -u   never answer unconfirmed uplinks, whatever they ask
+ *            -s   seed of the losses
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <openssl/evp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+typedef std::vector<uint8_t> bytes_t;
+
+//
+// LoRaWAN 1.0.3 and the EU868 regional parameters
+//
+const uint8_t MHDR_JREQ = 0x00;
+const uint8_t MHDR_JACC = 0x20;
+const uint8_t MHDR_DAUP = 0x40;
+const uint8_t MHDR_DADN = 0x60;
+const uint8_t MHDR_DCUP = 0x80;
+
+const uint8_t FCTRL_ADRACKREQ = 0x40;
+const uint8_t FCTRL_ACK = 0x20;
+const uint8_t FCTRL_FOPTSLEN = 0x0F;
+
+const uint8_t CMD_LINK_CHECK = 0x02;
+const uint8_t CMD_DEVICE_TIME = 0x0D;
+
+const uint64_t JOIN_ACCEPT_DELAY1_US = 5000000;
+const uint64_t RECEIVE_DELAY1_US = 1000000;
+const uint64_t RX2_EXTRA_US = 1000000;
+const uint32_t RX2_FREQ = 869525000;
+const uint8_t RX2_SF = 12;
+
+const uint32_t NET_ID = 0x000013;
+const uint32_t DEV_ADDR_BASE = 0x260b0000;
+
+/// CFList: the five channels of the plan past the default three
+const uint32_t CFLIST[] = {867100000, 867300000, 867500000, 867700000, 867900000};
+
+const uint8_t APP_PORT = 10;
+
+/// the gateway hears every uplink like this
+const int RSSI = -80;
+const int SNR_Q4 = 28;
+
+/// GPS epoch in Unix time, and the leap seconds since
+const uint64_t GPS_UNIX_OFFSET = 315964800;
+const uint64_t GPS_LEAP_SECONDS = 18;
+
+struct session_t
+{
+        uint8_t  nwk[16];
+        uint8_t  app[16];
+        bool     heard = false;     ///< fcnt_up is valid
+        uint32_t fcnt_up = 0;       ///< last accepted
+        uint32_t fcnt_down = 0;     ///< next to send
+        uint32_t uplinks = 0;
+};
+
+struct
+{
+        uint8_t  app_key[16] = {0};
+        uint64_t epoch = 1600000000;
+        uint32_t app_every = 0;
+        uint32_t loss = 0;
+        bool     rx2 = false;
+        bool     deaf = false;      ///< to unconfirmed uplinks
+} opt;
+
+struct
+{
+        uint32_t joins = 0;
+        uint32_t uplinks = 0;
+        uint32_t lost = 0;
+        uint32_t downlinks = 0;
+} stats;
+
+std::map<uint32_t, session_t> sessions;
+std::map<uint64_t, std::set<uint16_t>> nonces;
+uint32_t app_nonce = 1;
+uint32_t next_addr = 1;
+
+void aes(const uint8_t *key, uint8_t *block, const bool decrypt = false)
+{
+        EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+        int len = 0;
+
+        (void) EVP_CipherInit_ex(ctx, EVP_aes_128_ecb(), nullptr, key, nullptr, decrypt ? 0 : 1);
+        (void) EVP_CIPHER_CTX_set_padding(ctx, 0);
+        (void) EVP_CipherUpdate(ctx, block, &len, block, 16);
+        EVP_CIPHER_CTX_free(ctx);
+}
+
+void dbl(uint8_t *k)
+{
+        uint8_t carry = k[0] & 0x80;
+
+        for (int i = 0; i < 15; i++)
+        {
+                k[i] = static_cast<uint8_t>((k[i] << 1) | (k[i + 1] >> 7));
+        }
+
+        k[15] = static_cast<uint8_t>((k[15] << 1) ^ (carry ? 0x87 : 0));
+}
+
+/// RFC 4493 AES-CMAC, the first 4 bytes
+bytes_t cmac(const uint8_t *key, const bytes_t &msg)
+{
+        uint8_t k1[16] = {0}, k2[16];
+
+        aes(key, k1);
+        dbl(k1);
+        (void) memcpy(k2, k1, 16);
+        dbl(k2);
+
+        size_t blocks = msg.empty() ? 1 : (msg.size() + 15) / 16;
+        bool complete = !msg.empty() && msg.size() % 16 == 0;
+        uint8_t x[16] = {0};
+
+        for (size_t b = 0; b < blocks; b++)
+        {
+                for (size_t i = 0; i < 16; i++)
+                {
+                        size_t at = b * 16 + i;
+                        uint8_t m = at < msg.size() ? msg[at] : (at == msg.size() ? 0x80 : 0);
+
+                        if (b == blocks - 1)
+                        {
+                                m ^= complete ? k1[i] : k2[i];
+                        }
+
+                        x[i] ^= m;
+                }
+
+                aes(key, x);
+        }
+
+        return bytes_t(x, x + 4);
+}
+
+uint32_t rd4(const uint8_t *p)
+{
+        return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+void wr(bytes_t &b, const uint32_t v, const int n)
+{
+        for (int i = 0; i < n; i++)
+        {
+                b.push_back(static_cast<uint8_t>(v >> (8 * i)));
+        }
+}
+
+/// B0 (MIC) or Ai (payload) block of a data frame
+bytes_t block(const uint8_t first, const uint8_t dir, const uint32_t addr, const uint32_t fcnt, const uint8_t last)
+{
+        bytes_t b = {first, 0, 0, 0, 0, dir};
+
+        wr(b, addr, 4);
+        wr(b, fcnt, 4);
+        b.push_back(0);
+        b.push_back(last);
+
+        return b;
+}
+
+bytes_t data_mic(const session_t &s, const uint8_t dir, const uint32_t addr, const uint32_t fcnt, const bytes_t &msg)
+{
+        bytes_t b = block(0x49, dir, addr, fcnt, static_cast<uint8_t>(msg.size()));
+
+        b.insert(b.end(), msg.begin(), msg.end());
+
+        return cmac(s.nwk, b);
+}
+
+void crypt_payload(const uint8_t *key, const uint8_t dir, const uint32_t addr, const uint32_t fcnt, uint8_t *p,
+                   const size_t len)
+{
+        for (size_t i = 0; i < len; i += 16)
+        {
+                bytes_t a = block(0x01, dir, addr, fcnt, static_cast<uint8_t>(i / 16 + 1));
+
+                aes(key, a.data());
+
+                for (size_t j = 0; j < 16 && i + j < len; j++)
+                {
+                        p[i + j] ^= a[j];
+                }
+        }
+}
+
+bytes_t hex_to_bytes(const char *s)
+{
+        bytes_t b;
+
+        for (; s[0] != '\0' && s[1] != '\0'; s += 2)
+        {
+                char pair[3] = {s[0], s[1], '\0'};
+                b.push_back(static_cast<uint8_t>(strtoul(pair, nullptr, 16)));
+        }
+
+        return b;
+}
+
+std::string bytes_to_hex(const bytes_t &b)
+{
+        std::string s;
+        char pair[3];
+
+        for (uint8_t v : b)
+        {
+                (void) snprintf(pair, sizeof(pair), "%02x", v);
+                s += pair;
+        }
+
+        return s;
+}
+
+/// \struct an answer to send
+struct down_t
+{
+        uint64_t delay_us;
+        bytes_t  phy;
+};
+
+bool join(const bytes_t &up, down_t *down)
+{
+        if (up.size() != 23 || cmac(opt.app_key, bytes_t(up.begin(), up.begin() + 19)) != bytes_t(up.begin() + 19, up.end()))
+        {
+                return false;
+        }
+
+        uint64_t dev_eui = 0;
+
+        for (int i = 0; i < 8; i++)
+        {
+                dev_eui |= static_cast<uint64_t>(up[9 + i]) << (8 * i);
+        }
+
+        uint16_t dev_nonce = static_cast<uint16_t>(up[17] | (up[18] << 8));
+
+        //
+        // a DevNonce used before is a replay
+        //
+        if (!nonces[dev_eui].insert(dev_nonce).second)
+        {
+                fprintf(stderr, "netserver: DevNonce %04x replayed\n", dev_nonce);
+                return false;
+        }
+
+        uint32_t addr = DEV_ADDR_BASE | next_addr++;
+        bytes_t acc = {MHDR_JACC};
+
+        wr(acc, app_nonce++, 3);
+        wr(acc, NET_ID, 3);
+        wr(acc, addr, 4);
+        acc.push_back(0x00);                        // DLSettings: RX1DROffset 0, RX2 DR0
+        acc.push_back(RECEIVE_DELAY1_US / 1000000);
+
+        for (uint32_t f : CFLIST)
+        {
+                wr(acc, f / 100, 3);
+        }
+        acc.push_back(0);                           // CFListType: channels
+
+        bytes_t mic = cmac(opt.app_key, acc);
+        acc.insert(acc.end(), mic.begin(), mic.end());
+
+        //
+        // the join server encrypts with AES decrypt: the device only
+        // needs AES encrypt
+        //
+        for (size_t i = 1; i < acc.size(); i += 16)
+        {
+                aes(opt.app_key, acc.data() + i, true);
+        }
+
+        session_t s;
+        uint8_t nwk[16] = {0x01}, app[16] = {0x02};
+
+        for (int i = 0; i < 6; i++)
+        {
+                nwk[1 + i] = app[1 + i] = i < 3 ? static_cast<uint8_t>((app_nonce - 1) >> (8 * i))
+                                                : static_cast<uint8_t>(NET_ID >> (8 * (i - 3)));
+        }
+        nwk[7] = app[7] = up[17];
+        nwk[8] = app[8] = up[18];
+
+        aes(opt.app_key, nwk);
+        aes(opt.app_key, app);
+        (void) memcpy(s.nwk, nwk, 16);
+        (void) memcpy(s.app, app, 16);
+
+        sessions[addr] = s;
+        stats.joins++;
+
+        down->delay_us = JOIN_ACCEPT_DELAY1_US;
+        down->phy = acc;
+
+        return true;
+}
+
+bool data(const bytes_t &up, const uint64_t tmst, const int sf, down_t *down)
+{
+        if (up.size() < 12)
+        {
+                return false;
+        }
+
+        uint32_t addr = rd4(&up[1]);
+        auto it = sessions.find(addr);
+
+        if (it == sessions.end())
+        {
+                return false;
+        }
+
+        session_t &s = it->second;
+        uint8_t fctrl = up[5];
+        uint8_t olen = fctrl & FCTRL_FOPTSLEN;
+        uint16_t fcnt16 = static_cast<uint16_t>(up[6] | (up[7] << 8));
+        uint32_t fcnt = s.heard ? s.fcnt_up + static_cast<uint16_t>(fcnt16 - s.fcnt_up) : fcnt16;
+        bytes_t msg(up.begin(), up.end() - 4);
+
+        if (8u + olen > msg.size() || data_mic(s, 0, addr, fcnt, msg) != bytes_t(up.end() - 4, up.end()))
+        {
+                fprintf(stderr, "netserver: bad MIC from %08x\n", addr);
+                return false;
+        }
+
+        bool confirmed = (up[0] & 0xE0) == MHDR_DCUP;
+        bool repeat = s.heard && fcnt == s.fcnt_up;
+
+        //
+        // a frame counter that went back is a replay; a repeated one is
+        // a retry, which only gets its ACK again
+        //
+        if (s.heard && static_cast<int32_t>(fcnt - s.fcnt_up) < 0)
+        {
+                fprintf(stderr, "netserver: FCnt %u replayed by %08x\n", fcnt, addr);
+                return false;
+        }
+
+        if (repeat && !confirmed)
+        {
+                return false;
+        }
+
+        s.heard = true;
+        s.fcnt_up = fcnt;
+        s.uplinks += repeat ? 0 : 1;
+
+        if (!confirmed && opt.deaf)
+        {
+                return false;
+        }
+
+        //
+        // MAC commands
+        //
+        bytes_t opts;
+
+        for (uint8_t i = 0; i < olen; i++)
+        {
+                uint8_t cmd = up[8 + i];
+
+                if (cmd == CMD_LINK_CHECK)
+                {
+                        static const int floor_q4[] = {-30, -40, -50, -60, -70, -80};
+                        int margin = (SNR_Q4 - floor_q4[sf - 7]) / 4;
+
+                        opts.push_back(CMD_LINK_CHECK);
+                        opts.push_back(static_cast<uint8_t>(margin));
+                        opts.push_back(1);
+                }
+                else if (cmd == CMD_DEVICE_TIME)
+                {
+                        uint64_t us = opt.epoch * 1000000 + tmst;
+                        uint32_t gps = static_cast<uint32_t>(us / 1000000 - GPS_UNIX_OFFSET + GPS_LEAP_SECONDS);
+
+                        opts.push_back(CMD_DEVICE_TIME);
+                        wr(opts, gps, 4);
+                        opts.push_back(static_cast<uint8_t>((us % 1000000) * 256 / 1000000));
+                }
+                else
+                {
+                        break;
+                }
+        }
+
+        bool app = !repeat && opt.app_every > 0 && s.uplinks % opt.app_every == 0;
+
+        if (!confirmed && opts.empty() && !app && (fctrl & FCTRL_ADRACKREQ) == 0)
+        {
+                return false;
+        }
+
+        bytes_t dn = {MHDR_DADN};
+
+        wr(dn, addr, 4);
+        dn.push_back(static_cast<uint8_t>((confirmed ? FCTRL_ACK : 0) | opts.size()));
+        wr(dn, s.fcnt_down, 2);
+        dn.insert(dn.end(), opts.begin(), opts.end());
+
+        if (app)
+        {
+                char text[16];
+                int n = snprintf(text, sizeof(text), "dl%u", s.uplinks);
+
+                dn.push_back(APP_PORT);
+                size_t at = dn.size();
+                dn.insert(dn.end(), text, text + n);
+                crypt_payload(s.app, 1, addr, s.fcnt_down, dn.data() + at, n);
+        }
+
+        bytes_t mic = data_mic(s, 1, addr, s.fcnt_down, dn);
+        dn.insert(dn.end(), mic.begin(), mic.end());
+
+        s.fcnt_down++;
+
+        down->delay_us = RECEIVE_DELAY1_US;
+        down->phy = dn;
+
+        return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+        int c;
+        uint32_t seed = 1;
+
+        while ((c = getopt(argc, argv, "k:e:a:l:2us:")) != -1)
+        {
+                switch (c)
+                {
+                case 'k': {
+                        bytes_t k = hex_to_bytes(optarg);
+                        if (k.size() != 16)
+                        {
+                                fprintf(stderr, "netserver: AppKey must be 16 bytes\n");
+                                return 2;
+                        }
+                        (void) memcpy(opt.app_key, k.data(), 16);
+                        break;
+                }
+                case 'e':
+                        opt.epoch = strtoull(optarg, nullptr, 10);
+                        break;
+                case 'a':
+                        opt.app_every = static_cast<uint32_t>(strtoul(optarg, nullptr, 10));
+                        break;
+                case 'l':
+                        opt.loss = static_cast<uint32_t>(strtoul(optarg, nullptr, 10));
+                        break;
+                case '2':
+                        opt.rx2 = true;
+                        break;
+                case 'u':
+                        opt.deaf = true;
+                        break;
+                case 's':
+                        seed = static_cast<uint32_t>(strtoul(optarg, nullptr, 10));
+                        break;
+                default:
+                        fprintf(stderr, "usage: netserver [-k AppKey] [-e epoch] [-a every] [-l loss %%] [-2] [-u] [-s seed]\n");
+                        return 2;
+                }
+        }
+
+        srand(seed);
+
+        char line[1024];
+
+        while (fgets(line, sizeof(line), stdin) != nullptr)
+        {
+                unsigned long long tmst;
+                unsigned freq, sf, bw;
+                char hex[600];
+
+                if (sscanf(line, "UP %llu %u %u %u %599s", &tmst, &freq, &sf, &bw, hex) != 5 || sf < 7 || sf > 12)
+                {
+                        fprintf(stderr, "netserver: bad line: %s", line);
+                        printf("NONE\n");
+                        (void) fflush(stdout);
+                        continue;
+                }
+
+                bytes_t up = hex_to_bytes(hex);
+                down_t down;
+                bool answer = false;
+
+                stats.uplinks++;
+
+                if (static_cast<uint32_t>(rand() % 100) < opt.loss)
+                {
+                        stats.lost++;
+                }
+                else if (!up.empty() && (up[0] & 0xE0) == MHDR_JREQ)
+                {
+                        answer = join(up, &down);
+                }
+                else if (!up.empty() && ((up[0] & 0xE0) == MHDR_DAUP || (up[0] & 0xE0) == MHDR_DCUP))
+                {
+                        answer = data(up, tmst, static_cast<int>(sf), &down);
+                }
+
+                if (!answer)
+                {
+                        printf("NONE\n");
+                }
+                else
+                {
+                        //
+                        // RX1: same channel and data rate; RX2: fixed
+                        //
+                        uint64_t at = tmst + down.delay_us + (opt.rx2 ? RX2_EXTRA_US : 0);
+
+                        stats.downlinks++;
+                        printf("DOWN %llu %u %u %u %d %d %s\n", static_cast<unsigned long long>(at),
+                               opt.rx2 ? RX2_FREQ : freq, opt.rx2 ? RX2_SF : sf, opt.rx2 ? 125 : bw, RSSI, SNR_Q4,
+                               bytes_to_hex(down.phy).c_str());
+                }
+
+                (void) fflush(stdout);
+        }
+
+        fprintf(stderr, "netserver: %u joins, %u uplinks (%u lost), %u downlinks\n", stats.joins, stats.uplinks,
+                stats.lost, stats.downlinks);
+
+        return 0;
+}
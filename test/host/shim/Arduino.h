@@ -0,0 +1,92 @@
+/*
+ *
+ * Arduino stand-in
+ *
+ * PURPOSE: Host builds only: the parts of the Arduino core and of the
+ *          ESP-IDF logging the firmware modules under test use
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+
+//
+// RTC memory is plain memory here: tests reset it by hand
+//
+#define RTC_DATA_ATTR
+#define RTC_IRAM_ATTR
+#define IRAM_ATTR
+#define PROGMEM
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+//
+// the GPIOs the host board wires up are the radio's (see lmic/regs.cpp)
+//
+#define LOW    0x0
+#define HIGH   0x1
+#define INPUT  0x01
+#define OUTPUT 0x03
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+inline void interrupts() {}
+inline void noInterrupts() {}
+
+//
+// host only: the board's time is the host's plus the time it spent
+// sleeping, which passes at once (see host.cpp)
+//
+
+/// time passes without the CPU running, e.g. in light or deep sleep
+void host_skip_us(const uint64_t us);
+
+/// microseconds since the first power on, across deep sleeps (RTC timer)
+uint64_t host_rtc_us();
+
+/// a deep sleep wake or a reset: millis() and micros() restart from zero
+void host_reboot();
+
+class HostSerial
+{
+public:
+        void begin(unsigned long) {}
+        void flush() { (void) fflush(stdout); }
+
+        size_t print(const char *s) { return static_cast<size_t>(fprintf(stdout, "%s", s)); }
+        size_t print(long n) { return static_cast<size_t>(fprintf(stdout, "%ld", n)); }
+        size_t println(const char *s) { return static_cast<size_t>(fprintf(stdout, "%s\n", s)); }
+        size_t println(long n) { return static_cast<size_t>(fprintf(stdout, "%ld\n", n)); }
+};
+
+extern HostSerial Serial;
@@ -0,0 +1,179 @@
+/*
+ *
+ * Preferences stand-in
+ *
+ * PURPOSE: Host builds only: NVS in RAM, see Preferences.h
+ *          simulated by the LMIC stand-in
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "Preferences.h"
+
+#include <cstring>
+
+namespace
+{
+
+uint32_t writes = 0;
+
+} // namespace
+
+std::map<std::string, Preferences::space_t> &Preferences::nvs()
+{
+        static std::map<std::string, space_t> partition;
+
+        return partition;
+}
+
+bool Preferences::begin(const char *name, bool readOnly, const char *partition_label)
+{
+        (void) partition_label;
+
+        //
+        // as nvs_open(): a read-only namespace must exist already
+        //
+        if (readOnly && nvs().count(name) == 0)
+        {
+                return false;
+        }
+
+        space = &nvs()[name];
+        read_only = readOnly;
+
+        return true;
+}
+
+void Preferences::end()
+{
+        space = nullptr;
+}
+
+bool Preferences::clear()
+{
+        if (space == nullptr || read_only)
+        {
+                return false;
+        }
+
+        space->clear();
+        writes++;
+
+        return true;
+}
+
+bool Preferences::remove(const char *key)
+{
+        if (space == nullptr || read_only)
+        {
+                return false;
+        }
+
+        writes++;
+
+        return space->erase(key) > 0;
+}
+
+bool Preferences::isKey(const char *key)
+{
+        return get(key) != nullptr;
+}
+
+size_t Preferences::put(const char *key, const void *value, size_t len)
+{
+        if (space == nullptr || read_only)
+        {
+                return 0;
+        }
+
+        const uint8_t *bytes = static_cast<const uint8_t *>(value);
+
+        (*space)[key] = value_t(bytes, bytes + len);
+        writes++;
+
+        return len;
+}
+
+const Preferences::value_t *Preferences::get(const char *key)
+{
+        if (space == nullptr)
+        {
+                return nullptr;
+        }
+
+        space_t::const_iterator it = space->find(key);
+
+        return it == space->end() ? nullptr : &it->second;
+}
+
+size_t Preferences::putUInt(const char *key, uint32_t value)
+{
+        return put(key, &value, sizeof(value));
+}
+
+uint32_t Preferences::getUInt(const char *key, uint32_t defaultValue)
+{
+        const value_t *v = get(key);
+        uint32_t value = defaultValue;
+
+        if (v != nullptr && v->size() == sizeof(value))
+        {
+                (void) memcpy(&value, v->data(), sizeof(value));
+        }
+
+        return value;
+}
+
+size_t Preferences::putBytes(const char *key, const void *value, size_t len)
+{
+        return put(key, value, len);
+}
+
+size_t Preferences::getBytes(const char *key, void *buf, size_t maxLen)
+{
+        const value_t *v = get(key);
+
+        if (v == nullptr || v->size() > maxLen)
+        {
+                return 0;
+        }
+
+        (void) memcpy(buf, v->data(), v->size());
+
+        return v->size();
+}
+
+size_t Preferences::getBytesLength(const char *key)
+{
+        const value_t *v = get(key);
+
+        return v == nullptr ? 0 : v->size();
+}
+
+void Preferences::host_erase_all()
+{
+        nvs().clear();
+        writes++;
+}
+
+uint32_t Preferences::host_writes()
+{
+        return writes;
+}
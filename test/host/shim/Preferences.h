@@ -0,0 +1,76 @@
+/*
+ *
+ * Preferences stand-in
+ *
+ * PURPOSE: Host builds only: NVS namespaces in RAM, kept across simulated
+ *          deep sleeps and resets, with a count of the writes
+ *          simulated by the LMIC stand-in
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+class Preferences
+{
+public:
+        bool begin(const char *name, bool readOnly = false, const char *partition_label = nullptr);
+        void end();
+
+        bool clear();
+        bool remove(const char *key);
+        bool isKey(const char *key);
+
+        size_t putUInt(const char *key, uint32_t value);
+        uint32_t getUInt(const char *key, uint32_t defaultValue = 0);
+
+        size_t putBytes(const char *key, const void *value, size_t len);
+        size_t getBytes(const char *key, void *buf, size_t maxLen);
+        size_t getBytesLength(const char *key);
+
+        //
+        // host only
+        //
+
+        /// erases the whole NVS partition, as a freshly flashed board
+        static void host_erase_all();
+
+        /// writes that reached the NVS (put or clear) since the start
+        static uint32_t host_writes();
+
+private:
+        typedef std::vector<uint8_t> value_t;
+        typedef std::map<std::string, value_t> space_t;
+
+        static std::map<std::string, space_t> &nvs();
+
+        space_t *space = nullptr;
+        bool read_only = true;
+
+        size_t put(const char *key, const void *value, size_t len);
+        const value_t *get(const char *key);
+};
@@ -0,0 +1,64 @@
+/*
+ *
+ * SPI stand-in
+ *
+ * PURPOSE: Host builds only: the SPI bus object; the radio behind it is
+ *          the simulated SX1276 (lmic/regs.cpp)
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#define MSBFIRST  1
+#define SPI_MODE0 0
+
+class SPISettings
+{
+public:
+        SPISettings(uint32_t clock = 1000000, uint8_t bit_order = MSBFIRST, uint8_t data_mode = SPI_MODE0)
+        {
+                (void) clock;
+                (void) bit_order;
+                (void) data_mode;
+        }
+};
+
+class SPIClass
+{
+public:
+        void begin(int8_t sck = -1, int8_t miso = -1, int8_t mosi = -1, int8_t ss = -1)
+        {
+                (void) sck;
+                (void) miso;
+                (void) mosi;
+                (void) ss;
+        }
+
+        void beginTransaction(SPISettings settings) { (void) settings; }
+        void endTransaction() {}
+
+        /// one byte each way, to whichever chip select is low
+        uint8_t transfer(uint8_t data);
+};
+
+extern SPIClass SPI;
@@ -0,0 +1,161 @@
+/*
+ *
+ * SPIMemory stand-in
+ *
+ * PURPOSE: Host builds only: emulated SPI NOR flash, see SPIMemory.h
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "SPIMemory.h"
+
+#include <algorithm>
+#include <cstring>
+
+SPIFlash::SPIFlash(uint8_t cs, uint32_t capacity) : mem(capacity, 0xFF), wear(capacity / SECTOR, 0)
+{
+        (void) cs;
+}
+
+bool SPIFlash::begin(uint32_t flashChipSize)
+{
+        (void) flashChipSize;
+
+        return present;
+}
+
+uint32_t SPIFlash::getCapacity()
+{
+        return static_cast<uint32_t>(mem.size());
+}
+
+uint32_t SPIFlash::spi_us(const size_t bytes) const
+{
+        //
+        // command and 24 bit address, then the data
+        //
+        return static_cast<uint32_t>((4 + bytes) * 8 * 1000000ULL / SPI_HZ);
+}
+
+bool SPIFlash::readByteArray(uint32_t addr, uint8_t *data, size_t size, bool fastRead)
+{
+        (void) fastRead;
+
+        if (addr + size > mem.size())
+        {
+                return false;
+        }
+
+        (void) memcpy(data, &mem[addr], size);
+
+        stats.reads++;
+        stats.bytes_read += size;
+        stats.busy_us += spi_us(size);
+
+        return true;
+}
+
+bool SPIFlash::writeByte(uint32_t addr, uint8_t data, bool errorCheck)
+{
+        return writeByteArray(addr, &data, 1, errorCheck);
+}
+
+bool SPIFlash::writeByteArray(uint32_t addr, uint8_t *data, size_t size, bool errorCheck)
+{
+        if (addr + size > mem.size())
+        {
+                return false;
+        }
+
+        if (fail_next_writes > 0)
+        {
+                fail_next_writes--;
+                return false;
+        }
+
+        bool ok = true;
+
+        //
+        // one page program per page touched, like the library does
+        //
+        for (size_t done = 0; done < size;)
+        {
+                size_t n = std::min<size_t>(size - done, PAGE - (addr + done) % PAGE);
+
+                for (size_t i = 0; i < n; i++)
+                {
+                        uint8_t &cell = mem[addr + done + i];
+
+                        cell &= data[done + i];
+                        ok = ok && cell == data[done + i];
+                }
+
+                stats.programs++;
+                stats.busy_us += spi_us(n) + T_PAGE_PROGRAM_US;
+                done += n;
+        }
+
+        stats.bytes_written += size;
+
+        if (errorCheck)
+        {
+                //
+                // the library reads the data back
+                //
+                stats.busy_us += spi_us(size);
+
+                if (!ok)
+                {
+                        stats.failed_writes++;
+                        return false;
+                }
+        }
+
+        return true;
+}
+
+bool SPIFlash::eraseSector(uint32_t addr)
+{
+        if (addr >= mem.size())
+        {
+                return false;
+        }
+
+        if (fail_next_erases > 0)
+        {
+                fail_next_erases--;
+                return false;
+        }
+
+        uint32_t start = addr - addr % SECTOR;
+
+        std::fill(mem.begin() + start, mem.begin() + start + SECTOR, 0xFF);
+
+        wear[start / SECTOR]++;
+        stats.erases++;
+        stats.busy_us += spi_us(0) + T_SECTOR_ERASE_US;
+
+        return true;
+}
+
+uint32_t SPIFlash::max_wear() const
+{
+        return *std::max_element(wear.begin(), wear.end());
+}
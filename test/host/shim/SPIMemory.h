@@ -0,0 +1,98 @@
+/*
+ *
+ * SPIMemory stand-in
+ *
+ * PURPOSE: Host builds only: an SPI NOR flash emulated in RAM behind the
+ *          SPIFlash calls the firmware makes, with NOR semantics (a write
+ *          can only clear bits, an erase sets a 4 KiB sector to 0xFF) and
+ *          a time model from a W25Q32 datasheet (typical figures)
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+class SPIFlash
+{
+public:
+        static const uint32_t SECTOR = 4096;
+        static const uint32_t PAGE = 256;
+
+        /// typical timings, us
+        static const uint32_t T_PAGE_PROGRAM_US = 700;
+        static const uint32_t T_SECTOR_ERASE_US = 45000;
+
+        /// SPI clock for reads and command bytes, Hz
+        static const uint32_t SPI_HZ = 20000000;
+
+        /// \struct what the chip went through
+        struct stats_t
+        {
+                uint64_t busy_us;          ///< modeled time the chip was busy
+                uint32_t reads;            ///< read commands
+                uint64_t bytes_read;
+                uint32_t programs;         ///< page program commands
+                uint64_t bytes_written;
+                uint32_t erases;           ///< sector erases
+                uint32_t failed_writes;    ///< verify errors (bits that couldn't go 0 -> 1)
+        };
+
+        explicit SPIFlash(uint8_t cs = 0, uint32_t capacity = 4 * 1024 * 1024);
+
+        bool begin(uint32_t flashChipSize = 0);
+        uint32_t getCapacity();
+
+        bool readByteArray(uint32_t addr, uint8_t *data, size_t size, bool fastRead = false);
+        bool writeByte(uint32_t addr, uint8_t data, bool errorCheck = true);
+        bool writeByteArray(uint32_t addr, uint8_t *data, size_t size, bool errorCheck = true);
+        bool eraseSector(uint32_t addr);
+
+        //
+        // test hooks
+        //
+
+        /// the chip answers begin() (false: not fitted)
+        bool present = true;
+
+        /// the next erases or writes fail without touching the array
+        uint32_t fail_next_erases = 0;
+        uint32_t fail_next_writes = 0;
+
+        stats_t stats = {};
+
+        /// erase count of the most worn sector
+        uint32_t max_wear() const;
+
+        /// direct access to the array, e.g. to corrupt a record
+        uint8_t *raw() { return mem.data(); }
+
+        void reset_stats() { stats = {}; }
+
+private:
+        std::vector<uint8_t> mem;
+        std::vector<uint32_t> wear;
+
+        uint32_t spi_us(const size_t bytes) const;
+};
@@ -0,0 +1,36 @@
+/*
+ *
+ * ESP-IDF clock stand-in
+ *
+ * PURPOSE: Host builds only: the slow clock calibration, see soc/rtc.h
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/// the RTC slow clock period in us, Q13.19 as the ESP32 measures it:
+/// 150 kHz here, the nominal frequency of the internal RC oscillator
+inline uint32_t esp_clk_slowclk_cal_get()
+{
+        return static_cast<uint32_t>((1000000ULL << 19) / 150000);
+}
@@ -0,0 +1,46 @@
+/*
+ *
+ * ESP-IDF sleep stand-in
+ *
+ * PURPOSE: Host builds only: the wake cause, which tests set to tell a
+ *          deep sleep wake from a cold boot
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+typedef enum
+{
+        ESP_SLEEP_WAKEUP_UNDEFINED,
+        ESP_SLEEP_WAKEUP_ALL,
+        ESP_SLEEP_WAKEUP_EXT0,
+        ESP_SLEEP_WAKEUP_EXT1,
+        ESP_SLEEP_WAKEUP_TIMER,
+        ESP_SLEEP_WAKEUP_TOUCHPAD,
+        ESP_SLEEP_WAKEUP_ULP,
+        ESP_SLEEP_WAKEUP_GPIO,
+        ESP_SLEEP_WAKEUP_UART,
+} esp_sleep_wakeup_cause_t;
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause();
+
+/// host only: what the next esp_sleep_get_wakeup_cause() calls return
+void host_set_wakeup_cause(const esp_sleep_wakeup_cause_t cause);
@@ -0,0 +1,46 @@
+/*
+ *
+ * LMIC HAL stand-in
+ *
+ * PURPOSE: Host builds only: the pin map of arduino-lmic's HAL; the
+ *          radio behind the pins is simulated (lmic/sx1276.cpp)
+ *          simulated by the LMIC stand-in
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <lmic/lmic.h>
+
+enum { NUM_DIO = 3 };
+
+struct lmic_pinmap
+{
+        u1_t     nss;
+        u1_t     rxtx;
+        u1_t     rst;
+        u1_t     dio[NUM_DIO];
+        u1_t     rxtx_rx_active;
+        int8_t   rssi_cal;
+        uint32_t spi_freq;
+};
+
+const u1_t LMIC_UNUSED_PIN = 0xff;
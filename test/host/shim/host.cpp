@@ -0,0 +1,173 @@
+/*
+ *
+ * Host runtime
+ *
+ * PURPOSE: Host builds only: clock, delays, wake cause and logging
+ *          behind the Arduino and ESP-IDF stand-ins. The board's clock
+ *          runs with the host's, but sleeps and delays skip ahead instead
+ *          of waiting, so a simulated wake cycle takes its CPU time only
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <Arduino.h>
+#include <SPI.h>
+#include <esp_sleep.h>
+#include <sys/time.h>
+
+#include <chrono>
+#include <cstdarg>
+
+HostSerial Serial;
+SPIClass SPI;
+
+namespace
+{
+
+const std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+
+/// time skipped by sleeps and delays, us
+uint64_t skipped_us = 0;
+
+/// host_rtc_us() at the last reboot
+uint64_t boot_us = 0;
+
+/// the board's wall clock is host_rtc_us() plus this, us
+int64_t epoch_us = 0;
+
+esp_sleep_wakeup_cause_t wakeup_cause = ESP_SLEEP_WAKEUP_UNDEFINED;
+
+int rank(const char level)
+{
+        switch (level)
+        {
+        case 'E':
+                return 1;
+        case 'W':
+                return 2;
+        case 'I':
+                return 3;
+        case 'D':
+                return 4;
+        default:
+                return 5;
+        }
+}
+
+int threshold()
+{
+        static int t = -1;
+
+        if (t < 0)
+        {
+                const char *env = getenv("TBEAM_LOG");
+                t = rank(env != nullptr && env[0] != '\0' ? env[0] : 'W');
+        }
+
+        return t;
+}
+
+} // namespace
+
+uint64_t host_rtc_us()
+{
+        return static_cast<uint64_t>(
+                   std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started)
+                       .count()) +
+               skipped_us;
+}
+
+void host_skip_us(const uint64_t us)
+{
+        skipped_us += us;
+}
+
+void host_reboot()
+{
+        boot_us = host_rtc_us();
+}
+
+unsigned long micros()
+{
+        return static_cast<unsigned long>(host_rtc_us() - boot_us);
+}
+
+unsigned long millis()
+{
+        return micros() / 1000;
+}
+
+void delay(unsigned long ms)
+{
+        host_skip_us(ms * 1000ULL);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+        host_skip_us(us);
+}
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause()
+{
+        return wakeup_cause;
+}
+
+void host_set_wakeup_cause(const esp_sleep_wakeup_cause_t cause)
+{
+        wakeup_cause = cause;
+}
+
+int host_gettimeofday(struct timeval *tv, void *tz)
+{
+        (void) tz;
+
+        int64_t us = static_cast<int64_t>(host_rtc_us()) + epoch_us;
+
+        tv->tv_sec = us / 1000000;
+        tv->tv_usec = us % 1000000;
+
+        return 0;
+}
+
+int host_settimeofday(const struct timeval *tv, const void *tz)
+{
+        (void) tz;
+
+        epoch_us = static_cast<int64_t>(tv->tv_sec) * 1000000 + tv->tv_usec - static_cast<int64_t>(host_rtc_us());
+
+        return 0;
+}
+
+void host_log(const char level, const char *tag, const char *format, ...)
+{
+        if (rank(level) > threshold())
+        {
+                return;
+        }
+
+        va_list args;
+        va_start(args, format);
+
+        (void) fprintf(stderr, "%c (%lu) %s: ", level, millis(), tag);
+        (void) vfprintf(stderr, format, args);
+        (void) fputc('\n', stderr);
+
+        va_end(args);
+}
@@ -0,0 +1,258 @@
+/*
+ *
+ * LMIC stand-in
+ *
+ * PURPOSE: Host builds only: os_aes() in software, with the semantics of
+ *          arduino-lmic's AES modes (ECB, CMAC with or without the aux
+ *          block, CTR on the aux block). It has its own AES-128 so that
+ *          hwaes, on the OpenSSL stand-in for mbedTLS, is checked against
+ *          an independent implementation, as on the board
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "lmic.h"
+
+#include <cstring>
+
+namespace
+{
+
+const u1_t BLOCK = 16;
+const u1_t ROUNDS = 10;
+
+u1_t key_buf[BLOCK];
+u1_t aux_buf[BLOCK];
+
+u1_t sbox[256];
+
+u1_t xtime(const u1_t x)
+{
+        return static_cast<u1_t>((x << 1) ^ ((x & 0x80) ? 0x1b : 0));
+}
+
+///
+/// \brief           S-box from its definition: the inverse in GF(2^8)
+///                  followed by the affine transform
+///
+void make_sbox()
+{
+
+        u1_t p = 1, q = 1;
+
+        //
+        // p runs over the powers of 3, q over the powers of 1/3
+        //
+        do
+        {
+                p = p ^ xtime(p);
+
+                q ^= q << 1;
+                q ^= q << 2;
+                q ^= q << 4;
+                if (q & 0x80)
+                {
+                        q ^= 0x09;
+                }
+
+                u1_t s = q ^ static_cast<u1_t>((q << 1) | (q >> 7)) ^ static_cast<u1_t>((q << 2) | (q >> 6)) ^
+                         static_cast<u1_t>((q << 3) | (q >> 5)) ^ static_cast<u1_t>((q << 4) | (q >> 4));
+                sbox[p] = s ^ 0x63;
+        } while (p != 1);
+
+        sbox[0] = 0x63;
+}
+
+void encrypt(const u1_t *key, u1_t *block)
+{
+
+        if (sbox[0] == 0)
+        {
+                make_sbox();
+        }
+
+        u1_t rk[BLOCK];
+        u1_t rcon = 1;
+
+        (void) memcpy(rk, key, BLOCK);
+
+        for (u1_t i = 0; i < BLOCK; i++)
+        {
+                block[i] ^= rk[i];
+        }
+
+        for (u1_t round = 1; round <= ROUNDS; round++)
+        {
+                //
+                // next round key
+                //
+                rk[0] ^= sbox[rk[13]] ^ rcon;
+                rk[1] ^= sbox[rk[14]];
+                rk[2] ^= sbox[rk[15]];
+                rk[3] ^= sbox[rk[12]];
+                for (u1_t i = 4; i < BLOCK; i++)
+                {
+                        rk[i] ^= rk[i - 4];
+                }
+                rcon = xtime(rcon);
+
+                //
+                // SubBytes and ShiftRows; the state is column major
+                //
+                u1_t s[BLOCK];
+                for (u1_t c = 0; c < 4; c++)
+                {
+                        for (u1_t r = 0; r < 4; r++)
+                        {
+                                s[4 * c + r] = sbox[block[4 * ((c + r) % 4) + r]];
+                        }
+                }
+
+                //
+                // MixColumns, but in the last round
+                //
+                for (u1_t c = 0; c < 4; c++)
+                {
+                        u1_t *col = s + 4 * c;
+
+                        if (round < ROUNDS)
+                        {
+                                u1_t all = col[0] ^ col[1] ^ col[2] ^ col[3];
+                                u1_t first = col[0];
+
+                                col[0] ^= all ^ xtime(col[0] ^ col[1]);
+                                col[1] ^= all ^ xtime(col[1] ^ col[2]);
+                                col[2] ^= all ^ xtime(col[2] ^ col[3]);
+                                col[3] ^= all ^ xtime(col[3] ^ first);
+                        }
+                }
+
+                for (u1_t i = 0; i < BLOCK; i++)
+                {
+                        block[i] = s[i] ^ rk[i];
+                }
+        }
+}
+
+void dbl(u1_t *k)
+{
+
+        u1_t carry = k[0] & 0x80;
+
+        for (u1_t i = 0; i < BLOCK - 1; i++)
+        {
+                k[i] = static_cast<u1_t>((k[i] << 1) | (k[i + 1] >> 7));
+        }
+
+        k[BLOCK - 1] = static_cast<u1_t>((k[BLOCK - 1] << 1) ^ (carry ? 0x87 : 0));
+}
+
+///
+/// \brief           RFC 4493 over a message laid out in memory first
+///
+u4_t cmac(const u1_t *msg, const u2_t len)
+{
+
+        u1_t k1[BLOCK] = {0}, k2[BLOCK];
+
+        encrypt(AESkey, k1);
+        dbl(k1);
+        (void) memcpy(k2, k1, BLOCK);
+        dbl(k2);
+
+        u2_t blocks = (len + BLOCK - 1) / BLOCK;
+        bool complete = blocks > 0 && len % BLOCK == 0;
+        blocks = blocks > 0 ? blocks : 1;
+
+        u1_t x[BLOCK] = {0};
+
+        for (u2_t b = 0; b < blocks; b++)
+        {
+                for (u1_t i = 0; i < BLOCK; i++)
+                {
+                        u2_t at = b * BLOCK + i;
+                        u1_t m = at < len ? msg[at] : (at == len ? 0x80 : 0x00);
+
+                        if (b == blocks - 1)
+                        {
+                                m ^= complete ? k1[i] : k2[i];
+                        }
+
+                        x[i] ^= m;
+                }
+
+                encrypt(AESkey, x);
+        }
+
+        return os_rmsbf4(x);
+}
+
+} // namespace
+
+xref2u1_t AESkey = key_buf;
+xref2u1_t AESaux = aux_buf;
+
+u4_t os_aes(u1_t mode, xref2u1_t buf, u2_t len)
+{
+
+        if (mode & AES_MIC)
+        {
+                u1_t msg[BLOCK + 256];
+                u2_t skip = (mode & AES_MICNOAUX) ? 0 : BLOCK;
+
+                (void) memcpy(msg, AESaux, skip);
+                (void) memcpy(msg + skip, buf, len);
+
+                return cmac(msg, skip + len);
+        }
+
+        if (mode & AES_CTR)
+        {
+                while (len > 0)
+                {
+                        u1_t s[BLOCK];
+
+                        (void) memcpy(s, AESaux, BLOCK);
+                        encrypt(AESkey, s);
+
+                        for (u1_t i = 0; i < BLOCK && len > 0; i++, len--)
+                        {
+                                *buf++ ^= s[i];
+                        }
+
+                        AESaux[BLOCK - 1]++;
+                }
+
+                return 0;
+        }
+
+        if (mode == AES_ENC)
+        {
+                for (; len >= BLOCK; len -= BLOCK, buf += BLOCK)
+                {
+                        encrypt(AESkey, buf);
+                }
+        }
+
+        //
+        // AES_DEC: not needed by a LoRaWAN 1.0 device, left out
+        //
+        return 0;
+}
@@ -0,0 +1,33 @@
+/*
+ *
+ * LMIC stand-in
+ *
+ * PURPOSE: Host builds only: hal_sleep(), in a unit of its own so that the
+ *          call from os_runloop_once() is a link-time reference the
+ *          firmware's -Wl,--wrap=hal_sleep catches, as with MCCI's HAL
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "lmic.h"
+
+void hal_sleep(void)
+{
+}
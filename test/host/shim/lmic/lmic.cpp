@@ -0,0 +1,1105 @@
+/*
+ *
+ * LMIC stand-in
+ *
+ * PURPOSE: Host builds only: the class A MAC of arduino-lmic (EU868) as
+ *          the firmware sees it: OTAA join, sessions, frame counters,
+ *          confirmed retries, RX1/RX2 windows sized by the clock error,
+ *          duty cycle bands, link check and DeviceTimeReq. Frames are real
+ *          LoRaWAN 1.0 frames, MIC and payloads through os_aes()
+ *          simulated by the LMIC stand-in
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "lmic.h"
+
+#include <cstring>
+
+#include "sim.h"
+#include "sx1276.h"
+
+lmic_t LMIC;
+
+namespace
+{
+
+/// RX1 delays, s; RX2 opens a second later
+const u1_t DELAY_DNW1 = 1;
+const u1_t DELAY_JACC1 = 5;
+const u1_t DELAY_EXTDNW2 = 1;
+
+/// preamble symbols a window covers with no clock error
+const u1_t MINRX_SYMS = 6;
+const u1_t PAMBL_SYMS = 8;
+
+/// tries of a confirmed frame, and the random pause before the next, s
+const u1_t TXCONF_ATTEMPTS = 8;
+const u1_t RETRY_PERIOD_SECS = 3;
+
+/// random spread of join retries, s
+const u1_t JOIN_SPREAD_SECS = 8;
+
+//
+// link check, counted in LMIC.adrAckReq
+//
+const s1_t LINK_CHECK_CONT = 0;
+const s1_t LINK_CHECK_DEAD = 32;
+const s1_t LINK_CHECK_INIT = -64;
+const s1_t LINK_CHECK_OFF = -128;
+
+//
+// MAC header and frame control
+//
+const u1_t HDR_FTYPE_JREQ = 0x00;
+const u1_t HDR_FTYPE_JACC = 0x20;
+const u1_t HDR_FTYPE_DAUP = 0x40;
+const u1_t HDR_FTYPE_DADN = 0x60;
+const u1_t HDR_FTYPE_DCUP = 0x80;
+const u1_t HDR_FTYPE_DCDN = 0xA0;
+const u1_t HDR_FTYPE = 0xE0;
+const u1_t HDR_MAJOR = 0x03;
+
+const u1_t FCT_ADREN = 0x80;
+const u1_t FCT_ADRACKReq = 0x40;
+const u1_t FCT_ACK = 0x20;
+const u1_t FCT_OPTLEN = 0x0F;
+
+const u1_t LEN_JR = 23;
+const u1_t LEN_JA = 17;
+const u1_t LEN_JAEXT = LEN_JA + 16;
+
+//
+// MAC commands: the answers the device understands, the requests it sends
+//
+const u1_t MCMD_LCHK_REQ = 0x02;
+const u1_t MCMD_LCHK_ANS = 0x02;
+const u1_t MCMD_DEVTIME_REQ = 0x0D;
+const u1_t MCMD_DEVTIME_ANS = 0x0D;
+
+//
+// EU868
+//
+const u4_t EU868_F1 = 868100000;
+const u4_t EU868_F2 = 868300000;
+const u4_t EU868_F3 = 868500000;
+const u4_t EU868_FDOWN = 869525000;
+const u1_t NUM_DEFAULT_CHANNELS = 3;
+
+/// longest MAC payload (M) per data rate
+const u1_t MAX_MAC_PAYLOAD[] = {59, 59, 59, 123, 230, 230, 230, 230};
+
+void report(const ev_t ev)
+{
+        onEvent(ev);
+}
+
+u1_t rnd_below(const u1_t n)
+{
+        return static_cast<u1_t>(os_getRndU1() % n);
+}
+
+rps_t updr2rps(const dr_t dr)
+{
+        static const u1_t sf[] = {SF12, SF11, SF10, SF9, SF8, SF7, SF7, FSK};
+
+        return makeRps(sf[dr], dr == DR_SF7B ? BW250 : BW125, CR_4_5, 0, 0);
+}
+
+rps_t dndr2rps(const dr_t dr)
+{
+        return updr2rps(dr) | makeRps(0, 0, 0, 0, 1);
+}
+
+u1_t band_of(const u4_t freq)
+{
+        if (freq >= 869400000 && freq <= 869650000)
+        {
+                return BAND_DECI;
+        }
+
+        if ((freq >= 868000000 && freq <= 868600000) || (freq >= 869700000 && freq <= 870000000))
+        {
+                return BAND_CENTI;
+        }
+
+        return BAND_MILLI;
+}
+
+void default_channels()
+{
+        (void) memset(LMIC.channelFreq, 0, sizeof(LMIC.channelFreq));
+        (void) memset(LMIC.channelDrMap, 0, sizeof(LMIC.channelDrMap));
+        (void) memset(LMIC.bands, 0, sizeof(LMIC.bands));
+
+        static const u4_t freqs[NUM_DEFAULT_CHANNELS] = {EU868_F1, EU868_F2, EU868_F3};
+
+        for (u1_t ch = 0; ch < NUM_DEFAULT_CHANNELS; ch++)
+        {
+                LMIC.channelFreq[ch] = freqs[ch] | BAND_CENTI;
+                LMIC.channelDrMap[ch] = DR_RANGE_MAP(DR_SF12, DR_SF7);
+        }
+
+        LMIC.channelMap = (1 << NUM_DEFAULT_CHANNELS) - 1;
+
+        static const u2_t txcaps[MAX_BANDS] = {1000, 100, 10, 100};
+
+        for (u1_t b = 0; b < MAX_BANDS; b++)
+        {
+                LMIC.bands[b].txcap = txcaps[b];
+                LMIC.bands[b].txpow = 14;
+                LMIC.bands[b].lastchnl = rnd_below(MAX_CHANNELS);
+                LMIC.bands[b].avail = os_getTime();
+        }
+
+        LMIC.bands[BAND_DECI].txpow = 27;
+}
+
+///
+/// \brief           The enabled channel for the current data rate whose
+///                  band frees up first, ties broken at random
+///
+/// \param[out]      avail    when its band is free
+///
+/// \return          the channel, MAX_CHANNELS if none carries the data rate
+///
+u1_t next_channel(ostime_t *avail)
+{
+        u1_t best = MAX_CHANNELS;
+        u1_t start = rnd_below(MAX_CHANNELS);
+
+        for (u1_t i = 0; i < MAX_CHANNELS; i++)
+        {
+                u1_t ch = static_cast<u1_t>((start + i) % MAX_CHANNELS);
+
+                if ((LMIC.channelMap & (1 << ch)) == 0 || LMIC.channelFreq[ch] == 0 ||
+                    (LMIC.channelDrMap[ch] & (1 << LMIC.datarate)) == 0)
+                {
+                        continue;
+                }
+
+                const band_t &band = LMIC.bands[LMIC.channelFreq[ch] & 0x3];
+
+                if (best == MAX_CHANNELS || sim::diff(band.avail, *avail) < 0)
+                {
+                        best = ch;
+                        *avail = band.avail;
+                }
+        }
+
+        return best;
+}
+
+//
+// crypto, as lmic.c lays out the B0 and A blocks
+//
+u4_t frame_mic(const u1_t *key, const u1_t dir, const u4_t seqno, u1_t *pdu, const u1_t len)
+{
+        (void) memcpy(AESkey, key, 16);
+        (void) memset(AESaux, 0, 16);
+        AESaux[0] = 0x49;
+        AESaux[5] = dir;
+        os_wlsbf4(AESaux + 6, LMIC.devaddr);
+        os_wlsbf4(AESaux + 10, seqno);
+        AESaux[15] = len;
+
+        return os_aes(AES_MIC, pdu, len);
+}
+
+void frame_cipher(const u1_t *key, const u1_t dir, const u4_t seqno, u1_t *payload, const u1_t len)
+{
+        if (len == 0)
+        {
+                return;
+        }
+
+        (void) memcpy(AESkey, key, 16);
+        (void) memset(AESaux, 0, 16);
+        AESaux[0] = AESaux[15] = 1;
+        AESaux[5] = dir;
+        os_wlsbf4(AESaux + 6, LMIC.devaddr);
+        os_wlsbf4(AESaux + 10, seqno);
+
+        (void) os_aes(AES_CTR, payload, len);
+}
+
+void session_key(const u1_t type, const u1_t *accept, u1_t *key)
+{
+        (void) memset(key, 0, 16);
+        key[0] = type;
+        (void) memcpy(key + 1, accept + 1, 6);
+        os_wlsbf2(key + 7, LMIC.devNonce);
+
+        os_getDevKey(AESkey);
+        (void) os_aes(AES_ENC, key, 16);
+}
+
+void build_join_request()
+{
+        u1_t *d = LMIC.frame;
+
+        d[OFF_DAT_HDR] = HDR_FTYPE_JREQ;
+        os_getArtEui(d + 1);
+        os_getDevEui(d + 9);
+        os_wlsbf2(d + 17, LMIC.devNonce);
+
+        os_getDevKey(AESkey);
+        os_wmsbf4(d + 19, os_aes(AES_MIC | AES_MICNOAUX, d, 19));
+
+        LMIC.dataLen = LEN_JR;
+}
+
+///
+/// \brief           Frame of the pending data, with the MAC commands due
+///
+/// \return          false if it doesn't fit the data rate
+///
+bool build_data_frame()
+{
+        u1_t *d = LMIC.frame;
+
+        //
+        // a retry goes out with the same counter
+        //
+        u4_t seqno = LMIC.txCnt == 0 ? LMIC.seqnoUp++ : LMIC.seqnoUp - 1;
+
+        if (LMIC.txCnt == 0 && LMIC.adrAckReq != LINK_CHECK_OFF && LMIC.adrAckReq < LINK_CHECK_DEAD)
+        {
+                LMIC.adrAckReq++;
+        }
+
+        u1_t olen = 0;
+
+#if LMIC_ENABLE_DeviceTimeReq
+
+        if (LMIC.txDeviceTimeReqState == lmic_RequestTimeState_tx ||
+            LMIC.txDeviceTimeReqState == lmic_RequestTimeState_rx)
+        {
+                d[OFF_DAT_OPTS + olen++] = MCMD_DEVTIME_REQ;
+                LMIC.txDeviceTimeReqState = lmic_RequestTimeState_rx;
+        }
+
+#endif
+
+        if (LMIC.adrAckReq == LINK_CHECK_DEAD)
+        {
+                d[OFF_DAT_OPTS + olen++] = MCMD_LCHK_REQ;
+        }
+
+        d[OFF_DAT_HDR] = LMIC.pendTxConf ? HDR_FTYPE_DCUP : HDR_FTYPE_DAUP;
+        os_wlsbf4(d + OFF_DAT_ADDR, LMIC.devaddr);
+        d[OFF_DAT_FCT] = static_cast<u1_t>((LMIC.adrEnabled ? FCT_ADREN : 0) | LMIC.dnConf |
+                                           (LMIC.adrAckReq >= LINK_CHECK_CONT ? FCT_ADRACKReq : 0) | olen);
+        os_wlsbf2(d + OFF_DAT_SEQNO, static_cast<u2_t>(seqno));
+
+        u2_t end = OFF_DAT_OPTS + olen;
+
+        d[end] = LMIC.pendTxPort;
+        (void) memcpy(d + end + 1, LMIC.pendTxData, LMIC.pendTxLen);
+        frame_cipher(LMIC.pendTxPort == 0 ? LMIC.nwkKey : LMIC.artKey, 0, seqno, d + end + 1, LMIC.pendTxLen);
+        end += 1 + LMIC.pendTxLen;
+
+        if (end - 1 > MAX_MAC_PAYLOAD[LMIC.datarate])
+        {
+                return false;
+        }
+
+        os_wmsbf4(d + end, frame_mic(LMIC.nwkKey, 0, seqno, d, static_cast<u1_t>(end)));
+
+        LMIC.dnConf = 0;
+        LMIC.dataLen = static_cast<u1_t>(end + MIC_LEN);
+
+        return true;
+}
+
+void run_engine(osjob_t *job);
+void on_txdone(osjob_t *job);
+
+void start_tx(const bool join)
+{
+        if (join)
+        {
+                build_join_request();
+        }
+        else if (!build_data_frame())
+        {
+                LMIC.opmode &= ~OP_TXDATA;
+                report(EV_TXCANCELED);
+                return;
+        }
+
+        ostime_t now = os_getTime();
+        band_t &band = LMIC.bands[LMIC.channelFreq[LMIC.txChnl] & 0x3];
+
+        LMIC.freq = LMIC.channelFreq[LMIC.txChnl] & ~static_cast<u4_t>(0x3);
+        LMIC.rps = updr2rps(LMIC.datarate);
+        LMIC.txpow = LMIC.adrTxPow < band.txpow ? LMIC.adrTxPow : band.txpow;
+        LMIC.txrxFlags = 0;
+        LMIC.opmode |= OP_TXRXPEND;
+
+        report(EV_TXSTART);
+
+        LMIC.txend = sx1276::tx(LMIC.frame, LMIC.dataLen, LMIC.freq, LMIC.rps, LMIC.txpow, now);
+
+        //
+        // duty cycle: the band, and the whole radio
+        //
+        ostime_t airtime = LMIC.txend - now;
+
+        band.avail = now + airtime * band.txcap;
+        band.lastchnl = LMIC.txChnl;
+        LMIC.globalDutyAvail = now + (airtime << LMIC.globalDutyRate);
+
+        os_setTimedCallback(&LMIC.osjob, LMIC.txend, on_txdone);
+}
+
+void engine_update()
+{
+        if (LMIC.opmode & (OP_SHUTDOWN | OP_TXRXPEND))
+        {
+                return;
+        }
+
+        //
+        // data without a session: LMIC joins first
+        //
+        if (LMIC.devaddr == 0 && (LMIC.opmode & OP_JOINING) == 0)
+        {
+                if (LMIC.opmode & OP_TXDATA)
+                {
+                        (void) LMIC_startJoining();
+                }
+                return;
+        }
+
+        bool join = (LMIC.opmode & OP_JOINING) != 0;
+
+        if (!join && (LMIC.opmode & OP_TXDATA) == 0)
+        {
+                return;
+        }
+
+        ostime_t now = os_getTime();
+        ostime_t txbeg = (join && sim::diff(LMIC.txend, now) > 0) ? LMIC.txend : now;
+        ostime_t avail = 0;
+        u1_t ch = next_channel(&avail);
+
+        if (ch == MAX_CHANNELS)
+        {
+                LMIC.opmode &= ~OP_TXDATA;
+                report(EV_TXCANCELED);
+                return;
+        }
+
+        if (sim::diff(avail, txbeg) > 0)
+        {
+                txbeg = avail;
+        }
+
+        if (sim::diff(LMIC.globalDutyAvail, txbeg) > 0)
+        {
+                txbeg = LMIC.globalDutyAvail;
+        }
+
+        LMIC.txChnl = ch;
+
+        if (sim::diff(txbeg, now) > 0)
+        {
+                os_setTimedCallback(&LMIC.osjob, txbeg, run_engine);
+                return;
+        }
+
+        start_tx(join);
+}
+
+void run_engine(osjob_t *job)
+{
+        (void) job;
+
+        engine_update();
+}
+
+///
+/// \brief           Opens a receive window delay after the TX end, with
+///                  room for the clock error either way
+///
+void schedule_rx(const ostime_t delay, const dr_t dr, osjobcb_t func)
+{
+        ostime_t sym = sx1276::symbol(dndr2rps(dr));
+        ostime_t margin = static_cast<ostime_t>(static_cast<int64_t>(delay) * LMIC.clockError / MAX_CLOCK_ERROR);
+        ostime_t extra = (margin + sym - 1) / sym;
+        ostime_t syms = MINRX_SYMS + 2 * extra;
+
+        LMIC.dndr = dr;
+        LMIC.rxsyms = static_cast<u1_t>(syms > 255 ? 255 : syms);
+        LMIC.rxtime = LMIC.txend + delay + (PAMBL_SYMS - MINRX_SYMS) / 2 * sym - extra * sym;
+
+        os_setTimedCallback(&LMIC.osjob, LMIC.rxtime, func);
+}
+
+///
+/// \brief           Single RX in the window just scheduled
+///
+/// \return          when the radio is done: RX done or timeout
+///
+ostime_t receive(const u4_t freq)
+{
+        rps_t rps = dndr2rps(LMIC.dndr);
+        ostime_t close = LMIC.rxtime + LMIC.rxsyms * sx1276::symbol(rps);
+        sx1276::rx_t rx;
+
+        if (!sx1276::rx(freq, rps, LMIC.rxtime, close, LMIC.frame, &rx))
+        {
+                LMIC.dataLen = 0;
+                return close;
+        }
+
+        LMIC.dataLen = rx.len;
+        LMIC.rxtime = rx.end;
+        LMIC.rps = rx.rps;
+        LMIC.snr = rx.snr;
+        LMIC.rssi = static_cast<s1_t>(rx.rssi + 64 > 127 ? 127 : (rx.rssi + 64 < -128 ? -128 : rx.rssi + 64));
+
+        return rx.end;
+}
+
+void mac_commands(const u1_t *opts, const u1_t olen)
+{
+        for (u1_t i = 0; i < olen;)
+        {
+                switch (opts[i])
+                {
+
+                case MCMD_LCHK_ANS:
+                        if (i + 3 > olen)
+                        {
+                                return;
+                        }
+                        LMIC.gwMargin = opts[i + 1];
+                        LMIC.gwCnt = opts[i + 2];
+                        i += 3;
+                        break;
+
+                case MCMD_DEVTIME_ANS:
+                        if (i + 6 > olen)
+                        {
+                                return;
+                        }
+                        if (LMIC.txDeviceTimeReqState == lmic_RequestTimeState_rx)
+                        {
+                                LMIC.netDeviceTime = os_rlsbf4(opts + i + 1);
+                                LMIC.netDeviceTimeFrac = opts[i + 5];
+                                LMIC.txDeviceTimeReqState = lmic_RequestTimeState_success;
+                        }
+                        i += 6;
+                        break;
+
+                default:
+                        //
+                        // can't tell its length: the rest is lost, as in lmic.c
+                        //
+                        return;
+                }
+        }
+}
+
+bool decode_join_accept()
+{
+        u1_t *d = LMIC.frame;
+        u1_t len = LMIC.dataLen;
+
+        if ((len != LEN_JA && len != LEN_JAEXT) || d[OFF_DAT_HDR] != (HDR_FTYPE_JACC | 0))
+        {
+                return false;
+        }
+
+        //
+        // the network encrypts with AES decrypt, so the device decrypts
+        // with AES encrypt
+        //
+        os_getDevKey(AESkey);
+        (void) os_aes(AES_ENC, d + 1, len - 1);
+
+        os_getDevKey(AESkey);
+        if (os_aes(AES_MIC | AES_MICNOAUX, d, len - MIC_LEN) != os_rmsbf4(d + len - MIC_LEN))
+        {
+                return false;
+        }
+
+        session_key(0x01, d, LMIC.nwkKey);
+        session_key(0x02, d, LMIC.artKey);
+
+        LMIC.netid = (d[4] | (d[5] << 8) | (d[6] << 16)) & 0xFFFFFF;
+        LMIC.devaddr = os_rlsbf4(d + 7);
+        LMIC.dn1DrOffset = (d[11] >> 4) & 0x7;
+        LMIC.dn2Dr = d[11] & 0xF;
+        LMIC.rxDelay = (d[12] & 0xF) != 0 ? (d[12] & 0xF) : 1;
+
+        if (len == LEN_JAEXT)
+        {
+                for (u1_t i = 0; i < 5; i++)
+                {
+                        const u1_t *f = d + 13 + 3 * i;
+                        u4_t freq = (f[0] | (f[1] << 8) | (f[2] << 16)) * 100;
+
+                        if (freq != 0)
+                        {
+                                (void) LMIC_setupChannel(NUM_DEFAULT_CHANNELS + i, freq, 0, -1);
+                        }
+                }
+        }
+
+        LMIC.seqnoUp = 0;
+        LMIC.seqnoDn = 0;
+        LMIC.devNonce++;
+
+        return true;
+}
+
+///
+/// \brief           Checks and decodes a downlink in LMIC.frame
+///
+/// \return          true if it's ours
+///
+bool decode_data(const u1_t window)
+{
+        u1_t *d = LMIC.frame;
+        u1_t len = LMIC.dataLen;
+
+        if (len < OFF_DAT_OPTS + MIC_LEN)
+        {
+                return false;
+        }
+
+        u1_t ftype = d[OFF_DAT_HDR] & HDR_FTYPE;
+
+        if ((ftype != HDR_FTYPE_DADN && ftype != HDR_FTYPE_DCDN) || (d[OFF_DAT_HDR] & HDR_MAJOR) != 0 ||
+            os_rlsbf4(d + OFF_DAT_ADDR) != LMIC.devaddr)
+        {
+                return false;
+        }
+
+        u1_t fct = d[OFF_DAT_FCT];
+        u1_t olen = fct & FCT_OPTLEN;
+        u1_t poff = OFF_DAT_OPTS + olen;
+        u1_t pend = len - MIC_LEN;
+
+        if (poff > pend)
+        {
+                return false;
+        }
+
+        //
+        // the frame has the low 16 bits of the counter
+        //
+        u4_t seqno = LMIC.seqnoDn + static_cast<u2_t>(os_rlsbf2(d + OFF_DAT_SEQNO) - LMIC.seqnoDn);
+
+        if (frame_mic(LMIC.nwkKey, 1, seqno, d, pend) != os_rmsbf4(d + pend))
+        {
+                return false;
+        }
+
+        if (static_cast<s4_t>(seqno - LMIC.seqnoDn) < 0)
+        {
+                return false;
+        }
+
+        LMIC.seqnoDn = seqno + 1;
+
+        u1_t flags = window == 1 ? TXRX_DNW1 : TXRX_DNW2;
+
+        if (ftype == HDR_FTYPE_DCDN)
+        {
+                LMIC.dnConf = FCT_ACK;
+        }
+
+        if (LMIC.pendTxConf && (fct & FCT_ACK))
+        {
+                flags |= TXRX_ACK;
+        }
+
+        //
+        // the network hears us
+        //
+        if (LMIC.adrAckReq != LINK_CHECK_OFF)
+        {
+                LMIC.adrAckReq = LINK_CHECK_INIT;
+        }
+
+        if (LMIC.opmode & OP_LINKDEAD)
+        {
+                LMIC.opmode &= ~OP_LINKDEAD;
+                report(EV_LINK_ALIVE);
+        }
+
+        mac_commands(d + OFF_DAT_OPTS, olen);
+
+        LMIC.dataBeg = poff;
+        LMIC.dataLen = 0;
+
+        if (poff < pend)
+        {
+                u1_t port = d[poff];
+                u1_t plen = pend - poff - 1;
+
+                frame_cipher(port == 0 ? LMIC.nwkKey : LMIC.artKey, 1, seqno, d + poff + 1, plen);
+
+                if (port == 0)
+                {
+                        if (olen == 0)
+                        {
+                                mac_commands(d + poff + 1, plen);
+                        }
+                        flags |= TXRX_NOPORT;
+                }
+                else
+                {
+                        flags |= TXRX_PORT;
+                        LMIC.dataBeg = poff + 1;
+                        LMIC.dataLen = plen;
+                }
+        }
+        else
+        {
+                flags |= TXRX_NOPORT;
+        }
+
+        LMIC.txrxFlags = flags;
+
+        return true;
+}
+
+void finish_join(const bool joined)
+{
+        LMIC.opmode &= ~OP_TXRXPEND;
+
+        if (joined)
+        {
+                LMIC.opmode &= ~OP_JOINING;
+                LMIC.txCnt = 0;
+                LMIC.dnConf = 0;
+                LMIC.adrAckReq = LMIC.adrAckReq != LINK_CHECK_OFF ? LINK_CHECK_INIT : LINK_CHECK_OFF;
+
+                report(EV_JOINED);
+                engine_update();
+                return;
+        }
+
+        LMIC.devNonce++;
+        report(EV_JOIN_TXCOMPLETE);
+
+        //
+        // next attempt: a step slower every other time, after a random pause
+        //
+        LMIC.txCnt++;
+
+        if ((LMIC.txCnt & 1) == 0 && LMIC.datarate > DR_SF12)
+        {
+                LMIC.datarate--;
+        }
+
+        LMIC.txend = os_getTime() + sec2osticks(DELAY_EXTDNW2) + ms2osticks(rnd_below(JOIN_SPREAD_SECS * 25) * 40);
+
+        engine_update();
+}
+
+void finish_data(const bool got)
+{
+        LMIC.opmode &= ~OP_TXRXPEND;
+
+        if (!got)
+        {
+                LMIC.txrxFlags = 0;
+                LMIC.dataBeg = 0;
+                LMIC.dataLen = 0;
+        }
+
+        bool acked = (LMIC.txrxFlags & TXRX_ACK) != 0;
+
+        //
+        // confirmed and not acknowledged: again with the same counter,
+        // slower on attempts 2, 4 and 6, after a random pause
+        //
+        if (LMIC.pendTxConf && !acked && LMIC.txCnt < TXCONF_ATTEMPTS)
+        {
+                if ((LMIC.txCnt & 1) == 1 && LMIC.txCnt < 7 && LMIC.datarate > DR_SF12)
+                {
+                        LMIC.datarate--;
+                }
+
+                ostime_t retry = os_getTime() + ms2osticks(rnd_below(RETRY_PERIOD_SECS * 50) * 20);
+
+                if (sim::diff(LMIC.globalDutyAvail, retry) < 0)
+                {
+                        LMIC.globalDutyAvail = retry;
+                }
+
+                engine_update();
+                return;
+        }
+
+        if (LMIC.pendTxConf && !acked)
+        {
+                LMIC.txrxFlags |= TXRX_NACK;
+        }
+
+        LMIC.opmode &= ~OP_TXDATA;
+        LMIC.txCnt = 0;
+
+        if (LMIC.adrAckReq == LINK_CHECK_DEAD && (LMIC.opmode & OP_LINKDEAD) == 0)
+        {
+                LMIC.opmode |= OP_LINKDEAD;
+                report(EV_LINK_DEAD);
+        }
+
+#if LMIC_ENABLE_DeviceTimeReq
+
+        if (LMIC.txDeviceTimeReqState != lmic_RequestTimeState_idle)
+        {
+                bool ok = LMIC.txDeviceTimeReqState == lmic_RequestTimeState_success;
+
+                LMIC.txDeviceTimeReqState = lmic_RequestTimeState_idle;
+
+                if (LMIC.pNetworkTimeCb != nullptr)
+                {
+                        LMIC.pNetworkTimeCb(LMIC.pNetworkTimeUserData, ok ? 1 : 0);
+                }
+        }
+
+#endif
+
+        report(EV_TXCOMPLETE);
+        engine_update();
+}
+
+bool joining()
+{
+        return (LMIC.opmode & OP_JOINING) != 0;
+}
+
+bool decode(const u1_t window)
+{
+        return LMIC.dataLen > 0 && (joining() ? decode_join_accept() : decode_data(window));
+}
+
+void finish(const bool got)
+{
+        if (joining())
+        {
+                finish_join(got);
+        }
+        else
+        {
+                finish_data(got);
+        }
+}
+
+void on_rx2_done(osjob_t *job)
+{
+        (void) job;
+
+        finish(decode(2));
+}
+
+void on_rx2(osjob_t *job)
+{
+        (void) job;
+
+        os_setTimedCallback(&LMIC.osjob, receive(LMIC.dn2Freq), on_rx2_done);
+}
+
+void on_rx1_done(osjob_t *job)
+{
+        (void) job;
+
+        if (decode(1))
+        {
+                finish(true);
+                return;
+        }
+
+        u1_t delay = joining() ? DELAY_JACC1 : LMIC.rxDelay;
+
+        schedule_rx(sec2osticks(delay + DELAY_EXTDNW2), LMIC.dn2Dr, on_rx2);
+}
+
+void on_rx1(osjob_t *job)
+{
+        (void) job;
+
+        os_setTimedCallback(&LMIC.osjob, receive(LMIC.freq), on_rx1_done);
+}
+
+void on_txdone(osjob_t *job)
+{
+        (void) job;
+
+        bool join = joining();
+
+        if (!join)
+        {
+                LMIC.txCnt++;
+
+#if LMIC_ENABLE_DeviceTimeReq
+
+                if (LMIC.txDeviceTimeReqState == lmic_RequestTimeState_rx)
+                {
+                        LMIC.localDeviceTime = LMIC.txend;
+                }
+
+#endif
+        }
+
+        //
+        // RX1 on the uplink channel, at the uplink data rate less the offset
+        //
+        dr_t dr = LMIC.datarate;
+
+        if (!join)
+        {
+                dr = dr > LMIC.dn1DrOffset ? dr - LMIC.dn1DrOffset : DR_SF12;
+        }
+
+        schedule_rx(sec2osticks(join ? DELAY_JACC1 : LMIC.rxDelay), dr, on_rx1);
+}
+
+} // namespace
+
+void LMIC_reset(void)
+{
+        sx1276::sleep();
+        os_clearCallback(&LMIC.osjob);
+
+        (void) memset(&LMIC, 0, sizeof(LMIC));
+
+        LMIC.opmode = OP_NONE;
+        LMIC.devNonce = static_cast<u2_t>(os_getRndU1() | (os_getRndU1() << 8));
+        LMIC.adrEnabled = FCT_ADREN;
+        LMIC.adrAckReq = LINK_CHECK_INIT;
+        LMIC.adrTxPow = 14;
+        LMIC.datarate = DR_SF7;
+        LMIC.dn2Dr = DR_SF12;
+        LMIC.dn2Freq = EU868_FDOWN;
+        LMIC.rxDelay = DELAY_DNW1;
+        LMIC.globalDutyAvail = os_getTime();
+        LMIC.txend = os_getTime();
+
+        default_channels();
+}
+
+void LMIC_shutdown(void)
+{
+        os_clearCallback(&LMIC.osjob);
+        sx1276::sleep();
+
+        LMIC.opmode |= OP_SHUTDOWN;
+}
+
+bit_t LMIC_startJoining(void)
+{
+        if (LMIC.devaddr != 0 || (LMIC.opmode & OP_TXRXPEND))
+        {
+                return 0;
+        }
+
+        LMIC.opmode |= OP_JOINING;
+        LMIC.opmode &= ~OP_SHUTDOWN;
+        LMIC.txCnt = 0;
+        LMIC.txend = os_getTime();
+
+        report(EV_JOINING);
+        os_setCallback(&LMIC.osjob, run_engine);
+
+        return 1;
+}
+
+void LMIC_setSession(u4_t netid, devaddr_t devaddr, xref2u1_t nwkKey, xref2u1_t artKey)
+{
+        LMIC.netid = netid;
+        LMIC.devaddr = devaddr;
+
+        if (nwkKey != nullptr)
+        {
+                (void) memcpy(LMIC.nwkKey, nwkKey, 16);
+        }
+
+        if (artKey != nullptr)
+        {
+                (void) memcpy(LMIC.artKey, artKey, 16);
+        }
+
+        LMIC.opmode &= ~(OP_JOINING | OP_TRACK | OP_REJOIN | OP_TXRXPEND | OP_PINGINI | OP_UNJOIN);
+        LMIC.opmode |= OP_NEXTCHNL;
+        LMIC.txCnt = 0;
+        LMIC.seqnoUp = 0;
+        LMIC.seqnoDn = 0;
+        LMIC.dnConf = 0;
+        LMIC.adrAckReq = LMIC.adrAckReq != LINK_CHECK_OFF ? LINK_CHECK_INIT : LINK_CHECK_OFF;
+}
+
+void LMIC_getSessionKeys(u4_t *netid, devaddr_t *devaddr, xref2u1_t nwkKey, xref2u1_t artKey)
+{
+        *netid = LMIC.netid;
+        *devaddr = LMIC.devaddr;
+        (void) memcpy(nwkKey, LMIC.nwkKey, 16);
+        (void) memcpy(artKey, LMIC.artKey, 16);
+}
+
+void LMIC_setSeqnoUp(u4_t seq)
+{
+        LMIC.seqnoUp = seq;
+}
+
+void LMIC_setDrTxpow(dr_t dr, s1_t txpow)
+{
+        if (dr < DR_NONE)
+        {
+                LMIC.datarate = dr;
+        }
+
+        LMIC.adrTxPow = txpow;
+}
+
+void LMIC_setAdrMode(bit_t enabled)
+{
+        LMIC.adrEnabled = enabled ? FCT_ADREN : 0;
+}
+
+void LMIC_setLinkCheckMode(bit_t enabled)
+{
+        LMIC.adrAckReq = enabled ? LINK_CHECK_INIT : LINK_CHECK_OFF;
+}
+
+void LMIC_setClockError(u2_t error)
+{
+        LMIC.clockError = error;
+}
+
+lmic_tx_error_t LMIC_setTxData2(u1_t port, xref2u1_t data, u1_t dlen, u1_t confirmed)
+{
+        if (LMIC.opmode & (OP_TXDATA | OP_TXRXPEND))
+        {
+                return LMIC_ERROR_TX_BUSY;
+        }
+
+        if (dlen > sizeof(LMIC.pendTxData))
+        {
+                return LMIC_ERROR_TX_TOO_LARGE;
+        }
+
+        if (data != nullptr)
+        {
+                (void) memcpy(LMIC.pendTxData, data, dlen);
+        }
+
+        LMIC.pendTxPort = port;
+        LMIC.pendTxConf = confirmed;
+        LMIC.pendTxLen = dlen;
+        LMIC.txCnt = 0;
+        LMIC.opmode |= OP_TXDATA;
+
+        engine_update();
+
+        return LMIC_ERROR_SUCCESS;
+}
+
+void LMIC_requestNetworkTime(lmic_request_network_time_cb_t *pCallbackfn, void *pUserData)
+{
+#if LMIC_ENABLE_DeviceTimeReq
+
+        if (LMIC.txDeviceTimeReqState == lmic_RequestTimeState_idle)
+        {
+                LMIC.txDeviceTimeReqState = lmic_RequestTimeState_tx;
+                LMIC.pNetworkTimeCb = pCallbackfn;
+                LMIC.pNetworkTimeUserData = pUserData;
+                return;
+        }
+
+#endif
+
+        if (pCallbackfn != nullptr)
+        {
+                pCallbackfn(pUserData, 0);
+        }
+}
+
+int LMIC_getNetworkTimeReference(lmic_time_reference_t *pReference)
+{
+        if (pReference == nullptr || LMIC.netDeviceTime == 0)
+        {
+                return 0;
+        }
+
+        pReference->tLocal = LMIC.localDeviceTime;
+        pReference->tNetwork = LMIC.netDeviceTime;
+
+        return 1;
+}
+
+ostime_t calcAirTime(rps_t rps, u1_t plen)
+{
+        u1_t sf = getSf(rps);
+
+        //
+        // FSK at 50 kbps: preamble, sync word, length, payload and CRC
+        //
+        if (sf == FSK)
+        {
+                return us2osticks((plen + 5 + 3 + 1 + 2) * 8 * 20);
+        }
+
+        u1_t sfx = 7 + sf - SF7;
+        u1_t bw = getBw(rps);
+        bool de = sfx >= 11 && bw == BW125;
+        int ih = getIh(rps) != 0 ? 1 : 0;
+        int crc = getNocrc(rps) ? 0 : 1;
+        int cr = getCr(rps) + 1;
+
+        int num = 8 * plen - 4 * sfx + 28 + 16 * crc - 20 * ih;
+        int den = 4 * (sfx - (de ? 2 : 0));
+        int payload = 8 + (num > 0 ? (num + den - 1) / den * (cr + 4) : 0);
+
+        //
+        // 12.25 preamble symbols plus the payload, in 1/4 symbols
+        //
+        int64_t quarters = 49 + 4 * payload;
+        int64_t sym_us = (1000LL << sfx) / (125 << bw);
+
+        return us2osticks(quarters * sym_us / 4);
+}
+
+bit_t LMIC_setupChannel(u1_t channel, u4_t freq, u2_t drmap, s1_t band)
+{
+        if (channel >= MAX_CHANNELS)
+        {
+                return 0;
+        }
+
+        if (band == -1)
+        {
+                band = static_cast<s1_t>(band_of(freq));
+        }
+
+        LMIC.channelFreq[channel] = (freq & ~static_cast<u4_t>(0x3)) | static_cast<u1_t>(band);
+        LMIC.channelDrMap[channel] = drmap == 0 ? DR_RANGE_MAP(DR_SF12, DR_SF7) : drmap;
+        LMIC.channelMap |= 1 << channel;
+
+        return 1;
+}
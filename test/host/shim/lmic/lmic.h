@@ -0,0 +1,422 @@
+/*
+ *
+ * LMIC stand-in
+ *
+ * PURPOSE: Host builds only: the interface of MCCI arduino-lmic the
+ *          firmware uses, with the names and semantics of the library.
+ *          The region constants (data rate numbering, bands, channel
+ *          count) follow the CFG_xxx region given on the command line; the
+ *          MAC behind the rest (lmic.cpp, oslmic.cpp) is a class A
+ *          LoRaWAN 1.0 device for EU868 on a simulated SX1276 (sx1276.cpp)
+ *          and a software os_aes() (aes.cpp)
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+typedef uint8_t  u1_t;
+typedef int8_t   s1_t;
+typedef uint16_t u2_t;
+typedef int16_t  s2_t;
+typedef uint32_t u4_t;
+typedef int32_t  s4_t;
+typedef u1_t     bit_t;
+typedef u1_t     dr_t;
+typedef s4_t     ostime_t;
+typedef u1_t    *xref2u1_t;
+typedef const u1_t *xref2cu1_t;
+typedef u4_t     devaddr_t;
+typedef u2_t     rps_t;
+typedef u4_t     lmic_gpstime_t;
+
+#if defined(CFG_us915) || defined(CFG_au915)
+#define CFG_LMIC_US_like 1
+#else
+#define CFG_LMIC_EU_like 1
+#endif
+
+#ifndef LMIC_ENABLE_DeviceTimeReq
+#define LMIC_ENABLE_DeviceTimeReq 0
+#endif
+
+//
+// time, as in oslmic.h with the Arduino HAL: 16 us ticks from micros()
+//
+#define US_PER_OSTICK_EXPONENT 4
+#define US_PER_OSTICK (1 << US_PER_OSTICK_EXPONENT)
+#define OSTICKS_PER_SEC (1000000 / US_PER_OSTICK)
+
+#define us2osticks(us)   ((ostime_t) (((int64_t) (us) * OSTICKS_PER_SEC) / 1000000))
+#define ms2osticks(ms)   ((ostime_t) (((int64_t) (ms) * OSTICKS_PER_SEC) / 1000))
+#define sec2osticks(sec) ((ostime_t) ((int64_t) (sec) * OSTICKS_PER_SEC))
+#define osticks2ms(os)   ((s4_t) (((os) * (int64_t) 1000) / OSTICKS_PER_SEC))
+#define osticks2us(os)   ((s4_t) (((os) * (int64_t) 1000000) / OSTICKS_PER_SEC))
+
+//
+// radio parameters, as in lorabase.h
+//
+enum _cr_t { CR_4_5 = 0, CR_4_6, CR_4_7, CR_4_8 };
+enum _sf_t { FSK = 0, SF7, SF8, SF9, SF10, SF11, SF12, SFrfu };
+enum _bw_t { BW125 = 0, BW250, BW500, BWrfu };
+typedef u1_t cr_t;
+typedef u1_t sf_t;
+typedef u1_t bw_t;
+
+inline sf_t getSf(rps_t params) { return (sf_t) (params & 0x7); }
+inline bw_t getBw(rps_t params) { return (bw_t) ((params >> 3) & 0x3); }
+inline cr_t getCr(rps_t params) { return (cr_t) ((params >> 5) & 0x3); }
+inline int getNocrc(rps_t params) { return (params >> 7) & 0x1; }
+inline int getIh(rps_t params) { return (params >> 8) & 0xFF; }
+
+inline rps_t makeRps(sf_t sf, bw_t bw, cr_t cr, int ih, int nocrc)
+{
+        return (rps_t) ((sf & 0x7) | ((bw & 0x3) << 3) | ((cr & 0x3) << 5) | (nocrc ? (1 << 7) : 0) | ((ih & 0xFF) << 8));
+}
+
+//
+// data rate numbering, as in lorabase_xxx.h
+//
+#if defined(CFG_us915)
+enum { DR_SF10 = 0, DR_SF9, DR_SF8, DR_SF7, DR_SF8C, DR_NONE };
+#elif defined(CFG_au915)
+enum { DR_SF12 = 0, DR_SF11, DR_SF10, DR_SF9, DR_SF8, DR_SF7, DR_SF8C, DR_NONE };
+#else
+enum { DR_SF12 = 0, DR_SF11, DR_SF10, DR_SF9, DR_SF8, DR_SF7, DR_SF7B, DR_FSK, DR_NONE };
+#endif
+
+#define DR_RANGE_MAP(drlo, drhi) ((u2_t)((0xFFFFu << (drlo)) & (0xFFFFu >> (15 - (drhi)))))
+
+#if defined(CFG_LMIC_EU_like)
+enum { BAND_MILLI = 0, BAND_CENTI = 1, BAND_DECI = 2, BAND_AUX = 3 };
+enum { MAX_CHANNELS = 16, MAX_BANDS = 4 };
+#else
+enum { MAX_CHANNELS = 72 };
+#endif
+
+//
+// frame layout, as in lorabase.h
+//
+#ifndef LMIC_MAX_FRAME_LENGTH
+#define LMIC_MAX_FRAME_LENGTH 255
+#endif
+
+enum { MAX_LEN_FRAME = LMIC_MAX_FRAME_LENGTH };
+enum { MIC_LEN = 4 };
+enum { OFF_DAT_HDR = 0, OFF_DAT_ADDR = 1, OFF_DAT_FCT = 5, OFF_DAT_SEQNO = 6, OFF_DAT_OPTS = 8 };
+enum { MAX_LEN_PAYLOAD = MAX_LEN_FRAME - (int) OFF_DAT_OPTS - 1 - MIC_LEN };
+
+/// the clock error LMIC_setClockError() takes is a fraction of this
+#define MAX_CLOCK_ERROR 65536
+
+//
+// LMIC state, as in lmic.h
+//
+enum
+{
+        OP_NONE     = 0x0000,
+        OP_SCAN     = 0x0001,
+        OP_TRACK    = 0x0002,
+        OP_JOINING  = 0x0004,
+        OP_TXDATA   = 0x0008,
+        OP_POLL     = 0x0010,
+        OP_REJOIN   = 0x0020,
+        OP_SHUTDOWN = 0x0040,
+        OP_TXRXPEND = 0x0080,
+        OP_RNDTX    = 0x0100,
+        OP_PINGINI  = 0x0200,
+        OP_PINGABLE = 0x0400,
+        OP_NEXTCHNL = 0x0800,
+        OP_LINKDEAD = 0x1000,
+        OP_TESTMODE = 0x2000,
+        OP_UNJOIN   = 0x4000,
+};
+
+enum
+{
+        TXRX_ACK    = 0x80,
+        TXRX_NACK   = 0x40,
+        TXRX_NOPORT = 0x20,
+        TXRX_PORT   = 0x10,
+        TXRX_LENERR = 0x08,
+        TXRX_PING   = 0x04,
+        TXRX_DNW2   = 0x02,
+        TXRX_DNW1   = 0x01,
+};
+
+enum _ev_t
+{
+        EV_SCAN_TIMEOUT = 1,
+        EV_BEACON_FOUND,
+        EV_BEACON_MISSED,
+        EV_BEACON_TRACKED,
+        EV_JOINING,
+        EV_JOINED,
+        EV_RFU1,
+        EV_JOIN_FAILED,
+        EV_REJOIN_FAILED,
+        EV_TXCOMPLETE,
+        EV_LOST_TSYNC,
+        EV_RESET,
+        EV_RXCOMPLETE,
+        EV_LINK_DEAD,
+        EV_LINK_ALIVE,
+        EV_SCAN_FOUND,
+        EV_TXSTART,
+        EV_TXCANCELED,
+        EV_RXSTART,
+        EV_JOIN_TXCOMPLETE,
+};
+typedef enum _ev_t ev_t;
+
+typedef int lmic_tx_error_t;
+
+enum
+{
+        LMIC_ERROR_SUCCESS = 0,
+        LMIC_ERROR_TX_BUSY = -1,
+        LMIC_ERROR_TX_TOO_LARGE = -2,
+        LMIC_ERROR_TX_NOT_FEASIBLE = -3,
+        LMIC_ERROR_TX_FAILED = -4,
+};
+
+enum
+{
+        lmic_RequestTimeState_idle = 0,
+        lmic_RequestTimeState_tx,
+        lmic_RequestTimeState_rx,
+        lmic_RequestTimeState_success,
+};
+
+typedef struct
+{
+        ostime_t       tLocal;      ///< LMIC clock at the end of the uplink
+        lmic_gpstime_t tNetwork;    ///< network time (GPS seconds) of the same moment
+} lmic_time_reference_t;
+
+typedef void lmic_request_network_time_cb_t(void *pUserData, int flagSuccess);
+
+struct osjob_t;
+typedef void (*osjobcb_t)(struct osjob_t *);
+
+struct osjob_t
+{
+        struct osjob_t *next;
+        ostime_t        deadline;
+        osjobcb_t       func;
+};
+typedef struct osjob_t osjob_t;
+
+#if defined(CFG_LMIC_EU_like)
+
+typedef struct
+{
+        u2_t     txcap;       ///< duty cycle limitation: 1/txcap
+        s1_t     txpow;       ///< maximum TX power
+        u1_t     lastchnl;    ///< last used channel
+        ostime_t avail;       ///< channel is blocked until this time
+} band_t;
+
+#endif
+
+struct lmic_t
+{
+        osjob_t  osjob;
+
+        ostime_t txend;
+        ostime_t rxtime;
+        ostime_t globalDutyAvail;
+        u1_t     globalDutyRate;
+
+        u4_t     freq;
+        s1_t     rssi;            ///< RSSI of the last downlink, dBm + 64
+        s1_t     snr;             ///< SNR of the last downlink, quarters of dB
+        rps_t    rps;
+        u1_t     rxsyms;
+        u1_t     dndr;
+        s1_t     txpow;
+
+#if defined(CFG_LMIC_EU_like)
+        band_t   bands[MAX_BANDS];
+        u4_t     channelFreq[MAX_CHANNELS];    ///< frequency, band index in the low bits
+        u2_t     channelDrMap[MAX_CHANNELS];
+        u2_t     channelMap;
+#else
+        u2_t     channelMap[(MAX_CHANNELS + 15) / 16];
+#endif
+        u1_t     txChnl;
+
+        u2_t     clockError;      ///< see MAX_CLOCK_ERROR
+
+        u2_t     opmode;
+        u1_t     adrEnabled;
+        s1_t     adrTxPow;
+        s1_t     adrAckReq;       ///< link check state, LINK_CHECK_xxx
+        dr_t     datarate;
+        u1_t     dnConf;          ///< downlink to confirm in the next uplink
+        u1_t     txCnt;           ///< transmissions of the frame in flight
+
+        u4_t     netid;
+        devaddr_t devaddr;
+        u4_t     seqnoDn;
+        u4_t     seqnoUp;
+        u1_t     nwkKey[16];
+        u1_t     artKey[16];
+
+        u1_t     rxDelay;         ///< RX1 delay, s
+        dr_t     dn2Dr;
+        u4_t     dn2Freq;
+        u1_t     dn1DrOffset;
+
+        u2_t     devNonce;
+
+        u1_t     pendTxPort;
+        u1_t     pendTxConf;
+        u1_t     pendTxLen;
+        u1_t     pendTxData[MAX_LEN_PAYLOAD];
+
+        u1_t     gwMargin;        ///< last LinkCheckAns
+        u1_t     gwCnt;
+
+        u1_t                            txDeviceTimeReqState;
+        lmic_request_network_time_cb_t *pNetworkTimeCb;
+        void                           *pNetworkTimeUserData;
+        ostime_t                        localDeviceTime;
+        lmic_gpstime_t                  netDeviceTime;
+        u1_t                            netDeviceTimeFrac;
+
+        u1_t     txrxFlags;
+        u1_t     dataBeg;
+        u1_t     dataLen;
+        u1_t     frame[MAX_LEN_FRAME];
+};
+typedef struct lmic_t lmic_t;
+
+//
+// AES, as in oslmic.h
+//
+#define AES_ENC       0x00
+#define AES_DEC       0x01
+#define AES_MIC       0x02
+#define AES_CTR       0x04
+#define AES_MICNOAUX  0x08
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern lmic_t LMIC;
+
+extern xref2u1_t AESkey;
+extern xref2u1_t AESaux;
+
+u4_t os_aes(u1_t mode, xref2u1_t buf, u2_t len);
+
+//
+// run time, oslmic.cpp
+//
+int os_init_ex(const void *pintable);
+ostime_t os_getTime(void);
+void os_setCallback(osjob_t *job, osjobcb_t cb);
+void os_setTimedCallback(osjob_t *job, ostime_t time, osjobcb_t cb);
+void os_clearCallback(osjob_t *job);
+bit_t os_queryTimeCriticalJobs(ostime_t time);
+void os_runloop_once(void);
+u1_t os_getRndU1(void);
+
+//
+// given by the application
+//
+void os_getArtEui(u1_t *buf);
+void os_getDevEui(u1_t *buf);
+void os_getDevKey(u1_t *buf);
+void onEvent(ev_t e);
+
+//
+// HAL: the MCU may sleep, nothing to run (the firmware wraps it)
+//
+void hal_sleep(void);
+
+//
+// MAC, lmic.cpp
+//
+void LMIC_reset(void);
+void LMIC_shutdown(void);
+bit_t LMIC_startJoining(void);
+void LMIC_setSession(u4_t netid, devaddr_t devaddr, xref2u1_t nwkKey, xref2u1_t artKey);
+void LMIC_getSessionKeys(u4_t *netid, devaddr_t *devaddr, xref2u1_t nwkKey, xref2u1_t artKey);
+void LMIC_setSeqnoUp(u4_t seq);
+void LMIC_setDrTxpow(dr_t dr, s1_t txpow);
+void LMIC_setAdrMode(bit_t enabled);
+void LMIC_setLinkCheckMode(bit_t enabled);
+void LMIC_setClockError(u2_t error);
+lmic_tx_error_t LMIC_setTxData2(u1_t port, xref2u1_t data, u1_t dlen, u1_t confirmed);
+void LMIC_requestNetworkTime(lmic_request_network_time_cb_t *pCallbackfn, void *pUserData);
+int LMIC_getNetworkTimeReference(lmic_time_reference_t *pReference);
+ostime_t calcAirTime(rps_t rps, u1_t plen);
+
+#if defined(CFG_LMIC_EU_like)
+bit_t LMIC_setupChannel(u1_t channel, u4_t freq, u2_t drmap, s1_t band);
+#else
+bit_t LMIC_selectSubBand(u1_t band);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+inline u2_t os_rlsbf2(xref2cu1_t buf)
+{
+        return (u2_t) (buf[0] | (buf[1] << 8));
+}
+
+inline u4_t os_rlsbf4(xref2cu1_t buf)
+{
+        return (u4_t) buf[0] | ((u4_t) buf[1] << 8) | ((u4_t) buf[2] << 16) | ((u4_t) buf[3] << 24);
+}
+
+inline u4_t os_rmsbf4(xref2cu1_t buf)
+{
+        return (u4_t) buf[3] | ((u4_t) buf[2] << 8) | ((u4_t) buf[1] << 16) | ((u4_t) buf[0] << 24);
+}
+
+inline void os_wlsbf2(xref2u1_t buf, u2_t v)
+{
+        buf[0] = v;
+        buf[1] = v >> 8;
+}
+
+inline void os_wlsbf4(xref2u1_t buf, u4_t v)
+{
+        buf[0] = v;
+        buf[1] = v >> 8;
+        buf[2] = v >> 16;
+        buf[3] = v >> 24;
+}
+
+inline void os_wmsbf4(xref2u1_t buf, u4_t v)
+{
+        buf[3] = v;
+        buf[2] = v >> 8;
+        buf[1] = v >> 16;
+        buf[0] = v >> 24;
+}
@@ -0,0 +1,104 @@
+/*
+ *
+ * LMIC stand-in
+ *
+ * PURPOSE: Host builds only: the simulation hooks of sim.h when the host
+ *          build runs MCCI's arduino-lmic itself instead of the stand-in
+ *          MAC; its HAL drives the radio of regs.cpp
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <lmic.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "sim.h"
+#include "sx1276.h"
+
+namespace
+{
+
+/// the furthest a job is looked for, about 4.7 h of LMIC ticks
+const ostime_t HORIZON = 1L << 28;
+
+//
+// an LMIC assertion fails the test instead of spinning in hal_failed()
+//
+void LMIC_ABI_STD failed(const char *const file, const uint16_t line)
+{
+        (void) fprintf(stderr, "LMIC assertion failed at %s:%u\n", file, line);
+        abort();
+}
+
+struct failure_handler_t
+{
+        failure_handler_t()
+        {
+                hal_set_failure_handler(&failed);
+        }
+} failure_handler;
+
+} // namespace
+
+bool sim::next_job(ostime_t *deadline)
+{
+        //
+        // LMIC only tells whether a job is due within a given time: bisect
+        // for the deadline of the first one
+        //
+        if (!os_queryTimeCriticalJobs(HORIZON))
+        {
+                return false;
+        }
+
+        ostime_t lo = 0, hi = HORIZON;
+
+        while (hi - lo > 1)
+        {
+                ostime_t mid = lo + (hi - lo) / 2;
+
+                if (os_queryTimeCriticalJobs(mid))
+                {
+                        hi = mid;
+                }
+                else
+                {
+                        lo = mid;
+                }
+        }
+
+        *deadline = os_getTime() + lo;
+
+        return true;
+}
+
+void sim::reset()
+{
+        //
+        // os_init_ex() empties MCCI's job queue on the next boot
+        //
+        (void) memset(&LMIC, 0, sizeof(LMIC));
+
+        sx1276::sleep();
+        sx1276::reset();
+}
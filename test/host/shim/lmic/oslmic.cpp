@@ -0,0 +1,188 @@
+/*
+ *
+ * LMIC stand-in
+ *
+ * PURPOSE: Host builds only: the run time of oslmic.c (job queue, clock,
+ *          random numbers) on the host clock
+ *          simulated by the LMIC stand-in
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <Arduino.h>
+
+#include <cstring>
+
+#include "lmic.h"
+#include "sim.h"
+#include "sx1276.h"
+
+namespace
+{
+
+/// jobs to run now, in order
+osjob_t *runnable = nullptr;
+
+/// jobs to run at their deadline, earliest first
+osjob_t *scheduled = nullptr;
+
+u4_t rnd = 0x2545f491;
+
+bool unlink(osjob_t **list, osjob_t *job)
+{
+        for (; *list != nullptr; list = &(*list)->next)
+        {
+                if (*list == job)
+                {
+                        *list = job->next;
+                        return true;
+                }
+        }
+
+        return false;
+}
+
+} // namespace
+
+int os_init_ex(const void *pintable)
+{
+        (void) pintable;
+
+        sim::reset();
+
+        LMIC.opmode = OP_SHUTDOWN;
+
+        return 1;
+}
+
+ostime_t os_getTime(void)
+{
+        return static_cast<ostime_t>(micros() >> US_PER_OSTICK_EXPONENT);
+}
+
+u1_t os_getRndU1(void)
+{
+        //
+        // xorshift32: the same sequence on every run
+        //
+        rnd ^= rnd << 13;
+        rnd ^= rnd >> 17;
+        rnd ^= rnd << 5;
+
+        return static_cast<u1_t>(rnd);
+}
+
+void os_clearCallback(osjob_t *job)
+{
+        if (!unlink(&runnable, job))
+        {
+                (void) unlink(&scheduled, job);
+        }
+}
+
+void os_setCallback(osjob_t *job, osjobcb_t cb)
+{
+        os_clearCallback(job);
+
+        job->func = cb;
+        job->next = nullptr;
+
+        osjob_t **tail = &runnable;
+
+        while (*tail != nullptr)
+        {
+                tail = &(*tail)->next;
+        }
+
+        *tail = job;
+}
+
+void os_setTimedCallback(osjob_t *job, ostime_t time, osjobcb_t cb)
+{
+        os_clearCallback(job);
+
+        job->func = cb;
+        job->deadline = time;
+
+        osjob_t **at = &scheduled;
+
+        while (*at != nullptr && sim::diff((*at)->deadline, time) <= 0)
+        {
+                at = &(*at)->next;
+        }
+
+        job->next = *at;
+        *at = job;
+}
+
+bit_t os_queryTimeCriticalJobs(ostime_t time)
+{
+        return scheduled != nullptr && sim::diff(scheduled->deadline, os_getTime()) < time;
+}
+
+void os_runloop_once(void)
+{
+        osjob_t *job = nullptr;
+
+        if (runnable != nullptr)
+        {
+                job = runnable;
+                runnable = job->next;
+        }
+        else if (scheduled != nullptr && sim::diff(scheduled->deadline, os_getTime()) <= 0)
+        {
+                job = scheduled;
+                scheduled = job->next;
+        }
+        else
+        {
+                hal_sleep();
+                return;
+        }
+
+        job->func(job);
+}
+
+bool sim::next_job(ostime_t *deadline)
+{
+        if (runnable != nullptr)
+        {
+                *deadline = os_getTime();
+                return true;
+        }
+
+        if (scheduled != nullptr)
+        {
+                *deadline = scheduled->deadline;
+                return true;
+        }
+
+        return false;
+}
+
+void sim::reset()
+{
+        runnable = nullptr;
+        scheduled = nullptr;
+
+        (void) memset(&LMIC, 0, sizeof(LMIC));
+
+        sx1276::sleep();
+}
@@ -0,0 +1,136 @@
+/*
+ *
+ * LMIC stand-in
+ *
+ * PURPOSE: Host builds only: the air between the simulated SX1276 and a
+ *          network server process, see sim::pipe_t
+ *          simulated by the LMIC stand-in
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "sim.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+sim::pipe_t::pipe_t(const std::string &path, const std::vector<std::string> &args)
+{
+        int up[2], down[2];
+
+        if (pipe(up) != 0 || pipe(down) != 0)
+        {
+                perror("pipe");
+                abort();
+        }
+
+        pid = fork();
+
+        if (pid < 0)
+        {
+                perror("fork");
+                abort();
+        }
+
+        if (pid == 0)
+        {
+                (void) dup2(up[0], STDIN_FILENO);
+                (void) dup2(down[1], STDOUT_FILENO);
+                (void) close(up[0]);
+                (void) close(up[1]);
+                (void) close(down[0]);
+                (void) close(down[1]);
+
+                std::vector<char *> argv;
+
+                argv.push_back(const_cast<char *>(path.c_str()));
+                for (const std::string &a : args)
+                {
+                        argv.push_back(const_cast<char *>(a.c_str()));
+                }
+                argv.push_back(nullptr);
+
+                (void) execv(path.c_str(), argv.data());
+                perror(path.c_str());
+                _exit(127);
+        }
+
+        (void) close(up[0]);
+        (void) close(down[1]);
+
+        to = fdopen(up[1], "w");
+        from = fdopen(down[0], "r");
+}
+
+sim::pipe_t::~pipe_t()
+{
+        (void) fclose(to);
+        (void) fclose(from);
+        (void) waitpid(pid, nullptr, 0);
+}
+
+bool sim::pipe_t::uplink(const packet_t &up, packet_t *down)
+{
+        (void) fprintf(to, "UP %llu %u %u %u ", static_cast<unsigned long long>(up.tmst_us), up.freq, up.sf, up.bw_khz);
+
+        for (uint8_t i = 0; i < up.len; i++)
+        {
+                (void) fprintf(to, "%02x", up.data[i]);
+        }
+
+        (void) fputc('\n', to);
+        (void) fflush(to);
+
+        char line[1024];
+
+        if (fgets(line, sizeof(line), from) == nullptr)
+        {
+                fprintf(stderr, "network server gone\n");
+                abort();
+        }
+
+        unsigned long long tmst;
+        unsigned freq, sf, bw;
+        int rssi, snr;
+        char hex[600];
+
+        if (sscanf(line, "DOWN %llu %u %u %u %d %d %599s", &tmst, &freq, &sf, &bw, &rssi, &snr, hex) != 7)
+        {
+                return false;
+        }
+
+        down->tmst_us = tmst;
+        down->freq = freq;
+        down->sf = static_cast<uint8_t>(sf);
+        down->bw_khz = static_cast<uint16_t>(bw);
+        down->rssi = static_cast<int16_t>(rssi);
+        down->snr_q4 = static_cast<int8_t>(snr);
+        down->len = static_cast<uint8_t>(strlen(hex) / 2);
+
+        for (uint8_t i = 0; i < down->len; i++)
+        {
+                char pair[3] = {hex[2 * i], hex[2 * i + 1], '\0'};
+                down->data[i] = static_cast<uint8_t>(strtoul(pair, nullptr, 16));
+        }
+
+        return true;
+}
@@ -0,0 +1,404 @@
+/*
+ *
+ * LMIC stand-in
+ *
+ * PURPOSE: Host builds only: the SX1276 at register level, on the board's
+ *          SPI bus and GPIOs, for MCCI's radio.c and HAL; what it sends
+ *          and hears goes through sx1276::tx() and sx1276::rx()
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <Arduino.h>
+#include <SPI.h>
+
+#include <cstring>
+
+#include "sim.h"
+#include "sx1276.h"
+
+#include "../../../../config.h"
+
+namespace
+{
+
+//
+// LoRa mode registers (SX1276 datasheet, 6.4); RegImageCal is FSK's
+//
+const u1_t REG_FIFO = 0x00;
+const u1_t REG_OPMODE = 0x01;
+const u1_t REG_FRF_MSB = 0x06;
+const u1_t REG_FRF_MID = 0x07;
+const u1_t REG_FRF_LSB = 0x08;
+const u1_t REG_FIFO_ADDR_PTR = 0x0D;
+const u1_t REG_FIFO_TX_BASE = 0x0E;
+const u1_t REG_FIFO_RX_BASE = 0x0F;
+const u1_t REG_FIFO_RX_CURRENT = 0x10;
+const u1_t REG_IRQ_FLAGS_MASK = 0x11;
+const u1_t REG_IRQ_FLAGS = 0x12;
+const u1_t REG_RX_NB_BYTES = 0x13;
+const u1_t REG_PKT_SNR = 0x19;
+const u1_t REG_PKT_RSSI = 0x1A;
+const u1_t REG_MODEM_CONFIG1 = 0x1D;
+const u1_t REG_MODEM_CONFIG2 = 0x1E;
+const u1_t REG_SYMB_TIMEOUT_LSB = 0x1F;
+const u1_t REG_PAYLOAD_LENGTH = 0x22;
+const u1_t REG_RSSI_WIDEBAND = 0x2C;
+const u1_t REG_IMAGE_CAL = 0x3B;
+const u1_t REG_DIO_MAPPING1 = 0x40;
+const u1_t REG_VERSION = 0x42;
+
+const u1_t OPMODE_LORA = 0x80;
+const u1_t OPMODE_MASK = 0x07;
+const u1_t MODE_TX = 0x03;
+const u1_t MODE_RX_SINGLE = 0x06;
+const u1_t MODE_CAD = 0x07;
+
+const u1_t IRQ_RX_TIMEOUT = 0x80;
+const u1_t IRQ_RX_DONE = 0x40;
+const u1_t IRQ_TX_DONE = 0x08;
+const u1_t IRQ_CAD_DONE = 0x04;
+const u1_t IRQ_FHSS = 0x02;
+const u1_t IRQ_CAD_DETECTED = 0x01;
+
+const u1_t IMAGE_CAL_RUNNING = 0x20;
+const u1_t VERSION = 0x12;
+
+/// the packet RSSI register reads dBm plus this, on the HF port
+const s2_t RSSI_HF_OFF = 157;
+
+u1_t regs[0x80];
+u1_t fifo[0x100];
+
+/// SPI access in progress: its address, once the first byte came
+bool selected = false;
+bool addressed = false;
+bool writing = false;
+u1_t addr = 0;
+
+/// the IRQ the radio raises next, and when
+u1_t armed = 0;
+ostime_t armed_at = 0;
+
+/// the frame a window caught, until its RX done
+u1_t frame[0x100];
+sx1276::rx_t caught;
+
+u4_t noise = 0x2545f491;
+
+u4_t freq()
+{
+        uint64_t frf = (static_cast<uint64_t>(regs[REG_FRF_MSB]) << 16) | (regs[REG_FRF_MID] << 8) | regs[REG_FRF_LSB];
+        uint64_t hz = (frf * 32000000 + (1 << 18)) >> 19;
+
+        //
+        // the synthesizer steps by 61 Hz: channels sit on whole 100 Hz
+        //
+        return static_cast<u4_t>((hz + 50) / 100 * 100);
+}
+
+rps_t rps()
+{
+        u1_t sf = regs[REG_MODEM_CONFIG2] >> 4;
+        u1_t bw = regs[REG_MODEM_CONFIG1] >> 4;
+        u1_t cr = (regs[REG_MODEM_CONFIG1] >> 1) & 0x07;
+
+        return makeRps(static_cast<sf_t>(SF7 + sf - 7), static_cast<bw_t>(BW125 + bw - 7),
+                       static_cast<cr_t>(CR_4_5 + cr - 1), regs[REG_MODEM_CONFIG1] & 0x01,
+                       (regs[REG_MODEM_CONFIG2] & 0x04) == 0);
+}
+
+void arm(const u1_t irq, const ostime_t at)
+{
+        armed = irq;
+        armed_at = at;
+}
+
+/// raises the armed IRQ once its time came
+void update()
+{
+        if (armed == 0 || sim::diff(os_getTime(), armed_at) < 0)
+        {
+                return;
+        }
+
+        if (armed == IRQ_RX_DONE)
+        {
+                (void) memcpy(fifo + regs[REG_FIFO_RX_BASE], frame, caught.len);
+                regs[REG_FIFO_RX_CURRENT] = regs[REG_FIFO_RX_BASE];
+                regs[REG_RX_NB_BYTES] = caught.len;
+                regs[REG_PKT_SNR] = static_cast<u1_t>(caught.snr);
+                regs[REG_PKT_RSSI] = static_cast<u1_t>(caught.rssi + RSSI_HF_OFF);
+        }
+
+        regs[REG_IRQ_FLAGS] |= armed & ~regs[REG_IRQ_FLAGS_MASK];
+        armed = 0;
+
+        //
+        // single operations end in standby
+        //
+        regs[REG_OPMODE] = (regs[REG_OPMODE] & ~OPMODE_MASK) | 0x01;
+}
+
+void set_mode(const u1_t value)
+{
+        regs[REG_OPMODE] = value;
+        armed = 0;
+
+        if ((value & OPMODE_LORA) == 0)
+        {
+                return;
+        }
+
+        ostime_t now = os_getTime();
+
+        switch (value & OPMODE_MASK)
+        {
+        case MODE_TX: {
+                u1_t len = regs[REG_PAYLOAD_LENGTH];
+                u1_t data[0x100];
+
+                for (u2_t i = 0; i < len; i++)
+                {
+                        data[i] = fifo[static_cast<u1_t>(regs[REG_FIFO_TX_BASE] + i)];
+                }
+
+                arm(IRQ_TX_DONE, sx1276::tx(data, len, freq(), rps(), 0, now));
+                break;
+        }
+
+        case MODE_RX_SINGLE: {
+                u2_t syms = static_cast<u2_t>(((regs[REG_MODEM_CONFIG2] & 0x03) << 8) | regs[REG_SYMB_TIMEOUT_LSB]);
+                ostime_t close = now + syms * sx1276::symbol(rps());
+
+                if (sx1276::rx(freq(), rps(), now, close, frame, &caught))
+                {
+                        arm(IRQ_RX_DONE, caught.end);
+                }
+                else
+                {
+                        arm(IRQ_RX_TIMEOUT, close);
+                }
+
+                break;
+        }
+
+        case MODE_CAD:
+                arm(IRQ_CAD_DONE, now + sx1276::symbol(rps()));
+                break;
+
+        default:
+                //
+                // sleep, standby, FS modes, and the continuous RX radio.c
+                // only uses to read noise
+                //
+                break;
+        }
+}
+
+void write(const u1_t reg, const u1_t value)
+{
+        switch (reg)
+        {
+        case REG_FIFO:
+                fifo[regs[REG_FIFO_ADDR_PTR]++] = value;
+                break;
+
+        case REG_OPMODE:
+                set_mode(value);
+                break;
+
+        case REG_IRQ_FLAGS:
+                regs[REG_IRQ_FLAGS] &= ~value;
+                break;
+
+        case REG_IMAGE_CAL:
+                //
+                // the calibration is over at once
+                //
+                regs[reg] = value & ~IMAGE_CAL_RUNNING;
+                break;
+
+        case REG_VERSION:
+                break;
+
+        default:
+                regs[reg] = value;
+                break;
+        }
+}
+
+u1_t read(const u1_t reg)
+{
+        update();
+
+        switch (reg)
+        {
+        case REG_FIFO:
+                return fifo[regs[REG_FIFO_ADDR_PTR]++];
+
+        case REG_RSSI_WIDEBAND:
+                noise ^= noise << 13;
+                noise ^= noise >> 17;
+                noise ^= noise << 5;
+                return static_cast<u1_t>(noise);
+
+        default:
+                return regs[reg];
+        }
+}
+
+} // namespace
+
+void sx1276::select(const bool low)
+{
+        selected = low;
+        addressed = false;
+}
+
+u1_t sx1276::transfer(const u1_t out)
+{
+        if (!selected)
+        {
+                return 0;
+        }
+
+        if (!addressed)
+        {
+                addressed = true;
+                writing = (out & 0x80) != 0;
+                addr = out & 0x7F;
+                return 0;
+        }
+
+        u1_t in = 0;
+
+        if (writing)
+        {
+                write(addr, out);
+        }
+        else
+        {
+                in = read(addr);
+        }
+
+        if (addr != REG_FIFO)
+        {
+                addr = (addr + 1) & 0x7F;
+        }
+
+        return in;
+}
+
+void sx1276::reset()
+{
+        (void) memset(regs, 0, sizeof(regs));
+
+        regs[REG_OPMODE] = 0x09;
+        regs[REG_VERSION] = VERSION;
+        armed = 0;
+        selected = false;
+}
+
+bool sx1276::dio(const u1_t n)
+{
+        update();
+
+        u1_t map = regs[REG_DIO_MAPPING1];
+        u1_t flags = regs[REG_IRQ_FLAGS];
+
+        switch (n)
+        {
+        case 0: {
+                static const u1_t DIO0[] = {IRQ_RX_DONE, IRQ_TX_DONE, IRQ_CAD_DONE, 0};
+                return (flags & DIO0[map >> 6]) != 0;
+        }
+
+        case 1: {
+                static const u1_t DIO1[] = {IRQ_RX_TIMEOUT, IRQ_FHSS, IRQ_CAD_DETECTED, 0};
+                return (flags & DIO1[(map >> 4) & 0x03]) != 0;
+        }
+
+        case 2:
+                return (flags & IRQ_FHSS) != 0;
+
+        default:
+                return false;
+        }
+}
+
+bool sim::next_irq(ostime_t *at)
+{
+        if (armed == 0)
+        {
+                return false;
+        }
+
+        *at = armed_at;
+
+        return true;
+}
+
+//
+// the board's wiring: the radio is the only thing on SPI and on these GPIOs
+// (the SPI flash stand-in is not behind the bus)
+//
+uint8_t SPIClass::transfer(uint8_t data)
+{
+        return sx1276::transfer(data);
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+        (void) pin;
+        (void) mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+        if (pin == CONFIG_NSS_GPIO)
+        {
+                sx1276::select(val == LOW);
+        }
+        else if (pin == CONFIG_RESET_GPIO && val == LOW)
+        {
+                sx1276::reset();
+        }
+}
+
+int digitalRead(uint8_t pin)
+{
+        if (pin == CONFIG_DIO0_GPIO)
+        {
+                return sx1276::dio(0) ? HIGH : LOW;
+        }
+
+        if (pin == CONFIG_DIO1_GPIO)
+        {
+                return sx1276::dio(1) ? HIGH : LOW;
+        }
+
+        if (pin == CONFIG_DIO2_GPIO)
+        {
+                return sx1276::dio(2) ? HIGH : LOW;
+        }
+
+        return LOW;
+}
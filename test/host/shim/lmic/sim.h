@@ -0,0 +1,154 @@
+/*
+ *
+ * LMIC stand-in
+ *
+ * PURPOSE: Host builds only: what a simulation drives besides the LMIC
+ *          interface: the other side of the antenna, the board's clock
+ *          error as the RX windows see it, radio counters, and a reset
+ *          simulated by the LMIC stand-in
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <lmic/lmic.h>
+
+#include <stdio.h>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+namespace sim
+{
+
+/// \struct a LoRa frame on the air
+struct packet_t
+{
+        uint64_t tmst_us;      ///< uplinks: end of TX; downlinks: start of TX (host_rtc_us() time)
+        uint32_t freq;         ///< Hz
+        uint8_t  sf;           ///< 7..12
+        uint16_t bw_khz;
+        int16_t  rssi;         ///< as received, dBm
+        int8_t   snr_q4;       ///< as received, quarters of dB
+        uint8_t  len;
+        uint8_t  data[255];
+};
+
+/// \class gateways and network server: what the radio talks to
+class air_t
+{
+public:
+        virtual ~air_t() {}
+
+        ///
+        /// \brief           An uplink is on the air
+        ///
+        /// \param[in]       up      the frame, as the gateways heard it
+        /// \param[out]      down    the answer to send, if any
+        ///
+        /// \return          true if the network answers
+        ///
+        virtual bool uplink(const packet_t &up, packet_t *down) = 0;
+};
+
+/// \class a network server in its own process (test/host/netserver.cpp),
+///        one text line per frame on its stdin and stdout
+class pipe_t : public air_t
+{
+public:
+        ///
+        /// \brief           Starts the server
+        ///
+        /// \param[in]       path    its executable
+        /// \param[in]       args    its options
+        ///
+        pipe_t(const std::string &path, const std::vector<std::string> &args = {});
+
+        /// closes its stdin: the server prints its counters and quits
+        ~pipe_t() override;
+
+        bool uplink(const packet_t &up, packet_t *down) override;
+
+private:
+        pid_t pid = -1;
+        FILE *to = nullptr;
+        FILE *from = nullptr;
+};
+
+/// \struct what the radio went through
+struct radio_stats_t
+{
+        uint32_t tx;             ///< frames sent
+        uint64_t tx_us;          ///< their time on air
+        uint32_t rx_windows;     ///< receive windows opened
+        uint32_t rx;             ///< frames received
+        uint64_t rx_us;          ///< time spent receiving, windows included
+};
+
+/// the other side of the antenna, nullptr (default) if nobody listens
+void attach(air_t *air);
+
+/// the board's clock runs this fast (ppm), which shifts downlinks in the
+/// RX windows by the RX delay times this
+extern int32_t drift_ppm;
+
+extern radio_stats_t radio;
+
+///
+/// \brief           a - b on the LMIC clock, right across its wrap (every
+///                  9.5 h): the difference in unsigned, as MCCI's HAL takes
+///                  it, the signed one would overflow
+///
+/// \return          ticks, negative if a is before b
+///
+inline s4_t diff(const ostime_t a, const ostime_t b)
+{
+        return static_cast<s4_t>(static_cast<u4_t>(a) - static_cast<u4_t>(b));
+}
+
+///
+/// \brief           When the radio raises its next DIO line: the end of a
+///                  TX, a frame received or a window timing out
+///
+/// \param[out]      at    that time on the LMIC clock
+///
+/// \return          false if the radio isn't busy
+///
+bool next_irq(ostime_t *at);
+
+///
+/// \brief           Deadline of the first timed LMIC job
+///
+/// \param[out]      deadline    its time on the LMIC clock
+///
+/// \return          false if nothing is scheduled
+///
+bool next_job(ostime_t *deadline);
+
+///
+/// \brief           MCU reset or deep sleep wake: LMIC's RAM and the job
+///                  queue are lost (the simulated network is not)
+///
+/// \return          void
+///
+void reset();
+
+} // namespace sim
@@ -0,0 +1,183 @@
+/*
+ *
+ * LMIC stand-in
+ *
+ * PURPOSE: Host builds only: the SX1276 in time and on the air. A frame
+ *          sent goes to the network (sim::air_t), whose answer waits for
+ *          the RX windows; timings come from the LoRa time on air, seen
+ *          through the board's clock error (sim::drift_ppm)
+ *          simulated by the LMIC stand-in
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <Arduino.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "sim.h"
+#include "sx1276.h"
+
+namespace sim
+{
+
+int32_t drift_ppm = 0;
+
+radio_stats_t radio = {};
+
+} // namespace sim
+
+namespace
+{
+
+/// preamble of a LoRaWAN frame, and how much of it the radio needs to lock
+const ostime_t PREAMBLE_SYMS = 8;
+const ostime_t LOCK_SYMS = 4;
+
+sim::air_t *air = nullptr;
+
+/// the network's answer to the last uplink, until a window catches it
+bool pending = false;
+sim::packet_t down;
+
+/// end of the last uplink, on the air and on the LMIC clock
+uint64_t up_end_us = 0;
+ostime_t up_end = 0;
+
+uint8_t sf_of(const rps_t rps)
+{
+        return static_cast<uint8_t>(getSf(rps) - SF7 + 7);
+}
+
+uint16_t bw_of(const rps_t rps)
+{
+        return static_cast<uint16_t>(125 << getBw(rps));
+}
+
+/// host_rtc_us() at LMIC time t: the LMIC clock restarts at each boot, and
+/// wraps
+uint64_t air_us(const ostime_t t)
+{
+        uint64_t tick_us = host_rtc_us() - micros() % US_PER_OSTICK;
+
+        return tick_us + static_cast<int64_t>(sim::diff(t, os_getTime())) * US_PER_OSTICK;
+}
+
+} // namespace
+
+void sim::attach(air_t *a)
+{
+        air = a;
+        pending = false;
+}
+
+ostime_t sx1276::symbol(const rps_t rps)
+{
+        return us2osticks((1000UL << sf_of(rps)) / bw_of(rps));
+}
+
+ostime_t sx1276::tx(const u1_t *frame, const u1_t len, const u4_t freq, const rps_t rps, const s1_t txpow,
+                    const ostime_t start)
+{
+        (void) txpow;
+
+        ostime_t end = start + calcAirTime(rps, len);
+
+        sim::radio.tx++;
+        sim::radio.tx_us += osticks2us(end - start);
+
+        pending = false;
+
+        if (air == nullptr || getSf(rps) == FSK)
+        {
+                return end;
+        }
+
+        sim::packet_t up = {};
+
+        up.tmst_us = air_us(end);
+        up.freq = freq;
+        up.sf = sf_of(rps);
+        up.bw_khz = bw_of(rps);
+        up.len = len;
+        (void) memcpy(up.data, frame, len);
+
+        up_end_us = up.tmst_us;
+        up_end = end;
+
+        pending = air->uplink(up, &down);
+
+        return end;
+}
+
+bool sx1276::rx(const u4_t freq, const rps_t rps, const ostime_t open, const ostime_t close, u1_t *frame, rx_t *rx)
+{
+        sim::radio.rx_windows++;
+
+        if (!pending || down.freq != freq || down.sf != sf_of(rps) || down.bw_khz != bw_of(rps))
+        {
+                sim::radio.rx_us += osticks2us(close - open);
+                return false;
+        }
+
+        //
+        // the downlink starts on time for the network; our clock measures
+        // the delay since our TX end a bit longer or shorter
+        //
+        int64_t delay_us = static_cast<int64_t>(down.tmst_us - up_end_us);
+        delay_us += delay_us * sim::drift_ppm / 1000000;
+
+        ostime_t start = up_end + us2osticks(delay_us);
+        ostime_t sym = sx1276::symbol(rps);
+        //
+        // from the window's opening on: the LMIC clock may wrap in between
+        //
+        s4_t heard = std::min(sim::diff(start + PREAMBLE_SYMS * sym, open), sim::diff(close, open)) -
+                     std::max(sim::diff(start, open), 0);
+
+        if (heard < LOCK_SYMS * sym)
+        {
+                sim::radio.rx_us += osticks2us(close - open);
+                return false;
+        }
+
+        pending = false;
+
+        //
+        // downlinks carry no payload CRC
+        //
+        rx->rps = makeRps(getSf(rps), getBw(rps), CR_4_5, 0, 1);
+        rx->end = start + calcAirTime(rx->rps, down.len);
+        rx->snr = down.snr_q4;
+        rx->rssi = down.rssi;
+        rx->len = down.len;
+        (void) memcpy(frame, down.data, down.len);
+
+        sim::radio.rx++;
+        sim::radio.rx_us += osticks2us(rx->end - open);
+
+        return true;
+}
+
+void sx1276::sleep()
+{
+        pending = false;
+}
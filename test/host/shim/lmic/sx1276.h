@@ -0,0 +1,95 @@
+/*
+ *
+ * LMIC stand-in
+ *
+ * PURPOSE: Host builds only: the SX1276 as the MAC sees it, in time and
+ *          on the air; internal to the stand-in, see sim.h for the knobs
+ *          simulated by the LMIC stand-in
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <lmic/lmic.h>
+
+namespace sx1276
+{
+
+/// \struct a received frame
+typedef struct
+{
+        ostime_t end;        ///< RX done, LMIC clock
+        rps_t    rps;
+        s1_t     snr;        ///< quarters of dB
+        s2_t     rssi;       ///< dBm
+        u1_t     len;
+} rx_t;
+
+///
+/// \brief           Sends a frame starting at start; the network hears
+///                  it and may answer in the RX windows that follow
+///
+/// \return          the end of the transmission, LMIC clock
+///
+ostime_t tx(const u1_t *frame, const u1_t len, const u4_t freq, const rps_t rps, const s1_t txpow,
+            const ostime_t start);
+
+///
+/// \brief           Single RX between open and close: a downlink is caught
+///                  when enough of its preamble falls in the window
+///
+/// \param[out]      frame    the frame received
+/// \param[out]      rx       its timing and quality
+///
+/// \return          true if a frame was received
+///
+bool rx(const u4_t freq, const rps_t rps, const ostime_t open, const ostime_t close, u1_t *frame, rx_t *rx);
+
+/// symbol time at rps, LMIC ticks
+ostime_t symbol(const rps_t rps);
+
+/// radio off, pending downlinks dropped
+void sleep();
+
+//
+// the same radio at register level, as MCCI's radio.c drives it through its
+// HAL: SPI transfers while NSS is low, DIO lines read back (regs.cpp)
+//
+
+/// NSS line: low starts a register access, high ends it
+void select(const bool low);
+
+///
+/// \brief           One byte each way on SPI: the first after select() is
+///                  the address (bit 7 set for a write), the next ones the
+///                  data, the address going up except for RegFifo
+///
+/// \return          the byte read, 0 while writing
+///
+u1_t transfer(const u1_t out);
+
+/// RESET line pulled low: registers back to their reset values
+void reset();
+
+/// level of DIO line n (0..2), as mapped by RegDioMapping1
+bool dio(const u1_t n);
+
+} // namespace sx1276
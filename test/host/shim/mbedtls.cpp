@@ -0,0 +1,75 @@
+/*
+ *
+ * mbedTLS stand-in
+ *
+ * PURPOSE: Host builds only: AES-128 ECB on OpenSSL, see mbedtls/aes.h
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "mbedtls/aes.h"
+
+#include <openssl/evp.h>
+
+void mbedtls_aes_init(mbedtls_aes_context *ctx)
+{
+        ctx->evp = EVP_CIPHER_CTX_new();
+}
+
+void mbedtls_aes_free(mbedtls_aes_context *ctx)
+{
+        EVP_CIPHER_CTX_free(static_cast<EVP_CIPHER_CTX *>(ctx->evp));
+        ctx->evp = nullptr;
+}
+
+int mbedtls_aes_setkey_enc(mbedtls_aes_context *ctx, const unsigned char *key, unsigned int keybits)
+{
+        if (keybits != 128)
+        {
+                return MBEDTLS_ERR_AES_INVALID_KEY_LENGTH;
+        }
+
+        EVP_CIPHER_CTX *evp = static_cast<EVP_CIPHER_CTX *>(ctx->evp);
+
+        if (EVP_EncryptInit_ex(evp, EVP_aes_128_ecb(), nullptr, key, nullptr) != 1)
+        {
+                return MBEDTLS_ERR_AES_INVALID_KEY_LENGTH;
+        }
+
+        (void) EVP_CIPHER_CTX_set_padding(evp, 0);
+
+        return 0;
+}
+
+int mbedtls_aes_crypt_ecb(mbedtls_aes_context *ctx, int mode, const unsigned char input[16], unsigned char output[16])
+{
+        int len = 0;
+
+        //
+        // hwaes only encrypts; so does a LoRaWAN 1.0 device
+        //
+        if (mode != MBEDTLS_AES_ENCRYPT ||
+            EVP_EncryptUpdate(static_cast<EVP_CIPHER_CTX *>(ctx->evp), output, &len, input, 16) != 1 || len != 16)
+        {
+                return -1;
+        }
+
+        return 0;
+}
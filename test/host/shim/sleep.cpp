@@ -0,0 +1,102 @@
+/*
+ *
+ * Sleep stand-in
+ *
+ * PURPOSE: Host builds only: the sleep modes of pwr/sleep.h as time that
+ *          passes at once; a deep sleep shuts LMIC down, the caller
+ *          reboots the board (host_reboot()) to wake it
+ *          simulated by the LMIC stand-in
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <Arduino.h>
+#include <algorithm>
+#include <lmic.h>
+#include <lmic/sim.h>
+
+#include "include/pwr/sleep.h"
+
+namespace deepsleep
+{
+
+void interrupt(const uint8_t gpio, const uint8_t mode)
+{
+
+        (void) gpio;
+        (void) mode;
+
+        LMIC_shutdown();
+}
+
+void seconds(const uint32_t seconds)
+{
+
+        LMIC_shutdown();
+        host_skip_us(seconds * 1000000ULL);
+}
+
+void do_deepsleep(const uint64_t ms, const bool gps)
+{
+
+        (void) gps;
+
+        LMIC_shutdown();
+        host_skip_us(ms * 1000);
+}
+
+} // namespace deepsleep
+
+namespace lightsleep
+{
+
+bool until(const uint32_t ms, const uint64_t gpio_mask)
+{
+
+        uint64_t us = ms * 1000ULL;
+        ostime_t at;
+
+        //
+        // the radio's DIO lines: the stand-in MAC times its jobs, MCCI's
+        // waits for TX done, RX done or RX timeout
+        //
+        if (gpio_mask != 0 && sim::next_irq(&at))
+        {
+                uint64_t irq_us = static_cast<uint64_t>(std::max<s4_t>(sim::diff(at, os_getTime()), 0)) * US_PER_OSTICK;
+
+                if (irq_us < us)
+                {
+                        host_skip_us(irq_us);
+                        return true;
+                }
+        }
+
+        host_skip_us(us);
+
+        return false;
+}
+
+void wait(const uint32_t ms)
+{
+
+        delay(ms);
+}
+
+} // namespace lightsleep
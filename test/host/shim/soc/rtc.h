@@ -0,0 +1,41 @@
+/*
+ *
+ * ESP-IDF RTC stand-in
+ *
+ * PURPOSE: Host builds only: the RTC timer, which keeps counting across
+ *          deep sleeps (host_rtc_us()), in slow clock cycles
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <esp_clk.h>
+
+inline uint64_t rtc_time_get()
+{
+        return (host_rtc_us() << 19) / esp_clk_slowclk_cal_get();
+}
+
+inline uint64_t rtc_time_slowclk_to_us(uint64_t rtc_cycles, uint32_t period)
+{
+        return (rtc_cycles * period) >> 19;
+}
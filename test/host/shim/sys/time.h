@@ -0,0 +1,36 @@
+/*
+ *
+ * Time of day stand-in
+ *
+ * PURPOSE: Host builds only: the board's wall clock instead of the host's,
+ *          so that syncing it doesn't set the system time
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include_next <sys/time.h>
+
+int host_gettimeofday(struct timeval *tv, void *tz);
+int host_settimeofday(const struct timeval *tv, const void *tz);
+
+#define gettimeofday host_gettimeofday
+#define settimeofday host_settimeofday
@@ -0,0 +1,222 @@
+/*
+ *
+ * Channel plan tests
+ *
+ * PURPOSE: Checks the channel plan and data rate table of the region the
+ *          test is built for against the LoRaWAN Regional Parameters
+ *          (RP002-1.0.x): one executable per region, see CMakeLists.txt
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <gtest/gtest.h>
+#include <set>
+
+#include "include/config/channels.h"
+
+namespace
+{
+
+/// \struct one uplink data rate as the Regional Parameters list it
+struct reference_t
+{
+        uint8_t  sf;
+        uint16_t bw_khz;
+        uint8_t  n;
+};
+
+#if defined(CONFIG_REGION_EU868)
+
+const reference_t REFERENCE[] = {{12, 125, 51}, {11, 125, 51}, {10, 125, 51}, {9, 125, 115},
+                                 {8, 125, 222}, {7, 125, 222}, {7, 250, 222}, {0, 0, 222}};
+
+/// channels every EU868 device must have
+const uint32_t DEFAULT_FREQS[] = {868100000, 868300000, 868500000};
+
+#elif defined(CONFIG_REGION_US915)
+
+const reference_t REFERENCE[] = {{10, 125, 11}, {9, 125, 53}, {8, 125, 125}, {7, 125, 242}, {8, 500, 242}};
+
+#elif defined(CONFIG_REGION_AU915)
+
+const reference_t REFERENCE[] = {{12, 125, 51}, {11, 125, 51}, {10, 125, 51}, {9, 125, 115},
+                                 {8, 125, 242}, {7, 125, 242}, {8, 500, 242}};
+
+#elif defined(CONFIG_REGION_AS923)
+
+const reference_t REFERENCE[] = {{12, 125, 51}, {11, 125, 51}, {10, 125, 51}, {9, 125, 115},
+                                 {8, 125, 242}, {7, 125, 242}, {7, 250, 242}, {0, 0, 242}};
+
+const uint32_t DEFAULT_FREQS[] = {923200000, 923400000};
+
+#elif defined(CONFIG_REGION_KR920)
+
+const reference_t REFERENCE[] = {{12, 125, 51}, {11, 125, 51}, {10, 125, 51}, {9, 125, 115},
+                                 {8, 125, 242}, {7, 125, 242}};
+
+const uint32_t DEFAULT_FREQS[] = {922100000, 922300000, 922500000};
+
+#elif defined(CONFIG_REGION_IN865)
+
+const reference_t REFERENCE[] = {{12, 125, 51}, {11, 125, 51}, {10, 125, 51}, {9, 125, 115},
+                                 {8, 125, 242}, {7, 125, 242}, {0, 0, 0}, {0, 0, 242}};
+
+const uint32_t DEFAULT_FREQS[] = {865062500, 865402500, 865985000};
+
+#endif
+
+const uint8_t REFERENCE_SIZE = sizeof(REFERENCE) / sizeof(REFERENCE[0]);
+
+TEST(DataRates, MatchRegionalParameters)
+{
+        ASSERT_EQ(channels::DR_COUNT, REFERENCE_SIZE);
+
+        for (uint8_t dr = 0; dr < REFERENCE_SIZE; dr++)
+        {
+                EXPECT_EQ(channels::DATARATES[dr].sf, REFERENCE[dr].sf) << "DR" << +dr;
+                EXPECT_EQ(channels::DATARATES[dr].bw_khz, REFERENCE[dr].bw_khz) << "DR" << +dr;
+                EXPECT_EQ(channels::DATARATES[dr].payload, REFERENCE[dr].n) << "DR" << +dr;
+        }
+}
+
+TEST(DataRates, MatchLmicNumbering)
+{
+#if defined(CONFIG_REGION_US915)
+        EXPECT_EQ(channels::sf_of(DR_SF10), 10);
+        EXPECT_EQ(channels::sf_of(DR_SF7), 7);
+        EXPECT_EQ(channels::sf_of(DR_SF8C), 8);
+#else
+        EXPECT_EQ(channels::sf_of(DR_SF12), 12);
+        EXPECT_EQ(channels::sf_of(DR_SF7), 7);
+#endif
+        EXPECT_EQ(channels::sf_of(channels::DR_COUNT), 0);
+        EXPECT_EQ(channels::payload_of(channels::DR_COUNT), 0);
+}
+
+TEST(DataRates, SpreadingFactorRoundTrip)
+{
+        for (uint8_t dr = 0; dr < channels::DR_COUNT; dr++)
+        {
+                if (channels::lora125(dr))
+                {
+                        EXPECT_EQ(channels::dr_for_sf(channels::sf_of(dr)), dr) << "DR" << +dr;
+                }
+        }
+}
+
+TEST(DataRates, SpreadingFactorOutsideThePlan)
+{
+        uint8_t slowest_sf = channels::sf_of(channels::DR_SLOWEST);
+
+        //
+        // more robust than the plan allows: the slowest rate
+        //
+        for (uint8_t sf = slowest_sf; sf <= 12; sf++)
+        {
+                EXPECT_EQ(channels::dr_for_sf(sf), channels::DR_SLOWEST) << "SF" << +sf;
+        }
+
+        //
+        // faster than SF7: the fastest 125 kHz rate, never a wider channel
+        //
+        uint8_t fastest = channels::dr_for_sf(0);
+
+        EXPECT_TRUE(channels::lora125(fastest));
+        EXPECT_EQ(channels::sf_of(fastest), 7);
+}
+
+TEST(DataRates, SlowingDownNeverLeavesThePlan)
+{
+        //
+        // what missed_downlink() does, from each 125 kHz rate
+        //
+        for (uint8_t dr = 0; dr < channels::DR_COUNT; dr++)
+        {
+                if (!channels::lora125(dr) || dr == channels::DR_SLOWEST)
+                {
+                        continue;
+                }
+
+                EXPECT_TRUE(channels::lora125(dr - 1)) << "DR" << +dr;
+                EXPECT_GT(channels::sf_of(dr - 1), channels::sf_of(dr)) << "DR" << +dr;
+        }
+}
+
+#if defined(CFG_LMIC_EU_like)
+
+TEST(Plan, ChannelsInBandAndUnique)
+{
+        std::set<uint32_t> seen;
+
+        ASSERT_GT(channels::PLAN_SIZE, 0);
+        ASSERT_LE(channels::PLAN_SIZE, MAX_CHANNELS);
+
+        for (uint8_t i = 0; i < channels::PLAN_SIZE; i++)
+        {
+                const channels::channel_t &ch = channels::PLAN[i];
+
+                EXPECT_GE(ch.freq, channels::FREQ_MIN) << "channel " << +i;
+                EXPECT_LE(ch.freq, channels::FREQ_MAX) << "channel " << +i;
+                EXPECT_TRUE(seen.insert(ch.freq).second) << "channel " << +i << " duplicated";
+        }
+}
+
+TEST(Plan, DataRateMapsUseDefinedRates)
+{
+        for (uint8_t i = 0; i < channels::PLAN_SIZE; i++)
+        {
+                uint16_t map = channels::PLAN[i].drmap;
+
+                ASSERT_NE(map, 0) << "channel " << +i;
+
+                for (uint8_t dr = 0; dr < 16; dr++)
+                {
+                        if (map & (1 << dr))
+                        {
+                                EXPECT_LT(dr, channels::DR_COUNT) << "channel " << +i;
+                                EXPECT_GT(channels::payload_of(dr), 0) << "channel " << +i << " DR" << +dr;
+                        }
+                }
+        }
+}
+
+TEST(Plan, DefaultChannelsFirst)
+{
+        const uint8_t n = sizeof(DEFAULT_FREQS) / sizeof(DEFAULT_FREQS[0]);
+
+        ASSERT_GE(channels::PLAN_SIZE, n);
+
+        for (uint8_t i = 0; i < n; i++)
+        {
+                EXPECT_EQ(channels::PLAN[i].freq, DEFAULT_FREQS[i]);
+                EXPECT_EQ(channels::PLAN[i].drmap & DR_RANGE_MAP(0, 5), DR_RANGE_MAP(0, 5)) << "channel " << +i;
+        }
+}
+
+#else
+
+TEST(Plan, SubBandExists)
+{
+        EXPECT_LT(channels::SUBBAND, 8);
+}
+
+#endif
+
+} // namespace
@@ -0,0 +1,439 @@
+/*
+ *
+ * Flash log tests
+ *
+ * PURPOSE: Runs the store-and-forward log on the emulated flash: batch
+ *          encoding, corrupted and oversized records, ring wrap-around
+ *          and recovery after a cold boot
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <gtest/gtest.h>
+#include <memory>
+#include <vector>
+
+#include "include/util/flashlog.h"
+
+#include "../../config.h"
+
+namespace flashlog
+{
+extern bool positions_valid;
+}
+
+namespace
+{
+
+typedef std::vector<uint8_t> frame_t;
+
+const uint32_t RING_START = CONFIG_FLASHLOG_FIRST_SECTOR * SPIFlash::SECTOR;
+const uint32_t HEADER = 12;
+const uint8_t BATCH_HEADER = 4;
+
+/// \brief decodes a batch: [len][data] first, then [len][XOR delta, zero runs as 0 n]
+std::vector<frame_t> decode(const uint8_t *buf, const uint8_t size)
+{
+        std::vector<frame_t> frames;
+        uint8_t i = 0;
+
+        while (i < size)
+        {
+                frame_t f(buf[i++]);
+                const frame_t *prev = frames.empty() ? nullptr : &frames.back();
+
+                for (size_t j = 0; j < f.size();)
+                {
+                        uint8_t p = (prev != nullptr && j < prev->size()) ? (*prev)[j] : 0;
+
+                        if (prev != nullptr && buf[i] == 0)
+                        {
+                                uint8_t run = buf[i + 1];
+                                i += 2;
+
+                                for (uint8_t k = 0; k < run; k++, j++)
+                                {
+                                        f[j] = (j < prev->size()) ? (*prev)[j] : 0;
+                                }
+                                continue;
+                        }
+
+                        f[j++] = buf[i++] ^ p;
+                }
+
+                frames.push_back(f);
+        }
+
+        return frames;
+}
+
+/// \brief a frame like the packer's: a few channels, slowly changing values
+frame_t sample(const uint32_t n, const uint8_t size = 24)
+{
+        frame_t f(size);
+
+        for (uint8_t i = 0; i < size; i++)
+        {
+                f[i] = static_cast<uint8_t>((i % 3 == 0) ? i : (n * (i + 1) / 7));
+        }
+
+        return f;
+}
+
+class FlashLog : public ::testing::Test
+{
+protected:
+        std::unique_ptr<SPIFlash> chip;
+
+        void SetUp() override
+        {
+                chip.reset(new SPIFlash());
+                boot();
+        }
+
+        /// \brief cold boot: RTC memory is lost, positions come from the flash
+        void boot()
+        {
+                flashlog::positions_valid = false;
+                ASSERT_TRUE(flashlog::setup(chip.get()));
+        }
+
+        /// epoch of the last batch
+        uint32_t epoch = 0;
+
+        void append(const frame_t &f, const uint32_t sampled_at = 0)
+        {
+                ASSERT_TRUE(flashlog::append(f.data(), static_cast<uint8_t>(f.size()), sampled_at));
+        }
+
+        std::vector<frame_t> batch(const uint8_t max = CONFIG_MAX_PAYLOAD, const uint8_t age_at = flashlog::NO_AGE)
+        {
+                uint8_t buf[CONFIG_MAX_PAYLOAD];
+                uint8_t size = flashlog::read_batch(buf, max, age_at);
+
+                EXPECT_LE(size, max);
+
+                if (size == 0)
+                {
+                        return {};
+                }
+
+                EXPECT_GT(size, BATCH_HEADER);
+                epoch = (uint32_t(buf[0]) << 24) | (uint32_t(buf[1]) << 16) | (uint32_t(buf[2]) << 8) | buf[3];
+
+                return decode(buf + BATCH_HEADER, size - BATCH_HEADER);
+        }
+};
+
+TEST_F(FlashLog, EmptyLogHasNothingToSend)
+{
+        EXPECT_EQ(flashlog::backlog(), 0u);
+        EXPECT_TRUE(batch().empty());
+}
+
+TEST_F(FlashLog, BatchRoundTrip)
+{
+        std::vector<frame_t> sent;
+
+        for (uint32_t n = 0; n < 5; n++)
+        {
+                sent.push_back(sample(n));
+                append(sent.back());
+        }
+
+        EXPECT_EQ(flashlog::backlog(), 5u);
+        EXPECT_EQ(batch(), sent);
+
+        //
+        // not committed: the same records come again
+        //
+        EXPECT_EQ(batch(), sent);
+
+        flashlog::commit_batch();
+
+        EXPECT_EQ(flashlog::backlog(), 0u);
+        EXPECT_TRUE(batch().empty());
+}
+
+TEST_F(FlashLog, BatchFitsTheGivenSize)
+{
+        for (uint32_t n = 0; n < 40; n++)
+        {
+                append(sample(n, 30));
+        }
+
+        uint32_t got = 0;
+
+        //
+        // 36 B: SF12 in EU868 less room for MAC commands
+        //
+        while (flashlog::backlog() > 0)
+        {
+                std::vector<frame_t> frames = batch(36);
+
+                ASSERT_FALSE(frames.empty());
+
+                for (const frame_t &f : frames)
+                {
+                        EXPECT_EQ(f, sample(got++, 30));
+                }
+
+                flashlog::commit_batch();
+        }
+
+        EXPECT_EQ(got, 40u);
+}
+
+TEST_F(FlashLog, BatchCarriesAgesAfterItsEpoch)
+{
+        const uint32_t t0 = 1700000000;
+        const uint8_t age_at = 2;
+
+        //
+        // sampled before the clock was set: no time, its bytes go as they are
+        //
+        append(sample(0));
+
+        for (uint32_t n = 1; n < 5; n++)
+        {
+                append(sample(n), t0 + 300 * n);
+        }
+
+        std::vector<frame_t> frames = batch(CONFIG_MAX_PAYLOAD, age_at);
+
+        ASSERT_EQ(frames.size(), 5u);
+        EXPECT_EQ(epoch, t0 + 300);
+        EXPECT_EQ(frames[0], sample(0));
+
+        for (uint32_t n = 1; n < 5; n++)
+        {
+                uint16_t age = (frames[n][age_at] << 8) | frames[n][age_at + 1];
+
+                EXPECT_EQ(age, 300 * (n - 1)) << "record " << n;
+        }
+
+        //
+        // the rest of each record is untouched
+        //
+        frame_t f = frames[4];
+
+        f[age_at] = sample(4)[age_at];
+        f[age_at + 1] = sample(4)[age_at + 1];
+        EXPECT_EQ(f, sample(4));
+}
+
+TEST_F(FlashLog, AgeSaturatesInsteadOfWrapping)
+{
+        const uint32_t t0 = 1700000000;
+
+        append(sample(0), t0);
+        append(sample(1), t0 + 100000);
+
+        std::vector<frame_t> frames = batch(CONFIG_MAX_PAYLOAD, 0);
+
+        ASSERT_EQ(frames.size(), 2u);
+        EXPECT_EQ(epoch, t0);
+        EXPECT_EQ(frames[1][0], 0xFF);
+        EXPECT_EQ(frames[1][1], 0xFF);
+}
+
+TEST_F(FlashLog, CorruptedRecordDoesNotBreakTheDeltas)
+{
+        append(sample(0));
+        append(sample(1));
+        append(sample(2));
+
+        //
+        // flip a data bit of the first record: its CRC fails
+        //
+        chip->raw()[RING_START + HEADER + 5] ^= 0x01;
+
+        std::vector<frame_t> frames = batch();
+
+        ASSERT_EQ(frames.size(), 2u);
+        EXPECT_EQ(frames[0], sample(1));
+        EXPECT_EQ(frames[1], sample(2));
+
+        //
+        // the corrupted record goes with the batch
+        //
+        flashlog::commit_batch();
+        EXPECT_EQ(flashlog::backlog(), 0u);
+}
+
+TEST_F(FlashLog, SameBitFlippedTwiceIsCaught)
+{
+        append(sample(0));
+        append(sample(1));
+
+        //
+        // the same bit in two data bytes: a XOR of the bytes can't see it
+        //
+        chip->raw()[RING_START + HEADER + 3] ^= 0x10;
+        chip->raw()[RING_START + HEADER + 20] ^= 0x10;
+
+        std::vector<frame_t> frames = batch();
+
+        ASSERT_EQ(frames.size(), 1u);
+        EXPECT_EQ(frames[0], sample(1));
+}
+
+TEST_F(FlashLog, CorruptedTailIsRetired)
+{
+        append(sample(0));
+        append(sample(1));
+
+        chip->raw()[RING_START + HEADER] ^= 0x01;
+        chip->raw()[RING_START + 2 * HEADER + 24] ^= 0x01;
+
+        EXPECT_TRUE(batch().empty());
+        EXPECT_EQ(flashlog::backlog(), 0u);
+
+        //
+        // and the log goes on after it
+        //
+        append(sample(2));
+
+        std::vector<frame_t> frames = batch();
+
+        ASSERT_EQ(frames.size(), 1u);
+        EXPECT_EQ(frames[0], sample(2));
+}
+
+TEST_F(FlashLog, RecordTooLongForTheDataRateWaits)
+{
+        append(sample(0, 60));
+        append(sample(1, 60));
+
+        //
+        // a slow data rate can't carry it: nothing now, nothing lost
+        //
+        EXPECT_TRUE(batch(36).empty());
+        EXPECT_EQ(flashlog::backlog(), 2u);
+
+        std::vector<frame_t> frames = batch(115);
+
+        ASSERT_GE(frames.size(), 1u);
+        EXPECT_EQ(frames[0], sample(0, 60));
+}
+
+TEST_F(FlashLog, RecordTooLongForAnyFrameIsDropped)
+{
+        append(sample(0, CONFIG_MAX_PAYLOAD));
+        append(sample(1));
+
+        std::vector<frame_t> frames = batch();
+
+        ASSERT_EQ(frames.size(), 1u);
+        EXPECT_EQ(frames[0], sample(1));
+
+        flashlog::commit_batch();
+        EXPECT_EQ(flashlog::backlog(), 0u);
+}
+
+TEST_F(FlashLog, RecoversAfterColdBoot)
+{
+        for (uint32_t n = 0; n < 10; n++)
+        {
+                append(sample(n));
+        }
+
+        (void) batch(60);
+        flashlog::commit_batch();
+
+        uint32_t left = flashlog::backlog();
+
+        ASSERT_GT(left, 0u);
+        ASSERT_LT(left, 10u);
+
+        boot();
+
+        EXPECT_EQ(flashlog::backlog(), left);
+
+        //
+        // the unsent ones come back in order
+        //
+        uint32_t next = 10 - left;
+
+        while (flashlog::backlog() > 0)
+        {
+                std::vector<frame_t> frames = batch();
+
+                ASSERT_FALSE(frames.empty());
+
+                for (const frame_t &f : frames)
+                {
+                        EXPECT_EQ(f, sample(next++));
+                }
+
+                flashlog::commit_batch();
+        }
+
+        EXPECT_EQ(next, 10u);
+}
+
+TEST_F(FlashLog, FullRingDropsTheOldestSector)
+{
+        //
+        // records that pack a sector exactly, so a full sector forces the erase
+        //
+        const uint8_t size = 32 - HEADER;
+        const uint32_t per_sector = SPIFlash::SECTOR / (HEADER + size);
+        const uint32_t total = (CONFIG_FLASHLOG_SECTORS + 2) * per_sector;
+
+        for (uint32_t n = 0; n < total; n++)
+        {
+                append(sample(n, size));
+        }
+
+        //
+        // at most the ring less the sector being erased survives
+        //
+        EXPECT_LE(flashlog::backlog(), (CONFIG_FLASHLOG_SECTORS - 1) * per_sector);
+        EXPECT_GE(flashlog::backlog(), (CONFIG_FLASHLOG_SECTORS - 2) * per_sector);
+
+        //
+        // the oldest survivor comes first and the deltas still chain
+        //
+        std::vector<frame_t> frames = batch();
+        uint32_t first = total - flashlog::backlog();
+
+        ASSERT_FALSE(frames.empty());
+
+        for (size_t i = 0; i < frames.size(); i++)
+        {
+                EXPECT_EQ(frames[i], sample(first + i, size));
+        }
+
+        EXPECT_EQ(chip->stats.failed_writes, 0u);
+        EXPECT_LE(chip->max_wear(), 2u);
+}
+
+TEST_F(FlashLog, NoFlashMeansNoLog)
+{
+        SPIFlash absent;
+        absent.present = false;
+
+        EXPECT_FALSE(flashlog::setup(&absent));
+        EXPECT_FALSE(flashlog::available());
+        EXPECT_FALSE(flashlog::append(sample(0).data(), 24));
+}
+
+} // namespace
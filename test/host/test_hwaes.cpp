@@ -0,0 +1,251 @@
+/*
+ *
+ * AES tests
+ *
+ * PURPOSE: Known answers for every os_aes() mode LMIC uses, through the
+ *          hwaes path (mbedTLS stand-in on OpenSSL) and through LMIC's
+ *          software path: FIPS-197 for the cipher, RFC 4493 for the CMAC,
+ *          and a LoRaWAN uplink for the MIC and FRMPayload layout
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+#include <lmic.h>
+
+#include "include/util/hwaes.h"
+
+namespace hwaes
+{
+extern bool enabled;
+}
+
+namespace
+{
+
+typedef std::vector<u1_t> bytes_t;
+
+bytes_t hex(const std::string &s)
+{
+        bytes_t b;
+
+        for (size_t i = 0; i + 1 < s.size(); i += 2)
+        {
+                b.push_back(static_cast<u1_t>(std::stoul(s.substr(i, 2), nullptr, 16)));
+        }
+
+        return b;
+}
+
+//
+// RFC 4493, section 4
+//
+const bytes_t RFC_KEY = hex("2b7e151628aed2a6abf7158809cf4f3c");
+const bytes_t RFC_MSG = hex("6bc1bee22e409f96e93d7e117393172a"
+                            "ae2d8a571e03ac9c9eb76fac45af8e51"
+                            "30c81c46a35ce411e5fbc1191a0a52ef"
+                            "f69f2445df4f9b17ad2b417be66c3710");
+
+//
+// a LoRaWAN 1.0 uplink: DevAddr 49be7df1, FCnt 2, FPort 1, "test"
+//
+const bytes_t NWK_S_KEY = hex("44024241ed4ce9a68c6a8bc055233fd3");
+const bytes_t APP_S_KEY = hex("ec925802ae430ca77fd3dd73cb2cc588");
+const bytes_t PHY_PAYLOAD = hex("40f17dbe4900020001954378762b11ff0d");
+const u4_t DEV_ADDR = 0x49be7df1;
+const u4_t FCNT = 2;
+
+/// true: os_aes() goes to hwaes, false: to LMIC's software AES
+class Aes : public ::testing::TestWithParam<bool>
+{
+protected:
+        void SetUp() override
+        {
+                static const bool passed = hwaes::setup();
+
+                ASSERT_TRUE(passed);
+                hwaes::enabled = GetParam();
+        }
+
+        void TearDown() override
+        {
+                hwaes::enabled = true;
+        }
+
+        void key(const bytes_t &k)
+        {
+                (void) memcpy(AESkey, k.data(), 16);
+        }
+
+        /// B0 block of an uplink MIC, as LMIC's aes_appendMic() lays it out
+        void b0(const u4_t devaddr, const u4_t seqno, const u1_t len)
+        {
+                (void) memset(AESaux, 0, 16);
+                AESaux[0] = 0x49;
+                os_wlsbf4(AESaux + 6, devaddr);
+                os_wlsbf4(AESaux + 10, seqno);
+                AESaux[15] = len;
+        }
+
+        /// A1 block of an uplink FRMPayload, as LMIC's aes_cipher() lays it out
+        void a1(const u4_t devaddr, const u4_t seqno)
+        {
+                (void) memset(AESaux, 0, 16);
+                AESaux[0] = AESaux[15] = 1;
+                os_wlsbf4(AESaux + 6, devaddr);
+                os_wlsbf4(AESaux + 10, seqno);
+        }
+};
+
+TEST_P(Aes, Fips197Cipher)
+{
+        //
+        // FIPS-197, appendix C.1
+        //
+        bytes_t block = hex("00112233445566778899aabbccddeeff");
+
+        key(hex("000102030405060708090a0b0c0d0e0f"));
+        EXPECT_EQ(os_aes(AES_ENC, block.data(), 16), 0u);
+        EXPECT_EQ(block, hex("69c4e0d86a7b0430d8cdb78070b4c55a"));
+}
+
+TEST_P(Aes, Rfc4493Cmac)
+{
+        static const struct
+        {
+                u2_t len;
+                u4_t mic;
+        } examples[] =
+        {
+                {0, 0xbb1d6929},
+                {16, 0x070a16b4},
+                {40, 0xdfa66747},
+                {64, 0x51f0bebf},
+        };
+
+        for (const auto &e : examples)
+        {
+                bytes_t m = RFC_MSG;
+
+                key(RFC_KEY);
+                EXPECT_EQ(os_aes(AES_MIC | AES_MICNOAUX, m.data(), e.len), e.mic) << e.len << " B";
+                EXPECT_EQ(m, RFC_MSG) << "the MIC must not touch the message";
+        }
+}
+
+TEST_P(Aes, Rfc4493CmacWithAuxBlock)
+{
+        //
+        // the first block of the message as LMIC's aux block
+        //
+        bytes_t m(RFC_MSG.begin() + 16, RFC_MSG.end());
+
+        key(RFC_KEY);
+        (void) memcpy(AESaux, RFC_MSG.data(), 16);
+        EXPECT_EQ(os_aes(AES_MIC, m.data(), 24), 0xdfa66747u);
+
+        key(RFC_KEY);
+        (void) memcpy(AESaux, RFC_MSG.data(), 16);
+        EXPECT_EQ(os_aes(AES_MIC, m.data(), 48), 0x51f0bebfu);
+
+        key(RFC_KEY);
+        (void) memcpy(AESaux, RFC_MSG.data(), 16);
+        EXPECT_EQ(os_aes(AES_MIC, m.data(), 0), 0x070a16b4u);
+}
+
+TEST_P(Aes, LoRaWanUplinkMic)
+{
+        bytes_t pdu(PHY_PAYLOAD.begin(), PHY_PAYLOAD.end() - 4);
+
+        key(NWK_S_KEY);
+        b0(DEV_ADDR, FCNT, static_cast<u1_t>(pdu.size()));
+
+        u4_t mic = os_aes(AES_MIC, pdu.data(), static_cast<u2_t>(pdu.size()));
+
+        EXPECT_EQ(mic, os_rmsbf4(&PHY_PAYLOAD[PHY_PAYLOAD.size() - 4]));
+}
+
+TEST_P(Aes, LoRaWanUplinkPayload)
+{
+        //
+        // MHDR, FHDR (7 B), FPort, then the FRMPayload
+        //
+        bytes_t frm(PHY_PAYLOAD.begin() + 9, PHY_PAYLOAD.end() - 4);
+
+        key(APP_S_KEY);
+        a1(DEV_ADDR, FCNT);
+        EXPECT_EQ(os_aes(AES_CTR, frm.data(), static_cast<u2_t>(frm.size())), 0u);
+        EXPECT_EQ(std::string(frm.begin(), frm.end()), "test");
+
+        //
+        // and back
+        //
+        key(APP_S_KEY);
+        a1(DEV_ADDR, FCNT);
+        (void) os_aes(AES_CTR, frm.data(), static_cast<u2_t>(frm.size()));
+        EXPECT_EQ(frm, bytes_t(PHY_PAYLOAD.begin() + 9, PHY_PAYLOAD.end() - 4));
+}
+
+TEST_P(Aes, LoRaWanPayloadCounterBlocks)
+{
+        //
+        // a three block FRMPayload: block i is XORed with AES(Ai), the
+        // counter in the last byte of the aux block
+        //
+        bytes_t frm(40, 0);
+
+        key(APP_S_KEY);
+        a1(DEV_ADDR, FCNT);
+        (void) os_aes(AES_CTR, frm.data(), static_cast<u2_t>(frm.size()));
+
+        for (u1_t i = 1; i <= 3; i++)
+        {
+                bytes_t s(16);
+
+                a1(DEV_ADDR, FCNT);
+                (void) memcpy(s.data(), AESaux, 16);
+                s[15] = i;
+                key(APP_S_KEY);
+                (void) os_aes(AES_ENC, s.data(), 16);
+
+                size_t from = (i - 1) * 16u, n = std::min<size_t>(16, frm.size() - from);
+                EXPECT_EQ(bytes_t(frm.begin() + from, frm.begin() + from + n), bytes_t(s.begin(), s.begin() + n))
+                    << "block " << static_cast<int>(i);
+        }
+
+        //
+        // and the first 4 bytes of the keystream are the uplink's
+        //
+        bytes_t frm4(PHY_PAYLOAD.begin() + 9, PHY_PAYLOAD.end() - 4);
+        bytes_t plain = hex("74657374");
+
+        for (size_t i = 0; i < 4; i++)
+        {
+                EXPECT_EQ(frm[i], frm4[i] ^ plain[i]);
+        }
+}
+
+INSTANTIATE_TEST_SUITE_P(Path, Aes, ::testing::Values(true, false),
+                         [](const ::testing::TestParamInfo<bool> &info) { return info.param ? "hwaes" : "lmic"; });
+
+} // namespace
@@ -0,0 +1,347 @@
+/*
+ *
+ * Radio tests
+ *
+ * PURPOSE: Drives the simulated SX1276 at register level over SPI and the
+ *          DIO lines, the way MCCI's radio.c does: reset and version,
+ *          a frame out of the FIFO onto the air, the answer caught in a
+ *          single RX window, and a window timing out
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <gtest/gtest.h>
+#include <cstring>
+#include <vector>
+
+#include <Arduino.h>
+#include <SPI.h>
+#include <lmic.h>
+#include <lmic/sim.h>
+
+#include "../../config.h"
+
+//
+// the radio takes its time on air from LMIC's calcAirTime(), which brings
+// in the MAC: an application that never joins
+//
+void onEvent(ev_t ev)
+{
+        (void) ev;
+}
+
+void os_getArtEui(u1_t *buf)
+{
+        (void) memset(buf, 0, 8);
+}
+
+void os_getDevEui(u1_t *buf)
+{
+        (void) memset(buf, 0, 8);
+}
+
+void os_getDevKey(u1_t *buf)
+{
+        (void) memset(buf, 0, 16);
+}
+
+namespace
+{
+
+//
+// the registers radio.c touches here (SX1276 datasheet, 6.4)
+//
+const u1_t REG_FIFO = 0x00;
+const u1_t REG_OPMODE = 0x01;
+const u1_t REG_FRF_MSB = 0x06;
+const u1_t REG_FIFO_ADDR_PTR = 0x0D;
+const u1_t REG_FIFO_TX_BASE = 0x0E;
+const u1_t REG_FIFO_RX_BASE = 0x0F;
+const u1_t REG_FIFO_RX_CURRENT = 0x10;
+const u1_t REG_IRQ_FLAGS = 0x12;
+const u1_t REG_RX_NB_BYTES = 0x13;
+const u1_t REG_PKT_SNR = 0x19;
+const u1_t REG_PKT_RSSI = 0x1A;
+const u1_t REG_MODEM_CONFIG1 = 0x1D;
+const u1_t REG_MODEM_CONFIG2 = 0x1E;
+const u1_t REG_SYMB_TIMEOUT_LSB = 0x1F;
+const u1_t REG_PAYLOAD_LENGTH = 0x22;
+const u1_t REG_IMAGE_CAL = 0x3B;
+const u1_t REG_DIO_MAPPING1 = 0x40;
+const u1_t REG_VERSION = 0x42;
+
+const u1_t LORA_SLEEP = 0x80;
+const u1_t LORA_STANDBY = 0x81;
+const u1_t LORA_TX = 0x83;
+const u1_t LORA_RX_SINGLE = 0x86;
+
+const u1_t IRQ_RX_TIMEOUT = 0x80;
+const u1_t IRQ_RX_DONE = 0x40;
+const u1_t IRQ_TX_DONE = 0x08;
+
+const u1_t MAP_DIO0_RX_DONE = 0x00;
+const u1_t MAP_DIO0_TX_DONE = 0x40;
+
+const u4_t FREQ = 868100000;
+
+/// \class a network that answers every uplink one second after its end
+class Echo : public sim::air_t
+{
+public:
+        std::vector<sim::packet_t> heard;
+
+        bool uplink(const sim::packet_t &up, sim::packet_t *down) override
+        {
+                heard.push_back(up);
+
+                *down = up;
+                down->tmst_us = up.tmst_us + 1000000;
+                down->rssi = -97;
+                down->snr_q4 = -6;
+                down->len = 3;
+                (void) memcpy(down->data, "ans", 3);
+
+                return true;
+        }
+};
+
+void write(const u1_t reg, const u1_t value)
+{
+        digitalWrite(CONFIG_NSS_GPIO, LOW);
+        (void) SPI.transfer(reg | 0x80);
+        (void) SPI.transfer(value);
+        digitalWrite(CONFIG_NSS_GPIO, HIGH);
+}
+
+u1_t read(const u1_t reg)
+{
+        digitalWrite(CONFIG_NSS_GPIO, LOW);
+        (void) SPI.transfer(reg);
+        u1_t value = SPI.transfer(0x00);
+        digitalWrite(CONFIG_NSS_GPIO, HIGH);
+
+        return value;
+}
+
+/// SF9, 125 kHz, CR 4/5, explicit header, as configLoraModem() sets them
+void configure(const bool crc)
+{
+        u4_t frf = static_cast<u4_t>((static_cast<uint64_t>(FREQ) << 19) / 32000000);
+
+        //
+        // a burst: the address goes up by itself
+        //
+        digitalWrite(CONFIG_NSS_GPIO, LOW);
+        (void) SPI.transfer(REG_FRF_MSB | 0x80);
+        (void) SPI.transfer(static_cast<u1_t>(frf >> 16));
+        (void) SPI.transfer(static_cast<u1_t>(frf >> 8));
+        (void) SPI.transfer(static_cast<u1_t>(frf));
+        digitalWrite(CONFIG_NSS_GPIO, HIGH);
+
+        write(REG_MODEM_CONFIG1, 0x72);
+        write(REG_MODEM_CONFIG2, static_cast<u1_t>(0x90 | (crc ? 0x04 : 0)));
+}
+
+/// waits on the host clock until the radio's next IRQ
+void wait_irq()
+{
+        ostime_t at;
+
+        ASSERT_TRUE(sim::next_irq(&at));
+
+        s4_t wait = sim::diff(at, os_getTime());
+
+        if (wait > 0)
+        {
+                host_skip_us(static_cast<uint64_t>(wait) * US_PER_OSTICK);
+        }
+}
+
+class Radio : public ::testing::Test
+{
+protected:
+        Echo air;
+
+        void SetUp() override
+        {
+                host_reboot();
+                sim::radio = {};
+                sim::attach(&air);
+
+                //
+                // hal_pin_rst(0), then let it float
+                //
+                digitalWrite(CONFIG_RESET_GPIO, LOW);
+                pinMode(CONFIG_RESET_GPIO, INPUT);
+                write(REG_OPMODE, LORA_SLEEP);
+        }
+
+        void TearDown() override
+        {
+                sim::attach(nullptr);
+        }
+
+        /// txlora(): the frame through the FIFO, then TX mode
+        ostime_t send(const std::vector<u1_t> &frame)
+        {
+                configure(true);
+
+                write(REG_DIO_MAPPING1, MAP_DIO0_TX_DONE);
+                write(REG_FIFO_TX_BASE, 0x00);
+                write(REG_FIFO_ADDR_PTR, 0x00);
+                write(REG_PAYLOAD_LENGTH, static_cast<u1_t>(frame.size()));
+
+                digitalWrite(CONFIG_NSS_GPIO, LOW);
+                (void) SPI.transfer(REG_FIFO | 0x80);
+
+                for (u1_t b : frame)
+                {
+                        (void) SPI.transfer(b);
+                }
+
+                digitalWrite(CONFIG_NSS_GPIO, HIGH);
+
+                ostime_t start = os_getTime();
+
+                write(REG_OPMODE, LORA_TX);
+
+                return start;
+        }
+
+        /// rxlora(RXMODE_SINGLE): a window of syms symbols from now
+        void listen(const u1_t syms)
+        {
+                configure(false);
+
+                write(REG_DIO_MAPPING1, MAP_DIO0_RX_DONE);
+                write(REG_FIFO_RX_BASE, 0x00);
+                write(REG_FIFO_ADDR_PTR, 0x00);
+                write(REG_SYMB_TIMEOUT_LSB, syms);
+                write(REG_IRQ_FLAGS, 0xFF);
+                write(REG_OPMODE, LORA_RX_SINGLE);
+        }
+};
+
+TEST_F(Radio, AnswersItsVersionAfterReset)
+{
+        EXPECT_EQ(read(REG_VERSION), 0x12);
+
+        //
+        // the image calibration radio_init() starts is over at once
+        //
+        write(REG_OPMODE, 0x00);
+        write(REG_IMAGE_CAL, 0x40);
+        EXPECT_EQ(read(REG_IMAGE_CAL) & 0x20, 0);
+
+        EXPECT_FALSE(digitalRead(CONFIG_DIO0_GPIO));
+        EXPECT_FALSE(digitalRead(CONFIG_DIO1_GPIO));
+}
+
+TEST_F(Radio, SendsWhatTheFifoHolds)
+{
+        std::vector<u1_t> frame = {0x40, 0x34, 0x12, 0x0b, 0x26, 0x00, 0x01, 0x00, 0x5a, 0x5a};
+        ostime_t start = send(frame);
+
+        ASSERT_EQ(air.heard.size(), 1u);
+        EXPECT_EQ(air.heard[0].freq, FREQ);
+        EXPECT_EQ(air.heard[0].sf, 9);
+        EXPECT_EQ(air.heard[0].bw_khz, 125);
+        ASSERT_EQ(air.heard[0].len, frame.size());
+        EXPECT_EQ(std::vector<u1_t>(air.heard[0].data, air.heard[0].data + frame.size()), frame);
+
+        //
+        // TX done comes on DIO0 once the frame's time on air is over:
+        // 12.25 preamble and 23 payload symbols of 4.096 ms
+        //
+        ostime_t at;
+
+        ASSERT_TRUE(sim::next_irq(&at));
+        EXPECT_NEAR(sim::diff(at, start), us2osticks(144384), 2);
+        EXPECT_FALSE(digitalRead(CONFIG_DIO0_GPIO));
+
+        wait_irq();
+
+        EXPECT_TRUE(digitalRead(CONFIG_DIO0_GPIO));
+        EXPECT_EQ(read(REG_IRQ_FLAGS), IRQ_TX_DONE);
+        EXPECT_EQ(read(REG_OPMODE), LORA_STANDBY);
+
+        write(REG_IRQ_FLAGS, 0xFF);
+
+        EXPECT_FALSE(digitalRead(CONFIG_DIO0_GPIO));
+        EXPECT_FALSE(sim::next_irq(&at));
+}
+
+TEST_F(Radio, CatchesTheAnswerInItsWindow)
+{
+        (void) send({0x40, 0x34, 0x12, 0x0b, 0x26, 0x00, 0x01, 0x00});
+        wait_irq();
+        write(REG_OPMODE, LORA_SLEEP);
+
+        //
+        // RX1 opens a few symbols ahead of the answer
+        //
+        host_skip_us(1000000 - 4 * 4096);
+        listen(12);
+
+        EXPECT_FALSE(digitalRead(CONFIG_DIO0_GPIO));
+
+        wait_irq();
+
+        ASSERT_TRUE(digitalRead(CONFIG_DIO0_GPIO));
+        EXPECT_FALSE(digitalRead(CONFIG_DIO1_GPIO));
+        EXPECT_EQ(read(REG_IRQ_FLAGS), IRQ_RX_DONE);
+        ASSERT_EQ(read(REG_RX_NB_BYTES), 3);
+        EXPECT_EQ(static_cast<s1_t>(read(REG_PKT_SNR)), -6);
+        EXPECT_EQ(read(REG_PKT_RSSI) - 157, -97);
+
+        write(REG_FIFO_ADDR_PTR, read(REG_FIFO_RX_CURRENT));
+
+        char data[4] = {0};
+
+        for (int i = 0; i < 3; i++)
+        {
+                data[i] = static_cast<char>(read(REG_FIFO));
+        }
+
+        EXPECT_STREQ(data, "ans");
+        EXPECT_EQ(sim::radio.rx, 1u);
+}
+
+TEST_F(Radio, EmptyWindowTimesOut)
+{
+        sim::attach(nullptr);
+
+        ostime_t open = os_getTime();
+
+        listen(8);
+        wait_irq();
+
+        //
+        // RX timeout on DIO1 after the symbols radio.c asked for
+        //
+        EXPECT_GE(sim::diff(os_getTime(), open), 8 * us2osticks(4096));
+        EXPECT_LT(sim::diff(os_getTime(), open), 8 * us2osticks(4096) + ms2osticks(5));
+        EXPECT_FALSE(digitalRead(CONFIG_DIO0_GPIO));
+        EXPECT_TRUE(digitalRead(CONFIG_DIO1_GPIO));
+        EXPECT_EQ(read(REG_IRQ_FLAGS), IRQ_RX_TIMEOUT);
+        EXPECT_EQ(sim::radio.rx, 0u);
+}
+
+} // namespace
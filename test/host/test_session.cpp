@@ -0,0 +1,321 @@
+/*
+ *
+ * Session tests
+ *
+ * PURPOSE: Runs the LoRaWAN module on the LMIC stand-in across deep
+ *          sleeps: the MAC state saved to RTC memory comes back whole,
+ *          with its duty cycle timers and frame counter, only after a
+ *          deep sleep wake, only once, and without touching the flash
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <gtest/gtest.h>
+#include <vector>
+
+#include <Preferences.h>
+#include <esp_sleep.h>
+#include <lmic.h>
+#include <lmic/sim.h>
+
+#include "include/WAN.h"
+
+#include "board.h"
+
+#include "../../config.h"
+
+namespace
+{
+
+const u4_t NET_ID = 0x000013;
+const devaddr_t DEV_ADDR = 0x260b1234;
+const uint8_t NWK_KEY[16] = {0x44, 0x02, 0x42, 0x41, 0xed, 0x4c, 0xe9, 0xa6, 0x8c, 0x6a, 0x8b, 0xc0, 0x55, 0x23, 0x3f, 0xd3};
+const uint8_t ART_KEY[16] = {0xec, 0x92, 0x58, 0x02, 0xae, 0x43, 0x0c, 0xa7, 0x7f, 0xd3, 0xdd, 0x73, 0xcb, 0x2c, 0xc5, 0x88};
+
+std::vector<uint8_t> events;
+
+void on_event(uint8_t ev)
+{
+        events.push_back(ev);
+}
+
+/// \class a network that hears everything and never answers
+class Recorder : public sim::air_t
+{
+public:
+        std::vector<sim::packet_t> heard;
+
+        bool uplink(const sim::packet_t &up, sim::packet_t *down) override
+        {
+                (void) down;
+
+                heard.push_back(up);
+                return false;
+        }
+};
+
+class Session : public ::testing::Test
+{
+protected:
+        Recorder air;
+
+        void SetUp() override
+        {
+                //
+                // a board that joined once: keys in NVS, RTC memory blank
+                //
+                board::power_on();
+                board::provision(NET_ID, DEV_ADDR, NWK_KEY, ART_KEY);
+
+                sim::attach(&air);
+                wan::regist(on_event);
+
+                boot(ESP_SLEEP_WAKEUP_UNDEFINED);
+        }
+
+        void TearDown() override
+        {
+                sim::attach(nullptr);
+        }
+
+        void boot(const esp_sleep_wakeup_cause_t cause)
+        {
+                events.clear();
+                ASSERT_TRUE(board::boot(cause));
+        }
+
+        void sleep(const uint64_t ms)
+        {
+                events.clear();
+                ASSERT_TRUE(board::deep_sleep(ms));
+        }
+
+        void send(const uint8_t size, const bool confirmed = false)
+        {
+                std::vector<uint8_t> data(size, 0x5a);
+
+                wan::send(data.data(), size, 1, confirmed);
+                ASSERT_TRUE(board::run());
+        }
+
+        u2_t fcnt(const size_t i)
+        {
+                return os_rlsbf2(air.heard.at(i).data + OFF_DAT_SEQNO);
+        }
+};
+
+TEST_F(Session, ResumesTheSessionFromFlashAtFirst)
+{
+        EXPECT_TRUE(wan::is_joined());
+        EXPECT_EQ(LMIC.devaddr, DEV_ADDR);
+        EXPECT_EQ(wan::stats().resumes, 0u);
+        ASSERT_FALSE(events.empty());
+        EXPECT_EQ(events.back(), EV_JOINED);
+}
+
+TEST_F(Session, RoundTripKeepsTheMacState)
+{
+        send(10);
+
+        //
+        // what the network may have changed since the join
+        //
+        wan::set_spreading_factor(DR_SF9);
+        LMIC.rxDelay = 3;
+        LMIC.dn2Dr = DR_SF9;
+        LMIC.dn1DrOffset = 1;
+        (void) LMIC_setupChannel(10, 869525000, DR_RANGE_MAP(DR_SF12, DR_SF7), BAND_DECI);
+        LMIC.adrEnabled = !CONFIG_LORA_ADR;
+        LMIC.adrAckReq = 5;
+
+        lmic_t before = LMIC;
+
+        sleep(60000);
+
+        EXPECT_EQ(wan::stats().resumes, 1u);
+        EXPECT_EQ(events, std::vector<uint8_t>{EV_JOINED});
+        EXPECT_TRUE(wan::is_joined());
+
+        EXPECT_EQ(LMIC.netid, before.netid);
+        EXPECT_EQ(LMIC.devaddr, before.devaddr);
+        EXPECT_EQ(0, memcmp(LMIC.nwkKey, before.nwkKey, sizeof(LMIC.nwkKey)));
+        EXPECT_EQ(0, memcmp(LMIC.artKey, before.artKey, sizeof(LMIC.artKey)));
+        EXPECT_EQ(LMIC.seqnoUp, before.seqnoUp);
+        EXPECT_EQ(LMIC.seqnoDn, before.seqnoDn);
+        EXPECT_EQ(LMIC.datarate, DR_SF9);
+        EXPECT_EQ(LMIC.adrTxPow, before.adrTxPow);
+        EXPECT_EQ(LMIC.adrEnabled, before.adrEnabled);
+        EXPECT_EQ(LMIC.adrAckReq, 5);
+        EXPECT_EQ(LMIC.rxDelay, 3);
+        EXPECT_EQ(LMIC.dn2Dr, DR_SF9);
+        EXPECT_EQ(LMIC.dn2Freq, before.dn2Freq);
+        EXPECT_EQ(LMIC.dn1DrOffset, 1);
+        EXPECT_EQ(LMIC.channelMap, before.channelMap);
+        EXPECT_EQ(0, memcmp(LMIC.channelFreq, before.channelFreq, sizeof(LMIC.channelFreq)));
+        EXPECT_EQ(0, memcmp(LMIC.channelDrMap, before.channelDrMap, sizeof(LMIC.channelDrMap)));
+}
+
+TEST_F(Session, FrameCounterGoesOnAfterTheWake)
+{
+        for (int i = 0; i < 3; i++)
+        {
+                send(10);
+        }
+
+        sleep(30000);
+        send(10);
+
+        ASSERT_EQ(air.heard.size(), 4u);
+
+        for (size_t i = 0; i < air.heard.size(); i++)
+        {
+                EXPECT_EQ(fcnt(i), i);
+                EXPECT_EQ(os_rlsbf4(air.heard[i].data + OFF_DAT_ADDR), DEV_ADDR);
+        }
+}
+
+TEST_F(Session, DutyCycleCarriesOverTheSleep)
+{
+        //
+        // SF12: about 2 s on air, the 1 % band is closed for minutes
+        //
+        wan::set_spreading_factor(DR_SF12);
+        send(40);
+
+        ASSERT_EQ(air.heard.size(), 1u);
+
+        ostime_t airtime = calcAirTime(LMIC.rps, air.heard[0].len);
+        ostime_t closed = LMIC.bands[BAND_CENTI].avail - os_getTime();
+
+        ASSERT_GT(closed, sec2osticks(60));
+
+        sleep(60000);
+
+        //
+        // the band reopens when it would have without the sleep
+        //
+        ostime_t left = LMIC.bands[BAND_CENTI].avail - os_getTime();
+
+        EXPECT_NEAR(osticks2ms(left), osticks2ms(closed) - 60000, 50);
+
+        send(40);
+
+        ASSERT_EQ(air.heard.size(), 2u);
+
+        int64_t gap_ms = static_cast<int64_t>(air.heard[1].tmst_us - air.heard[0].tmst_us) / 1000;
+
+        EXPECT_NEAR(gap_ms, osticks2us(airtime) / 10, 50);
+}
+
+TEST_F(Session, LongSleepReopensEveryBand)
+{
+        wan::set_spreading_factor(DR_SF12);
+        send(40);
+
+        ASSERT_EQ(air.heard.size(), 1u);
+
+        //
+        // ten hours: more than the 32-bit LMIC clock can hold in ticks
+        //
+        sleep(10ULL * 3600 * 1000);
+
+        ostime_t now = os_getTime();
+
+        for (const auto &band : LMIC.bands)
+        {
+                EXPECT_LE(band.avail - now, 0);
+        }
+
+        EXPECT_LE(LMIC.globalDutyAvail - now, 0);
+
+        //
+        // nothing but its own airtime holds the next frame back
+        //
+        uint64_t woke_us = host_rtc_us();
+
+        send(40);
+
+        ASSERT_EQ(air.heard.size(), 2u);
+        EXPECT_LT(air.heard[1].tmst_us - woke_us, 5000000u);
+}
+
+TEST_F(Session, ResetDoesNotResume)
+{
+        send(10);
+        wan::set_spreading_factor(DR_SF9);
+        wan::save_session(60000);
+
+        //
+        // a reset keeps RTC memory, but its content can't be trusted
+        //
+        boot(ESP_SLEEP_WAKEUP_UNDEFINED);
+
+        EXPECT_EQ(wan::stats().resumes, 0u);
+        EXPECT_TRUE(wan::is_joined());
+        EXPECT_EQ(LMIC.datarate, CONFIG_LORA_SPREADING_FACTOR);
+
+        send(10);
+
+        ASSERT_EQ(air.heard.size(), 2u);
+        EXPECT_EQ(fcnt(1), 1u);
+}
+
+TEST_F(Session, BusyMacIsNotSaved)
+{
+        std::vector<uint8_t> data(10, 0);
+
+        wan::send(data.data(), 10, 1, false);
+
+        ASSERT_TRUE(LMIC.opmode & OP_TXRXPEND);
+
+        sleep(60000);
+
+        EXPECT_EQ(wan::stats().resumes, 0u);
+}
+
+TEST_F(Session, SavedSessionIsUsedOnce)
+{
+        sleep(1000);
+
+        EXPECT_EQ(wan::stats().resumes, 1u);
+
+        //
+        // woken again without saving: back to the keys in flash
+        //
+        boot(ESP_SLEEP_WAKEUP_TIMER);
+
+        EXPECT_EQ(wan::stats().resumes, 1u);
+        EXPECT_TRUE(wan::is_joined());
+}
+
+TEST_F(Session, ResumeDoesNotWriteTheFlash)
+{
+        send(10);
+
+        uint32_t writes = Preferences::host_writes();
+
+        sleep(60000);
+        sleep(60000);
+
+        EXPECT_EQ(wan::stats().resumes, 2u);
+        EXPECT_EQ(Preferences::host_writes(), writes);
+}
+
+} // namespace
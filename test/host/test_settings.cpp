@@ -0,0 +1,108 @@
+/*
+ *
+ * Settings tests
+ *
+ * PURPOSE: Downlink commands and the NVS copy of the settings: a sensor
+ *          mask never enables a sensor the build lacks, whether it comes
+ *          from a downlink or from a blob another build wrote
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <gtest/gtest.h>
+
+#include <Preferences.h>
+
+#include "include/util/settings.h"
+
+namespace settings
+{
+extern bool loaded;
+settings_t defaults();
+}
+
+namespace
+{
+
+class Settings : public ::testing::Test
+{
+protected:
+        void SetUp() override
+        {
+                Preferences::host_erase_all();
+                boot();
+        }
+
+        /// \brief cold boot: RTC memory is lost, the settings come from NVS
+        void boot()
+        {
+                settings::loaded = false;
+                settings::setup();
+        }
+
+        /// \brief the sensors this build has
+        uint8_t built()
+        {
+                return settings::defaults().sensors;
+        }
+};
+
+TEST_F(Settings, SensorMaskKeepsOnlyBuiltSensors)
+{
+        const uint8_t cmd[] = {settings::CMD_SENSORS, settings::SENSOR_BME680, settings::CMD_SENSORS, 0xFF};
+
+        EXPECT_TRUE(settings::apply(cmd, 2));
+        EXPECT_TRUE(settings::apply(cmd + 2, 2));
+        EXPECT_EQ(settings::get().sensors, built());
+        EXPECT_FALSE(settings::enabled(static_cast<settings::sensor_t>(0x80)));
+}
+
+TEST_F(Settings, SensorCanBeDisabled)
+{
+        const uint8_t cmd[] = {settings::CMD_SENSORS, settings::SENSOR_BME680};
+
+        EXPECT_TRUE(settings::apply(cmd, sizeof(cmd)));
+        EXPECT_TRUE(settings::enabled(settings::SENSOR_BME680));
+        EXPECT_FALSE(settings::enabled(settings::SENSOR_SPS30));
+
+        //
+        // and it stays so after a cold boot
+        //
+        boot();
+        EXPECT_FALSE(settings::enabled(settings::SENSOR_SPS30));
+}
+
+TEST_F(Settings, ForeignBlobIsMasked)
+{
+        settings::settings_t s = settings::get();
+        Preferences p;
+
+        s.sensors = 0xFF;
+        ASSERT_TRUE(p.begin("settings", false));
+        ASSERT_EQ(p.putBytes("cfg", &s, sizeof(s)), sizeof(s));
+        p.end();
+
+        boot();
+
+        EXPECT_EQ(settings::get().sensors, built());
+        EXPECT_EQ(settings::get().send_interval, s.send_interval);
+}
+
+} // namespace
@@ -0,0 +1,405 @@
+/*
+ *
+ * WAN simulation tests
+ *
+ * PURPOSE: Runs the WAN module on the LMIC stand-in against the network
+ *          server stand-in (netserver.cpp) in its own process: OTAA join,
+ *          ACKs, downlinks, network time, resume after deep sleep, lost
+ *          frames and a drifting clock
+ *
+ * -----------------------------------------------------------------------
+ *
+ * This file is part of tbeamLoRa
+ * Copyright (C) 2020-2021  Marco Savelli
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <lmic.h>
+#include <lmic/sim.h>
+
+#include "include/WAN.h"
+#include "include/util/timesync.h"
+
+#include "board.h"
+
+#include "../../config.h"
+
+namespace wan
+{
+extern uint32_t clock_error;
+}
+
+namespace
+{
+
+/// the network server's clock: Unix time at host_rtc_us() == 0
+const uint64_t EPOCH = 1700000000;
+
+std::vector<uint8_t> events;
+
+struct downlink_t
+{
+        uint8_t     port;
+        std::string data;
+};
+
+std::vector<downlink_t> downlinks;
+
+void on_event(uint8_t ev)
+{
+        events.push_back(ev);
+}
+
+void on_downlink(uint8_t port, const uint8_t *data, uint8_t size)
+{
+        downlinks.push_back({port, std::string(data, data + size)});
+}
+
+bool seen(const uint8_t ev)
+{
+        return std::find(events.begin(), events.end(), ev) != events.end();
+}
+
+class Wan : public ::testing::Test
+{
+protected:
+        std::unique_ptr<sim::pipe_t> server;
+
+        void SetUp() override
+        {
+                board::power_on();
+
+                events.clear();
+                downlinks.clear();
+                wan::regist(on_event);
+                wan::regist_downlink(on_downlink);
+                wan::set_confirm_every(CONFIG_LORA_CONFIRM_EVERY);
+        }
+
+        void TearDown() override
+        {
+                sim::attach(nullptr);
+                server.reset();
+        }
+
+        void start(std::vector<std::string> args = {})
+        {
+                args.push_back("-e");
+                args.push_back(std::to_string(EPOCH));
+
+                server.reset(new sim::pipe_t(NETSERVER, args));
+                sim::attach(server.get());
+        }
+
+        void join()
+        {
+                ASSERT_TRUE(board::boot(ESP_SLEEP_WAKEUP_UNDEFINED));
+                ASSERT_TRUE(board::run());
+                ASSERT_TRUE(wan::is_joined());
+        }
+
+        void send(const uint8_t size, const bool confirmed = false)
+        {
+                std::vector<uint8_t> data(size, 0x5a);
+
+                events.clear();
+                wan::send(data.data(), size, 1, confirmed);
+                ASSERT_TRUE(board::run());
+        }
+};
+
+TEST_F(Wan, JoinsOverTheAir)
+{
+        start();
+        join();
+
+        EXPECT_EQ(wan::stats().joins, 1u);
+        EXPECT_EQ(LMIC.devaddr & 0xffff0000, 0x260b0000u);
+        EXPECT_EQ(LMIC.netid, 0x13u);
+        EXPECT_EQ(sim::radio.tx, 1u);
+
+        //
+        // the session is in flash for the next cold boot
+        //
+        Preferences p;
+
+        ASSERT_TRUE(p.begin("lora", true));
+        EXPECT_EQ(p.getUInt("devAddr", 0), LMIC.devaddr);
+        p.end();
+}
+
+TEST_F(Wan, ConfirmedFrameIsAcked)
+{
+        start();
+        join();
+        send(10, true);
+
+        EXPECT_TRUE(seen(wan::EV_ACK));
+        EXPECT_FALSE(seen(wan::EV_NACK));
+        EXPECT_EQ(wan::stats().acks, 1u);
+        EXPECT_TRUE(wan::link_up());
+}
+
+TEST_F(Wan, DownlinkReachesTheHandler)
+{
+        start({"-a", "2"});
+        join();
+        send(10);
+        send(10);
+
+        ASSERT_EQ(downlinks.size(), 1u);
+        EXPECT_EQ(downlinks[0].port, 10);
+        EXPECT_EQ(downlinks[0].data, "dl2");
+}
+
+TEST_F(Wan, NetworkTimeSetsTheClock)
+{
+        start();
+        join();
+
+        EXPECT_FALSE(timesync::valid());
+
+        send(10);
+
+        ASSERT_TRUE(timesync::valid());
+        EXPECT_NEAR(static_cast<double>(timesync::now()), static_cast<double>(EPOCH + host_rtc_us() / 1000000), 1.0);
+}
+
+TEST_F(Wan, SampleAgeIsStampedWhenTheFrameGoesOut)
+{
+        start();
+        join();
+        send(10);
+
+        ASSERT_TRUE(timesync::valid());
+
+        //
+        // the age is what the sample is worth at TX time, not when it was queued
+        //
+        std::vector<uint8_t> data(10, 0x5a);
+        uint32_t sampled_at = timesync::now() - 42;
+
+        wan::send(data.data(), data.size(), 1, false, wan::PRIO_DATA, 2, sampled_at);
+        ASSERT_TRUE(board::run());
+
+        ASSERT_EQ(LMIC.pendTxLen, data.size());
+
+        uint16_t age = (LMIC.pendTxData[2] << 8) | LMIC.pendTxData[3];
+        uint32_t sent_at = timesync::now();
+
+        EXPECT_GE(age, 42u);
+        EXPECT_LE(age, sent_at - sampled_at);
+        EXPECT_EQ(LMIC.pendTxData[4], 0x5a);
+
+        //
+        // the caller's buffer is left alone
+        //
+        EXPECT_EQ(data[2], 0x5a);
+}
+
+TEST_F(Wan, ResumedSessionKeepsTalking)
+{
+        start();
+        join();
+        send(10);
+
+        ASSERT_TRUE(board::deep_sleep(300000));
+
+        EXPECT_EQ(wan::stats().resumes, 1u);
+
+        //
+        // the server only ACKs a frame counter that went on
+        //
+        send(10, true);
+
+        EXPECT_TRUE(seen(wan::EV_ACK));
+        EXPECT_EQ(wan::stats().joins, 1u);
+}
+
+TEST_F(Wan, ResetRejoinsFromFlash)
+{
+        start();
+        join();
+        send(10);
+
+        //
+        // no resume, no new join: the session comes from flash
+        //
+        ASSERT_TRUE(board::boot(ESP_SLEEP_WAKEUP_UNDEFINED));
+        ASSERT_TRUE(board::run());
+
+        send(10, true);
+
+        EXPECT_TRUE(seen(wan::EV_ACK));
+        EXPECT_EQ(wan::stats().joins, 1u);
+        EXPECT_EQ(wan::stats().resumes, 0u);
+}
+
+TEST_F(Wan, UnheardFrameIsRetriedThenReported)
+{
+        //
+        // the network never hears us: a session from flash, no join
+        //
+        const uint8_t key[16] = {0};
+
+        board::provision(0x13, 0x260b0001, key, key);
+        start({"-l", "100"});
+        join();
+
+        send(10, true);
+
+        EXPECT_EQ(sim::radio.tx, 8u);
+        EXPECT_TRUE(seen(wan::EV_NACK));
+        EXPECT_FALSE(wan::link_up());
+}
+
+TEST_F(Wan, LossyLinkGetsThroughOnRetries)
+{
+        start({"-l", "50", "-s", "7"});
+        join();
+
+        uint32_t before = sim::radio.tx;
+        uint32_t acked = 0;
+
+        for (int i = 0; i < 5; i++)
+        {
+                send(10, true);
+                acked += seen(wan::EV_ACK) ? 1 : 0;
+        }
+
+        EXPECT_EQ(acked, 5u);
+        EXPECT_GT(sim::radio.tx - before, 5u);
+}
+
+TEST_F(Wan, SilentNetworkTurnsOnConfirmedProbes)
+{
+        //
+        // the network stops answering unconfirmed frames, and no confirmed
+        // one is due for a long while
+        //
+        start({"-u"});
+        join();
+        wan::set_confirm_every(UINT8_MAX);
+
+        int frames = 0;
+
+        while (frames < 200 && !seen(EV_LINK_DEAD))
+        {
+                ASSERT_FALSE(wan::confirm_due());
+                send(10);
+                frames++;
+
+                //
+                // the link check count carries over deep sleep
+                //
+                if (frames == 40)
+                {
+                        ASSERT_TRUE(board::deep_sleep(60000));
+                }
+        }
+
+        //
+        // LMIC gives up after its ADR ACK limit and delay, and the policy
+        // switches to confirmed probes
+        //
+        ASSERT_TRUE(seen(EV_LINK_DEAD));
+        EXPECT_GT(frames, 64);
+        EXPECT_FALSE(wan::link_up());
+        ASSERT_TRUE(wan::confirm_due());
+
+        send(10, true);
+
+        EXPECT_TRUE(seen(wan::EV_ACK));
+        EXPECT_TRUE(wan::link_up());
+}
+
+TEST_F(Wan, LearnsTheClockErrorFromDownlinks)
+{
+        start();
+        join();
+
+        //
+        // 2000 ppm: 2 ms late after RX1's second, still in the window
+        //
+        sim::drift_ppm = 2000;
+        send(10, true);
+
+        EXPECT_TRUE(seen(wan::EV_ACK));
+        EXPECT_GT(wan::clock_error, 0u);
+        EXPECT_EQ(LMIC.clockError, 2 * wan::clock_error);
+}
+
+TEST_F(Wan, WindowsWidenToCatchALateDownlink)
+{
+        start();
+        join();
+
+        //
+        // 5000 ppm: the downlink misses the SF7 window; LMIC's slower
+        // retries (longer symbols) catch it, and from then on the clock
+        // error is known
+        //
+        sim::drift_ppm = 5000;
+
+        uint32_t before = sim::radio.tx;
+
+        send(10, true);
+
+        EXPECT_TRUE(seen(wan::EV_ACK));
+        EXPECT_GT(sim::radio.tx - before, 1u);
+
+        wan::set_spreading_factor(DR_SF7);
+        before = sim::radio.tx;
+
+        send(10, true);
+
+        EXPECT_TRUE(seen(wan::EV_ACK));
+        EXPECT_EQ(sim::radio.tx - before, 1u);
+}
+
+TEST_F(Wan, KeepsTalkingAcrossTheClockWrap)
+{
+        start();
+        join();
+
+        //
+        // the LMIC clock (16 us ticks in an ostime_t) wraps after 9.5 h
+        // awake: get within a few frames of it
+        //
+        const uint64_t wrap_us = (1ULL << 31) * US_PER_OSTICK;
+
+        host_skip_us(wrap_us - micros() - 10000000);
+
+        for (int i = 0; i < 4; i++)
+        {
+                send(10, true);
+
+                EXPECT_TRUE(seen(wan::EV_ACK)) << "frame " << i;
+        }
+
+        EXPECT_GT(micros(), wrap_us);
+        EXPECT_EQ(wan::stats().acks, 4u);
+}
+
+} // namespace